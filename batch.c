@@ -0,0 +1,588 @@
+/* batch.c: running a program headless at maximum speed
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: philip-fuse@shadowmagic.org.uk
+
+*/
+
+/* In batch mode, Fuse runs whatever was loaded from the command line
+   with no sound, no display updates and no speed limit until it reaches
+   a given address, a debugger breakpoint or a frame limit. It then
+   writes any requested dumps of the machine state and exits with a
+   status code (see batch.h).
+
+   Given a manifest, Fuse instead runs each job in the manifest in its
+   own process, with up to one process per host core running at once.
+   Fuse's state is global, so one process per machine is the only way to
+   run them in parallel. The processes are forked as soon as the settings
+   have been read, before anything starts a thread, and each then starts
+   up and shuts down just as a single batch run does; the parent process
+   never starts the emulator at all */
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_STRINGS_STRCASECMP
+#include <strings.h>
+#endif      /* #ifdef HAVE_STRINGS_STRCASECMP */
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif			/* #ifndef WIN32 */
+
+#include "libspectrum.h"
+
+#include "batch.h"
+#include "compat.h"
+#include "debugger/debugger.h"
+#include "display.h"
+#include "fuse.h"
+#include "memory_pages.h"
+#include "screenshot.h"
+#include "settings.h"
+#include "spectrum.h"
+#include "tape.h"
+#include "ui/ui.h"
+#include "utils.h"
+#include "z80/z80.h"
+#include "z80/z80_macros.h"
+
+/* Have we stopped yet? */
+static int stopped = 0;
+
+static int exit_code = BATCH_EXIT_OK;
+
+/* Frames run so far */
+static libspectrum_dword frames = 0;
+
+/* Set in the parent process once every job in the manifest has run */
+static int manifest_done = 0;
+
+static void run_manifest( void );
+
+void
+batch_init( void )
+{
+  if( settings_current.batch_manifest ) settings_current.batch = 1;
+
+  if( !settings_current.batch ) return;
+
+  settings_current.sound = 0;
+  display_set_skip_rendering( 1 );
+
+  if( settings_current.batch_manifest ) run_manifest();
+}
+
+int
+batch_manifest_done( void )
+{
+  return manifest_done;
+}
+
+static int
+set_stop_address( void )
+{
+  const char *pc = settings_current.batch_stop_pc;
+  char *end;
+  long address;
+
+  if( !pc || !*pc ) return 0;
+
+  address = strtol( pc, &end, 0 );
+  if( *end || address < 0 || address > 0xffff ) {
+    ui_error( UI_ERROR_ERROR, "invalid batch stop address `%s'", pc );
+    return 1;
+  }
+
+  return debugger_breakpoint_add_address(
+    DEBUGGER_BREAKPOINT_TYPE_EXECUTE, memory_source_any, 0, address, 0,
+    DEBUGGER_BREAKPOINT_LIFE_PERMANENT, NULL
+  );
+}
+
+static int
+dump_memory( const char *filename )
+{
+  libspectrum_byte *buffer;
+  size_t i;
+  int error;
+
+  buffer = libspectrum_new( libspectrum_byte, 0x10000 );
+
+  /* Whatever is currently paged in, without triggering breakpoints */
+  for( i = 0; i < 0x10000; i++ ) buffer[i] = readbyte_internal( i );
+
+  error = utils_write_file( filename, buffer, 0x10000 );
+
+  libspectrum_free( buffer );
+
+  return error;
+}
+
+static int
+dump_registers( const char *filename )
+{
+  FILE *f;
+
+  if( !strcmp( filename, "-" ) ) {
+    f = stdout;
+  } else {
+    f = fopen( filename, "w" );
+    if( !f ) {
+      ui_error( UI_ERROR_ERROR, "couldn't open `%s' for writing", filename );
+      return 1;
+    }
+  }
+
+  fprintf( f, "PC=%04x SP=%04x AF=%04x BC=%04x DE=%04x HL=%04x\n",
+           PC, SP, AF, BC, DE, HL );
+  fprintf( f, "IX=%04x IY=%04x AF'=%04x BC'=%04x DE'=%04x HL'=%04x\n",
+           IX, IY, AF_, BC_, DE_, HL_ );
+  fprintf( f, "I=%02x R=%02x IM=%d IFF1=%d IFF2=%d HALTED=%d\n",
+           I, ( R7 & 0x80 ) | ( R & 0x7f ), IM, IFF1, IFF2, z80.halted );
+  fprintf( f, "FRAMES=%lu TSTATES=%lu\n", (unsigned long)frames,
+           (unsigned long)tstates );
+
+  if( f == stdout ) {
+    fflush( f );
+  } else if( fclose( f ) ) {
+    ui_error( UI_ERROR_ERROR, "couldn't write `%s'", filename );
+    return 1;
+  }
+
+  return 0;
+}
+
+static int
+write_screenshot( const char *filename )
+{
+  const char *extension = strrchr( filename, '.' );
+
+  if( extension && !strcasecmp( extension, ".scr" ) )
+    return screenshot_scr_write( filename );
+
+#ifdef USE_LIBPNG
+  /* Nothing has been drawn, so draw the screen as it is now */
+  display_update_image();
+  return screenshot_write( filename, SCALER_NORMAL );
+#else
+  ui_error( UI_ERROR_ERROR, "PNG screenshots are not supported; use .scr" );
+  return 1;
+#endif
+}
+
+/* Write the dumps and arrange for the main loop to finish */
+static void
+batch_stop( int code )
+{
+  if( stopped ) return;
+  stopped = 1;
+
+  exit_code = code;
+
+  if( settings_current.batch_dump_memory &&
+      dump_memory( settings_current.batch_dump_memory ) )
+    exit_code = BATCH_EXIT_ERROR;
+
+  if( settings_current.batch_dump_registers &&
+      dump_registers( settings_current.batch_dump_registers ) )
+    exit_code = BATCH_EXIT_ERROR;
+
+  if( settings_current.batch_screenshot &&
+      write_screenshot( settings_current.batch_screenshot ) )
+    exit_code = BATCH_EXIT_ERROR;
+
+  fuse_exiting = 1;
+}
+
+int
+batch_debugger_trap( void )
+{
+  /* Take the dumps with the machine exactly at the breakpoint */
+  batch_stop( BATCH_EXIT_OK );
+
+  /* There's no one to hand control to, so just carry on to the end of
+     the frame */
+  return debugger_run();
+}
+
+/* Run until a stop condition and return the exit code */
+static int
+run_to_stop( void )
+{
+  int have_stop_address = settings_current.batch_stop_pc &&
+                          *settings_current.batch_stop_pc;
+
+  if( set_stop_address() ) return BATCH_EXIT_ERROR;
+
+  while( !fuse_exiting ) {
+    spectrum_do_frame();
+    frames++;
+
+    if( settings_current.batch_frames &&
+        frames >= (libspectrum_dword)settings_current.batch_frames )
+      batch_stop( have_stop_address ? BATCH_EXIT_TIMEOUT : BATCH_EXIT_OK );
+  }
+
+  /* Finished by the debugger's `exit' command */
+  if( !stopped ) batch_stop( debugger_get_exit_code() );
+
+  return exit_code;
+}
+
+#ifndef WIN32
+
+/* One line of the manifest:
+
+   <file> [frames=<n>] [pc=<address>] [memory=<file>] [registers=<file>]
+          [screenshot=<file>] [script=<file>]
+
+   Each option overrides the corresponding --batch-... setting for this
+   job; script names a file of debugger commands to run once <file> has
+   been loaded. Blank lines and lines starting with # are ignored */
+typedef struct batch_job_t {
+  size_t line;
+  char *file;
+  char *frames;
+  char *pc;
+  char *memory;
+  char *registers;
+  char *screenshot;
+  char *script;
+
+  /* Filled in by the parent */
+  pid_t pid;
+  double start, elapsed;
+  int status;
+} batch_job_t;
+
+static void
+free_job( batch_job_t *job )
+{
+  libspectrum_free( job->file );
+  libspectrum_free( job->frames );
+  libspectrum_free( job->pc );
+  libspectrum_free( job->memory );
+  libspectrum_free( job->registers );
+  libspectrum_free( job->screenshot );
+  libspectrum_free( job->script );
+}
+
+static int
+parse_job_option( batch_job_t *job, const char *option )
+{
+  static const struct {
+    const char *name;
+    size_t offset;
+  } options[] = {
+    { "frames", offsetof( batch_job_t, frames ) },
+    { "pc", offsetof( batch_job_t, pc ) },
+    { "memory", offsetof( batch_job_t, memory ) },
+    { "registers", offsetof( batch_job_t, registers ) },
+    { "screenshot", offsetof( batch_job_t, screenshot ) },
+    { "script", offsetof( batch_job_t, script ) },
+  };
+  const char *value = strchr( option, '=' );
+  size_t i;
+
+  if( value ) {
+    for( i = 0; i < ARRAY_SIZE( options ); i++ ) {
+      if( strlen( options[i].name ) == (size_t)( value - option ) &&
+          !strncmp( option, options[i].name, value - option ) ) {
+        char **field = (char**)( (char*)job + options[i].offset );
+        libspectrum_free( *field );
+        *field = utils_safe_strdup( value + 1 );
+        return 0;
+      }
+    }
+  }
+
+  ui_error( UI_ERROR_ERROR, "%s:%lu: unknown job option `%s'",
+            settings_current.batch_manifest, (unsigned long)job->line,
+            option );
+  return 1;
+}
+
+/* Parse the manifest into an array of jobs */
+static int
+read_manifest( const char *filename, batch_job_t **jobs, size_t *count )
+{
+  FILE *f;
+  char buffer[ 1024 ];
+  size_t line = 0, allocated = 0;
+  int error = 0;
+
+  *jobs = NULL; *count = 0;
+
+  f = fopen( filename, "r" );
+  if( !f ) {
+    ui_error( UI_ERROR_ERROR, "couldn't open `%s': %s", filename,
+              strerror( errno ) );
+    return 1;
+  }
+
+  while( !error && fgets( buffer, sizeof( buffer ), f ) ) {
+    batch_job_t *job;
+    char *token, *saveptr;
+
+    line++;
+
+    token = strtok_r( buffer, " \t\r\n", &saveptr );
+    if( !token || *token == '#' ) continue;
+
+    if( *count == allocated ) {
+      allocated = allocated ? 2 * allocated : 16;
+      *jobs = libspectrum_renew( batch_job_t, *jobs, allocated );
+    }
+
+    job = &(*jobs)[ (*count)++ ];
+    memset( job, 0, sizeof( *job ) );
+    job->line = line;
+    job->file = utils_safe_strdup( token );
+
+    while( !error && ( token = strtok_r( NULL, " \t\r\n", &saveptr ) ) )
+      error = parse_job_option( job, token );
+  }
+
+  fclose( f );
+
+  if( !error && !*count ) {
+    ui_error( UI_ERROR_ERROR, "no jobs in `%s'", filename );
+    error = 1;
+  }
+
+  return error;
+}
+
+static int
+run_script( const char *filename )
+{
+  utils_file file;
+  char *commands;
+
+  if( utils_read_file( filename, &file ) ) return 1;
+
+  commands = libspectrum_new( char, file.length + 1 );
+  memcpy( commands, file.buffer, file.length );
+  commands[ file.length ] = '\0';
+  utils_close_file( &file );
+
+  debugger_command_evaluate( commands );
+
+  libspectrum_free( commands );
+
+  return 0;
+}
+
+/* The job this process is running, if it is one of a manifest's */
+static batch_job_t *current_job = NULL;
+
+/* Apply one job's settings; called in the child process before anything
+   is initialised */
+static void
+set_job_settings( batch_job_t *job )
+{
+  if( job->frames ) settings_current.batch_frames = atoi( job->frames );
+  if( job->pc )
+    settings_set_string( &settings_current.batch_stop_pc, job->pc );
+  if( job->memory )
+    settings_set_string( &settings_current.batch_dump_memory, job->memory );
+  if( job->registers )
+    settings_set_string( &settings_current.batch_dump_registers,
+                         job->registers );
+  if( job->screenshot )
+    settings_set_string( &settings_current.batch_screenshot,
+                         job->screenshot );
+
+  current_job = job;
+}
+
+/* Run the current job; called in the child process once Fuse has been
+   initialised */
+static int
+run_job( batch_job_t *job )
+{
+  if( utils_open_file( job->file, tape_can_autoload(), NULL ) )
+    return BATCH_EXIT_ERROR;
+
+  if( job->script && run_script( job->script ) ) return BATCH_EXIT_ERROR;
+
+  return run_to_stop();
+}
+
+static int
+get_workers( void )
+{
+  long workers = settings_current.batch_workers;
+
+  if( workers <= 0 ) {
+#ifdef _SC_NPROCESSORS_ONLN
+    workers = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+    if( workers <= 0 ) workers = 1;
+  }
+
+  return workers;
+}
+
+static void
+report_job( size_t index, const batch_job_t *job )
+{
+  char result[ 32 ];
+
+  if( WIFEXITED( job->status ) ) {
+    switch( WEXITSTATUS( job->status ) ) {
+    case BATCH_EXIT_OK: strcpy( result, "ok" ); break;
+    case BATCH_EXIT_ERROR: strcpy( result, "error" ); break;
+    case BATCH_EXIT_TIMEOUT: strcpy( result, "timeout" ); break;
+    default:
+      snprintf( result, sizeof( result ), "exit-%d",
+                WEXITSTATUS( job->status ) );
+      break;
+    }
+  } else if( WIFSIGNALED( job->status ) ) {
+    snprintf( result, sizeof( result ), "signal-%d",
+              WTERMSIG( job->status ) );
+  } else {
+    strcpy( result, "unknown" );
+  }
+
+  printf( "%lu\t%s\t%s\t%.3f\n", (unsigned long)index + 1, result,
+          job->file, job->elapsed );
+  fflush( stdout );
+}
+
+/* Run every job in the manifest. In each child, this returns with that
+   job's settings in place, to carry on starting up. In the parent, it
+   returns once every job has finished, with exit_code BATCH_EXIT_OK if
+   every job succeeded and BATCH_EXIT_ERROR otherwise */
+static void
+run_manifest( void )
+{
+  batch_job_t *jobs;
+  size_t count, next = 0, running = 0, i, passed = 0;
+  int workers, code = BATCH_EXIT_OK;
+  double start;
+
+  manifest_done = 1;
+
+  if( read_manifest( settings_current.batch_manifest, &jobs, &count ) ) {
+    exit_code = BATCH_EXIT_ERROR;
+    return;
+  }
+
+  workers = get_workers();
+  start = compat_timer_get_time();
+
+  /* Don't let the children inherit any buffered output */
+  fflush( stdout ); fflush( stderr );
+
+  while( next < count || running ) {
+    pid_t pid;
+    int status;
+
+    while( next < count && running < (size_t)workers ) {
+      batch_job_t *job = &jobs[ next ];
+
+      job->start = compat_timer_get_time();
+
+      pid = fork();
+      if( pid == 0 ) {
+        manifest_done = 0;
+        set_job_settings( job );
+        return;
+      }
+
+      if( pid < 0 ) {
+        ui_error( UI_ERROR_ERROR, "couldn't start job %lu: %s",
+                  (unsigned long)next + 1, strerror( errno ) );
+        job->status = BATCH_EXIT_ERROR << 8;
+        code = BATCH_EXIT_ERROR;
+        next = count;
+        break;
+      }
+
+      job->pid = pid;
+      next++; running++;
+    }
+
+    if( !running ) break;
+
+    pid = waitpid( -1, &status, 0 );
+    if( pid < 0 ) {
+      if( errno == EINTR ) continue;
+      ui_error( UI_ERROR_ERROR, "waitpid failed: %s", strerror( errno ) );
+      code = BATCH_EXIT_ERROR;
+      break;
+    }
+
+    for( i = 0; i < next; i++ ) {
+      if( jobs[i].pid != pid ) continue;
+      jobs[i].pid = 0;
+      jobs[i].status = status;
+      jobs[i].elapsed = compat_timer_get_time() - jobs[i].start;
+      report_job( i, &jobs[i] );
+      if( WIFEXITED( status ) && WEXITSTATUS( status ) == BATCH_EXIT_OK )
+        passed++;
+      running--;
+      break;
+    }
+  }
+
+  if( passed != count ) code = BATCH_EXIT_ERROR;
+
+  printf( "# %lu jobs, %lu ok, %lu failed, %d workers, %.2f jobs/s\n",
+          (unsigned long)count, (unsigned long)passed,
+          (unsigned long)( count - passed ), workers,
+          count / ( compat_timer_get_time() - start ) );
+
+  for( i = 0; i < count; i++ ) free_job( &jobs[i] );
+  libspectrum_free( jobs );
+
+  exit_code = code;
+}
+
+#else			/* #ifndef WIN32 */
+
+static void
+run_manifest( void )
+{
+  ui_error( UI_ERROR_ERROR, "batch manifests are not supported on Windows" );
+  manifest_done = 1;
+  exit_code = BATCH_EXIT_ERROR;
+}
+
+#endif			/* #ifndef WIN32 */
+
+int
+batch_run( void )
+{
+  if( manifest_done ) return exit_code;
+
+#ifndef WIN32
+  if( current_job ) return run_job( current_job );
+#endif			/* #ifndef WIN32 */
+
+  return run_to_stop();
+}
@@ -0,0 +1,57 @@
+/* batch.h: running a program headless at maximum speed
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: philip-fuse@shadowmagic.org.uk
+
+*/
+
+#ifndef FUSE_BATCH_H
+#define FUSE_BATCH_H
+
+/* Exit codes from a batch run; a debugger `exit' command's own code is
+   used as is */
+typedef enum batch_exit_code {
+  /* The stop address or a breakpoint was reached, or the frame limit was
+     reached with no stop address given */
+  BATCH_EXIT_OK = 0,
+
+  /* Something went wrong, e.g. a dump couldn't be written */
+  BATCH_EXIT_ERROR = 1,
+
+  /* The frame limit was reached before the stop address */
+  BATCH_EXIT_TIMEOUT = 2,
+} batch_exit_code;
+
+/* Adjust the settings for batch mode; called before anything is
+   initialised. Given a manifest, this forks a process for each job,
+   which returns with that job's settings, and returns in the parent
+   only once every job has finished */
+void batch_init( void );
+
+/* Non-zero in the parent process of a manifest run, which has nothing
+   left to do but exit with batch_run()'s code */
+int batch_manifest_done( void );
+
+/* Run the emulation until a stop condition, or run a manifest's job, and
+   return the exit code */
+int batch_run( void );
+
+/* Called by the debugger when a breakpoint is hit in batch mode */
+int batch_debugger_trap( void );
+
+#endif			/* #ifndef FUSE_BATCH_H */
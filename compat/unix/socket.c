@@ -29,6 +29,11 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <stdint.h>
+#include <sys/eventfd.h>
+#endif
+
 #include "compat.h"
 #include "fuse.h"
 #include "ui/ui.h"
@@ -89,6 +94,55 @@ compat_socket_get_strerror( void )
   return strerror( errno );
 }
 
+#ifdef HAVE_SYS_EVENTFD_H
+
+/* Where available, an eventfd does the job of the pipe: any number of wakes
+   before the reader gets round to it collapse into a single read */
+
+compat_socket_selfpipe_t* compat_socket_selfpipe_alloc( void )
+{
+  compat_socket_selfpipe_t *self =
+    libspectrum_new( compat_socket_selfpipe_t, 1 );
+
+  self->read_fd = self->write_fd = eventfd( 0, 0 );
+  if( self->read_fd == -1 ) {
+    ui_error( UI_ERROR_ERROR, "%s: %d: error %d creating eventfd", __FILE__, __LINE__, errno );
+    fuse_abort();
+  }
+
+  return self;
+}
+
+void compat_socket_selfpipe_free( compat_socket_selfpipe_t *self )
+{
+  close( self->read_fd );
+  libspectrum_free( self );
+}
+
+void compat_socket_selfpipe_wake( compat_socket_selfpipe_t *self )
+{
+  const uint64_t one = 1;
+  ssize_t unused = write( self->write_fd, &one, sizeof( one ) );
+  (void) unused;
+}
+
+void compat_socket_selfpipe_discard_data( compat_socket_selfpipe_t *self )
+{
+  uint64_t count;
+  ssize_t bytes_read;
+
+  do {
+    bytes_read = read( self->read_fd, &count, sizeof( count ) );
+    if( bytes_read == -1 && errno != EINTR ) {
+      ui_error( UI_ERROR_ERROR,
+                "%s: %d: unexpected error %d (%s) reading from eventfd",
+                __FILE__, __LINE__, errno, strerror(errno) );
+    }
+  } while( bytes_read < 0 && errno == EINTR );
+}
+
+#else                           /* #ifdef HAVE_SYS_EVENTFD_H */
+
 compat_socket_selfpipe_t* compat_socket_selfpipe_alloc( void )
 {
   int error;
@@ -116,11 +170,6 @@ void compat_socket_selfpipe_free( compat_socket_selfpipe_t *self )
   libspectrum_free( self );
 }
 
-compat_socket_t compat_socket_selfpipe_get_read_fd( compat_socket_selfpipe_t *self )
-{
-  return self->read_fd;
-}
-
 void compat_socket_selfpipe_wake( compat_socket_selfpipe_t *self )
 {
   const char dummy = 0;
@@ -142,3 +191,10 @@ void compat_socket_selfpipe_discard_data( compat_socket_selfpipe_t *self )
     }
   } while( bytes_read < 0 );
 }
+
+#endif                          /* #ifdef HAVE_SYS_EVENTFD_H */
+
+compat_socket_t compat_socket_selfpipe_get_read_fd( compat_socket_selfpipe_t *self )
+{
+  return self->read_fd;
+}
@@ -29,6 +29,7 @@
 #include "gdbserver.h"
 
 #include <ctype.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "libspectrum.h"
@@ -46,6 +47,19 @@ GSList *debugger_breakpoints;
 /* The next breakpoint ID to use */
 static size_t next_breakpoint_id;
 
+/* Bitmaps of the addresses and ports at which a breakpoint of each type
+   could trigger, so debugger_check() only has to walk the breakpoint list
+   when one of them is hit. Page-specific breakpoints are indexed by their
+   offset within the page */
+static struct {
+  libspectrum_byte address[3][ 0x10000 / 8 ];
+  libspectrum_byte offset[3][ 0x4000 / 8 ];
+  libspectrum_byte port[2][ 0x10000 / 8 ];
+} breakpoint_index;
+
+#define INDEX_SET( map, n ) ( (map)[ (n) >> 3 ] |= 1 << ( (n) & 7 ) )
+#define INDEX_TEST( map, n ) ( (map)[ (n) >> 3 ] & ( 1 << ( (n) & 7 ) ) )
+
 /* Textual representations of the breakpoint types and lifetimes */
 const char *debugger_breakpoint_type_text[] = {
   "Execute", "Read", "Write", "Port Read", "Port Write", "Time", "Event",
@@ -73,13 +87,14 @@ static int breakpoint_check( debugger_breakpoint *bp,
 static debugger_breakpoint* get_breakpoint_by_id( size_t id );
 static gint find_breakpoint_by_id( gconstpointer data,
 				   gconstpointer user_data );
-static void remove_time( gpointer data, gpointer user_data );
 static gint find_breakpoint_by_id( gconstpointer data,
 				   gconstpointer user_data );
 static gint find_breakpoint_by_address( gconstpointer data,
 					gconstpointer user_data );
 static void free_breakpoint( gpointer data, gpointer user_data );
 static void add_time_event( gpointer data, gpointer user_data );
+static void index_rebuild( void );
+static int index_test( debugger_breakpoint_type type, libspectrum_dword value );
 
 /* Add a breakpoint */
 int
@@ -207,6 +222,7 @@ breakpoint_add( debugger_breakpoint_type type, debugger_breakpoint_value value,
       libspectrum_free( bp );
       return 1;
     }
+    debugger_expression_compile( bp->condition );
   } else {
     bp->condition = NULL;
   }
@@ -214,14 +230,16 @@ breakpoint_add( debugger_breakpoint_type type, debugger_breakpoint_value value,
   bp->commands = NULL;
 
   debugger_breakpoints = g_slist_append( debugger_breakpoints, bp );
+  index_rebuild();
 
   if( debugger_mode == DEBUGGER_MODE_INACTIVE )
     debugger_mode = DEBUGGER_MODE_ACTIVE;
 
   /* If this was a timed breakpoint, set an event to stop emulation
-     at that point */
+     at that point; the event carries the breakpoint so it can be found
+     again if the breakpoint is removed */
   if( type == DEBUGGER_BREAKPOINT_TYPE_TIME )
-    event_add( value.time.tstates, debugger_breakpoint_event );
+    event_add_with_data( value.time.tstates, debugger_breakpoint_event, bp );
 
   ui_breakpoints_updated();
 
@@ -242,6 +260,8 @@ debugger_check( debugger_breakpoint_type type, libspectrum_dword value )
   case DEBUGGER_MODE_INACTIVE: return 0;
 
   case DEBUGGER_MODE_ACTIVE:
+    if( !index_test( type, value ) ) return 0;
+
     for( ptr = debugger_breakpoints; ptr; ptr = ptr_next ) {
 
       bp = ptr->data;
@@ -272,8 +292,10 @@ debugger_check( debugger_breakpoint_type type, libspectrum_dword value )
 
   }
 
-  if( signal_breakpoints_updated )
-      ui_breakpoints_updated();
+  if( signal_breakpoints_updated ) {
+    index_rebuild();
+    ui_breakpoints_updated();
+  }
 
   /* Debugger mode could have been reset by a breakpoint command */
   return ( debugger_mode == DEBUGGER_MODE_HALTED );
@@ -379,13 +401,6 @@ breakpoint_check( debugger_breakpoint *bp, debugger_breakpoint_type type,
   return debugger_breakpoint_trigger( bp );
 }
 
-struct remove_t {
-
-  libspectrum_dword tstates;
-  int done;
-
-};
-
 /* Remove breakpoint with the given ID */
 int
 debugger_breakpoint_remove( size_t id )
@@ -399,18 +414,12 @@ debugger_breakpoint_remove( size_t id )
     debugger_mode = DEBUGGER_MODE_INACTIVE;
 
   /* If this was a timed breakpoint, remove the event as well */
-  if( bp->type == DEBUGGER_BREAKPOINT_TYPE_TIME ) {
-
-    struct remove_t remove;
-
-    remove.tstates = bp->value.time.tstates;
-    remove.done = 0;
-
-    event_foreach( remove_time, &remove );
-  }
+  if( bp->type == DEBUGGER_BREAKPOINT_TYPE_TIME )
+    event_remove_type_user_data( debugger_breakpoint_event, bp );
 
   libspectrum_free( bp );
 
+  index_rebuild();
   ui_breakpoints_updated();
 
   return 0;
@@ -441,23 +450,6 @@ find_breakpoint_by_id( gconstpointer data, gconstpointer user_data )
   return bp->id - id;
 }
 
-static void
-remove_time( gpointer data, gpointer user_data )
-{
-  event_t *event;
-  struct remove_t *remove;
-
-  event = data; remove = user_data;
-
-  if( remove->done ) return;
-
-  if( event->type == debugger_breakpoint_event &&
-      event->tstates == remove->tstates ) {
-    event->type = event_type_null;
-    remove->done = 1;
-  }
-}
-
 /* Remove all breakpoints at the given address */
 int
 debugger_breakpoint_clear( libspectrum_word address )
@@ -490,6 +482,7 @@ debugger_breakpoint_clear( libspectrum_word address )
       ui_error( UI_ERROR_ERROR, "No breakpoint at 0x%04x", address );
     }
   } else {
+      index_rebuild();
       ui_breakpoints_updated();
   }
 
@@ -520,12 +513,16 @@ debugger_breakpoint_remove_all( void )
   g_slist_foreach( debugger_breakpoints, free_breakpoint, NULL );
   g_slist_free( debugger_breakpoints ); debugger_breakpoints = NULL;
 
+  /* The events for any timed breakpoints refer to them, so go too */
+  event_remove_type( debugger_breakpoint_event );
+
   if( debugger_mode == DEBUGGER_MODE_ACTIVE )
     debugger_mode = DEBUGGER_MODE_INACTIVE;
 
   /* Restart the breakpoint numbering */
   next_breakpoint_id = 1;
 
+  index_rebuild();
   ui_breakpoints_updated();
 
   return 0;
@@ -584,6 +581,7 @@ debugger_breakpoint_set_condition( size_t id, debugger_expression *condition )
   if( condition ) {
     bp->condition = debugger_expression_copy( condition );
     if( !bp->condition ) return 1;
+    debugger_expression_compile( bp->condition );
   } else {
     bp->condition = NULL;
   }
@@ -620,7 +618,8 @@ add_time_event( gpointer data, gpointer user_data GCC_UNUSED )
   if( bp->type == DEBUGGER_BREAKPOINT_TYPE_TIME && bp->value.time.triggered ) {
     bp->value.time.triggered = 0;
     bp->value.time.tstates = bp->value.time.initial_tstates;
-    event_add( bp->value.time.tstates, debugger_breakpoint_event );
+    event_add_with_data( bp->value.time.tstates, debugger_breakpoint_event,
+                         bp );
   }
 }
 
@@ -630,3 +629,185 @@ debugger_breakpoint_time_fn( libspectrum_dword tstates, int type GCC_UNUSED,
 {
   debugger_check( DEBUGGER_BREAKPOINT_TYPE_TIME, 0 );
 }
+
+/* Recalculate the breakpoint bitmaps after the list has changed */
+static void
+index_rebuild( void )
+{
+  GSList *ptr;
+  debugger_breakpoint *bp;
+  libspectrum_dword port;
+
+  memset( &breakpoint_index, 0, sizeof( breakpoint_index ) );
+
+  for( ptr = debugger_breakpoints; ptr; ptr = ptr->next ) {
+    bp = ptr->data;
+
+    switch( bp->type ) {
+
+    case DEBUGGER_BREAKPOINT_TYPE_EXECUTE:
+    case DEBUGGER_BREAKPOINT_TYPE_READ:
+    case DEBUGGER_BREAKPOINT_TYPE_WRITE:
+      if( bp->value.address.source == memory_source_any ) {
+        INDEX_SET( breakpoint_index.address[ bp->type ],
+                   bp->value.address.offset );
+      } else {
+        INDEX_SET( breakpoint_index.offset[ bp->type ],
+                   bp->value.address.offset & 0x3fff );
+      }
+      break;
+
+    case DEBUGGER_BREAKPOINT_TYPE_PORT_READ:
+    case DEBUGGER_BREAKPOINT_TYPE_PORT_WRITE:
+      for( port = 0; port < 0x10000; port++ )
+        if( ( port & bp->value.port.mask ) == bp->value.port.port )
+          INDEX_SET( breakpoint_index.port[ bp->type -
+                                            DEBUGGER_BREAKPOINT_TYPE_PORT_READ ],
+                     port );
+      break;
+
+    case DEBUGGER_BREAKPOINT_TYPE_TIME:
+    case DEBUGGER_BREAKPOINT_TYPE_EVENT:
+      /* Not indexed */
+      break;
+
+    }
+  }
+}
+
+/* Could any breakpoint of 'type' trigger for 'value'? */
+static int
+index_test( debugger_breakpoint_type type, libspectrum_dword value )
+{
+  value &= 0xffff;
+
+  switch( type ) {
+
+  case DEBUGGER_BREAKPOINT_TYPE_EXECUTE:
+  case DEBUGGER_BREAKPOINT_TYPE_READ:
+  case DEBUGGER_BREAKPOINT_TYPE_WRITE:
+    return INDEX_TEST( breakpoint_index.address[ type ], value ) ||
+           INDEX_TEST( breakpoint_index.offset[ type ], value & 0x3fff );
+
+  case DEBUGGER_BREAKPOINT_TYPE_PORT_READ:
+  case DEBUGGER_BREAKPOINT_TYPE_PORT_WRITE:
+    return INDEX_TEST(
+      breakpoint_index.port[ type - DEBUGGER_BREAKPOINT_TYPE_PORT_READ ], value
+    );
+
+  default:
+    return 1;
+
+  }
+}
+
+/*
+ * Unit tests
+ */
+
+/* Would walking the whole breakpoint list find one to trigger? */
+static int
+unittest_walk( debugger_breakpoint_type type, libspectrum_dword value )
+{
+  GSList *ptr;
+
+  for( ptr = debugger_breakpoints; ptr; ptr = ptr->next )
+    if( breakpoint_check( ptr->data, type, value ) ) return 1;
+
+  return 0;
+}
+
+/* Check that debugger_check() agrees with the list walk for every address
+   and port */
+static int
+unittest_check_all( void )
+{
+  static const debugger_breakpoint_type types[] = {
+    DEBUGGER_BREAKPOINT_TYPE_EXECUTE,
+    DEBUGGER_BREAKPOINT_TYPE_READ,
+    DEBUGGER_BREAKPOINT_TYPE_WRITE,
+    DEBUGGER_BREAKPOINT_TYPE_PORT_READ,
+    DEBUGGER_BREAKPOINT_TYPE_PORT_WRITE,
+  };
+  libspectrum_dword value;
+  int expected, triggered;
+  size_t i;
+
+  for( i = 0; i < ARRAY_SIZE( types ); i++ ) {
+    for( value = 0; value < 0x10000; value++ ) {
+
+      expected = unittest_walk( types[i], value );
+      triggered = debugger_check( types[i], value );
+      if( debugger_mode == DEBUGGER_MODE_HALTED )
+        debugger_mode = DEBUGGER_MODE_ACTIVE;
+
+      if( triggered != expected ) {
+        printf( "breakpoint test: %s 0x%04x: expected %d, got %d\n",
+                debugger_breakpoint_type_text[ types[i] ], value, expected,
+                triggered );
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int
+debugger_breakpoint_unittest( void )
+{
+  enum debugger_mode_t mode = debugger_mode;
+  int r = 0;
+
+  debugger_breakpoint_remove_all();
+
+  debugger_breakpoint_add_address( DEBUGGER_BREAKPOINT_TYPE_EXECUTE,
+                                   memory_source_any, 0, 0x8000, 0,
+                                   DEBUGGER_BREAKPOINT_LIFE_PERMANENT, NULL );
+  debugger_breakpoint_add_address( DEBUGGER_BREAKPOINT_TYPE_READ,
+                                   memory_source_ram, 5, 0x1234, 0,
+                                   DEBUGGER_BREAKPOINT_LIFE_PERMANENT, NULL );
+  debugger_breakpoint_add_address( DEBUGGER_BREAKPOINT_TYPE_WRITE,
+                                   memory_source_any, 0, 0xffff, 0,
+                                   DEBUGGER_BREAKPOINT_LIFE_PERMANENT, NULL );
+  debugger_breakpoint_add_port( DEBUGGER_BREAKPOINT_TYPE_PORT_READ,
+                                0x00fe, 0x00ff, 0,
+                                DEBUGGER_BREAKPOINT_LIFE_PERMANENT, NULL );
+  debugger_breakpoint_add_port( DEBUGGER_BREAKPOINT_TYPE_PORT_WRITE,
+                                0x0000, 0x8002, 0,
+                                DEBUGGER_BREAKPOINT_LIFE_PERMANENT, NULL );
+
+  if( !unittest_walk( DEBUGGER_BREAKPOINT_TYPE_EXECUTE, 0x8000 ) ||
+      !unittest_walk( DEBUGGER_BREAKPOINT_TYPE_PORT_READ, 0x7ffe ) ) {
+    printf( "breakpoint test: breakpoints not added\n" );
+    r++;
+  }
+
+  r += unittest_check_all();
+
+  /* A one-shot breakpoint triggers once, and leaves the others working once
+     it has gone */
+  debugger_breakpoint_add_address( DEBUGGER_BREAKPOINT_TYPE_EXECUTE,
+                                   memory_source_any, 0, 0x9000, 0,
+                                   DEBUGGER_BREAKPOINT_LIFE_ONESHOT, NULL );
+  if( !debugger_check( DEBUGGER_BREAKPOINT_TYPE_EXECUTE, 0x9000 ) ) {
+    printf( "breakpoint test: one-shot breakpoint did not trigger\n" );
+    r++;
+  }
+  debugger_mode = DEBUGGER_MODE_ACTIVE;
+  if( debugger_check( DEBUGGER_BREAKPOINT_TYPE_EXECUTE, 0x9000 ) ) {
+    printf( "breakpoint test: one-shot breakpoint triggered twice\n" );
+    debugger_mode = DEBUGGER_MODE_ACTIVE;
+    r++;
+  }
+  r += unittest_check_all();
+
+  /* As does removing a breakpoint */
+  debugger_breakpoint_remove( 1 );
+  r += unittest_check_all();
+
+  debugger_breakpoint_remove_all();
+  debugger_mode = mode;
+
+  return r;
+}
@@ -23,15 +23,18 @@
 
 #include "config.h"
 
+#include "batch.h"
 #include "debugger.h"
 #include "gdbserver.h"
 #include "debugger_internals.h"
+#include "display.h"
 #include "event.h"
 #include "fuse.h"
 #include "infrastructure/startup_manager.h"
 #include "memory_pages.h"
 #include "mempool.h"
 #include "periph.h"
+#include "settings.h"
 #include "ui/ui.h"
 #include "z80/z80.h"
 #include "z80/z80_macros.h"
@@ -110,6 +113,13 @@ is_debugger_enabled()
 int
 debugger_trap( void )
 {
+    if( settings_current.batch ) {
+        return batch_debugger_trap();
+    }
+
+    /* The screen should show where the debugger stopped */
+    display_stop_adaptive_skip();
+
     if (gdbserver_debugging_enabled) {
         return gdbserver_activate();
     } else {
@@ -102,6 +102,8 @@ void debugger_system_variable_register(
   debugger_set_system_variable_fn_t set );
 
 /* Unit tests */
+int debugger_breakpoint_unittest( void );
 int debugger_disassemble_unittest( void );
+int debugger_expression_unittest( void );
 
 #endif				/* #ifndef FUSE_DEBUGGER_H */
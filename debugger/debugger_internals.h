@@ -92,6 +92,7 @@ void debugger_expression_delete( debugger_expression* expression );
 
 libspectrum_dword
 debugger_expression_evaluate( debugger_expression* expression );
+void debugger_expression_compile( debugger_expression *expression );
 
 /* Event handling */
 
@@ -105,6 +106,8 @@ void debugger_system_variable_init( void );
 void debugger_system_variable_end( void );
 int debugger_system_variable_find( const char *type, const char *detail );
 libspectrum_dword debugger_system_variable_get( int system_variable );
+debugger_get_system_variable_fn_t
+debugger_system_variable_getter( int system_variable );
 void debugger_system_variable_set( const char *type, const char *detail,
                                    libspectrum_dword value );
 void debugger_system_variable_text( char *buffer, size_t length,
@@ -116,5 +119,6 @@ void debugger_variable_init( void );
 void debugger_variable_end( void );
 void debugger_variable_set( const char *name, libspectrum_dword value );
 libspectrum_dword debugger_variable_get( const char *name );
+libspectrum_dword* debugger_variable_slot( const char *name );
 
 #endif				/* #ifndef FUSE_DEBUGGER_INTERNALS_H */
@@ -77,6 +77,70 @@ struct binaryop_type {
 
 };
 
+/* Compiled expressions: a flat program for a small stack machine */
+
+/* The deepest stack a compiled expression may use; anything deeper is left
+   to the tree evaluator */
+#define CODE_STACK_SIZE 32
+
+typedef enum code_opcode {
+
+  /* Push a value */
+  CODE_INTEGER,
+  CODE_SYSVAR,
+  CODE_VARIABLE,
+  CODE_TREE,			/* Evaluate a subtree the slow way */
+
+  /* Replace the top of the stack */
+  CODE_NOT,
+  CODE_COMPLEMENT,
+  CODE_NEGATE,
+  CODE_DEREFERENCE,
+  CODE_BOOLEAN,			/* Convert to 0 or 1 */
+
+  /* Replace the top two values on the stack with one */
+  CODE_ADD,
+  CODE_SUBTRACT,
+  CODE_MULTIPLY,
+  CODE_DIVIDE,
+  CODE_EQUAL_TO,
+  CODE_NOT_EQUAL_TO,
+  CODE_LESS_THAN,
+  CODE_GREATER_THAN,
+  CODE_LESS_THAN_OR_EQUAL_TO,
+  CODE_GREATER_THAN_OR_EQUAL_TO,
+  CODE_BITWISE_AND,
+  CODE_BITWISE_XOR,
+  CODE_BITWISE_OR,
+
+  /* Short circuits: if the top of the stack decides the result, leave it
+     there (as 0 or 1) and jump to the target; otherwise pop it */
+  CODE_LOGICAL_AND,
+  CODE_LOGICAL_OR,
+
+} code_opcode;
+
+typedef struct code_instruction {
+
+  code_opcode opcode;
+
+  union {
+    libspectrum_dword integer;
+    debugger_get_system_variable_fn_t get;
+    const libspectrum_dword *variable;
+    debugger_expression *tree;
+    size_t target;
+  } operand;
+
+} code_instruction;
+
+typedef struct expression_code {
+
+  code_instruction *instructions;
+  size_t length, allocated;
+
+} expression_code;
+
 struct debugger_expression {
 
   expression_type type;
@@ -90,10 +154,15 @@ struct debugger_expression {
     int system_variable;
   } types;
 
+  /* Set on the root of a compiled expression */
+  expression_code *code;
+
 };
 
 static libspectrum_dword evaluate_unaryop( struct unaryop_type *unaryop );
 static libspectrum_dword evaluate_binaryop( struct binaryop_type *binary );
+static libspectrum_dword code_run( const expression_code *code );
+static void code_free( expression_code *code );
 
 static int deparse_unaryop( char *buffer, size_t length,
 			    const struct unaryop_type *unaryop );
@@ -157,6 +226,7 @@ debugger_expression_new_number( libspectrum_dword number, int pool )
   exp->type = DEBUGGER_EXPRESSION_TYPE_INTEGER;
   exp->precedence = PRECEDENCE_ATOMIC;
   exp->types.integer = number;
+  exp->code = NULL;
 
   return exp;
 }
@@ -175,6 +245,7 @@ debugger_expression_new_binaryop( int operation, debugger_expression *operand1,
   exp->types.binaryop.operation = operation;
   exp->types.binaryop.op1 = operand1;
   exp->types.binaryop.op2 = operand2;
+  exp->code = NULL;
 
   return exp;
 }
@@ -192,6 +263,7 @@ debugger_expression_new_unaryop( int operation, debugger_expression *operand,
 
   exp->types.unaryop.operation = operation;
   exp->types.unaryop.op = operand;
+  exp->code = NULL;
 
   return exp;
 }
@@ -215,6 +287,7 @@ debugger_expression_new_system_variable( const char *type, const char *detail,
   exp->type = DEBUGGER_EXPRESSION_TYPE_SYSVAR;
   exp->precedence = PRECEDENCE_ATOMIC;
   exp->types.system_variable = system_variable;
+  exp->code = NULL;
 
   return exp;
 }
@@ -229,6 +302,7 @@ debugger_expression_new_variable( const char *name, int pool )
   exp->type = DEBUGGER_EXPRESSION_TYPE_VARIABLE;
   exp->precedence = PRECEDENCE_ATOMIC;
   exp->types.variable = mempool_strdup( pool, name );
+  exp->code = NULL;
 
   return exp;
 }
@@ -255,6 +329,8 @@ debugger_expression_delete( debugger_expression *exp )
     libspectrum_free( exp->types.variable );
     break;
   }
+
+  if( exp->code ) code_free( exp->code );
     
   libspectrum_free( exp );
 }
@@ -269,6 +345,7 @@ debugger_expression_copy( debugger_expression *src )
 
   dest->type = src->type;
   dest->precedence = src->precedence;
+  dest->code = NULL;
 
   switch( dest->type ) {
 
@@ -317,6 +394,8 @@ debugger_expression_copy( debugger_expression *src )
 libspectrum_dword
 debugger_expression_evaluate( debugger_expression *exp )
 {
+  if( exp->code ) return code_run( exp->code );
+
   switch( exp->type ) {
 
   case DEBUGGER_EXPRESSION_TYPE_INTEGER:
@@ -426,6 +505,276 @@ evaluate_binaryop( struct binaryop_type *binary )
   fuse_abort();
 }
 
+/*
+ * Compiling expressions
+ */
+
+/* Can this subtree be evaluated once, at compile time? */
+static int
+is_constant( debugger_expression *exp )
+{
+  switch( exp->type ) {
+
+  case DEBUGGER_EXPRESSION_TYPE_INTEGER:
+    return 1;
+
+  case DEBUGGER_EXPRESSION_TYPE_UNARYOP:
+    return exp->types.unaryop.operation != DEBUGGER_TOKEN_DEREFERENCE &&
+           is_constant( exp->types.unaryop.op );
+
+  case DEBUGGER_EXPRESSION_TYPE_BINARYOP:
+    if( !is_constant( exp->types.binaryop.op1 ) ||
+        !is_constant( exp->types.binaryop.op2 ) ) return 0;
+
+    /* Leave division by zero to report its error at run time */
+    return exp->types.binaryop.operation != '/' ||
+           debugger_expression_evaluate( exp->types.binaryop.op2 ) != 0;
+
+  case DEBUGGER_EXPRESSION_TYPE_SYSVAR:
+  case DEBUGGER_EXPRESSION_TYPE_VARIABLE:
+    return 0;
+
+  }
+
+  return 0;
+}
+
+/* The number of stack entries needed to evaluate this subtree */
+static size_t
+stack_needed( debugger_expression *exp )
+{
+  size_t op1, op2;
+
+  if( is_constant( exp ) ) return 1;
+
+  switch( exp->type ) {
+
+  case DEBUGGER_EXPRESSION_TYPE_UNARYOP:
+    return stack_needed( exp->types.unaryop.op );
+
+  case DEBUGGER_EXPRESSION_TYPE_BINARYOP:
+    op1 = stack_needed( exp->types.binaryop.op1 );
+    op2 = stack_needed( exp->types.binaryop.op2 );
+
+    /* The short circuits pop the first operand before the second is
+       evaluated */
+    if( exp->types.binaryop.operation != DEBUGGER_TOKEN_LOGICAL_AND &&
+        exp->types.binaryop.operation != DEBUGGER_TOKEN_LOGICAL_OR )
+      op2++;
+
+    return op1 > op2 ? op1 : op2;
+
+  default:
+    return 1;
+
+  }
+}
+
+static code_instruction*
+code_emit( expression_code *code, code_opcode opcode )
+{
+  code_instruction *instruction;
+
+  if( code->length == code->allocated ) {
+    code->allocated = code->allocated ? 2 * code->allocated : 16;
+    code->instructions = libspectrum_renew( code_instruction,
+                                            code->instructions,
+                                            code->allocated );
+  }
+
+  instruction = &code->instructions[ code->length++ ];
+  instruction->opcode = opcode;
+
+  return instruction;
+}
+
+static code_opcode
+unaryop_opcode( int operation )
+{
+  switch( operation ) {
+  case '!': return CODE_NOT;
+  case '~': return CODE_COMPLEMENT;
+  case '-': return CODE_NEGATE;
+  case DEBUGGER_TOKEN_DEREFERENCE: return CODE_DEREFERENCE;
+  default: return CODE_TREE;
+  }
+}
+
+static code_opcode
+binaryop_opcode( int operation )
+{
+  switch( operation ) {
+  case '+': return CODE_ADD;
+  case '-': return CODE_SUBTRACT;
+  case '*': return CODE_MULTIPLY;
+  case '/': return CODE_DIVIDE;
+  case DEBUGGER_TOKEN_EQUAL_TO: return CODE_EQUAL_TO;
+  case DEBUGGER_TOKEN_NOT_EQUAL_TO: return CODE_NOT_EQUAL_TO;
+  case '<': return CODE_LESS_THAN;
+  case '>': return CODE_GREATER_THAN;
+  case DEBUGGER_TOKEN_LESS_THAN_OR_EQUAL_TO: return CODE_LESS_THAN_OR_EQUAL_TO;
+  case DEBUGGER_TOKEN_GREATER_THAN_OR_EQUAL_TO:
+    return CODE_GREATER_THAN_OR_EQUAL_TO;
+  case '&': return CODE_BITWISE_AND;
+  case '^': return CODE_BITWISE_XOR;
+  case '|': return CODE_BITWISE_OR;
+  case DEBUGGER_TOKEN_LOGICAL_AND: return CODE_LOGICAL_AND;
+  case DEBUGGER_TOKEN_LOGICAL_OR: return CODE_LOGICAL_OR;
+  default: return CODE_TREE;
+  }
+}
+
+static void
+compile_node( expression_code *code, debugger_expression *exp )
+{
+  code_opcode opcode;
+  size_t jump;
+
+  if( is_constant( exp ) ) {
+    code_emit( code, CODE_INTEGER )->operand.integer =
+      debugger_expression_evaluate( exp );
+    return;
+  }
+
+  switch( exp->type ) {
+
+  case DEBUGGER_EXPRESSION_TYPE_SYSVAR:
+    code_emit( code, CODE_SYSVAR )->operand.get =
+      debugger_system_variable_getter( exp->types.system_variable );
+    return;
+
+  case DEBUGGER_EXPRESSION_TYPE_VARIABLE:
+    code_emit( code, CODE_VARIABLE )->operand.variable =
+      debugger_variable_slot( exp->types.variable );
+    return;
+
+  case DEBUGGER_EXPRESSION_TYPE_UNARYOP:
+    opcode = unaryop_opcode( exp->types.unaryop.operation );
+    if( opcode == CODE_TREE ) break;
+    compile_node( code, exp->types.unaryop.op );
+    code_emit( code, opcode );
+    return;
+
+  case DEBUGGER_EXPRESSION_TYPE_BINARYOP:
+    opcode = binaryop_opcode( exp->types.binaryop.operation );
+    if( opcode == CODE_TREE ) break;
+    compile_node( code, exp->types.binaryop.op1 );
+
+    if( opcode == CODE_LOGICAL_AND || opcode == CODE_LOGICAL_OR ) {
+      jump = code->length;
+      code_emit( code, opcode );
+      compile_node( code, exp->types.binaryop.op2 );
+      code_emit( code, CODE_BOOLEAN );
+      code->instructions[ jump ].operand.target = code->length;
+    } else {
+      compile_node( code, exp->types.binaryop.op2 );
+      code_emit( code, opcode );
+    }
+    return;
+
+  default:
+    break;
+
+  }
+
+  code_emit( code, CODE_TREE )->operand.tree = exp;
+}
+
+/* Compile an expression which is going to be evaluated many times, such as
+   a breakpoint condition. The expression must not be modified afterwards */
+void
+debugger_expression_compile( debugger_expression *exp )
+{
+  expression_code *code;
+
+  if( exp->code ) return;
+
+  if( stack_needed( exp ) > CODE_STACK_SIZE ) return;
+
+  code = libspectrum_new( expression_code, 1 );
+  code->instructions = NULL;
+  code->length = code->allocated = 0;
+
+  compile_node( code, exp );
+
+  exp->code = code;
+}
+
+static void
+code_free( expression_code *code )
+{
+  libspectrum_free( code->instructions );
+  libspectrum_free( code );
+}
+
+static libspectrum_dword
+code_run( const expression_code *code )
+{
+  libspectrum_dword stack[ CODE_STACK_SIZE ], *sp = stack;
+  const code_instruction *pc = code->instructions,
+    *end = code->instructions + code->length;
+
+  while( pc < end ) {
+
+    switch( pc->opcode ) {
+
+    case CODE_INTEGER: *sp++ = pc->operand.integer; break;
+    case CODE_SYSVAR: *sp++ = pc->operand.get(); break;
+    case CODE_VARIABLE: *sp++ = *pc->operand.variable; break;
+    case CODE_TREE:
+      *sp++ = debugger_expression_evaluate( pc->operand.tree ); break;
+
+    case CODE_NOT: sp[-1] = !sp[-1]; break;
+    case CODE_COMPLEMENT: sp[-1] = ~sp[-1]; break;
+    case CODE_NEGATE: sp[-1] = -sp[-1]; break;
+    case CODE_DEREFERENCE: sp[-1] = readbyte_internal( sp[-1] ); break;
+    case CODE_BOOLEAN: sp[-1] = !!sp[-1]; break;
+
+    case CODE_ADD: sp--; sp[-1] += sp[0]; break;
+    case CODE_SUBTRACT: sp--; sp[-1] -= sp[0]; break;
+    case CODE_MULTIPLY: sp--; sp[-1] *= sp[0]; break;
+    case CODE_DIVIDE:
+      sp--;
+      if( sp[0] == 0 ) {
+        ui_error( UI_ERROR_ERROR, "divide by 0" );
+        sp[-1] = 0;
+      } else {
+        sp[-1] /= sp[0];
+      }
+      break;
+    case CODE_EQUAL_TO: sp--; sp[-1] = sp[-1] == sp[0]; break;
+    case CODE_NOT_EQUAL_TO: sp--; sp[-1] = sp[-1] != sp[0]; break;
+    case CODE_LESS_THAN: sp--; sp[-1] = sp[-1] < sp[0]; break;
+    case CODE_GREATER_THAN: sp--; sp[-1] = sp[-1] > sp[0]; break;
+    case CODE_LESS_THAN_OR_EQUAL_TO: sp--; sp[-1] = sp[-1] <= sp[0]; break;
+    case CODE_GREATER_THAN_OR_EQUAL_TO:
+      sp--; sp[-1] = sp[-1] >= sp[0]; break;
+    case CODE_BITWISE_AND: sp--; sp[-1] &= sp[0]; break;
+    case CODE_BITWISE_XOR: sp--; sp[-1] ^= sp[0]; break;
+    case CODE_BITWISE_OR: sp--; sp[-1] |= sp[0]; break;
+
+    case CODE_LOGICAL_AND:
+      if( !sp[-1] ) { pc = code->instructions + pc->operand.target; continue; }
+      sp--;
+      break;
+
+    case CODE_LOGICAL_OR:
+      if( sp[-1] ) {
+        sp[-1] = 1;
+        pc = code->instructions + pc->operand.target;
+        continue;
+      }
+      sp--;
+      break;
+
+    }
+
+    pc++;
+  }
+
+  return sp[-1];
+}
+
 int
 debugger_expression_deparse( char *buffer, size_t length,
 			     const debugger_expression *exp )
@@ -647,3 +996,152 @@ is_non_associative( int operation )
   fuse_abort();
 }
 
+
+/*
+ * Unit tests
+ */
+
+static const libspectrum_dword unittest_values[] = {
+  0, 1, 2, 0x7f, 0x80, 0xffff, 0x10000, 0x7fffffff, 0xffffffff
+};
+
+/* Evaluate an expression through both the tree and a compiled copy, for
+   every pair of values of the variables x and y */
+static int
+compile_unittest( debugger_expression *exp, int divides )
+{
+  debugger_expression *compiled = debugger_expression_copy( exp );
+  libspectrum_dword tree, code;
+  size_t i, j;
+  int r = 0;
+
+  debugger_expression_compile( compiled );
+
+  for( i = 0; i < ARRAY_SIZE( unittest_values ) && !r; i++ ) {
+    for( j = 0; j < ARRAY_SIZE( unittest_values ) && !r; j++ ) {
+
+      /* Division by zero is tested separately so as to report its error
+         only once */
+      if( divides && !unittest_values[j] ) continue;
+
+      debugger_variable_set( "unittest_x", unittest_values[i] );
+      debugger_variable_set( "unittest_y", unittest_values[j] );
+
+      tree = debugger_expression_evaluate( exp );
+      code = debugger_expression_evaluate( compiled );
+
+      if( tree != code ) {
+        printf( "expression test: x=0x%x, y=0x%x: tree gave 0x%x, "
+                "compiled gave 0x%x\n", unittest_values[i],
+                unittest_values[j], tree, code );
+        r = 1;
+      }
+    }
+  }
+
+  debugger_expression_delete( compiled );
+  debugger_expression_delete( exp );
+
+  return r;
+}
+
+static debugger_expression*
+unittest_variable( const char *name )
+{
+  return debugger_expression_new_variable( name, MEMPOOL_UNTRACKED );
+}
+
+static debugger_expression*
+unittest_number( libspectrum_dword value )
+{
+  return debugger_expression_new_number( value, MEMPOOL_UNTRACKED );
+}
+
+static debugger_expression*
+unittest_unaryop( int operation, debugger_expression *operand )
+{
+  return debugger_expression_new_unaryop( operation, operand,
+                                          MEMPOOL_UNTRACKED );
+}
+
+static debugger_expression*
+unittest_binaryop( int operation, debugger_expression *operand1,
+                   debugger_expression *operand2 )
+{
+  return debugger_expression_new_binaryop( operation, operand1, operand2,
+                                           MEMPOOL_UNTRACKED );
+}
+
+int
+debugger_expression_unittest( void )
+{
+  static const int unary[] = { '!', '~', '-', DEBUGGER_TOKEN_DEREFERENCE };
+  static const int binary[] = {
+    '+', '-', '*', '/',
+    DEBUGGER_TOKEN_EQUAL_TO, DEBUGGER_TOKEN_NOT_EQUAL_TO, '<', '>',
+    DEBUGGER_TOKEN_LESS_THAN_OR_EQUAL_TO,
+    DEBUGGER_TOKEN_GREATER_THAN_OR_EQUAL_TO,
+    '&', '^', '|', DEBUGGER_TOKEN_LOGICAL_AND, DEBUGGER_TOKEN_LOGICAL_OR,
+  };
+  debugger_expression *exp;
+  size_t i;
+  int r = 0;
+
+  for( i = 0; i < ARRAY_SIZE( unary ); i++ )
+    r += compile_unittest(
+      unittest_unaryop( unary[i], unittest_variable( "unittest_x" ) ), 0 );
+
+  /* Each operator on variables, and with one side folded to a constant */
+  for( i = 0; i < ARRAY_SIZE( binary ); i++ ) {
+    int divides = binary[i] == '/';
+
+    r += compile_unittest(
+      unittest_binaryop( binary[i], unittest_variable( "unittest_x" ),
+                         unittest_variable( "unittest_y" ) ), divides );
+    r += compile_unittest(
+      unittest_binaryop( binary[i],
+                         unittest_binaryop( '+', unittest_number( 0x7ffe ),
+                                            unittest_number( 1 ) ),
+                         unittest_variable( "unittest_y" ) ), divides );
+    r += compile_unittest(
+      unittest_binaryop( binary[i], unittest_variable( "unittest_x" ),
+                         unittest_unaryop( '~', unittest_number( 0 ) ) ), 0 );
+  }
+
+  /* Short circuits which skip a dereference, and which don't */
+  r += compile_unittest(
+    unittest_binaryop(
+      DEBUGGER_TOKEN_LOGICAL_AND,
+      unittest_binaryop( '>', unittest_variable( "unittest_x" ),
+                         unittest_number( 0x80 ) ),
+      unittest_unaryop( DEBUGGER_TOKEN_DEREFERENCE,
+                        unittest_variable( "unittest_y" ) ) ), 0 );
+  r += compile_unittest(
+    unittest_binaryop(
+      DEBUGGER_TOKEN_LOGICAL_OR,
+      unittest_binaryop(
+        DEBUGGER_TOKEN_EQUAL_TO,
+        unittest_binaryop( '-',
+                           unittest_binaryop( '*',
+                                              unittest_variable( "unittest_x" ),
+                                              unittest_number( 3 ) ),
+                           unittest_number( 1 ) ),
+        unittest_variable( "unittest_y" ) ),
+      unittest_binaryop( DEBUGGER_TOKEN_LOGICAL_AND,
+                         unittest_variable( "unittest_x" ),
+                         unittest_variable( "unittest_y" ) ) ), 0 );
+
+  /* Nesting to the right needs more stack than the compiled form has, so is
+     left to the tree evaluator; nesting to the left does not */
+  exp = unittest_variable( "unittest_x" );
+  for( i = 0; i < CODE_STACK_SIZE + 8; i++ )
+    exp = unittest_binaryop( '+', unittest_variable( "unittest_y" ), exp );
+  r += compile_unittest( exp, 0 );
+
+  exp = unittest_variable( "unittest_x" );
+  for( i = 0; i < CODE_STACK_SIZE + 8; i++ )
+    exp = unittest_binaryop( '^', exp, unittest_variable( "unittest_y" ) );
+  r += compile_unittest( exp, 0 );
+
+  return r;
+}
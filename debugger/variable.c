@@ -36,13 +36,16 @@
 #include "ui/ui.h"
 #include "utils.h"
 
+/* Variable names to their values. Each value lives in its own allocation so
+   that compiled expressions can refer to it directly */
 static GHashTable *debugger_variables;
 
 void
 debugger_variable_init( void )
 {
   debugger_variables = g_hash_table_new_full( g_str_hash, g_str_equal,
-                                              libspectrum_free, NULL );
+                                              libspectrum_free,
+                                              libspectrum_free );
 }
 
 void
@@ -55,14 +58,28 @@ debugger_variable_end( void )
 void
 debugger_variable_set( const char *name, libspectrum_dword value )
 {
-  g_hash_table_insert( debugger_variables, utils_safe_strdup( name ),
-                       GINT_TO_POINTER(value) );
+  *debugger_variable_slot( name ) = value;
 }
 
 libspectrum_dword
 debugger_variable_get( const char *name )
 {
-  gpointer v = g_hash_table_lookup( debugger_variables, name );
+  libspectrum_dword *slot = g_hash_table_lookup( debugger_variables, name );
 
-  return v ? GPOINTER_TO_INT(v) : 0;
+  return slot ? *slot : 0;
+}
+
+/* Get the storage for a variable, creating it with a value of zero if it
+   doesn't exist yet. Stays valid until debugger_variable_end() */
+libspectrum_dword*
+debugger_variable_slot( const char *name )
+{
+  libspectrum_dword *slot = g_hash_table_lookup( debugger_variables, name );
+
+  if( !slot ) {
+    slot = libspectrum_new0( libspectrum_dword, 1 );
+    g_hash_table_insert( debugger_variables, utils_safe_strdup( name ), slot );
+  }
+
+  return slot;
 }
@@ -40,6 +40,7 @@
 #include "screenshot.h"
 #include "settings.h"
 #include "spectrum.h"
+#include "timer/timer.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
 
@@ -102,6 +103,28 @@ static int display_redraw_all;
 /* The last point at which we updated the screen display */
 static int critical_region_x = 0, critical_region_y = 0;
 
+/* Are we skipping all display updates? */
+static int skip_rendering = 0;
+
+/* The reasons we may be skipping them: because display_set_skip_rendering()
+   asked us to, or because frames are being emulated much faster than they
+   can be shown */
+static int skip_requested = 0;
+static int skip_adaptive = 0;
+
+/* While skipping adaptively, the UI is sent a frame about this often
+   (in seconds) */
+#define ADAPTIVE_SKIP_INTERVAL 0.02
+
+/* When the last frame ended and was shown, and the smoothed time each
+   frame is taking, all in seconds; a negative frame time means we have
+   nothing to go on yet */
+static double adaptive_last_frame, adaptive_last_shown;
+static double adaptive_frame_time = -1;
+
+/* Set when the next frame drawn must be shown whatever the frame rate */
+static int present_next_frame = 0;
+
 /* The border colour changes which have occurred in this frame */
 struct border_change_t {
   int x, y;
@@ -913,8 +936,9 @@ update_border( void )
   error = add_border_sentinel(); if( error ) return;
 }
 
-/* Send the updated screen to the UI-specific code */
-static void
+/* Send the updated screen to the UI-specific code; returns non-zero if
+   the frame was shown */
+static int
 update_ui_screen( void )
 {
   static int frame_count = 0;
@@ -922,8 +946,10 @@ update_ui_screen( void )
   size_t i;
   struct rectangle *ptr;
 
-  if( settings_current.frame_rate <= ++frame_count ) {
+  if( present_next_frame ||
+      settings_current.frame_rate <= ++frame_count ) {
     frame_count = 0;
+    present_next_frame = 0;
     if( movie_recording ) {
       movie_start_frame();
     }
@@ -952,29 +978,134 @@ update_ui_screen( void )
     rectangle_inactive_count = 0;
 
     uidisplay_frame_end();
+
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Forget this frame's border changes without drawing them */
+static void
+discard_border_changes( void )
+{
+  border_changes_last = 0;
+  add_border_sentinel();
+}
+
+/* Turn skipping on or off if either reason for it has changed */
+static void
+update_skip_rendering( void )
+{
+  int skip = skip_requested || skip_adaptive;
+
+  if( skip_rendering == skip ) return;
+
+  skip_rendering = skip;
+
+  if( skip ) {
+    critical_region_x = DISPLAY_WIDTH_COLS;
+    critical_region_y = DISPLAY_HEIGHT - 1;
+  } else {
+    /* Everything we skipped must be drawn from the next frame on */
+    critical_region_x = critical_region_y = 0;
+    display_refresh_all();
+  }
+}
+
+static void
+set_skip_adaptive( int skip )
+{
+  if( skip_adaptive == skip ) return;
+
+  skip_adaptive = skip;
+
+  /* The frame after a run of skipped ones is the one which catches the
+     UI up, so it must not be dropped by the frame rate setting */
+  if( !skip ) present_next_frame = 1;
+
+  update_skip_rendering();
+}
+
+/* Decide whether the next frame should be drawn. When frames are ending
+   more than twice as often as we want to show them, as they do when
+   running at high speed, draw only the last one to end before it is
+   time to show another; the others skip all display work, and the one
+   drawn is redrawn in full from video memory */
+static void
+update_adaptive_skip( int shown )
+{
+  double now, frame_time;
+
+  if( !settings_current.adaptive_frame_skip || skip_requested ||
+      movie_recording ) {
+    adaptive_frame_time = -1;
+    set_skip_adaptive( 0 );
+    return;
+  }
+
+  now = timer_get_time();
+
+  if( adaptive_frame_time < 0 ) {
+    adaptive_frame_time = ADAPTIVE_SKIP_INTERVAL;
+    adaptive_last_shown = now;
+  } else {
+    /* Smooth the frame time, as frames may be emulated in bursts */
+    frame_time = now - adaptive_last_frame;
+    adaptive_frame_time = ( 3 * adaptive_frame_time + frame_time ) / 4;
   }
+
+  adaptive_last_frame = now;
+  if( shown ) adaptive_last_shown = now;
+
+  /* Skip the next frame only if the one after it is also expected to end
+     before the next frame is due to be shown */
+  set_skip_adaptive(
+    adaptive_frame_time < ADAPTIVE_SKIP_INTERVAL / 2 &&
+    now + 2 * adaptive_frame_time <
+      adaptive_last_shown + ADAPTIVE_SKIP_INTERVAL
+  );
 }
 
 int
 display_frame( void )
 {
-  /* Copy all the critical region to the display */
-  copy_critical_region( DISPLAY_WIDTH_COLS, DISPLAY_HEIGHT - 1 );
-  critical_region_x = critical_region_y = 0;
+  int shown = 0;
 
-  update_border();
-  update_dirty_rects();
-  update_ui_screen();
+  if( skip_rendering ) {
+
+    /* Leave the critical region at the end of the screen so that writes
+       to video memory during the next frame don't copy anything */
+    critical_region_x = DISPLAY_WIDTH_COLS;
+    critical_region_y = DISPLAY_HEIGHT - 1;
 
+    discard_border_changes();
+
+  } else {
+
+    /* Copy all the critical region to the display */
+    copy_critical_region( DISPLAY_WIDTH_COLS, DISPLAY_HEIGHT - 1 );
+    critical_region_x = critical_region_y = 0;
+
+    update_border();
+    update_dirty_rects();
+    shown = update_ui_screen();
+
+  }
+
+  /* While skipping, the flashing attributes will be redrawn along with
+     everything else when we stop */
   display_frame_count++;
   if(display_frame_count==16) {
     display_flash_reversed=1;
-    display_dirty_flashing();
+    if( !skip_rendering ) display_dirty_flashing();
   } else if(display_frame_count==32) {
     display_flash_reversed=0;
-    display_dirty_flashing();
+    if( !skip_rendering ) display_dirty_flashing();
     display_frame_count=0;
   }
+
+  update_adaptive_skip( shown );
   
   return 0;
 }
@@ -1033,6 +1164,59 @@ display_dirty_flashing_sinclair(void)
   }
 }
 
+/* Turn skipping of all display updates on or off. While it is on, the
+   emulated screen is not drawn and nothing is sent to the UI */
+void
+display_set_skip_rendering( int skip )
+{
+  skip_requested = skip;
+  update_skip_rendering();
+}
+
+/* Bring the whole display image up to date with the current contents of
+   video memory and the current border colour; used when rendering has
+   been skipped but the image is needed, e.g. for a screenshot */
+void
+display_update_image( void )
+{
+  int colour = scld_last_dec.name.hires ?
+               display_hires_border : display_lores_border;
+  int y;
+
+  display_refresh_main_screen();
+
+  /* This leaves the critical region at the end of the screen */
+  critical_region_x = critical_region_y = 0;
+  copy_critical_region( DISPLAY_WIDTH_COLS, DISPLAY_HEIGHT - 1 );
+
+  for( y = 0; y < DISPLAY_SCREEN_HEIGHT; y++ )
+    border_change_line( y, colour );
+}
+
+/* Stop skipping frames adaptively and show the current contents of
+   video memory; called when emulation stops, so that a paused screen or
+   one left up by the debugger isn't the last frame to have been shown,
+   which may be several frames old */
+void
+display_stop_adaptive_skip( void )
+{
+  /* Whatever speed we were running at has no bearing on the next one */
+  adaptive_frame_time = -1;
+
+  /* Nothing to do unless frames are being skipped, or have been and the
+     frame which would catch up with them hasn't been drawn yet */
+  if( !skip_adaptive && !present_next_frame ) return;
+
+  set_skip_adaptive( 0 );
+
+  /* Still skipping for batch mode, which draws the image when it needs it */
+  if( skip_rendering ) return;
+
+  display_update_image();
+  update_dirty_rects();
+  update_ui_screen();
+}
+
 void display_refresh_main_screen(void)
 {
   size_t i;
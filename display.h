@@ -115,6 +115,9 @@ int display_dirty_border(void);
 int display_frame(void);
 void display_refresh_main_screen(void);
 void display_refresh_all(void);
+void display_set_skip_rendering( int skip );
+void display_update_image( void );
+void display_stop_adaptive_skip( void );
 
 #define display_get_offset( x, y ) display_line_start[(y)]+(x)
 
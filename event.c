@@ -23,6 +23,7 @@
 
 #include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "libspectrum.h"
@@ -45,12 +46,32 @@ int event_frame_end;
 /* We've had a timer event */
 int event_timer;
 
-/* The actual list of events */
-static GSList *event_list = NULL;
+/* The pending events, as a binary min-heap ordered by time */
+static event_t **event_heap = NULL;
+static size_t event_heap_count = 0, event_heap_size = 0;
 
-/* An event ready to be reused */
+/* Absolute time of the start of the current frame; events store absolute
+   times so that event_frame() need only move this along */
+static libspectrum_qword event_frame_base = 0;
+
+/* Orders events due at the same time in the order they were added */
+static libspectrum_dword event_sequence = 0;
+
+/* Events are allocated from a pool, in blocks of this many */
+#define EVENT_BLOCK_SIZE 256
+
+typedef struct event_block_t {
+  struct event_block_t *next;
+  event_t events[ EVENT_BLOCK_SIZE ];
+} event_block_t;
+
+static event_block_t *event_blocks = NULL;
+
+/* Events ready to be reused */
 static event_t *event_free = NULL;
 
+static event_pool_stats_t event_stats;
+
 /* A null event */
 int event_type_null;
 
@@ -61,11 +82,42 @@ typedef struct event_descriptor_t {
 
 static GArray *registered_events;
 
+static void event_release( event_t *ptr );
+
+/* Add another block of events to the pool */
+static void
+event_pool_grow( void )
+{
+  event_block_t *block = libspectrum_new( event_block_t, 1 );
+  size_t i;
+
+  block->next = event_blocks;
+  event_blocks = block;
+
+  for( i = EVENT_BLOCK_SIZE; i-- > 0; ) event_release( &block->events[i] );
+
+  event_stats.size += EVENT_BLOCK_SIZE;
+  event_stats.allocations++;
+}
+
+static void
+event_heap_grow( void )
+{
+  event_heap_size = event_heap_size ? 2 * event_heap_size : EVENT_BLOCK_SIZE;
+  event_heap = libspectrum_renew( event_t*, event_heap, event_heap_size );
+  event_stats.allocations++;
+}
+
 static int
 event_init( void *context )
 {
   registered_events = g_array_new( FALSE, FALSE, sizeof( event_descriptor_t ) );
 
+  /* Start with enough events and heap space that a running machine
+     shouldn't need any more */
+  event_pool_grow();
+  event_heap_grow();
+
   event_type_null = event_register( NULL, "[Deleted event]" );
 
   event_next_event = event_no_events;
@@ -88,43 +140,119 @@ event_register( event_fn_t fn, const char *description )
   return registered_events->len - 1;
 }
 
-static gint
-event_add_cmp( gconstpointer a1, gconstpointer b1 )
+/* Does event a happen before event b? Events at the same time happen in
+   type order, then in the order they were added */
+static inline int
+event_before( const event_t *a, const event_t *b )
 {
-  const event_t *a = a1, *b = b1;
-  /* (a->tstates - b->tstates) although usually sufficient as a GCompareFunc,
-     can overflow for high values of b->tstates. High values can occur in e.g.
-     timer events when fuse is run with --speed <very high number>. This
-     overflow can cause a crash if it pushes a spectrum frame event beyond a
-     distant timer event. Therefore use overflow safe variation
-     (a->tstates > b->tstates) - (a->tstates < b->tstates) instead. */
-  return a->tstates != b->tstates ? (a->tstates > b->tstates) - (a->tstates < b->tstates)
-		                  : a->type - b->type;
+  if( a->time != b->time ) return a->time < b->time;
+  if( a->type != b->type ) return a->type < b->type;
+  return (libspectrum_signed_dword)( a->sequence - b->sequence ) < 0;
 }
 
-/* Add an event at the correct place in the event list */
+static inline void
+event_heap_set( size_t index, event_t *ptr )
+{
+  event_heap[ index ] = ptr;
+  ptr->heap_index = index;
+}
+
+static void
+event_sift_up( size_t index )
+{
+  event_t *ptr = event_heap[ index ];
+
+  while( index > 0 ) {
+    size_t parent = ( index - 1 ) / 2;
+    if( !event_before( ptr, event_heap[ parent ] ) ) break;
+    event_heap_set( index, event_heap[ parent ] );
+    index = parent;
+  }
+
+  event_heap_set( index, ptr );
+}
+
+static void
+event_sift_down( size_t index )
+{
+  event_t *ptr = event_heap[ index ];
+
+  while( 1 ) {
+    size_t child = 2 * index + 1;
+    if( child >= event_heap_count ) break;
+    if( child + 1 < event_heap_count &&
+        event_before( event_heap[ child + 1 ], event_heap[ child ] ) )
+      child++;
+    if( !event_before( event_heap[ child ], ptr ) ) break;
+    event_heap_set( index, event_heap[ child ] );
+    index = child;
+  }
+
+  event_heap_set( index, ptr );
+}
+
+/* Take an event out of the heap, wherever it is */
+static void
+event_heap_remove( event_t *ptr )
+{
+  size_t index = ptr->heap_index;
+  event_t *last = event_heap[ --event_heap_count ];
+
+  if( last == ptr ) return;
+
+  event_heap_set( index, last );
+  if( index > 0 && event_before( last, event_heap[ ( index - 1 ) / 2 ] ) ) {
+    event_sift_up( index );
+  } else {
+    event_sift_down( index );
+  }
+}
+
+/* When an event is due, relative to the start of the current frame */
+static inline libspectrum_dword
+event_relative_time( const event_t *ptr )
+{
+  return ptr->time > event_frame_base ? ptr->time - event_frame_base : 0;
+}
+
+static void
+event_update_next_event( void )
+{
+  event_next_event = event_heap_count ?
+    event_relative_time( event_heap[0] ) : event_no_events;
+}
+
+static void
+event_release( event_t *ptr )
+{
+  ptr->next_free = event_free;
+  event_free = ptr;
+}
+
+/* Add an event at the correct place in the event queue */
 void
 event_add_with_data( libspectrum_dword event_time, int type, void *user_data )
 {
   event_t *ptr;
 
-  if( event_free ) {
-    ptr = event_free;
-    event_free = NULL;
-  } else {
-    ptr = libspectrum_new( event_t, 1 );
-  }
+  if( !event_free ) event_pool_grow();
+  ptr = event_free;
+  event_free = ptr->next_free;
 
   ptr->tstates = event_time;
   ptr->type = type;
   ptr->user_data = user_data;
+  ptr->time = event_frame_base + event_time;
+  ptr->sequence = event_sequence++;
 
-  if( event_time < event_next_event ) {
-    event_next_event = event_time;
-    event_list = g_slist_prepend( event_list, ptr );
-  } else {
-    event_list = g_slist_insert_sorted( event_list, ptr, event_add_cmp );
-  }
+  if( event_heap_count == event_heap_size ) event_heap_grow();
+
+  event_heap_set( event_heap_count++, ptr );
+  if( event_heap_count > event_stats.peak )
+    event_stats.peak = event_heap_count;
+  event_sift_up( ptr->heap_index );
+
+  if( event_time < event_next_event ) event_next_event = event_time;
 }
 
 /* Do all events which have passed */
@@ -135,48 +263,29 @@ event_do_events( void )
 
   while(event_next_event <= tstates) {
     event_descriptor_t descriptor;
-    ptr = event_list->data;
+    ptr = event_heap[0];
     descriptor =
       g_array_index( registered_events, event_descriptor_t, ptr->type );
 
-    /* Remove the event from the list *before* processing */
-    event_list = g_slist_remove( event_list, ptr );
-
-    if( event_list == NULL ) {
-      event_next_event = event_no_events;
-    } else {
-      event_next_event = ((event_t*)(event_list->data))->tstates;
-    }
+    /* Remove the event from the queue *before* processing */
+    event_heap_remove( ptr );
+    event_update_next_event();
 
+    ptr->tstates = event_relative_time( ptr );
     if( descriptor.fn ) descriptor.fn( ptr->tstates, ptr->type, ptr->user_data );
 
-    if( event_free ) {
-      libspectrum_free( ptr );
-    } else {
-      event_free = ptr;
-    }
+    event_release( ptr );
   }
 
   return 0;
 }
 
-static void
-event_reduce_tstates( gpointer data, gpointer user_data )
-{
-  event_t *ptr = data;
-  libspectrum_dword *tstates_per_frame = user_data;
-
-  ptr->tstates -= *tstates_per_frame;
-}
-
 /* Called at end of frame to reduce T-state count of all entries */
 void
 event_frame( libspectrum_dword tstates_per_frame )
 {
-  g_slist_foreach( event_list, event_reduce_tstates, &tstates_per_frame );
-
-  event_next_event = event_list ?
-    ((event_t*)(event_list->data))->tstates : event_no_events;
+  event_frame_base += tstates_per_frame;
+  event_update_next_event();
 }
 
 /* Do all events that would happen between the current time and when
@@ -196,69 +305,96 @@ event_force_events( void )
   }
 }
 
+/* Remove every event matching type (and user_data, if match_user_data is
+   set), then rebuild the heap */
 static void
-set_event_null( gpointer data, gpointer user_data )
+event_remove_matching( int type, int match_user_data, gpointer user_data )
 {
-  event_t *ptr = data;
-  int *type = user_data;
+  size_t i, kept = 0;
 
-  if( ptr->type == *type ) ptr->type = event_type_null;
-}
+  for( i = 0; i < event_heap_count; i++ ) {
+    event_t *ptr = event_heap[i];
+    if( ptr->type == type &&
+        ( !match_user_data || ptr->user_data == user_data ) ) {
+      event_release( ptr );
+    } else {
+      event_heap_set( kept++, ptr );
+    }
+  }
 
-static void
-set_event_null_with_user_data( gpointer data, gpointer user_data )
-{
-  event_t *event = data;
-  event_t *template = user_data;
+  if( kept == event_heap_count ) return;
+
+  event_heap_count = kept;
+  for( i = event_heap_count / 2; i-- > 0; ) event_sift_down( i );
 
-  if( event->type == template->type && event->user_data == template->user_data )
-    event->type = event_type_null;
+  event_update_next_event();
 }
 
-/* Remove all events of a specific type from the stack */
+/* Remove all events of a specific type from the queue */
 void
 event_remove_type( int type )
 {
-  g_slist_foreach( event_list, set_event_null, &type );
+  event_remove_matching( type, 0, NULL );
 }
 
-/* Remove all events of a specific type and user data from the stack */
+/* Remove all events of a specific type and user data from the queue */
 void
 event_remove_type_user_data( int type, gpointer user_data )
 {
-  event_t template;
-
-  template.type = type;
-  template.user_data = user_data;
-  g_slist_foreach( event_list, set_event_null_with_user_data, &template );
+  event_remove_matching( type, 1, user_data );
 }
 
-/* Free the memory used by a specific entry */
-static void
-event_free_entry( gpointer data, gpointer user_data GCC_UNUSED )
+/* Clear the event queue */
+void
+event_reset( void )
 {
-  libspectrum_free( data );
+  size_t i;
+
+  for( i = 0; i < event_heap_count; i++ ) event_release( event_heap[i] );
+  event_heap_count = 0;
+
+  event_next_event = event_no_events;
+  event_frame_base = 0;
 }
 
-/* Clear the event stack */
+/* How big the event pool is, and how often it and the heap have had to
+   grow */
 void
-event_reset( void )
+event_pool_stats( event_pool_stats_t *stats )
 {
-  g_slist_foreach( event_list, event_free_entry, NULL );
-  g_slist_free( event_list );
-  event_list = NULL;
+  *stats = event_stats;
+  stats->in_use = event_heap_count;
+}
 
-  event_next_event = event_no_events;
+static int
+event_foreach_cmp( const void *a1, const void *b1 )
+{
+  const event_t *a = *(event_t * const *)a1, *b = *(event_t * const *)b1;
 
-  libspectrum_free( event_free );
-  event_free = NULL;
+  return event_before( a, b ) ? -1 : event_before( b, a );
 }
 
-/* Call a user-supplied function for every event in the current list */
+/* Call a user-supplied function for every event in the queue, in the
+   order they will happen */
 void
 event_foreach( GFunc function, gpointer user_data )
 {
-  g_slist_foreach( event_list, function, user_data );
+  event_t **sorted;
+  size_t i, count = event_heap_count;
+
+  if( !count ) return;
+
+  sorted = libspectrum_new( event_t*, count );
+  memcpy( sorted, event_heap, count * sizeof( *sorted ) );
+  qsort( sorted, count, sizeof( *sorted ), event_foreach_cmp );
+
+  for( i = 0; i < count; i++ ) {
+    event_t *ptr = sorted[i];
+    ptr->tstates = event_relative_time( ptr );
+    function( ptr, user_data );
+  }
+
+  libspectrum_free( sorted );
 }
 
 /* A textual representation of each event type */
@@ -291,6 +427,19 @@ event_end( void )
 {
   event_reset();
   registered_events_free();
+
+  libspectrum_free( event_heap );
+  event_heap = NULL;
+  event_heap_size = 0;
+
+  while( event_blocks ) {
+    event_block_t *next = event_blocks->next;
+    libspectrum_free( event_blocks );
+    event_blocks = next;
+  }
+  event_free = NULL;
+
+  memset( &event_stats, 0, sizeof( event_stats ) );
 }
 
 void
@@ -32,9 +32,17 @@
 
 /* Information about an event */
 typedef struct event_t {
-  libspectrum_dword tstates;
+  libspectrum_dword tstates;	/* Relative to the start of the current
+				   frame; valid in callbacks and
+				   event_foreach() */
   int type;
   void *user_data;
+
+  /* Private to event.c */
+  libspectrum_qword time;	/* Absolute time the event is due */
+  libspectrum_dword sequence;	/* Orders events due at the same time */
+  size_t heap_index;		/* Position in the event heap */
+  struct event_t *next_free;	/* Link in the pool's free list */
 } event_t;
 
 /* A null event type */
@@ -74,18 +82,29 @@ void event_frame( libspectrum_dword tstates_per_frame );
 /* Force all events between now and the next interrupt to happen */
 void event_force_events( void );
 
-/* Remove all events of a specific type from the stack */
+/* Remove all events of a specific type from the queue */
 void event_remove_type( int type );
 
-/* Remove all events of a specific type and user data from the stack */
+/* Remove all events of a specific type and user data from the queue */
 void event_remove_type_user_data( int type, gpointer user_data );
 
-/* Clear the event stack */
+/* Clear the event queue */
 void event_reset( void );
 
-/* Call a user-supplied function for every event in the current list */
+/* Call a user-supplied function for every event in the queue, in the
+   order they will happen */
 void event_foreach( GFunc function, gpointer user_data );
 
+/* Statistics on the pool events are allocated from */
+typedef struct event_pool_stats_t {
+  size_t size;			/* Events in the pool */
+  size_t in_use;		/* Events currently pending */
+  size_t peak;			/* Most events ever pending at once */
+  unsigned long allocations;	/* Times the pool or the heap has grown */
+} event_pool_stats_t;
+
+void event_pool_stats( event_pool_stats_t *stats );
+
 /* A textual representation of each event type */
 const char *event_name( int type );
 
@@ -54,6 +54,7 @@
 #include <libxml/encoding.h>
 #endif
 
+#include "batch.h"
 #include "debugger/debugger.h"
 #include "debugger/gdbserver.h"
 #include "display.h"
@@ -194,8 +195,13 @@ int old_main(int argc, char **argv)
   if( settings_current.show_help ||
       settings_current.show_version ) return 0;
 
+  /* The parent of a batch manifest's jobs never started anything up */
+  if( batch_manifest_done() ) return batch_run();
+
   if( settings_current.unittests ) {
     r = unittests_run();
+  } else if( settings_current.batch ) {
+    r = batch_run();
   } else {
     while( !fuse_exiting ) {
       spectrum_do_frame();
@@ -385,10 +391,14 @@ int fuse_init(int argc, char **argv)
     return 0;
   }
 
-  start_scaler = utils_safe_strdup( settings_current.start_scaler_mode );
-
   fuse_show_copyright();
 
+  /* Before anything starts a thread, as this may fork */
+  batch_init();
+  if( batch_manifest_done() ) return 0;
+
+  start_scaler = utils_safe_strdup( settings_current.start_scaler_mode );
+
   if( run_startup_manager( &argc, &argv ) ) return 1;
 
   error = machine_select_id( settings_current.start_machine );
@@ -580,6 +590,10 @@ int fuse_emulation_pause(void)
      turn it off */
   sound_pause();
 
+  /* Show the screen as it is now, not as it was when a frame last made
+     it to the UI */
+  display_stop_adaptive_skip();
+
   return 0;
 }
 
@@ -983,6 +997,7 @@ int fuse_end(void)
 
   periph_end();
   ui_end();
+  scaler_threads_end();	/* after the UI has stopped scaling */
   ui_media_drive_end();
   module_end();
   pokemem_end();
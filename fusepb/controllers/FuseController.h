@@ -141,6 +141,7 @@
 - (IBAction)movie_record_from_rzx:(id)sender;
 - (IBAction)movie_pause:(id)sender;
 - (IBAction)movie_stop:(id)sender;
+- (IBAction)movie_statistics:(id)sender;
 - (IBAction)didaktik80_snap:(id)sender;
 - (IBAction)multiface_red_button:(id)sender;
 
@@ -1138,6 +1138,11 @@ save_as_exit:
   [[DisplayOpenGLView instance] movieStop];
 }
 
+- (IBAction)movie_statistics:(id)sender
+{
+  [[DisplayOpenGLView instance] movieStatistics];
+}
+
 - (IBAction)didaktik80_snap:(id)sender
 {
   [[DisplayOpenGLView instance] didaktik80Snap];
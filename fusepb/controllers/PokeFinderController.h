@@ -36,6 +36,8 @@
 - (IBAction)search:(id)sender;
 - (IBAction)incremented:(id)sender;
 - (IBAction)decremented:(id)sender;
+- (IBAction)changed:(id)sender;
+- (IBAction)unchanged:(id)sender;
 - (IBAction)reset:(id)sender;
 - (void)showWindow:(id)sender;
 - (int)numberOfRowsInTableView:(NSTableView *)table;
@@ -25,7 +25,6 @@
 
 #include <config.h>
 
-#import "NumberFormatter.h"
 #import "PokeFinderController.h"
 #import "DisplayOpenGLView.h"
 
@@ -50,13 +49,6 @@
 
 - (void)awakeFromNib
 {
-  NumberFormatter *searchForFormatter = [[[NumberFormatter alloc] init] autorelease];
-
-  [searchForFormatter setMinimum:[NSDecimalNumber zero]];
-  [searchForFormatter setMaximum:[NSDecimalNumber decimalNumberWithString:@"255"]];
-  [searchForFormatter setFormat:@"0"];
-  [searchFor setFormatter:searchForFormatter];
-
   [matchList setTarget:self];
   [matchList setDoubleAction:@selector(matchListDoubleAction:)];
 }
@@ -137,7 +129,8 @@
 
 - (IBAction)search:(id)sender
 {
-  pokefinder_search( [searchFor intValue] );
+  /* A byte, a 16-bit value or a range of bytes such as 10-20 */
+  if( pokefinder_search_text( [[searchFor stringValue] UTF8String] ) ) return;
   [self update_pokefinder];
 }
 
@@ -153,6 +146,18 @@
   [self update_pokefinder];
 }
 
+- (IBAction)changed:(id)sender
+{
+  pokefinder_changed();
+  [self update_pokefinder];
+}
+
+- (IBAction)unchanged:(id)sender
+{
+  pokefinder_unchanged();
+  [self update_pokefinder];
+}
+
 - (IBAction)reset:(id)sender
 {
   pokefinder_clear();
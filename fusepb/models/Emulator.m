@@ -1061,6 +1061,11 @@ static Emulator *instance = nil;
   movie_stop();
 }
 
+-(void)movieStatistics
+{
+  movie_show_statistics();
+}
+
 -(void) didaktik80Snap
 {
   didaktik80_snap = 1;
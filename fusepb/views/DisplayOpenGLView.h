@@ -151,6 +151,7 @@
 -(void) movieStartRecording:(const char *)filename;
 -(void) movieTogglePause;
 -(void) movieStop;
+-(void) movieStatistics;
 
 -(void) didaktik80Snap;
 
@@ -908,6 +908,11 @@ static DisplayOpenGLView *instance = nil;
   [proxy_emulator movieStop];
 }
 
+-(void)movieStatistics
+{
+  [proxy_emulator movieStatistics];
+}
+
 -(void) didaktik80Snap
 {
   [proxy_emulator didaktik80Snap];
@@ -251,7 +251,9 @@ machine_select_machine( fuse_machine_info *machine )
 
   /* Reset the event stack */
   event_reset();
-  event_add( 0, timer_event );
+
+  /* In batch mode we run as fast as possible */
+  if( !settings_current.batch ) event_add( 0, timer_event );
   event_add( machine->timings.tstates_per_frame, spectrum_frame_event );
 
   sound_end();
@@ -252,6 +252,13 @@ MENU_CALLBACK( menu_file_movie_pause )
   movie_pause();
 }
 
+MENU_CALLBACK( menu_file_movie_statistics )
+{
+  ui_widget_finish();
+
+  movie_show_statistics();
+}
+
 MENU_CALLBACK_WITH_ACTION( menu_options_selectroms_machine_select )
 {
   switch( action ) {
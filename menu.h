@@ -71,6 +71,7 @@ MENU_CALLBACK( menu_file_scalablevectorgraphics_stopcapture );
 
 MENU_CALLBACK( menu_file_movie_stop );
 MENU_CALLBACK( menu_file_movie_pause );
+MENU_CALLBACK( menu_file_movie_statistics );
 
 MENU_CALLBACK_WITH_ACTION( menu_options_selectroms_machine_select );
 MENU_CALLBACK_WITH_ACTION( menu_options_selectroms_peripheral_select );
@@ -25,6 +25,9 @@
 #include "config.h"
 
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif				/* #ifdef HAVE_PTHREAD */
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -37,6 +40,7 @@
 #include <zlib.h>
 #endif
 
+#include "debugger/debugger.h"
 #include "display.h"
 #include "fuse.h"
 #include "machine.h"
@@ -115,9 +119,53 @@
       concat several FMF file without any problem...
 */
 
+/*
+  Encoding happens on a separate thread: the emulation thread only copies
+  the changed screen areas and the sound samples into a ring buffer, and
+  the encoder thread does the RLE, compression and file output. The ring
+  buffer has a single producer and a single consumer, so, as with sfifo,
+  each side only ever writes its own position and no lock is needed
+  around the data itself. If the encoder falls behind and the buffer
+  fills, whole frames are dropped until there is room for a frame with a
+  full screen image, so the decoded movie stays consistent.
+
+  Without POSIX threads, or if the thread can't be started, the emulation
+  thread does the encoding itself whenever a frame has been queued or the
+  queue is full, so nothing is ever dropped.
+*/
+
+/* Must be a power of two */
+#ifdef HAVE_PTHREAD
+/* Enough for over 200 full screen frames */
+#define QUEUE_SIZE ( 1 << 23 )
+#else				/* #ifdef HAVE_PTHREAD */
+/* Enough for a frame; the queue is emptied as it fills */
+#define QUEUE_SIZE ( 1 << 17 )
+#endif				/* #ifdef HAVE_PTHREAD */
+
+typedef enum record_type {
+  RECORD_RAW,		/* Bytes to be written as they are */
+  RECORD_AREA,		/* A screen area and a copy of its contents */
+  RECORD_SOUND,		/* Sound samples and their format */
+} record_type;
+
+typedef struct record_t {
+  record_type type;
+  size_t length;	/* Number of bytes following this header */
+
+  union {
+    struct { int x, y, w, h, planes; } area;
+    struct { int len; char format, stereo; int freq, framesiz; } sound;
+  } data;
+} record_t;
+
 int movie_recording = 0;
 static int movie_paused = 0;
 
+/* Set when the next frame must start with the full screen, because the
+   frames before it were dropped */
+static int movie_force_keyframe = 0;
+
 static int frame_no, slice_no;
 
 static FILE *of = NULL;	/* out file */
@@ -128,6 +176,31 @@ static char stereo = 'M';
 static char format = '?';
 static int framesiz = 4;
 
+static libspectrum_byte *queue = NULL;
+static volatile size_t queue_readpos, queue_writepos;
+
+/* Set while frames are being dropped because the queue is full */
+static int queue_dropping;
+
+static size_t queue_peak;
+static libspectrum_dword frames_dropped;
+
+#ifdef HAVE_PTHREAD
+static pthread_t encoder_thread;
+static pthread_mutex_t encoder_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t encoder_cond = PTHREAD_COND_INITIALIZER;
+static int encoder_stop;
+#endif				/* #ifdef HAVE_PTHREAD */
+static int encoder_running;
+
+/* Buffers used only by the encoder */
+static libspectrum_dword area_buffer[ DISPLAY_SCREEN_WIDTH_COLS *
+				      DISPLAY_SCREEN_HEIGHT ];
+static libspectrum_signed_word *sound_buffer = NULL;
+static size_t sound_buffer_size = 0;
+
+static const char * const debugger_type_string = "movie";
+
 static libspectrum_byte sbuff[ 4096 ];
 #ifdef HAVE_ZLIB_H
 #define ZBUF_SIZE 8192
@@ -212,19 +285,21 @@ fwrite_compr( const void *b, size_t n, size_t m, FILE *f )
 #define fwrite_compr fwrite
 #endif	/* HAVE_ZLIB_H */
 
+/* area is the copy of the screen made by movie_add_area(), w columns
+   wide */
 static void
-movie_compress_area( int x, int y, int w, int h, int s )
+movie_compress_area( const libspectrum_dword *area, int w, int h, int s )
 {
-  libspectrum_dword *dpoint, *dline;
+  const libspectrum_dword *dpoint, *dline;
   libspectrum_byte d, d1, *b;
   libspectrum_byte buff[ 960 ];
   int w0, h0, l;
 
-  dline = &display_last_screen[x + 40 * y];
+  dline = area;
   b = buff; l = -1;
   d1 = ( ( *dline >> s ) & 0xff ) + 1;		/* *d1 != dpoint :-) */
 
-  for( h0 = h; h0 > 0; h0--, dline += 40 ) {
+  for( h0 = h; h0 > 0; h0--, dline += w ) {
     dpoint = dline;
     for( w0 = w; w0 > 0; w0--, dpoint++) {
       d = ( *dpoint >> s ) & 0xff;	/* bitmask1 */
@@ -267,13 +342,12 @@ movie_compress_area( int x, int y, int w, int h, int s )
 
 /* abcdefghijkl... cc# where # mean cc + # c char*/
 
-void
-movie_add_area( int x, int y, int w, int h )
+static void
+encode_area( const record_t *record, const libspectrum_dword *area )
 {
-  if( movie_paused ) {
-    movie_start_frame();
-    return;
-  }
+  int x = record->data.area.x, y = record->data.area.y;
+  int w = record->data.area.w, h = record->data.area.h;
+
   head[0] = '$';			/* RLE compressed data... */
   head[1] = x;
   head[2] = y & 0xff;
@@ -282,21 +356,311 @@ movie_add_area( int x, int y, int w, int h )
   head[5] = h & 0xff;
   head[6] = h >> 8;
   fwrite_compr( head, 7, 1, of );
-  movie_compress_area( x, y, w, h, 0 );	/* Bitmap1 */
-  movie_compress_area( x, y, w, h, 8 );	/* Attrib/B2 */
-  if( fmf_screen == 'R' ) {
-    movie_compress_area( x, y, w, h, 16 );	/* HiRes attrib */
+  movie_compress_area( area, w, h, 0 );	/* Bitmap1 */
+  movie_compress_area( area, w, h, 8 );	/* Attrib/B2 */
+  if( record->data.area.planes == 3 ) {
+    movie_compress_area( area, w, h, 16 );	/* HiRes attrib */
+  }
+}
+
+/* The queue */
+
+#ifdef __GNUC__
+#define queue_barrier() __sync_synchronize()
+#else				/* #ifdef __GNUC__ */
+#define queue_barrier()
+#endif				/* #ifdef __GNUC__ */
+
+static size_t
+queue_used( void )
+{
+  return ( queue_writepos - queue_readpos ) & ( QUEUE_SIZE - 1 );
+}
+
+static size_t
+queue_space( void )
+{
+  return QUEUE_SIZE - 1 - queue_used();
+}
+
+/* Copy data into the queue at *pos, without making it visible to the
+   encoder */
+static void
+queue_write( size_t *pos, const void *data, size_t length )
+{
+  const libspectrum_byte *bytes = data;
+  size_t chunk = QUEUE_SIZE - *pos;
+
+  if( chunk > length ) chunk = length;
+  memcpy( queue + *pos, bytes, chunk );
+  memcpy( queue, bytes + chunk, length - chunk );
+  *pos = ( *pos + length ) & ( QUEUE_SIZE - 1 );
+}
+
+static void
+queue_read( size_t *pos, void *data, size_t length )
+{
+  libspectrum_byte *bytes = data;
+  size_t chunk = QUEUE_SIZE - *pos;
+
+  if( chunk > length ) chunk = length;
+  memcpy( bytes, queue + *pos, chunk );
+  memcpy( bytes + chunk, queue, length - chunk );
+  *pos = ( *pos + length ) & ( QUEUE_SIZE - 1 );
+}
+
+/* Make everything written since the last call visible to the encoder */
+static void
+queue_publish( size_t pos )
+{
+  size_t used;
+
+  queue_barrier();
+  queue_writepos = pos;
+
+  used = queue_used();
+  if( used > queue_peak ) queue_peak = used;
+}
+
+static void encoder_process( void );
+
+/* Wake the encoder, or encode everything now if there's no encoder
+   thread */
+static void
+encoder_wake( void )
+{
+  if( !encoder_running ) {
+    encoder_process();
+    return;
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock( &encoder_mutex );
+  pthread_cond_signal( &encoder_cond );
+  pthread_mutex_unlock( &encoder_mutex );
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+/* Is there room for a record with `length' bytes of data? Without an
+   encoder thread, make room by encoding what's already queued */
+static int
+queue_has_room( size_t length )
+{
+  if( queue_dropping ) return 0;
+
+  if( queue_space() < sizeof( record_t ) + length && !encoder_running )
+    encoder_process();
+
+  return queue_space() >= sizeof( record_t ) + length;
+}
+
+static int
+queue_raw( const libspectrum_byte *data, size_t length )
+{
+  record_t record;
+  size_t pos = queue_writepos;
+
+  if( !queue_has_room( length ) ) return 1;
+
+  record.type = RECORD_RAW;
+  record.length = length;
+  queue_write( &pos, &record, sizeof( record ) );
+  queue_write( &pos, data, length );
+  queue_publish( pos );
+
+  return 0;
+}
+
+static int
+queue_area( int x, int y, int w, int h )
+{
+  record_t record;
+  size_t pos = queue_writepos;
+  int row;
+
+  record.type = RECORD_AREA;
+  record.length = (size_t)w * h * sizeof( libspectrum_dword );
+  record.data.area.x = x; record.data.area.y = y;
+  record.data.area.w = w; record.data.area.h = h;
+  record.data.area.planes = fmf_screen == 'R' ? 3 : 2;
+
+  if( !queue_has_room( record.length ) ) return 1;
+
+  queue_write( &pos, &record, sizeof( record ) );
+  for( row = y; row < y + h; row++ )
+    queue_write( &pos, &display_last_screen[ x + 40 * row ],
+		 w * sizeof( libspectrum_dword ) );
+  queue_publish( pos );
+
+  return 0;
+}
+
+/* Start dropping frames; the next frame which fits will be a full
+   screen one */
+static void
+queue_drop( void )
+{
+  if( !queue_dropping ) frames_dropped++;
+  queue_dropping = 1;
+}
+
+void
+movie_add_area( int x, int y, int w, int h )
+{
+  if( movie_paused ) {
+    movie_start_frame();
+    return;
   }
+  if( queue_area( x, y, w, h ) ) queue_drop();
   slice_no++;
 }
 
+/* The encoder */
+
+static void
+encode_sound_frame( const record_t *record, libspectrum_signed_word *buff,
+		    int len );
+
 static void
+encode_sound( const record_t *record, libspectrum_signed_word *buff )
+{
+  int len = record->data.sound.len;
+
+  while( len ) {
+    if( record->data.sound.stereo == 'S' ) {
+      encode_sound_frame( record, buff, len > 131072 ? 65536 : len >> 1 );
+      buff += len > 131072 ? 131072 : len;
+      len -= len > 131072 ? 131072 : len;
+    } else {
+      encode_sound_frame( record, buff, len > 65536 ? 65536 : len );
+      buff += len > 65536 ? 65536 : len;
+      len -= len > 65536 ? 65536 : len;
+    }
+  }
+}
+
+/* Encode everything currently in the queue */
+static void
+encoder_process( void )
+{
+  size_t pos = queue_readpos;
+
+  while( pos != queue_writepos ) {
+    record_t record;
+    libspectrum_byte raw[8];
+
+    queue_barrier();
+    queue_read( &pos, &record, sizeof( record ) );
+
+    switch( record.type ) {
+
+    case RECORD_RAW:
+      queue_read( &pos, raw, record.length );
+      fwrite_compr( raw, record.length, 1, of );
+      break;
+
+    case RECORD_AREA:
+      queue_read( &pos, area_buffer, record.length );
+      encode_area( &record, area_buffer );
+      break;
+
+    case RECORD_SOUND:
+      if( record.length > sound_buffer_size ) {
+	sound_buffer = libspectrum_renew( libspectrum_signed_word,
+					  sound_buffer,
+					  record.length /
+					  sizeof( libspectrum_signed_word ) );
+	sound_buffer_size = record.length;
+      }
+      queue_read( &pos, sound_buffer, record.length );
+      encode_sound( &record, sound_buffer );
+      break;
+
+    }
+
+    queue_barrier();
+    queue_readpos = pos;
+  }
+}
+
+#ifdef HAVE_PTHREAD
+static void*
+encoder_main( void *arg GCC_UNUSED )
+{
+  pthread_mutex_lock( &encoder_mutex );
+
+  while( 1 ) {
+    if( queue_readpos == queue_writepos ) {
+      if( encoder_stop ) break;
+      pthread_cond_wait( &encoder_cond, &encoder_mutex );
+      continue;
+    }
+
+    pthread_mutex_unlock( &encoder_mutex );
+    encoder_process();
+    pthread_mutex_lock( &encoder_mutex );
+  }
+
+  pthread_mutex_unlock( &encoder_mutex );
+
+  return NULL;
+}
+#endif				/* #ifdef HAVE_PTHREAD */
+
+static void
+encoder_start( void )
+{
+  queue = libspectrum_new( libspectrum_byte, QUEUE_SIZE );
+  queue_readpos = queue_writepos = 0;
+  queue_dropping = 0;
+  queue_peak = 0;
+  frames_dropped = 0;
+  movie_force_keyframe = 0;
+
+#ifdef HAVE_PTHREAD
+  encoder_stop = 0;
+  encoder_running = !pthread_create( &encoder_thread, NULL, encoder_main,
+				     NULL );
+
+  /* Not fatal: we can still encode everything on this thread */
+  if( !encoder_running )
+    ui_error( UI_ERROR_WARNING,
+	      "couldn't start movie encoder thread; encoding synchronously" );
+#else				/* #ifdef HAVE_PTHREAD */
+  encoder_running = 0;
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+/* Wait for the encoder to write out everything in the queue */
+static void
+encoder_end( void )
+{
+#ifdef HAVE_PTHREAD
+  if( encoder_running ) {
+    pthread_mutex_lock( &encoder_mutex );
+    encoder_stop = 1;
+    pthread_cond_signal( &encoder_cond );
+    pthread_mutex_unlock( &encoder_mutex );
+
+    pthread_join( encoder_thread, NULL );
+    encoder_running = 0;
+  }
+#endif				/* #ifdef HAVE_PTHREAD */
+
+  encoder_process();
+
+  libspectrum_free( queue ); queue = NULL;
+  libspectrum_free( sound_buffer ); sound_buffer = NULL;
+  sound_buffer_size = 0;
+}
+
+static int
 movie_start_fmf( const char *name )
 {
   if( ( of = fopen(name, "wb") ) == NULL ) {  /* trunc old file ? or append ? */
     ui_error( UI_ERROR_ERROR, "error opening movie file '%s': %s", name,
               strerror( errno ) );
-    return;
+    return 1;
   }
 #ifdef WORDS_BIGENDIAN
   fwrite( "FMF_V1E", 7, 1, of );	/* write magic header Fuse Movie File */
@@ -333,7 +697,11 @@ movie_start_fmf( const char *name )
   head[6] = stereo;
   head[7] = '\n';	/* padding */
   fwrite( head, 8, 1, of );		/* write initial params */
+  encoder_start();
   movie_add_area( 0, 0, 40, 240 );
+  encoder_wake();
+
+  return 0;
 }
 
 void
@@ -343,7 +711,7 @@ movie_start( const char *name )	/* some init, open file (name)*/
   if( name == NULL || *name == '\0' )
     name = "fuse.fmf";			/* fuse movie file */
 
-  movie_start_fmf( name );
+  if( movie_start_fmf( name ) ) return;
   movie_recording = 1;
   ui_menu_activate( UI_MENU_ITEM_FILE_MOVIE_RECORDING, 1 );
   ui_menu_activate( UI_MENU_ITEM_FILE_MOVIE_PAUSE, 1 );
@@ -354,6 +722,8 @@ movie_stop( void )
 {
   if( !movie_paused && !movie_recording ) return;
 
+  encoder_end();
+
   fwrite_compr( "X", 1, 1, of );	/* End of Recording! */
 #ifdef HAVE_ZLIB_H
   {
@@ -378,7 +748,13 @@ movie_stop( void )
   }
 #ifdef MOVIE_DEBUG_PRINT
   fprintf( stderr, "Debug movie: saved %d.%d frame(.slice)\n", frame_no, slice_no );
+  fprintf( stderr, "Debug movie: queue peak %lu bytes\n",
+           (unsigned long)queue_peak );
 #endif 	/* MOVIE_DEBUG_PRINT */
+  if( frames_dropped )
+    ui_error( UI_ERROR_WARNING,
+              "movie encoder couldn't keep up: %lu frames dropped",
+              (unsigned long)frames_dropped );
   movie_recording = 0;
   movie_paused = 0;
   ui_menu_activate( UI_MENU_ITEM_FILE_MOVIE_RECORDING, 0 );
@@ -430,59 +806,143 @@ write_alaw( libspectrum_signed_word *buff, int len )
 }
 
 static void
-add_sound( libspectrum_signed_word *buff, int len )
+encode_sound_frame( const record_t *record, libspectrum_signed_word *buff,
+		    int len )
 {
   head[0] = 'S';	/* sound frame */
-  head[1] = format;	/* sound format */
-  head[2] = freq & 0xff;
-  head[3] = freq >> 8;
-  head[4] = stereo;
+  head[1] = record->data.sound.format;	/* sound format */
+  head[2] = record->data.sound.freq & 0xff;
+  head[3] = record->data.sound.freq >> 8;
+  head[4] = record->data.sound.stereo;
   len--;		/*len - 1*/
   head[5] = len & 0xff;
   head[6] = len >> 8;
   len++;		/* len :-) */
   fwrite_compr( head, 7, 1, of );	/* Sound frame */
-  if( format == 'P' )
-    fwrite_compr( buff, len * framesiz , 1, of );	/* write frame */
-  else if( format == 'A' )
-    write_alaw( buff, len * framesiz );
+  if( record->data.sound.format == 'P' )
+    fwrite_compr( buff, len * record->data.sound.framesiz , 1, of );	/* write frame */
+  else if( record->data.sound.format == 'A' )
+    write_alaw( buff, len * record->data.sound.framesiz );
 }
 
 void
 movie_add_sound( libspectrum_signed_word *buff, int len )
 {
-  while( len ) {
-    if( stereo == 'S' ) {
-      add_sound( buff, len > 131072 ? 65536 : len >> 1 );
-      buff += len > 131072 ? 131072 : len;
-      len -= len > 131072 ? 131072 : len;
-    } else {
-      add_sound( buff, len > 65536 ? 65536 : len );
-      buff += len > 65536 ? 65536 : len;
-      len -= len > 65536 ? 65536 : len;
-    }
+  record_t record;
+  size_t pos = queue_writepos;
+
+  record.type = RECORD_SOUND;
+  record.length = len * sizeof( libspectrum_signed_word );
+  record.data.sound.len = len;
+  record.data.sound.format = format;
+  record.data.sound.stereo = stereo;
+  record.data.sound.freq = freq;
+  record.data.sound.framesiz = framesiz;
+
+  if( !queue_has_room( record.length ) ) {
+    queue_drop();
+    return;
   }
+
+  queue_write( &pos, &record, sizeof( record ) );
+  queue_write( &pos, buff, record.length );
+  queue_publish( pos );
+
+  encoder_wake();
 }
 
 void
 movie_start_frame( void )
 {
+  libspectrum_byte frame[4];
+
+  /* When frames are being dropped, wait until there's room for this
+     header and a full screen */
+  if( queue_dropping ) {
+    if( queue_space() < 2 * sizeof( record_t ) + sizeof( frame ) +
+	sizeof( area_buffer ) ) {
+      frames_dropped++;
+      return;
+    }
+    queue_dropping = 0;
+    movie_force_keyframe = 1;
+  }
+
   /* $ - ZX$, T - TX$, C - HiCol, R - HiRes */
-  head[0] = 'N';
-  head[1] = settings_current.frame_rate;
-  head[2] = get_screentype();
-  head[3] = get_timing();
-  fwrite_compr( head, 4, 1, of );	/* New frame! */
+  frame[0] = 'N';
+  frame[1] = settings_current.frame_rate;
+  frame[2] = get_screentype();
+  frame[3] = get_timing();
+  if( queue_raw( frame, 4 ) ) {	/* New frame! */
+    queue_drop();
+    return;
+  }
   frame_no++;
-  if( movie_paused ) {
+  if( movie_paused || movie_force_keyframe ) {
     movie_paused = 0;
+    movie_force_keyframe = 0;
     movie_add_area( 0, 0, 40, 240 );
   }
+
+  encoder_wake();
+}
+
+static libspectrum_dword
+get_queue( void )
+{
+  return queue ? queue_used() : 0;
+}
+
+static libspectrum_dword
+get_queue_peak( void )
+{
+  return queue_peak;
+}
+
+static libspectrum_dword
+get_dropped( void )
+{
+  return frames_dropped;
+}
+
+/* Tell the user how well the encoder is keeping up with the movie being
+   recorded, or did with the last one */
+void
+movie_show_statistics( void )
+{
+  if( !movie_recording && !movie_paused ) {
+    if( !frame_no ) {
+      ui_error( UI_ERROR_INFO, "No movie has been recorded" );
+      return;
+    }
+    ui_error( UI_ERROR_INFO,
+	      "Last movie: %d frames; encoder queue peak %lu of %lu KB; "
+	      "%lu frames dropped", frame_no,
+	      (unsigned long)( queue_peak / 1024 ),
+	      (unsigned long)( QUEUE_SIZE / 1024 ),
+	      (unsigned long)frames_dropped );
+    return;
+  }
+
+  ui_error( UI_ERROR_INFO,
+	    "Recording movie: %d frames; encoder queue %lu KB, peak %lu of "
+	    "%lu KB; %lu frames dropped", frame_no,
+	    (unsigned long)( get_queue() / 1024 ),
+	    (unsigned long)( queue_peak / 1024 ),
+	    (unsigned long)( QUEUE_SIZE / 1024 ),
+	    (unsigned long)frames_dropped );
 }
 
 void
 movie_init( void )
 {
+  debugger_system_variable_register( debugger_type_string, "queue",
+				     get_queue, NULL );
+  debugger_system_variable_register( debugger_type_string, "queuepeak",
+				     get_queue_peak, NULL );
+  debugger_system_variable_register( debugger_type_string, "dropped",
+				     get_dropped, NULL );
+
   /* start movie recording if user requested... */
   if( settings_current.movie_start )
     movie_start( settings_current.movie_start );
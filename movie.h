@@ -30,6 +30,7 @@ void movie_init( void );
 void movie_start( const char *name );
 void movie_stop( void );
 void movie_pause( void );
+void movie_show_statistics( void );
 void movie_add_area( int x, int y, int w, int h );
 void movie_start_frame( void );
 void movie_init_sound( int f, int s );
@@ -24,6 +24,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "libspectrum.h"
 
 #include "debugger/debugger.h"
@@ -64,6 +66,21 @@ typedef struct periph_port_private_t {
 /* The list of currently active ports */
 static GSList *ports = NULL;
 
+/* The active ports compiled into a decode table: for every port value, the
+   index of the list of port responses which match it. Each distinct list
+   is stored once in decode_ports, NULL-terminated and in the same order as
+   the responses appear in ports */
+static libspectrum_word *decode_table = NULL;
+static const periph_port_t **decode_ports = NULL;
+static size_t *decode_lists = NULL;
+
+/* Set whenever ports changes; the table is rebuilt before its next use */
+static int decode_stale = 1;
+
+/* The number of 32-bit words in the sets of responses being compared
+   while building the table */
+static size_t decode_set_words;
+
 /* The strings used for debugger events */
 static const char * const page_event_string = "page",
   * const unpage_event_string = "unpage";
@@ -80,6 +97,7 @@ port_register( periph_type type, const periph_port_t *port )
   private->port = *port;
 
   ports = g_slist_append( ports, private );
+  decode_stale = 1;
 }
 
 /* Register a peripheral with the system */
@@ -136,6 +154,7 @@ periph_activate_type( periph_type type, int active )
     GSList *found;
     while( ( found = g_slist_find_custom( ports, GINT_TO_POINTER( type ), find_by_type ) ) != NULL )
       ports = g_slist_remove( ports, found->data );
+    decode_stale = 1;
   }
 
   return 1;
@@ -238,6 +257,7 @@ periph_clear( void )
   g_slist_foreach( ports, free_peripheral, NULL );
   g_slist_free( ports );
   ports = NULL;
+  decode_stale = 1;
   set_types_inactive();
 }
 
@@ -249,22 +269,124 @@ periph_end( void )
   g_slist_free( ports );
   ports = NULL;
 
+  libspectrum_free( decode_table ); decode_table = NULL;
+  libspectrum_free( decode_ports ); decode_ports = NULL;
+  libspectrum_free( decode_lists ); decode_lists = NULL;
+  decode_stale = 1;
+
   g_hash_table_destroy( peripherals );
   peripherals = NULL;
 }
 
 /*
- * The actual routines to read and write a port
+ * Building the port decode table
  */
 
-/* Internal type used for passing to read_peripheral and write_peripheral */
-struct peripheral_data_t {
+static guint
+decode_set_hash( gconstpointer key )
+{
+  const libspectrum_dword *set = key;
+  guint hash = 2166136261u;
+  size_t i;
+
+  for( i = 0; i < decode_set_words; i++ ) hash = ( hash ^ set[i] ) * 16777619u;
+
+  return hash;
+}
+
+static gboolean
+decode_set_equal( gconstpointer a, gconstpointer b )
+{
+  return !memcmp( a, b, decode_set_words * sizeof( libspectrum_dword ) );
+}
+
+/* Work out which port responses match each of the 65536 port values and
+   store each distinct set of responses once */
+static void
+decode_build( void )
+{
+  const periph_port_t **responses;
+  libspectrum_dword *set;
+  GHashTable *sets;
+  GSList *ptr;
+  size_t count, i, lists = 0, lists_size = 16, used = 0, ports_size = 64;
+  libspectrum_dword port;
+
+  count = g_slist_length( ports );
+  responses = libspectrum_new( const periph_port_t*, count + 1 );
+  for( ptr = ports, i = 0; ptr; ptr = ptr->next, i++ )
+    responses[i] = &( ( (periph_port_private_t*)ptr->data )->port );
+
+  decode_set_words = count / 32 + 1;
+  set = libspectrum_new( libspectrum_dword, decode_set_words );
+  sets = g_hash_table_new_full( decode_set_hash, decode_set_equal,
+                                libspectrum_free, NULL );
+
+  if( !decode_table ) decode_table = libspectrum_new( libspectrum_word, 0x10000 );
+  libspectrum_free( decode_ports );
+  decode_ports = libspectrum_new( const periph_port_t*, ports_size );
+  libspectrum_free( decode_lists );
+  decode_lists = libspectrum_new( size_t, lists_size );
+
+  for( port = 0; port < 0x10000; port++ ) {
+    libspectrum_dword *key;
+    gpointer id;
+
+    memset( set, 0, decode_set_words * sizeof( libspectrum_dword ) );
+    for( i = 0; i < count; i++ )
+      if( ( port & responses[i]->mask ) == responses[i]->value )
+        set[ i / 32 ] |= 1u << ( i % 32 );
+
+    id = g_hash_table_lookup( sets, set );
+
+    if( !id ) {
+
+      if( lists == lists_size ) {
+        lists_size *= 2;
+        decode_lists = libspectrum_renew( size_t, decode_lists, lists_size );
+      }
+      decode_lists[ lists ] = used;
+
+      for( i = 0; i <= count; i++ ) {
+        if( used == ports_size ) {
+          ports_size *= 2;
+          decode_ports = libspectrum_renew( const periph_port_t*, decode_ports,
+                                            ports_size );
+        }
+        if( i == count ) {
+          decode_ports[ used++ ] = NULL;
+        } else if( set[ i / 32 ] & ( 1u << ( i % 32 ) ) ) {
+          decode_ports[ used++ ] = responses[i];
+        }
+      }
+
+      key = libspectrum_new( libspectrum_dword, decode_set_words );
+      memcpy( key, set, decode_set_words * sizeof( libspectrum_dword ) );
+      id = GINT_TO_POINTER( ++lists );
+      g_hash_table_insert( sets, key, id );
+    }
+
+    decode_table[ port ] = GPOINTER_TO_INT( id ) - 1;
+  }
+
+  g_hash_table_destroy( sets );
+  libspectrum_free( set );
+  libspectrum_free( responses );
+
+  decode_stale = 0;
+}
 
-  libspectrum_word port;
+/* The port responses matching a port value, NULL-terminated */
+static inline const periph_port_t**
+decode_port( libspectrum_word port )
+{
+  if( decode_stale ) decode_build();
+  return &decode_ports[ decode_lists[ decode_table[ port ] ] ];
+}
 
-  libspectrum_byte attached;
-  libspectrum_byte value;
-};
+/*
+ * The actual routines to read and write a port
+ */
 
 /* Read a byte from a port, taking the appropriate time */
 libspectrum_byte
@@ -288,30 +410,12 @@ readport( libspectrum_word port )
   return b;
 }
 
-/* Read a byte from a specific port response */
-static void
-read_peripheral( gpointer data, gpointer user_data )
-{
-  periph_port_private_t *private = data;
-  struct peripheral_data_t *callback_info = user_data;
-  libspectrum_byte last_attached;
-
-  periph_port_t *port = &( private->port );
-
-  if( port->read &&
-      ( ( callback_info->port & port->mask ) == port->value ) ) {
-    last_attached = callback_info->attached;
-    callback_info->value &= (   port->read( callback_info->port,
-					    &( callback_info->attached ) )
-			      | last_attached );
-  }
-}
-
 /* Read a byte from a port, taking no time */
 libspectrum_byte
 readport_internal( libspectrum_word port )
 {
-  struct peripheral_data_t callback_info;
+  const periph_port_t **response;
+  libspectrum_byte attached, last_attached, value;
 
   /* Trigger the debugger if wanted */
   if( debugger_mode != DEBUGGER_MODE_INACTIVE )
@@ -337,21 +441,24 @@ readport_internal( libspectrum_word port )
   }
 
   /* If we're not doing RZX playback, get the byte normally */
-  callback_info.port = port;
-  callback_info.attached = 0x00;
-  callback_info.value = 0xff;
+  attached = 0x00;
+  value = 0xff;
 
-  g_slist_foreach( ports, read_peripheral, &callback_info );
+  for( response = decode_port( port ); *response; response++ ) {
+    if( (*response)->read ) {
+      last_attached = attached;
+      value &= ( (*response)->read( port, &attached ) | last_attached );
+    }
+  }
 
-  if( callback_info.attached != 0xff )
-    callback_info.value =
-      periph_merge_floating_bus( callback_info.value, callback_info.attached,
-                                 machine_current->unattached_port() );
+  if( attached != 0xff )
+    value = periph_merge_floating_bus( value, attached,
+                                       machine_current->unattached_port() );
 
   /* If we're RZX recording, store this byte */
-  if( rzx_recording ) rzx_store_byte( callback_info.value );
+  if( rzx_recording ) rzx_store_byte( value );
 
-  return callback_info.value;
+  return value;
 }
 
 /* Merge the read value with the floating bus. Deliberately doesn't take
@@ -372,34 +479,18 @@ writeport( libspectrum_word port, libspectrum_byte b )
   ula_contend_port_late( port ); tstates++;
 }
 
-/* Write a byte to a specific port response */
-static void
-write_peripheral( gpointer data, gpointer user_data )
-{
-  periph_port_private_t *private = data;
-  struct peripheral_data_t *callback_info = user_data;
-
-  periph_port_t *port = &( private->port );
-  
-  if( port->write &&
-      ( ( callback_info->port & port->mask ) == port->value ) )
-    port->write( callback_info->port, callback_info->value );
-}
-
 /* Write a byte to a port, taking no time */
 void
 writeport_internal( libspectrum_word port, libspectrum_byte b )
 {
-  struct peripheral_data_t callback_info;
+  const periph_port_t **response;
 
   /* Trigger the debugger if wanted */
   if( debugger_mode != DEBUGGER_MODE_INACTIVE )
     debugger_check( DEBUGGER_BREAKPOINT_TYPE_PORT_WRITE, port );
 
-  callback_info.port = port;
-  callback_info.value = b;
-  
-  g_slist_foreach( ports, write_peripheral, &callback_info );
+  for( response = decode_port( port ); *response; response++ )
+    if( (*response)->write ) (*response)->write( port, b );
 }
 
 /*
@@ -487,6 +578,9 @@ periph_update( void )
 
   g_hash_table_foreach( peripherals, set_activity, &needs_hard_reset );
 
+  /* Compile the new set of ports now rather than on the first access */
+  if( decode_stale ) decode_build();
+
   update_peripherals_status();
   machine_current->memory_map();
 
@@ -0,0 +1,509 @@
+#include "config.h"
+#include "compat.h"
+#include "xfs.h"
+#include "xfs_cache.h"
+#include "xfs_worker.h"
+
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+#ifdef WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+#include "libspectrum.h"
+#include "debugger/debugger.h"
+#include "settings.h"
+
+// Macro for XFS debug output (only prints if enabled)
+#define XFS_DEBUG(...) do { if (xfs_debug_is_enabled()) printf(__VA_ARGS__); } while(0)
+
+#define XFS_CACHE_PATH_MAX (1024)
+
+struct xfs_cache_writer_t
+{
+    FILE* file;
+    char url[XFS_CACHE_PATH_MAX];
+    struct xfs_cache_entry_t entry;
+    size_t chunk_size;
+    uint32_t chunks;
+    uint32_t chunks_written;
+    uint8_t* written;                    // One bit per chunk
+};
+
+static uint32_t cache_hits;
+static uint32_t cache_misses;
+static uint32_t cache_revalidated;
+static uint32_t cache_stale;
+static uint32_t cache_bytes_read;
+static uint32_t cache_bytes_stored;
+static uint32_t cache_evictions;
+
+// 64-bit FNV-1a; the cache is content-addressed by URL
+static uint64_t cache_hash(const char* url)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    while (*url)
+    {
+        hash ^= (uint8_t)*url++;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+// Compose a path, failing rather than truncating it: a truncated path could
+// name some other file, which we would then open or remove
+static int cache_path(char* buffer, size_t size, const char* format, ...)
+{
+    va_list ap;
+    int length;
+
+    va_start(ap, format);
+    length = vsnprintf(buffer, size, format, ap);
+    va_end(ap);
+
+    if (length < 0 || (size_t)length >= size)
+    {
+        XFS_DEBUG("xfs_cache: path too long, not using the cache\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int cache_dir_path(char* buffer, size_t size)
+{
+    return cache_path(buffer, size, "%s/%s", xfs_base_path, XFS_CACHE_DIR_NAME);
+}
+
+static int cache_file_path(const char* url, const char* extension, char* buffer, size_t size)
+{
+    return cache_path(buffer, size, "%s/%s/%016llx.%s", xfs_base_path, XFS_CACHE_DIR_NAME,
+                      (unsigned long long)cache_hash(url), extension);
+}
+
+static int cache_ensure_dir(void)
+{
+    char path[XFS_CACHE_PATH_MAX];
+
+    if (xfs_base_path[0] == '\0' || cache_dir_path(path, sizeof(path)) != 0)
+        return -1;
+
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+    {
+        XFS_DEBUG("xfs_cache: failed to create '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+// rename() won't replace an existing file on Windows
+static int cache_replace(const char* from, const char* to)
+{
+#ifdef WIN32
+    remove(to);
+#endif
+    return rename(from, to);
+}
+
+static void cache_remove_entry(const char* url)
+{
+    char path[XFS_CACHE_PATH_MAX];
+
+    if (cache_file_path(url, "dat", path, sizeof(path)) == 0)
+        remove(path);
+    if (cache_file_path(url, "meta", path, sizeof(path)) == 0)
+        remove(path);
+}
+
+static size_t cache_budget(void)
+{
+    return (size_t)settings_current.xfs_cache_size * 1024 * 1024;
+}
+
+// Drop least recently used entries (by data file mtime, which is refreshed
+// on every hit) until the cache fits in its budget
+static void cache_evict(size_t incoming)
+{
+    char dir_path[XFS_CACHE_PATH_MAX];
+    char path[XFS_CACHE_PATH_MAX];
+    const size_t budget = cache_budget();
+
+    if (cache_dir_path(dir_path, sizeof(dir_path)) != 0)
+        return;
+
+    while (true)
+    {
+        DIR* dir = opendir(dir_path);
+        if (!dir)
+            return;
+
+        size_t total = incoming;
+        time_t oldest_time = 0;
+        char oldest[256] = "";
+        struct dirent* entry;
+
+        while ((entry = readdir(dir)) != NULL)
+        {
+            const size_t len = strlen(entry->d_name);
+            struct stat st;
+
+            if (len < 5 || strcmp(entry->d_name + len - 4, ".dat") != 0)
+                continue;
+
+            if (cache_path(path, sizeof(path), "%s/%s", dir_path, entry->d_name) != 0 ||
+                stat(path, &st) != 0)
+            {
+                continue;
+            }
+
+            total += st.st_size;
+            if (oldest[0] == '\0' || st.st_mtime < oldest_time)
+            {
+                oldest_time = st.st_mtime;
+                snprintf(oldest, sizeof(oldest), "%.*s", (int)(len - 4), entry->d_name);
+            }
+        }
+        closedir(dir);
+
+        if (total <= budget || oldest[0] == '\0')
+            return;
+
+        XFS_DEBUG("xfs_cache: evicting %s (total=%zu budget=%zu)\n", oldest, total, budget);
+
+        // Stop rather than loop forever if the oldest entry can't be removed
+        if (cache_path(path, sizeof(path), "%s/%s.dat", dir_path, oldest) != 0 ||
+            remove(path) != 0)
+        {
+            return;
+        }
+        if (cache_path(path, sizeof(path), "%s/%s.meta", dir_path, oldest) == 0)
+            remove(path);
+        cache_evictions++;
+    }
+}
+
+static int cache_write_meta(const char* url, const struct xfs_cache_entry_t* entry)
+{
+    char path[XFS_CACHE_PATH_MAX];
+    char tmp_path[XFS_CACHE_PATH_MAX];
+
+    if (cache_file_path(url, "meta", path, sizeof(path)) != 0 ||
+        cache_path(tmp_path, sizeof(tmp_path), "%s.tmp", path) != 0)
+    {
+        return -1;
+    }
+
+    FILE* f = fopen(tmp_path, "w");
+    if (!f)
+        return -1;
+
+    fprintf(f, "url=%s\netag=%s\nlast_modified=%s\nsize=%lu\n", url, entry->etag,
+            entry->last_modified, (unsigned long)entry->size);
+
+    if (fclose(f) != 0 || cache_replace(tmp_path, path) != 0)
+    {
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void cache_copy_value(char* dest, const char* value)
+{
+    size_t len = strcspn(value, "\r\n");
+    if (len >= XFS_CACHE_VALIDATOR_MAX)
+        len = XFS_CACHE_VALIDATOR_MAX - 1;
+    memcpy(dest, value, len);
+    dest[len] = '\0';
+}
+
+bool xfs_cache_offline(void)
+{
+    return settings_current.xfs_offline;
+}
+
+bool xfs_cache_lookup(const char* url, struct xfs_cache_entry_t* entry)
+{
+    char path[XFS_CACHE_PATH_MAX];
+    char line[XFS_CACHE_PATH_MAX + 16];
+    bool url_matches = false;
+    struct stat st;
+
+    if (xfs_base_path[0] == '\0' || cache_budget() == 0 || strlen(url) >= XFS_CACHE_PATH_MAX)
+        return false;
+
+    if (cache_file_path(url, "meta", path, sizeof(path)) != 0)
+        return false;
+
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    memset(entry, 0, sizeof(*entry));
+
+    while (fgets(line, sizeof(line), f))
+    {
+        if (strncmp(line, "url=", 4) == 0)
+            url_matches = strncmp(line + 4, url, strlen(url)) == 0 && line[4 + strlen(url)] == '\n';
+        else if (strncmp(line, "etag=", 5) == 0)
+            cache_copy_value(entry->etag, line + 5);
+        else if (strncmp(line, "last_modified=", 14) == 0)
+            cache_copy_value(entry->last_modified, line + 14);
+        else if (strncmp(line, "size=", 5) == 0)
+            entry->size = (uint32_t)strtoul(line + 5, NULL, 10);
+    }
+    fclose(f);
+
+    // Guard against hash collisions and data lost behind our back
+    if (!url_matches || cache_file_path(url, "dat", path, sizeof(path)) != 0 ||
+        stat(path, &st) != 0 || (uint32_t)st.st_size != entry->size)
+        return false;
+
+    return true;
+}
+
+FILE* xfs_cache_open(const char* url)
+{
+    char path[XFS_CACHE_PATH_MAX];
+
+    if (cache_file_path(url, "dat", path, sizeof(path)) != 0)
+        return NULL;
+
+    FILE* f = fopen(path, "rb");
+    if (f)
+    {
+        // Refresh mtime; it's the LRU key for eviction
+        utime(path, NULL);
+    }
+
+    return f;
+}
+
+int xfs_cache_read_all(const char* url, void** data, size_t* size)
+{
+    struct xfs_cache_entry_t entry;
+
+    if (!xfs_cache_lookup(url, &entry))
+        return -1;
+
+    FILE* f = xfs_cache_open(url);
+    if (!f)
+        return -1;
+
+    void* buffer = libspectrum_malloc(entry.size ? entry.size : 1);
+    if (fread(buffer, 1, entry.size, f) != entry.size)
+    {
+        libspectrum_free(buffer);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    *data = buffer;
+    *size = entry.size;
+    return 0;
+}
+
+int xfs_cache_store(const char* url, const struct xfs_cache_entry_t* entry, const void* data, size_t size)
+{
+    char path[XFS_CACHE_PATH_MAX];
+    char tmp_path[XFS_CACHE_PATH_MAX];
+    struct xfs_cache_entry_t stored = *entry;
+
+    if (size > cache_budget() || cache_ensure_dir() != 0)
+        return -1;
+
+    if (cache_file_path(url, "dat", path, sizeof(path)) != 0 ||
+        cache_path(tmp_path, sizeof(tmp_path), "%s.tmp", path) != 0)
+    {
+        return -1;
+    }
+
+    cache_evict(size);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return -1;
+
+    if ((size && fwrite(data, 1, size, f) != size) || fclose(f) != 0)
+    {
+        remove(tmp_path);
+        return -1;
+    }
+
+    // Drop the old metadata first so a crash can't pair it with new data
+    cache_remove_entry(url);
+    stored.size = (uint32_t)size;
+    if (cache_replace(tmp_path, path) != 0 || cache_write_meta(url, &stored) != 0)
+    {
+        remove(tmp_path);
+        cache_remove_entry(url);
+        return -1;
+    }
+
+    cache_bytes_stored += size;
+    XFS_DEBUG("xfs_cache: stored %zu bytes for '%s'\n", size, url);
+    return 0;
+}
+
+void xfs_cache_invalidate(const char* url)
+{
+    if (xfs_base_path[0] == '\0')
+        return;
+
+    cache_remove_entry(url);
+}
+
+struct xfs_cache_writer_t* xfs_cache_writer_begin(const char* url, const struct xfs_cache_entry_t* entry,
+    size_t chunk_size)
+{
+    char path[XFS_CACHE_PATH_MAX];
+
+    if (!chunk_size || entry->size == 0 || entry->size > cache_budget() ||
+        strlen(url) >= XFS_CACHE_PATH_MAX || cache_ensure_dir() != 0)
+    {
+        return NULL;
+    }
+
+    if (cache_file_path(url, "part", path, sizeof(path)) != 0)
+        return NULL;
+
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return NULL;
+
+    struct xfs_cache_writer_t* writer = libspectrum_new0(struct xfs_cache_writer_t, 1);
+    writer->file = f;
+    strcpy(writer->url, url);
+    writer->entry = *entry;
+    writer->chunk_size = chunk_size;
+    writer->chunks = (entry->size + chunk_size - 1) / chunk_size;
+    writer->written = libspectrum_new0(uint8_t, (writer->chunks + 7) / 8);
+
+    return writer;
+}
+
+void xfs_cache_writer_write(struct xfs_cache_writer_t* writer, uint32_t chunk, const void* data, size_t length)
+{
+    if (!writer || !writer->file || chunk >= writer->chunks)
+        return;
+
+    if (writer->written[chunk / 8] & (1 << (chunk % 8)))
+        return;
+
+    if (fseek(writer->file, (long)chunk * writer->chunk_size, SEEK_SET) != 0 ||
+        fwrite(data, 1, length, writer->file) != length)
+    {
+        // Give up on this entry; xfs_cache_writer_end() will discard it
+        fclose(writer->file);
+        writer->file = NULL;
+        return;
+    }
+
+    writer->written[chunk / 8] |= 1 << (chunk % 8);
+    writer->chunks_written++;
+}
+
+bool xfs_cache_writer_complete(const struct xfs_cache_writer_t* writer)
+{
+    return writer && writer->file && writer->chunks_written == writer->chunks;
+}
+
+void xfs_cache_writer_end(struct xfs_cache_writer_t* writer)
+{
+    char part_path[XFS_CACHE_PATH_MAX];
+    char path[XFS_CACHE_PATH_MAX];
+
+    if (!writer)
+        return;
+
+    const bool complete = xfs_cache_writer_complete(writer);
+
+    if (writer->file && fclose(writer->file) != 0)
+    {
+        writer->file = NULL;
+    }
+
+    // xfs_cache_writer_begin() has already composed this path successfully
+    cache_file_path(writer->url, "part", part_path, sizeof(part_path));
+
+    if (complete)
+    {
+        cache_evict(writer->entry.size);
+        cache_remove_entry(writer->url);
+        if (cache_file_path(writer->url, "dat", path, sizeof(path)) == 0 &&
+            cache_replace(part_path, path) == 0 && cache_write_meta(writer->url, &writer->entry) == 0)
+        {
+            cache_bytes_stored += writer->entry.size;
+            XFS_DEBUG("xfs_cache: stored %lu bytes for '%s' (ranged)\n",
+                      (unsigned long)writer->entry.size, writer->url);
+        }
+        else
+        {
+            cache_remove_entry(writer->url);
+        }
+    }
+
+    remove(part_path);
+    libspectrum_free(writer->written);
+    libspectrum_free(writer);
+}
+
+void xfs_cache_count_hit(size_t bytes)
+{
+    cache_hits++;
+    cache_bytes_read += bytes;
+}
+
+void xfs_cache_count_miss(void)
+{
+    cache_misses++;
+}
+
+void xfs_cache_count_revalidated(void)
+{
+    cache_revalidated++;
+}
+
+void xfs_cache_count_stale(void)
+{
+    cache_stale++;
+}
+
+static libspectrum_dword get_hits(void) { return cache_hits; }
+static libspectrum_dword get_misses(void) { return cache_misses; }
+static libspectrum_dword get_revalidated(void) { return cache_revalidated; }
+static libspectrum_dword get_stale(void) { return cache_stale; }
+static libspectrum_dword get_bytes_read(void) { return cache_bytes_read; }
+static libspectrum_dword get_bytes_stored(void) { return cache_bytes_stored; }
+static libspectrum_dword get_evictions(void) { return cache_evictions; }
+
+static void reset_stats(libspectrum_dword value GCC_UNUSED)
+{
+    cache_hits = cache_misses = cache_revalidated = cache_stale = 0;
+    cache_bytes_read = cache_bytes_stored = cache_evictions = 0;
+}
+
+void xfs_cache_init(void)
+{
+    debugger_system_variable_register("xfscache", "hits", get_hits, reset_stats);
+    debugger_system_variable_register("xfscache", "misses", get_misses, reset_stats);
+    debugger_system_variable_register("xfscache", "revalidated", get_revalidated, reset_stats);
+    debugger_system_variable_register("xfscache", "stale", get_stale, reset_stats);
+    debugger_system_variable_register("xfscache", "bytesread", get_bytes_read, reset_stats);
+    debugger_system_variable_register("xfscache", "bytesstored", get_bytes_stored, reset_stats);
+    debugger_system_variable_register("xfscache", "evictions", get_evictions, reset_stats);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Persistent on-disk cache of remote (HTTPS) XFS content, kept under
+// xfs_base_path. Entries are keyed by a hash of the URL and carry the
+// ETag/Last-Modified validators needed to revalidate them.
+
+// Name of the cache directory inside xfs_base_path (hidden from the RAM engine)
+#define XFS_CACHE_DIR_NAME ".https-cache"
+
+#define XFS_CACHE_VALIDATOR_MAX (128)
+
+struct xfs_cache_entry_t
+{
+    char etag[XFS_CACHE_VALIDATOR_MAX];
+    char last_modified[XFS_CACHE_VALIDATOR_MAX];
+    uint32_t size;
+};
+
+// Incremental writer for content fetched in pieces (ranged GETs); the
+// entry only becomes visible once every chunk has been written
+struct xfs_cache_writer_t;
+
+void xfs_cache_init(void);
+
+// Offline mode: serve from the cache without touching the network
+bool xfs_cache_offline(void);
+
+// Returns true and fills in entry if url is cached
+bool xfs_cache_lookup(const char* url, struct xfs_cache_entry_t* entry);
+
+// Open the cached content of url for reading, marking it recently used.
+// Returns NULL if not cached.
+FILE* xfs_cache_open(const char* url);
+
+// Read the whole cached content of url into a new buffer
+int xfs_cache_read_all(const char* url, void** data, size_t* size);
+
+// Store complete content for url, replacing anything already cached
+int xfs_cache_store(const char* url, const struct xfs_cache_entry_t* entry, const void* data, size_t size);
+
+void xfs_cache_invalidate(const char* url);
+
+struct xfs_cache_writer_t* xfs_cache_writer_begin(const char* url, const struct xfs_cache_entry_t* entry,
+    size_t chunk_size);
+void xfs_cache_writer_write(struct xfs_cache_writer_t* writer, uint32_t chunk, const void* data, size_t length);
+bool xfs_cache_writer_complete(const struct xfs_cache_writer_t* writer);
+// Commits the entry if complete, otherwise discards it; frees writer either way
+void xfs_cache_writer_end(struct xfs_cache_writer_t* writer);
+
+// Statistics, also available as xfscache:* debugger system variables
+void xfs_cache_count_hit(size_t bytes);
+void xfs_cache_count_miss(void);
+void xfs_cache_count_revalidated(void);
+void xfs_cache_count_stale(void);
@@ -1,6 +1,7 @@
 #include "config.h"
 #include "compat.h"  /* Include before system headers to get compat/getopt.h */
 #include "xfs.h"
+#include "xfs_cache.h"
 #include "xfs_worker.h"
 #include <string.h>
 #include <stdlib.h>
@@ -386,8 +387,9 @@ static int16_t fs_readdir(const struct xfs_engine_mount_t* engine, struct xfs_ha
             }
             break; // End of directory or error
         }
-        // Skip "." and ".." entries
-    } while (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0);
+        // Skip "." and ".." entries, and the HTTPS engine's cache
+    } while (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+             strcmp(entry->d_name, XFS_CACHE_DIR_NAME) == 0);
     
     if (err != 0)
     {
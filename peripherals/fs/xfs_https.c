@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include "xfs.h"
+#include "xfs_cache.h"
 #include "xfs_worker.h"
 
 #include <string.h>
@@ -13,17 +14,46 @@
 #include <dirent.h>
 
 #include "libspectrum.h"
+#include "settings.h"
+#include "timer/timer.h"
+#include "utils.h"
 #include "../http/httpc.h"
 #include "../http/http_sck.h"
 
 // Macro for XFS debug output (only prints if enabled)
 #define XFS_DEBUG(...) do { if (xfs_debug_is_enabled()) printf(__VA_ARGS__); } while(0)
 
+// Ranged fetches are made in blocks of this size...
+#define HTTPS_RANGE_BLOCK_SIZE (16 * 1024)
+// ...this many blocks at a time, starting with the one being read
+#define HTTPS_RANGE_READAHEAD 4
+// Blocks kept per open file, least recently used is replaced first
+#define HTTPS_RANGE_CACHE_BLOCKS 8
+
+struct https_range_block_t
+{
+    uint8_t* data;                       // HTTPS_RANGE_BLOCK_SIZE bytes, or NULL if unused
+    uint32_t index;                      // Block number within the file
+    uint32_t length;                     // Valid bytes (short for the last block)
+    uint32_t stamp;                      // Last use, for LRU replacement
+};
+
 struct xfs_handle_https_file_t
 {
-    void* data;                          // Pointer to file data buffer
-    size_t size;                         // Size of file data buffer
-    size_t pos;                          // Current read position in buffer
+    void* data;                          // Pointer to file data buffer (full download only)
+    size_t size;                         // Size of file
+    size_t pos;                          // Current read position in file
+
+    // Served from the on-disk cache rather than memory
+    FILE* cache_file;
+
+    // Ranged mode: data is fetched on demand rather than downloaded on open
+    uint8_t ranged;
+    char* url;
+    uint32_t stamp;
+    struct https_range_block_t blocks[HTTPS_RANGE_CACHE_BLOCKS];
+    // Fetched blocks are also written here; committed to the cache once complete
+    struct xfs_cache_writer_t* cache_writer;
 };
 
 struct xfs_handle_https_dir_t
@@ -46,24 +76,35 @@ static struct xfs_handle_https_dir_t* get_https_dir_handle(const struct xfs_hand
 
 // Maximum hostname length
 #define HTTPS_MAX_HOSTNAME 256
-// Maximum cached directories
-#define HTTPS_DIR_CACHE_SIZE 4
 // Maximum path length for cache
 #define HTTPS_CACHE_PATH_MAX 256
+// Hash buckets for the directory listing cache
+#define HTTPS_DIR_CACHE_BUCKETS 64
 
+// A cached directory listing. Listings are found through a hash table
+// keyed on the normalized path and kept on an intrusive LRU list, most
+// recently used first.
 struct https_dir_cache_entry_t
 {
     char path[HTTPS_CACHE_PATH_MAX];
+    uint32_t hash;
     struct xfs_handle_https_dir_entry_t** dir_entries;
     uint8_t dir_entries_count;
-    uint8_t in_use;  // Non-zero if this cache slot is in use
+    double expires;                      // timer_get_time() after which we refetch
+    size_t bytes;                        // Memory used, counted against the budget
+    struct https_dir_cache_entry_t* hash_next;
+    struct https_dir_cache_entry_t* lru_prev;
+    struct https_dir_cache_entry_t* lru_next;
 };
 
 struct https_engine_mount_data_t
 {
     char url[HTTPS_MAX_HOSTNAME];
-    struct https_dir_cache_entry_t https_dir_cache[HTTPS_DIR_CACHE_SIZE];
-    uint8_t next_cache;
+    struct https_dir_cache_entry_t* dir_cache[HTTPS_DIR_CACHE_BUCKETS];
+    struct https_dir_cache_entry_t* lru_head;
+    struct https_dir_cache_entry_t* lru_tail;
+    unsigned dir_cache_count;
+    size_t dir_cache_bytes;
 };
 
 static inline struct https_engine_mount_data_t* get_mount_data(const struct xfs_engine_mount_t* engine_mount)
@@ -130,51 +171,70 @@ static int build_https_url(const char* base_url, const char* path, char* url_buf
     return 0;
 }
 
-// Normalize directory path for cache lookup (same logic used in stat)
+// Normalize directory path for cache lookup: always a leading '/', no
+// trailing '/' (except for the root itself), no leading "./"
 static void https_normalize_dir_path(const char* path, char normalized[HTTPS_CACHE_PATH_MAX])
 {
-    if (!path || strcmp(path, ".") == 0 || strcmp(path, "./") == 0)
+    if (!path)
     {
-        strncpy(normalized, "/", HTTPS_CACHE_PATH_MAX);
-        return;
+        path = "";
     }
 
-    strncpy(normalized, path, HTTPS_CACHE_PATH_MAX);
+    while (path[0] == '.' && (path[1] == '/' || path[1] == '\0'))
+    {
+        path += path[1] ? 2 : 1;
+    }
+    while (path[0] == '/')
+    {
+        path++;
+    }
 
-    const uint16_t path_len = strlen(path);
-    if (path_len > 1 && normalized[path_len - 1] == '/')
+    snprintf(normalized, HTTPS_CACHE_PATH_MAX, "/%s", path);
+
+    size_t path_len = strlen(normalized);
+    while (path_len > 1 && normalized[path_len - 1] == '/')
     {
-        normalized[path_len - 1] = '\0';
+        normalized[--path_len] = '\0';
     }
 }
 
-static struct xfs_handle_https_dir_entry_t* https_cache_find_entry(
-    const struct xfs_engine_mount_t* engine, const char* dir_path, const char* entry_name)
+static uint32_t https_cache_hash(const char* path)
 {
-    char normalized_path[HTTPS_CACHE_PATH_MAX];
-    https_normalize_dir_path(dir_path, normalized_path);
+    uint32_t hash = 2166136261u;
 
-    const struct https_engine_mount_data_t* mount_data = get_mount_data(engine);
-    
-    // Find cache entry for this directory
-    for (int i = 0; i < HTTPS_DIR_CACHE_SIZE; i++)
+    while (*path)
     {
-        if (mount_data->https_dir_cache[i].in_use && strcmp(mount_data->https_dir_cache[i].path, normalized_path) == 0)
-        {
-            // Search entries in this cached directory
-            for (uint8_t j = 0; j < mount_data->https_dir_cache[i].dir_entries_count; j++)
-            {
-                if (mount_data->https_dir_cache[i].dir_entries[j] &&
-                    strcmp(mount_data->https_dir_cache[i].dir_entries[j]->name, entry_name) == 0)
-                {
-                    return mount_data->https_dir_cache[i].dir_entries[j];
-                }
-            }
-            break;
-        }
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
     }
-    
-    return NULL;
+
+    return hash;
+}
+
+static void https_cache_lru_unlink(struct https_engine_mount_data_t* mount_data, struct https_dir_cache_entry_t* cache_entry)
+{
+    if (cache_entry->lru_prev)
+        cache_entry->lru_prev->lru_next = cache_entry->lru_next;
+    else
+        mount_data->lru_head = cache_entry->lru_next;
+
+    if (cache_entry->lru_next)
+        cache_entry->lru_next->lru_prev = cache_entry->lru_prev;
+    else
+        mount_data->lru_tail = cache_entry->lru_prev;
+
+    cache_entry->lru_prev = cache_entry->lru_next = NULL;
+}
+
+static void https_cache_lru_push_front(struct https_engine_mount_data_t* mount_data, struct https_dir_cache_entry_t* cache_entry)
+{
+    cache_entry->lru_prev = NULL;
+    cache_entry->lru_next = mount_data->lru_head;
+    if (mount_data->lru_head)
+        mount_data->lru_head->lru_prev = cache_entry;
+    mount_data->lru_head = cache_entry;
+    if (!mount_data->lru_tail)
+        mount_data->lru_tail = cache_entry;
 }
 
 // Free directory entries from a cache entry
@@ -197,151 +257,222 @@ static void https_cache_free_entries(struct https_dir_cache_entry_t* cache_entry
     cache_entry->dir_entries_count = 0;
 }
 
-static struct xfs_handle_https_dir_entry_t* https_cache_copy_entry(const struct xfs_handle_https_dir_entry_t* src)
+// Remove a listing from the hash table and LRU list and free it
+static void https_cache_remove(struct https_engine_mount_data_t* mount_data, struct https_dir_cache_entry_t* cache_entry)
 {
-    if (!src)
+    struct https_dir_cache_entry_t** link = &mount_data->dir_cache[cache_entry->hash % HTTPS_DIR_CACHE_BUCKETS];
+
+    while (*link && *link != cache_entry)
     {
-        return NULL;
+        link = &(*link)->hash_next;
     }
-
-    struct xfs_handle_https_dir_entry_t* dst = libspectrum_malloc(sizeof(struct xfs_handle_https_dir_entry_t));
-
-    if (!dst)
+    if (*link)
     {
-        return NULL;
+        *link = cache_entry->hash_next;
     }
 
-    memcpy(dst, src, sizeof(struct xfs_handle_https_dir_entry_t));
-    return dst;
+    https_cache_lru_unlink(mount_data, cache_entry);
+    mount_data->dir_cache_count--;
+    mount_data->dir_cache_bytes -= cache_entry->bytes;
+
+    https_cache_free_entries(cache_entry);
+    libspectrum_free(cache_entry);
 }
 
-// Put directory entries into cache
-static void https_cache_put_entries(const struct xfs_engine_mount_t* engine, const char* dir_path,
-    struct xfs_handle_https_dir_entry_t** entries, uint8_t count)
+static void https_cache_clear(struct https_engine_mount_data_t* mount_data)
 {
-    if (!entries || count == 0)
+    while (mount_data->lru_head)
     {
-        return;
+        https_cache_remove(mount_data, mount_data->lru_head);
     }
+}
 
+// Find the cached listing for an already normalized path, dropping it if
+// it has expired. A hit makes the listing the most recently used.
+static struct https_dir_cache_entry_t* https_cache_lookup(const struct xfs_engine_mount_t* engine, const char* normalized_path)
+{
     struct https_engine_mount_data_t* mount_data = get_mount_data(engine);
+    const uint32_t hash = https_cache_hash(normalized_path);
+    struct https_dir_cache_entry_t* cache_entry = mount_data->dir_cache[hash % HTTPS_DIR_CACHE_BUCKETS];
 
-    int cache_idx = -1;
+    while (cache_entry && (cache_entry->hash != hash || strcmp(cache_entry->path, normalized_path) != 0))
+    {
+        cache_entry = cache_entry->hash_next;
+    }
 
+    if (!cache_entry)
     {
-      for (int i = 0; i < HTTPS_DIR_CACHE_SIZE; i++)
-      {
-          if (!mount_data->https_dir_cache[i].in_use)
-          {
-              cache_idx = i;
-              break;
-          }
-      }
+        return NULL;
     }
 
-    // If cache is full, use next_cache slot and cycle to next
-    if (cache_idx == -1)
+    if (timer_get_time() >= cache_entry->expires)
     {
-        cache_idx = mount_data->next_cache;
-        mount_data->next_cache = (mount_data->next_cache + 1) % HTTPS_DIR_CACHE_SIZE;
+        XFS_DEBUG("https: cache listing for '%s' expired\n", normalized_path);
+        https_cache_remove(mount_data, cache_entry);
+        return NULL;
     }
 
-    // If cache slot was in use, free old entries
-    if (mount_data->https_dir_cache[cache_idx].in_use)
+    https_cache_lru_unlink(mount_data, cache_entry);
+    https_cache_lru_push_front(mount_data, cache_entry);
+    return cache_entry;
+}
+
+static struct xfs_handle_https_dir_entry_t* https_cache_entry_named(
+    const struct https_dir_cache_entry_t* cache_entry, const char* entry_name)
+{
+    for (uint8_t j = 0; j < cache_entry->dir_entries_count; j++)
     {
-        if (mount_data->https_dir_cache[cache_idx].dir_entries)
+        if (cache_entry->dir_entries[j] && strcmp(cache_entry->dir_entries[j]->name, entry_name) == 0)
         {
-            https_cache_free_entries(&mount_data->https_dir_cache[cache_idx]);
+            return cache_entry->dir_entries[j];
         }
     }
 
-    // Copy path
-    size_t path_len = strlen(dir_path);
-    if (path_len >= HTTPS_CACHE_PATH_MAX)
+    return NULL;
+}
+
+static struct xfs_handle_https_dir_entry_t* https_cache_find_entry(
+    const struct xfs_engine_mount_t* engine, const char* dir_path, const char* entry_name)
+{
+    char normalized_path[HTTPS_CACHE_PATH_MAX];
+    https_normalize_dir_path(dir_path, normalized_path);
+
+    const struct https_dir_cache_entry_t* cache_entry = https_cache_lookup(engine, normalized_path);
+    return cache_entry ? https_cache_entry_named(cache_entry, entry_name) : NULL;
+}
+
+// Returns true if cached listings prove that directory dir_path can't
+// exist: the nearest cached ancestor listing lacks the next component of
+// the path, or has it as a file
+static bool https_cache_dir_known_missing(const struct xfs_engine_mount_t* engine, const char* dir_path)
+{
+    char normalized_path[HTTPS_CACHE_PATH_MAX];
+    https_normalize_dir_path(dir_path, normalized_path);
+
+    char* slash;
+    while ((slash = strrchr(normalized_path, '/')) != NULL && slash[1] != '\0')
     {
-        path_len = HTTPS_CACHE_PATH_MAX - 1;
+        char component[HTTPS_CACHE_PATH_MAX];
+        snprintf(component, sizeof(component), "%s", slash + 1);
+
+        // Truncate to the parent, keeping the root's '/'
+        slash[slash == normalized_path ? 1 : 0] = '\0';
+
+        const struct https_dir_cache_entry_t* parent = https_cache_lookup(engine, normalized_path);
+        if (parent)
+        {
+            const struct xfs_handle_https_dir_entry_t* entry = https_cache_entry_named(parent, component);
+            return !entry || !entry->is_dir;
+        }
     }
-    memcpy(mount_data->https_dir_cache[cache_idx].path, dir_path, path_len);
-    mount_data->https_dir_cache[cache_idx].path[path_len] = '\0';
 
-    // Allocate array of pointers
-    mount_data->https_dir_cache[cache_idx].dir_entries = (struct xfs_handle_https_dir_entry_t**)libspectrum_malloc(
-        count * sizeof(struct xfs_handle_https_dir_entry_t*));
+    return false;
+}
 
-    if (!mount_data->https_dir_cache[cache_idx].dir_entries)
+static struct xfs_handle_https_dir_entry_t* https_cache_copy_entry(const struct xfs_handle_https_dir_entry_t* src)
+{
+    if (!src)
     {
-        mount_data->https_dir_cache[cache_idx].in_use = 0;
+        return NULL;
+    }
+
+    struct xfs_handle_https_dir_entry_t* dst = libspectrum_malloc(sizeof(struct xfs_handle_https_dir_entry_t));
+
+    if (!dst)
+    {
+        return NULL;
+    }
+
+    memcpy(dst, src, sizeof(struct xfs_handle_https_dir_entry_t));
+    return dst;
+}
+
+// Insert a listing (taking ownership of entries), replacing any existing
+// listing for the same path and evicting least recently used listings to
+// stay within the configured capacity and memory budget
+static void https_cache_insert(const struct xfs_engine_mount_t* engine, const char* dir_path,
+    struct xfs_handle_https_dir_entry_t** entries, const uint8_t count)
+{
+    struct https_engine_mount_data_t* mount_data = get_mount_data(engine);
+    const unsigned capacity = settings_current.xfs_dir_cache_size;
+    // Memory the cache may use for this mount; the setting is in kilobytes
+    const size_t memory = (size_t)settings_current.xfs_dir_cache_memory * 1024;
+
+    if (capacity == 0)
+    {
+        struct https_dir_cache_entry_t discard = { .dir_entries = entries, .dir_entries_count = count };
+        https_cache_free_entries(&discard);
         return;
     }
 
-    // Copy all entries
+    struct https_dir_cache_entry_t* old_entry;
+    while ((old_entry = https_cache_lookup(engine, dir_path)) != NULL)
+    {
+        https_cache_remove(mount_data, old_entry);
+    }
+
+    struct https_dir_cache_entry_t* cache_entry = libspectrum_new0(struct https_dir_cache_entry_t, 1);
+    snprintf(cache_entry->path, sizeof(cache_entry->path), "%s", dir_path);
+    cache_entry->hash = https_cache_hash(cache_entry->path);
+    cache_entry->dir_entries = entries;
+    cache_entry->dir_entries_count = count;
+    cache_entry->expires = timer_get_time() + settings_current.xfs_dir_cache_ttl;
+    cache_entry->bytes = sizeof(*cache_entry) +
+        count * (sizeof(struct xfs_handle_https_dir_entry_t*) + sizeof(struct xfs_handle_https_dir_entry_t));
+
+    while (mount_data->lru_tail &&
+           (mount_data->dir_cache_count >= capacity ||
+            mount_data->dir_cache_bytes + cache_entry->bytes > memory))
+    {
+        XFS_DEBUG("https: cache evicting listing for '%s'\n", mount_data->lru_tail->path);
+        https_cache_remove(mount_data, mount_data->lru_tail);
+    }
+
+    const uint32_t bucket = cache_entry->hash % HTTPS_DIR_CACHE_BUCKETS;
+    cache_entry->hash_next = mount_data->dir_cache[bucket];
+    mount_data->dir_cache[bucket] = cache_entry;
+    https_cache_lru_push_front(mount_data, cache_entry);
+    mount_data->dir_cache_count++;
+    mount_data->dir_cache_bytes += cache_entry->bytes;
+}
+
+// Put directory entries into cache (copies them; caller keeps its own)
+static void https_cache_put_entries(const struct xfs_engine_mount_t* engine, const char* dir_path,
+    struct xfs_handle_https_dir_entry_t** entries, uint8_t count)
+{
+    struct xfs_handle_https_dir_entry_t** copies = NULL;
     int dir_entries_count = 0;
-    for (int i = 0; i < count; i++)
+
+    if (count)
     {
-        if (entries[i])
+        copies = libspectrum_new(struct xfs_handle_https_dir_entry_t*, count);
+
+        for (int i = 0; i < count; i++)
         {
-            struct xfs_handle_https_dir_entry_t* cached_entry = https_cache_copy_entry(entries[i]);
-            if (cached_entry)
+            if (entries && entries[i])
             {
-                mount_data->https_dir_cache[cache_idx].dir_entries[dir_entries_count] = cached_entry;
-                dir_entries_count++;
+                struct xfs_handle_https_dir_entry_t* cached_entry = https_cache_copy_entry(entries[i]);
+                if (cached_entry)
+                {
+                    copies[dir_entries_count] = cached_entry;
+                    dir_entries_count++;
+                }
             }
         }
     }
 
-    mount_data->https_dir_cache[cache_idx].dir_entries_count = dir_entries_count;
-    mount_data->https_dir_cache[cache_idx].in_use = 1;
+    https_cache_insert(engine, dir_path, copies, dir_entries_count);
 
-    XFS_DEBUG("https: cache_put cached %d entries for path '%s' at slot %d\n",
-        dir_entries_count, dir_path, cache_idx);
+    XFS_DEBUG("https: cache_put cached %d entries for path '%s'\n", dir_entries_count, dir_path);
 }
 
 // Put directory entries into cache (stores pointer directly, no copying)
 static void https_cache_store_entries(const struct xfs_engine_mount_t* engine,
     const char* dir_path, struct xfs_handle_https_dir_entry_t** entries, const uint8_t count)
 {
-    if (!entries || count == 0)
-    {
-        return;
-    }
-
-    struct https_engine_mount_data_t* mount_data = get_mount_data(engine);
-    
-    // Find first unused cache slot
-    int cache_idx = -1;
+    https_cache_insert(engine, dir_path, entries, count);
 
-    for (int i = 0; i < HTTPS_DIR_CACHE_SIZE; i++)
-    {
-        if (!mount_data->https_dir_cache[i].in_use)
-        {
-            cache_idx = i;
-            break;
-        }
-    }
-    
-    // If cache is full, use next_cache slot and cycle to next
-    if (cache_idx == -1)
-    {
-        cache_idx = mount_data->next_cache;
-        mount_data->next_cache = (mount_data->next_cache + 1) % HTTPS_DIR_CACHE_SIZE;
-    }
-    
-    // If cache slot was in use, free old entries
-    if (mount_data->https_dir_cache[cache_idx].in_use)
-    {
-        https_cache_free_entries(&mount_data->https_dir_cache[cache_idx]);
-    }
-    
-    // Copy path
-    strncpy(mount_data->https_dir_cache[cache_idx].path, dir_path, HTTPS_CACHE_PATH_MAX);
-    
-    // Store entries pointer directly (no copying)
-    mount_data->https_dir_cache[cache_idx].dir_entries = entries;
-    mount_data->https_dir_cache[cache_idx].dir_entries_count = count;
-    mount_data->https_dir_cache[cache_idx].in_use = 1;
-    
-    XFS_DEBUG("https: cache_store stored %d entries for path '%s' at slot %d\n", 
-              count, dir_path, cache_idx);
+    XFS_DEBUG("https: cache_store stored %d entries for path '%s'\n", count, dir_path);
 }
 
 // Callback function for httpc_get to write downloaded data to buffer
@@ -403,6 +534,167 @@ static int write_buffer_callback(void *param, unsigned char *buf, size_t length,
     return (int)length;
 }
 
+// Destination for a ranged GET: bytes [from, from + length) of the file
+struct https_range_fetch_t
+{
+    uint8_t* data;
+    size_t from;
+    size_t length;
+    size_t received;                     // Highest window offset written
+};
+
+// Callback for httpc_get_range. A server without range support answers
+// 200 with the whole file, so positions are mapped back to file offsets
+// and anything outside the requested window is dropped.
+static int write_range_callback(void *param, unsigned char *buf, size_t length, size_t position, size_t content_length)
+{
+    struct https_range_fetch_t* fetch = (struct https_range_fetch_t*)param;
+    (void)content_length;
+
+    const size_t file_pos = (tls_sck.response == 206 ? fetch->from : 0) + position;
+    size_t skip = 0;
+
+    if (file_pos + length <= fetch->from || file_pos >= fetch->from + fetch->length)
+    {
+        return (int)length;
+    }
+
+    if (file_pos < fetch->from)
+    {
+        skip = fetch->from - file_pos;
+    }
+
+    const size_t offset = file_pos + skip - fetch->from;
+    size_t count = length - skip;
+    if (offset + count > fetch->length)
+    {
+        count = fetch->length - offset;
+    }
+
+    memcpy(fetch->data + offset, buf + skip, count);
+    if (offset + count > fetch->received)
+    {
+        fetch->received = offset + count;
+    }
+
+    return (int)length;
+}
+
+// Cache entry describing the response to the last request
+static void https_cache_entry_from_response(struct xfs_cache_entry_t* entry, size_t size)
+{
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->etag, sizeof(entry->etag), "%s", tls_sck.etag);
+    snprintf(entry->last_modified, sizeof(entry->last_modified), "%s", tls_sck.last_modified);
+    entry->size = (uint32_t)size;
+}
+
+// GET url, made conditional on the validators of a cached copy if there is
+// one. If window is non-zero only that many bytes from the start are asked for.
+static int https_conditional_get(const char* url, const struct xfs_cache_entry_t* cached,
+    size_t window, struct https_buffer_info_t* buffer_info)
+{
+    char headers[2][XFS_CACHE_VALIDATOR_MAX + 32];
+    char* argv[2];
+    int argc = 0;
+
+    if (cached && cached->etag[0])
+    {
+        snprintf(headers[argc], sizeof(headers[argc]), "If-None-Match: %s", cached->etag);
+        argv[argc] = headers[argc];
+        argc++;
+    }
+    if (cached && cached->last_modified[0])
+    {
+        snprintf(headers[argc], sizeof(headers[argc]), "If-Modified-Since: %s", cached->last_modified);
+        argv[argc] = headers[argc];
+        argc++;
+    }
+
+    tls_sck.argc = argc;
+    tls_sck.argv = argc ? argv : NULL;
+    const int result = window ?
+        httpc_get_range(&tls_sck, url, 0, window - 1, write_buffer_callback, buffer_info) :
+        httpc_get(&tls_sck, url, write_buffer_callback, buffer_info);
+    tls_sck.argc = 0;
+    tls_sck.argv = NULL;
+
+    return result;
+}
+
+// Fetch url into a new buffer (NULL if empty) through the on-disk cache:
+// a cached copy is revalidated with the server, used as is when offline
+// and used stale if the server can't be reached
+static int16_t https_cached_get(const char* url, void** out_data, size_t* out_size)
+{
+    struct xfs_cache_entry_t entry;
+    const bool cached = xfs_cache_lookup(url, &entry);
+
+    *out_data = NULL;
+    *out_size = 0;
+
+    if (xfs_cache_offline())
+    {
+        if (cached && xfs_cache_read_all(url, out_data, out_size) == 0)
+        {
+            xfs_cache_count_hit(*out_size);
+            return XFS_ERR_OK;
+        }
+        xfs_cache_count_miss();
+        return XFS_ERR_NOENT;
+    }
+
+    struct https_buffer_info_t buffer_info = {0};
+    const int result = https_conditional_get(url, cached ? &entry : NULL, 0, &buffer_info);
+
+    if (result == HTTPC_OK && tls_sck.response == 304 && cached)
+    {
+        if (buffer_info.data)
+        {
+            libspectrum_free(buffer_info.data);
+        }
+        if (xfs_cache_read_all(url, out_data, out_size) == 0)
+        {
+            xfs_cache_count_revalidated();
+            xfs_cache_count_hit(*out_size);
+            return XFS_ERR_OK;
+        }
+        xfs_cache_invalidate(url);
+        return XFS_ERR_IO;
+    }
+
+    if (result == HTTPC_OK && tls_sck.response < 300)
+    {
+        xfs_cache_count_miss();
+        https_cache_entry_from_response(&entry, buffer_info.size);
+        xfs_cache_store(url, &entry, buffer_info.data, buffer_info.size);
+        *out_data = buffer_info.data;
+        *out_size = buffer_info.size;
+        return XFS_ERR_OK;
+    }
+
+    if (buffer_info.data)
+    {
+        libspectrum_free(buffer_info.data);
+    }
+
+    if (result == -404)
+    {
+        xfs_cache_invalidate(url);
+        return XFS_ERR_NOENT;
+    }
+
+    if (cached && xfs_cache_read_all(url, out_data, out_size) == 0)
+    {
+        XFS_DEBUG("https: '%s' unreachable, using cached copy\n", url);
+        xfs_cache_count_stale();
+        xfs_cache_count_hit(*out_size);
+        return XFS_ERR_OK;
+    }
+
+    return XFS_ERR_IO;
+}
+
 static int parse_index_line_to_entry(const char* line, struct xfs_handle_https_dir_entry_t* entry);
 static int https_parse_index_txt(const char* buffer, const size_t buffer_len,
     struct xfs_handle_https_dir_entry_t** entries,
@@ -448,20 +740,14 @@ static int16_t https_fetch_and_parse_index(const struct xfs_engine_mount_t* engi
 
     XFS_DEBUG("https: fetch_index fetching from '%s'\n", url);
 
-    // Allocate buffer and fetch index.txt
-    const size_t buffer_size = 2048;
-    char* buffer = (char*)libspectrum_malloc(buffer_size);
-    if (!buffer)
+    // Fetch index.txt, from the on-disk cache if it's still current
+    char* buffer = NULL;
+    size_t length = 0;
+    const int16_t fetch_result = https_cached_get(url, (void**)&buffer, &length);
+    if (fetch_result != XFS_ERR_OK)
     {
-        return XFS_ERR_NOMEM;
-    }
-
-    size_t length = buffer_size;
-    if (httpc_get_buffer(&tls_sck, url, buffer, &length) != HTTPC_OK)
-    {
-        XFS_DEBUG("https: fetch_index failed: httpc_get_buffer error\n");
-        libspectrum_free(buffer);
-        return XFS_ERR_NOENT;
+        XFS_DEBUG("https: fetch_index failed: %d\n", fetch_result);
+        return fetch_result == XFS_ERR_IO ? XFS_ERR_NOENT : fetch_result;
     }
 
     XFS_DEBUG("https: fetch_index received %zu bytes\n", length);
@@ -486,7 +772,10 @@ static int16_t https_fetch_and_parse_index(const struct xfs_engine_mount_t* engi
     if (entry_count == 0)
     {
         XFS_DEBUG("https: fetch_index empty directory\n");
-        libspectrum_free(buffer);
+        if (buffer)
+        {
+            libspectrum_free(buffer);
+        }
         *out_entries = NULL;
         *out_entry_count = 0;
         return XFS_ERR_OK; // Empty directory
@@ -560,9 +849,6 @@ static int16_t https_mount(const struct xfs_engine_t* engine, const char* hostna
     }
     memset(mount_data, 0, sizeof(struct https_engine_mount_data_t));
 
-    // Initialize cache rotation index
-    mount_data->next_cache = 0;
-
     // Handle empty path by treating it as root "/"
     const char* normalized_path = path;
     const size_t path_len = strlen(path);
@@ -630,6 +916,12 @@ static int16_t https_mount(const struct xfs_engine_t* engine, const char* hostna
     // Temporarily set mount_data so we can use fetch functions
     out_mount->mount_data = mount_data;
 
+    if (xfs_cache_offline())
+    {
+        XFS_DEBUG("https: mount offline, not verifying URL\n");
+        return XFS_ERR_OK;
+    }
+
     // Verify mount URL exists using HEAD request
     XFS_DEBUG("https: mount verifying URL with HEAD request: %s\n", mount_data->url);
     const int head_result = httpc_head(&tls_sck, mount_data->url);
@@ -682,14 +974,7 @@ static void https_unmount(const struct xfs_engine_t* engine, struct xfs_engine_m
     }
     
     // Free all cache entries
-    for (int i = 0; i < HTTPS_DIR_CACHE_SIZE; i++)
-    {
-        if (mount_data->https_dir_cache[i].in_use)
-        {
-            https_cache_free_entries(&mount_data->https_dir_cache[i]);
-            mount_data->https_dir_cache[i].in_use = 0;
-        }
-    }
+    https_cache_clear(mount_data);
     
     // Clear hostname
     mount_data->url[0] = '\0';
@@ -699,7 +984,327 @@ static void https_unmount(const struct xfs_engine_t* engine, struct xfs_engine_m
     libspectrum_free(mount_data);
 }
 
-// Open file - download to memory buffer
+static void https_free_file_handle(struct xfs_handle_https_file_t* https_handle)
+{
+    if (https_handle->cache_file)
+    {
+        fclose(https_handle->cache_file);
+        https_handle->cache_file = NULL;
+    }
+
+    // Commits the fetched content to the cache if every block was read
+    xfs_cache_writer_end(https_handle->cache_writer);
+    https_handle->cache_writer = NULL;
+
+    if (https_handle->data)
+    {
+        libspectrum_free(https_handle->data);
+        https_handle->data = NULL;
+    }
+
+    for (int i = 0; i < HTTPS_RANGE_CACHE_BLOCKS; i++)
+    {
+        if (https_handle->blocks[i].data)
+        {
+            libspectrum_free(https_handle->blocks[i].data);
+            https_handle->blocks[i].data = NULL;
+        }
+    }
+
+    if (https_handle->url)
+    {
+        libspectrum_free(https_handle->url);
+        https_handle->url = NULL;
+    }
+
+    libspectrum_free(https_handle);
+}
+
+// Pick the block slot to (re)fill: an unused one, otherwise the least recently used
+static struct https_range_block_t* https_range_victim(struct xfs_handle_https_file_t* https_handle)
+{
+    struct https_range_block_t* victim = &https_handle->blocks[0];
+
+    for (int i = 0; i < HTTPS_RANGE_CACHE_BLOCKS; i++)
+    {
+        struct https_range_block_t* block = &https_handle->blocks[i];
+        if (!block->data || !block->length)
+        {
+            return block;
+        }
+        if (block->stamp < victim->stamp)
+        {
+            victim = block;
+        }
+    }
+
+    return victim;
+}
+
+static struct https_range_block_t* https_range_find(struct xfs_handle_https_file_t* https_handle, uint32_t index)
+{
+    for (int i = 0; i < HTTPS_RANGE_CACHE_BLOCKS; i++)
+    {
+        struct https_range_block_t* block = &https_handle->blocks[i];
+        if (block->data && block->length && block->index == index)
+        {
+            block->stamp = ++https_handle->stamp;
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+// Split a contiguous window starting at block first_index into cache blocks.
+// Only the last block of the file may be short; a short block anywhere else
+// (the server sent less than we asked for) is dropped to be fetched again.
+static void https_range_store(struct xfs_handle_https_file_t* https_handle, uint32_t first_index,
+    const uint8_t* data, size_t length)
+{
+    for (size_t offset = 0; offset < length; offset += HTTPS_RANGE_BLOCK_SIZE)
+    {
+        const uint32_t index = first_index + offset / HTTPS_RANGE_BLOCK_SIZE;
+        const size_t chunk = (length - offset < HTTPS_RANGE_BLOCK_SIZE) ? length - offset : HTTPS_RANGE_BLOCK_SIZE;
+
+        if ((size_t)index * HTTPS_RANGE_BLOCK_SIZE + chunk > https_handle->size ||
+            (chunk < HTTPS_RANGE_BLOCK_SIZE && (size_t)index * HTTPS_RANGE_BLOCK_SIZE + chunk != https_handle->size))
+        {
+            XFS_DEBUG("https: dropping short block %u (%zu bytes)\n", index, chunk);
+            break;
+        }
+
+        if (https_range_find(https_handle, index))
+        {
+            continue;
+        }
+
+        struct https_range_block_t* block = https_range_victim(https_handle);
+        if (!block->data)
+        {
+            block->data = libspectrum_malloc(HTTPS_RANGE_BLOCK_SIZE);
+        }
+
+        memcpy(block->data, data + offset, chunk);
+        block->index = index;
+        block->length = chunk;
+        block->stamp = ++https_handle->stamp;
+
+        xfs_cache_writer_write(https_handle->cache_writer, index, data + offset, chunk);
+    }
+
+    if (xfs_cache_writer_complete(https_handle->cache_writer))
+    {
+        xfs_cache_writer_end(https_handle->cache_writer);
+        https_handle->cache_writer = NULL;
+    }
+}
+
+// Fetch the read-ahead window starting at block index into the block cache
+static int16_t https_range_fetch(struct xfs_handle_https_file_t* https_handle, uint32_t index)
+{
+    const size_t from = (size_t)index * HTTPS_RANGE_BLOCK_SIZE;
+    if (from >= https_handle->size)
+    {
+        return XFS_ERR_INVAL;
+    }
+
+    size_t length = HTTPS_RANGE_BLOCK_SIZE * HTTPS_RANGE_READAHEAD;
+    if (from + length > https_handle->size)
+    {
+        length = https_handle->size - from;
+    }
+
+    struct https_range_fetch_t fetch = {0};
+    fetch.data = libspectrum_malloc(length);
+    fetch.from = from;
+    fetch.length = length;
+
+    XFS_DEBUG("https: range fetch bytes %zu-%zu\n", from, from + length - 1);
+
+    // A different total means the file has changed under us, and a short
+    // answer would leave a hole; either way the window can't be used
+    if (httpc_get_range(&tls_sck, https_handle->url, from, from + length - 1,
+                        write_range_callback, &fetch) != HTTPC_OK || fetch.received != length ||
+        (tls_sck.response == 206 && tls_sck.range_total != https_handle->size))
+    {
+        XFS_DEBUG("https: range fetch failed (response=%d received=%zu)\n",
+                  tls_sck.response, fetch.received);
+        libspectrum_free(fetch.data);
+        return XFS_ERR_IO;
+    }
+
+    https_range_store(https_handle, index, fetch.data, length);
+    libspectrum_free(fetch.data);
+
+    return XFS_ERR_OK;
+}
+
+// Try to open a file in ranged mode by fetching its first window, made
+// conditional on the validators of a cached copy if there is one. Returns
+// XFS_ERR_OK with https_handle->ranged set if the server honours ranges,
+// XFS_ERR_OK with the whole file in https_handle->data if it sent the file
+// anyway, XFS_ERR_OK with nothing set if it answered 304 Not Modified,
+// XFS_ERR_NOENT if there's no such file, or XFS_ERR_IO if the caller should
+// fall back to a plain download.
+static int16_t https_open_ranged(struct xfs_handle_https_file_t* https_handle, const char* url,
+    const struct xfs_cache_entry_t* cached)
+{
+    const size_t window = HTTPS_RANGE_BLOCK_SIZE * HTTPS_RANGE_READAHEAD;
+    struct https_buffer_info_t buffer_info = {0};
+
+    const int result = https_conditional_get(url, cached, window, &buffer_info);
+    if (result != HTTPC_OK || tls_sck.response == 304)
+    {
+        if (buffer_info.data)
+        {
+            libspectrum_free(buffer_info.data);
+        }
+        if (result == HTTPC_OK)
+        {
+            XFS_DEBUG("https: open cached copy not modified\n");
+            return XFS_ERR_OK;
+        }
+        // e.g. 416 for an empty file; let the plain download sort it out
+        XFS_DEBUG("https: open ranged request failed (response=%d)\n", tls_sck.response);
+        return result == -404 ? XFS_ERR_NOENT : XFS_ERR_IO;
+    }
+
+    if (tls_sck.response != 206)
+    {
+        // No range support; we've been sent the whole file
+        XFS_DEBUG("https: open server ignored range (response=%d), size=%zu\n",
+                  tls_sck.response, buffer_info.size);
+        struct xfs_cache_entry_t entry;
+        https_cache_entry_from_response(&entry, buffer_info.size);
+        xfs_cache_store(url, &entry, buffer_info.data, buffer_info.size);
+        https_handle->data = buffer_info.data;
+        https_handle->size = buffer_info.size;
+        return XFS_ERR_OK;
+    }
+
+    if (tls_sck.range_total == 0 || buffer_info.size == 0 || buffer_info.size > tls_sck.range_total ||
+        buffer_info.size > window)
+    {
+        // Can't tell how big the file is, or the answer doesn't fit it, so
+        // can't do ranged reads
+        XFS_DEBUG("https: open ranged response without usable length\n");
+        if (buffer_info.data)
+        {
+            libspectrum_free(buffer_info.data);
+        }
+        return XFS_ERR_IO;
+    }
+
+    struct xfs_cache_entry_t entry;
+    https_cache_entry_from_response(&entry, tls_sck.range_total);
+
+    https_handle->url = utils_safe_strdup(url);
+    https_handle->size = tls_sck.range_total;
+    https_handle->ranged = 1;
+    https_handle->cache_writer = xfs_cache_writer_begin(url, &entry, HTTPS_RANGE_BLOCK_SIZE);
+    https_range_store(https_handle, 0, buffer_info.data, buffer_info.size);
+    libspectrum_free(buffer_info.data);
+
+    XFS_DEBUG("https: open ranged, size=%zu\n", https_handle->size);
+    return XFS_ERR_OK;
+}
+
+// Download the whole of a file to memory, made conditional on the validators
+// of a cached copy if there is one. Returns XFS_ERR_OK with
+// https_handle->data set, or with nothing set if the server answered 304
+// Not Modified.
+static int16_t https_open_download(struct xfs_handle_https_file_t* https_handle, const char* url,
+    const struct xfs_cache_entry_t* cached)
+{
+    struct https_buffer_info_t buffer_info = {0};
+
+    XFS_DEBUG("https: open downloading from URL...\n");
+    const int result = https_conditional_get(url, cached, 0, &buffer_info);
+
+    if (result != HTTPC_OK || tls_sck.response == 304)
+    {
+        if (buffer_info.data)
+        {
+            libspectrum_free(buffer_info.data);
+        }
+        if (result == HTTPC_OK)
+        {
+            return XFS_ERR_OK;
+        }
+        XFS_DEBUG("https: open failed: httpc_get error\n");
+        return result == -404 ? XFS_ERR_NOENT : XFS_ERR_IO;
+    }
+
+    XFS_DEBUG("https: open download complete, size=%zu\n", buffer_info.size);
+
+    struct xfs_cache_entry_t entry;
+    https_cache_entry_from_response(&entry, buffer_info.size);
+    xfs_cache_store(url, &entry, buffer_info.data, buffer_info.size);
+
+    https_handle->data = buffer_info.data;
+    https_handle->size = buffer_info.size;
+    return XFS_ERR_OK;
+}
+
+// Open a file we have in the on-disk cache. The cached copy is used if it's
+// still current, when offline, or if the server can't be reached; if the
+// file has changed it's opened as if it weren't cached, and the cache is
+// refilled as it's read.
+static int16_t https_open_cached(struct xfs_handle_https_file_t* https_handle, const char* url,
+    const struct xfs_cache_entry_t* entry)
+{
+    if (!xfs_cache_offline())
+    {
+        int16_t result = https_open_ranged(https_handle, url, entry);
+
+        // The server answered, but not with a usable range (e.g. 416 for a
+        // file which is now empty), so check for a new copy the old way
+        if (result == XFS_ERR_IO &&
+            (tls_sck.response == 416 || (tls_sck.response >= 200 && tls_sck.response < 300)))
+        {
+            result = https_open_download(https_handle, url, entry);
+        }
+
+        if (result == XFS_ERR_NOENT)
+        {
+            xfs_cache_invalidate(url);
+            return XFS_ERR_NOENT;
+        }
+
+        if (result == XFS_ERR_OK && tls_sck.response != 304)
+        {
+            XFS_DEBUG("https: open cached copy out of date, size=%zu\n", https_handle->size);
+            xfs_cache_count_miss();
+            return XFS_ERR_OK;
+        }
+
+        if (result == XFS_ERR_OK)
+        {
+            xfs_cache_count_revalidated();
+        }
+        else
+        {
+            XFS_DEBUG("https: open '%s' unreachable, using cached copy\n", url);
+            xfs_cache_count_stale();
+        }
+    }
+
+    https_handle->cache_file = xfs_cache_open(url);
+    if (!https_handle->cache_file)
+    {
+        return XFS_ERR_IO;
+    }
+
+    https_handle->size = entry->size;
+    xfs_cache_count_hit(entry->size);
+    XFS_DEBUG("https: open from cache, size=%zu\n", https_handle->size);
+    return XFS_ERR_OK;
+}
+
+// Open file - from the on-disk cache if we have it, otherwise fetch the
+// start of it with a ranged request, falling back to downloading the whole
+// file to a memory buffer
 static int16_t https_open(const struct xfs_engine_mount_t* engine, struct xfs_handle_t* handle, const char* path, int flags)
 {
     XFS_DEBUG("https: open path='%s' flags=0x%04x\n", path ? path : "(null)", flags);
@@ -730,27 +1335,38 @@ static int16_t https_open(const struct xfs_engine_mount_t* engine, struct xfs_ha
     }
     memset(https_handle, 0, sizeof(struct xfs_handle_https_file_t));
 
-    // Initialize buffer info for download callback
-    struct https_buffer_info_t buffer_info = {0};
-    
-    // Download file using httpc_get
-    XFS_DEBUG("https: open downloading from URL...\n");
-    if (httpc_get(&tls_sck, url, write_buffer_callback, &buffer_info) != HTTPC_OK)
+    struct xfs_cache_entry_t entry;
+    if (xfs_cache_lookup(url, &entry))
     {
-        XFS_DEBUG("https: open failed: httpc_get error\n");
-        if (buffer_info.data)
+        const int16_t result = https_open_cached(https_handle, url, &entry);
+        if (result != XFS_ERR_OK)
         {
-            libspectrum_free(buffer_info.data);
+            https_free_file_handle(https_handle);
+            return result;
         }
-        libspectrum_free(https_handle);
-        return XFS_ERR_IO;
     }
-    
-    XFS_DEBUG("https: open download complete, size=%zu\n", buffer_info.size);
-    
-    // Store buffer pointer and size
-    https_handle->data = buffer_info.data;
-    https_handle->size = buffer_info.size;
+    else if (xfs_cache_offline())
+    {
+        XFS_DEBUG("https: open failed: offline and not cached\n");
+        xfs_cache_count_miss();
+        https_free_file_handle(https_handle);
+        return XFS_ERR_NOENT;
+    }
+    else
+    {
+        int16_t result = https_open_ranged(https_handle, url, NULL);
+        if (result == XFS_ERR_IO)
+        {
+            result = https_open_download(https_handle, url, NULL);
+        }
+        if (result != XFS_ERR_OK)
+        {
+            https_free_file_handle(https_handle);
+            return result;
+        }
+        xfs_cache_count_miss();
+    }
+
     https_handle->pos = 0;
 
     handle->type = XFS_HANDLE_TYPE_FILE;
@@ -760,6 +1376,49 @@ static int16_t https_open(const struct xfs_engine_mount_t* engine, struct xfs_ha
     return XFS_ERR_OK;
 }
 
+// Read from the block cache, fetching further windows as needed
+static int16_t https_read_ranged(struct xfs_handle_https_file_t* https_handle, uint8_t* buffer, size_t to_read)
+{
+    size_t done = 0;
+
+    while (done < to_read)
+    {
+        const uint32_t index = https_handle->pos / HTTPS_RANGE_BLOCK_SIZE;
+        const size_t offset = https_handle->pos % HTTPS_RANGE_BLOCK_SIZE;
+
+        struct https_range_block_t* block = https_range_find(https_handle, index);
+        if (!block)
+        {
+            if (https_range_fetch(https_handle, index) != XFS_ERR_OK ||
+                !(block = https_range_find(https_handle, index)))
+            {
+                // Report what we have; the next read will retry
+                return done ? (int16_t)done : XFS_ERR_IO;
+            }
+        }
+
+        if (offset >= block->length)
+        {
+            // Only the last block is short, and reads stop at the end of
+            // the file, so we must have been given less than we asked for
+            XFS_DEBUG("https: read past the end of block %u\n", index);
+            return done ? (int16_t)done : XFS_ERR_IO;
+        }
+
+        size_t count = block->length - offset;
+        if (count > to_read - done)
+        {
+            count = to_read - done;
+        }
+
+        memcpy(buffer + done, block->data + offset, count);
+        done += count;
+        https_handle->pos += count;
+    }
+
+    return (int16_t)done;
+}
+
 // Read from memory buffer
 static int16_t https_read(const struct xfs_engine_mount_t* engine, struct xfs_handle_t* handle, void* buffer, uint16_t size)
 {
@@ -776,7 +1435,26 @@ static int16_t https_read(const struct xfs_engine_mount_t* engine, struct xfs_ha
     // Calculate how much we can read
     size_t remaining = https_handle->size - https_handle->pos;
     size_t to_read = (size < remaining) ? size : remaining;
-    
+
+    if (https_handle->cache_file)
+    {
+        if (fseek(https_handle->cache_file, (long)https_handle->pos, SEEK_SET) != 0)
+        {
+            return XFS_ERR_IO;
+        }
+        to_read = fread(buffer, 1, to_read, https_handle->cache_file);
+        https_handle->pos += to_read;
+        XFS_DEBUG("https: read size=%d bytes_read=%zu (cached)\n", size, to_read);
+        return (int16_t)to_read;
+    }
+
+    if (https_handle->ranged)
+    {
+        const int16_t bytes_read = https_read_ranged(https_handle, buffer, to_read);
+        XFS_DEBUG("https: read size=%d bytes_read=%d (ranged)\n", size, bytes_read);
+        return bytes_read;
+    }
+
     // Copy data from buffer
     memcpy(buffer, (unsigned char*)https_handle->data + https_handle->pos, to_read);
     https_handle->pos += to_read;
@@ -804,22 +1482,16 @@ static int16_t https_close(const struct xfs_engine_mount_t* engine, struct xfs_h
 
     struct xfs_handle_https_file_t* https_handle = get_https_file_handle(handle);
     
-    // Free buffer
-    if (https_handle->data)
-    {
-        libspectrum_free(https_handle->data);
-        https_handle->data = NULL;
-    }
-    
-    // Free file handle
-    libspectrum_free(https_handle);
+    // Free buffer, cached blocks and file handle
+    https_free_file_handle(https_handle);
     handle->data = NULL;
     
     XFS_DEBUG("https: close success\n");
     return XFS_ERR_OK;
 }
 
-// Seek in memory buffer
+// Seek in memory buffer; in ranged mode blocks already cached are kept, so
+// seeking back and forth within them doesn't refetch anything
 static int16_t https_lseek(const struct xfs_engine_mount_t* engine, struct xfs_handle_t* handle, uint32_t offset, uint8_t whence)
 {
     XFS_DEBUG("https: lseek offset=%lu whence=%d\n", (unsigned long)offset, whence);
@@ -1080,9 +1752,16 @@ static int16_t https_opendir(const struct xfs_engine_mount_t* engine, struct xfs
         return result;
     }
     
+    // Cache the directory entries using normalized directory path (same as stat() will use);
+    // empty listings are cached too so stat() can answer NOENT for them
+    char cache_path[HTTPS_CACHE_PATH_MAX];
+    https_normalize_dir_path(path, cache_path);
+    https_cache_put_entries(engine, cache_path, https_handle->dir_entries, entry_count);
+
     if (entry_count == 0)
     {
         // Empty directory
+        libspectrum_free(https_handle->dir_entries);
         libspectrum_free(https_handle);
         return XFS_ERR_OK;
     }
@@ -1090,11 +1769,6 @@ static int16_t https_opendir(const struct xfs_engine_mount_t* engine, struct xfs
     https_handle->dir_entries_count = entry_count;
     https_handle->dir_entries_pos = 0;
     
-    // Cache the directory entries using normalized directory path (same as stat() will use)
-    char cache_path[HTTPS_CACHE_PATH_MAX];
-    https_normalize_dir_path(path, cache_path);
-    https_cache_put_entries(engine, cache_path, https_handle->dir_entries, entry_count);
-    
     handle->data = https_handle;
     handle->type = XFS_HANDLE_TYPE_DIR;
     
@@ -1246,6 +1920,15 @@ static int16_t https_stat(const struct xfs_engine_mount_t* engine, const char* p
         entry_name[sizeof(entry_name) - 1] = '\0';
     }
     
+    if (entry_name[0] == '\0')
+    {
+        // The root directory always exists, no need to ask the server
+        memset(stat_info, 0, sizeof(*stat_info));
+        stat_info->type = XFS_TYPE_DIR;
+        strcpy(stat_info->name, "/");
+        return XFS_ERR_OK;
+    }
+
     // Try to find entry in cache first
     const struct xfs_handle_https_dir_entry_t* cached_entry =
         https_cache_find_entry(engine, dir_path, entry_name);
@@ -1281,6 +1964,16 @@ static int16_t https_stat(const struct xfs_engine_mount_t* engine, const char* p
         return XFS_ERR_OK;
     }
     
+    // A cached listing of the directory without the entry, or of an ancestor
+    // without the directory, answers the stat without a request
+    char cache_path[HTTPS_CACHE_PATH_MAX];
+    https_normalize_dir_path(dir_path, cache_path);
+    if (https_cache_lookup(engine, cache_path) || https_cache_dir_known_missing(engine, cache_path))
+    {
+        XFS_DEBUG("https: stat failed from cache: '%s' not in '%s'\n", entry_name, dir_path);
+        return XFS_ERR_NOENT;
+    }
+
     // Not in cache, fetch index.txt for the directory
     struct xfs_handle_https_dir_entry_t** entries = NULL;
     uint8_t entry_count = 0;
@@ -1304,8 +1997,6 @@ static int16_t https_stat(const struct xfs_engine_mount_t* engine, const char* p
     }
     
     // Cache the directory entries for future use (transfer ownership to cache)
-    char cache_path[HTTPS_CACHE_PATH_MAX];
-    https_normalize_dir_path(dir_path, cache_path);
     https_cache_store_entries(engine, cache_path, entries, entry_count);
     // Ownership transferred to cache, entries will be freed when cache is evicted
     entries = NULL;
@@ -1408,16 +2099,10 @@ static void https_free_handle(const struct xfs_engine_mount_t* engine, struct xf
     {
         struct xfs_handle_https_file_t* https_handle = get_https_file_handle(handle);
 
-        // Free buffer if exists
+        // Free buffer and cached blocks if exists
         if (https_handle)
         {
-          if (https_handle->data)
-          {
-              libspectrum_free(https_handle->data);
-              https_handle->data = NULL;
-          }
-
-          libspectrum_free(https_handle);
+          https_free_file_handle(https_handle);
         }
     }
     else if (handle->type == XFS_HANDLE_TYPE_DIR)
@@ -7,7 +7,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #if defined(WIN32) || defined(_WIN32)
 #include <direct.h>
@@ -16,7 +18,9 @@
 #endif
 
 #include "libspectrum.h"
+#include "debugger/debugger.h"
 #include "memory_pages.h"
+#include "timer/timer.h"
 #include "ui/ui.h"
 #include "compat.h"
 
@@ -62,29 +66,290 @@ void xfs_init()
 void xfs_reset(void)
 {
     XFS_DEBUG("xfs: reset - cleaning up all mounts and handles\n");
+
+    // Don't pull mounts out from under a command that's still running
+    xfs_worker_wait_idle();
     
     // Call xfs_free() from xfs.c to clean up all resources
+    xfs_worker_lock_mounts();
     xfs_free();
+    xfs_worker_unlock_mounts();
     
     XFS_DEBUG("xfs: reset complete\n");
 }
 
+// Worker thread state. Commands are executed off the emulation thread so
+// that slow engines (HTTPS downloads in particular) don't stall the Z80;
+// the guest sees XFS_STATUS_BUSY until the command has completed.
+static pthread_t xfs_worker_thread;
+static pthread_mutex_t xfs_worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t xfs_worker_cond = PTHREAD_COND_INITIALIZER;
+static bool xfs_worker_running = false;
+static bool xfs_worker_stop = false;
+// True from the command register write until the handler has returned
+static bool xfs_worker_busy = false;
+// The register page as it was when the command was handed over; the guest
+// reads this while the worker is busy rewriting the real one
+static struct xfs_registers_t xfs_registers_snapshot;
+// Held while anything uses the mounts, as Spectranext enginecalls read their
+// input through them on a thread of their own
+static pthread_mutex_t xfs_mounts_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Command service time histogram; bucket n counts commands which took
+// less than xfs_latency_limits[n] microseconds, the last bucket the rest
+static const uint32_t xfs_latency_limits[XFS_LATENCY_BUCKETS - 1] = {
+    100, 1000, 10000, 100000, 1000000,
+};
+static const char * const xfs_latency_detail_strings[XFS_LATENCY_BUCKETS] = {
+    "lat100us", "lat1ms", "lat10ms", "lat100ms", "lat1s", "latslow",
+};
+static uint32_t xfs_latency_histogram[XFS_LATENCY_BUCKETS];
+static uint32_t xfs_latency_max_us;
+static uint32_t xfs_commands_serviced;
+
+static void xfs_record_latency(uint32_t us)
+{
+    int bucket = 0;
+
+    while (bucket < XFS_LATENCY_BUCKETS - 1 && us >= xfs_latency_limits[bucket])
+        bucket++;
+
+    xfs_latency_histogram[bucket]++;
+    xfs_commands_serviced++;
+    if (us > xfs_latency_max_us)
+        xfs_latency_max_us = us;
+}
+
+static void* xfs_worker_main(void* arg GCC_UNUSED)
+{
+    pthread_mutex_lock(&xfs_worker_mutex);
+
+    while (true)
+    {
+        while (!xfs_worker_busy && !xfs_worker_stop)
+            pthread_cond_wait(&xfs_worker_cond, &xfs_worker_mutex);
+
+        if (xfs_worker_stop)
+            break;
+
+        pthread_mutex_unlock(&xfs_worker_mutex);
+
+        const double start = timer_get_time();
+        xfs_worker_lock_mounts();
+        xfs_handle_command((struct xfs_registers_t*)&xfs_registers);
+        xfs_worker_unlock_mounts();
+        const double elapsed = timer_get_time() - start;
+
+        pthread_mutex_lock(&xfs_worker_mutex);
+
+        xfs_record_latency(elapsed > 0 ? (uint32_t)(elapsed * 1000000.0) : 0);
+        XFS_DEBUG("xfs: command complete status=%d result=%d in %.3f ms\n",
+                  xfs_registers.status, xfs_registers.result, elapsed * 1000.0);
+
+        xfs_worker_busy = false;
+        pthread_cond_broadcast(&xfs_worker_cond);
+    }
+
+    pthread_mutex_unlock(&xfs_worker_mutex);
+    return NULL;
+}
+
+// Must be called with xfs_worker_mutex held
+static int xfs_worker_start(void)
+{
+    int error;
+
+    if (xfs_worker_running)
+        return 0;
+
+    xfs_worker_stop = false;
+    error = pthread_create(&xfs_worker_thread, NULL, xfs_worker_main, NULL);
+    if (error)
+    {
+        ui_error( UI_ERROR_ERROR, "xfs: error %d creating worker thread", error );
+        return 1;
+    }
+
+    xfs_worker_running = true;
+    return 0;
+}
+
+void xfs_worker_lock_mounts(void)
+{
+    pthread_mutex_lock(&xfs_mounts_mutex);
+}
+
+void xfs_worker_unlock_mounts(void)
+{
+    pthread_mutex_unlock(&xfs_mounts_mutex);
+}
+
+void xfs_worker_wait_idle(void)
+{
+    pthread_mutex_lock(&xfs_worker_mutex);
+    while (xfs_worker_busy)
+        pthread_cond_wait(&xfs_worker_cond, &xfs_worker_mutex);
+    pthread_mutex_unlock(&xfs_worker_mutex);
+}
+
+void xfs_worker_end(void)
+{
+    pthread_mutex_lock(&xfs_worker_mutex);
+
+    if (!xfs_worker_running)
+    {
+        pthread_mutex_unlock(&xfs_worker_mutex);
+        return;
+    }
+
+    // Let any in-flight command finish; engines aren't cancellable
+    while (xfs_worker_busy)
+        pthread_cond_wait(&xfs_worker_cond, &xfs_worker_mutex);
+
+    xfs_worker_stop = true;
+    pthread_cond_broadcast(&xfs_worker_cond);
+    pthread_mutex_unlock(&xfs_worker_mutex);
+
+    pthread_join(xfs_worker_thread, NULL);
+    xfs_worker_running = false;
+    xfs_worker_stop = false;
+}
+
+void xfs_worker_get_stats(struct xfs_worker_stats_t* stats)
+{
+    pthread_mutex_lock(&xfs_worker_mutex);
+    memcpy(stats->histogram, xfs_latency_histogram, sizeof(stats->histogram));
+    stats->commands = xfs_commands_serviced;
+    stats->max_us = xfs_latency_max_us;
+    pthread_mutex_unlock(&xfs_worker_mutex);
+}
+
+void xfs_worker_reset_stats(void)
+{
+    pthread_mutex_lock(&xfs_worker_mutex);
+    memset(xfs_latency_histogram, 0, sizeof(xfs_latency_histogram));
+    xfs_commands_serviced = 0;
+    xfs_latency_max_us = 0;
+    pthread_mutex_unlock(&xfs_worker_mutex);
+}
+
+// Debugger system variables: xfs:commands, xfs:latmax (microseconds) and
+// one counter per histogram bucket. Writing any of them resets the stats.
+static libspectrum_dword get_histogram_bucket(int bucket)
+{
+    struct xfs_worker_stats_t stats;
+    xfs_worker_get_stats(&stats);
+    return stats.histogram[bucket];
+}
+
+#define XFS_BUCKET_GETTER(n) \
+    static libspectrum_dword get_bucket_##n(void) { return get_histogram_bucket(n); }
+
+XFS_BUCKET_GETTER(0)
+XFS_BUCKET_GETTER(1)
+XFS_BUCKET_GETTER(2)
+XFS_BUCKET_GETTER(3)
+XFS_BUCKET_GETTER(4)
+XFS_BUCKET_GETTER(5)
+
+static const debugger_get_system_variable_fn_t
+xfs_bucket_getters[XFS_LATENCY_BUCKETS] = {
+    get_bucket_0, get_bucket_1, get_bucket_2,
+    get_bucket_3, get_bucket_4, get_bucket_5,
+};
+
+static libspectrum_dword get_commands(void)
+{
+    struct xfs_worker_stats_t stats;
+    xfs_worker_get_stats(&stats);
+    return stats.commands;
+}
+
+static libspectrum_dword get_max_latency(void)
+{
+    struct xfs_worker_stats_t stats;
+    xfs_worker_get_stats(&stats);
+    return stats.max_us;
+}
+
+static void reset_stats(libspectrum_dword value GCC_UNUSED)
+{
+    xfs_worker_reset_stats();
+}
+
+void xfs_worker_init(void)
+{
+    debugger_system_variable_register("xfs", "commands", get_commands, reset_stats);
+    debugger_system_variable_register("xfs", "latmax", get_max_latency, reset_stats);
+
+    for (int i = 0; i < XFS_LATENCY_BUCKETS; i++)
+    {
+        debugger_system_variable_register("xfs", xfs_latency_detail_strings[i],
+                                          xfs_bucket_getters[i], reset_stats);
+    }
+}
+
 libspectrum_byte xfs_read( memory_page *page GCC_UNUSED, libspectrum_word address )
 {
     libspectrum_word offset = address & 0xfff;  // XFS is single page (0x49)
     uint8_t *registers = (uint8_t*)&xfs_registers;
-    return registers[offset];
+    libspectrum_byte value;
+
+    // Reads synchronise with the worker so that once the guest sees the
+    // command complete, all of its results are visible too. While it is
+    // still running, the guest sees the registers as they were when the
+    // command was issued rather than whatever the handler is part way
+    // through writing
+    pthread_mutex_lock(&xfs_worker_mutex);
+
+    if (!xfs_worker_busy)
+        value = registers[offset];
+    else if (offset == offsetof(struct xfs_registers_t, status))
+        value = XFS_STATUS_BUSY;
+    else
+        value = ((uint8_t*)&xfs_registers_snapshot)[offset];
+
+    pthread_mutex_unlock(&xfs_worker_mutex);
+
+    return value;
 }
 
 void xfs_write( memory_page *page GCC_UNUSED, libspectrum_word address, libspectrum_byte b )
 {
     libspectrum_word offset = address & 0xfff;
     uint8_t *registers = (uint8_t*)&xfs_registers;
+
+    pthread_mutex_lock(&xfs_worker_mutex);
+
+    if (xfs_worker_busy)
+    {
+        // The worker owns the register page until it has finished; drop
+        // the write rather than corrupt the arguments it is working from
+        pthread_mutex_unlock(&xfs_worker_mutex);
+        XFS_DEBUG("xfs: write to 0x%03x ignored while busy\n", offset);
+        return;
+    }
+
     registers[offset] = b;
-    
+
     if (offset == 0)
     {
-        // Command register written - process command via dispatcher
-        xfs_handle_command(&xfs_registers);
+        // Command register written - hand the command to the worker
+        if (xfs_worker_start())
+        {
+            pthread_mutex_unlock(&xfs_worker_mutex);
+            xfs_worker_lock_mounts();
+            xfs_handle_command((struct xfs_registers_t*)&xfs_registers);
+            xfs_worker_unlock_mounts();
+            return;
+        }
+
+        xfs_registers.status = XFS_STATUS_BUSY;
+        memcpy(&xfs_registers_snapshot, (struct xfs_registers_t*)&xfs_registers,
+               sizeof(xfs_registers_snapshot));
+        xfs_worker_busy = true;
+        pthread_cond_broadcast(&xfs_worker_cond);
     }
+
+    pthread_mutex_unlock(&xfs_worker_mutex);
 }
@@ -13,6 +13,28 @@ extern char xfs_base_path[];
 
 void xfs_init();
 
+// Command service time histogram buckets: <100us, <1ms, <10ms, <100ms, <1s
+// and anything slower
+#define XFS_LATENCY_BUCKETS (6)
+
+struct xfs_worker_stats_t
+{
+    uint32_t histogram[XFS_LATENCY_BUCKETS];
+    uint32_t commands;
+    uint32_t max_us;
+};
+
+// Worker thread which executes XFS commands off the emulation thread
+void xfs_worker_init(void);
+void xfs_worker_end(void);
+void xfs_worker_wait_idle(void);
+
+// Serialise use of the mounts with the worker from other threads
+void xfs_worker_lock_mounts(void);
+void xfs_worker_unlock_mounts(void);
+void xfs_worker_get_stats(struct xfs_worker_stats_t* stats);
+void xfs_worker_reset_stats(void);
+
 // Fuse-specific memory access functions
 libspectrum_byte xfs_read( memory_page *page GCC_UNUSED, libspectrum_word address );
 void xfs_write( memory_page *page GCC_UNUSED, libspectrum_word address, libspectrum_byte b );
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -19,6 +20,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <sys/select.h>
 #endif
 
 #include "libspectrum.h"
@@ -26,12 +28,155 @@
 #include "../security/tls.h"
 #include "../nic/dns_resolver.h"
 
+// Idle keep-alive connections kept across requests
+#define HTTP_POOL_SIZE 4
+// Seconds an idle connection is kept before it is closed
+#define HTTP_POOL_IDLE_TIMEOUT 30.0
+// Hosts whose TLS sessions are remembered for resumption
+#define HTTP_SESSION_CACHE_SIZE 4
+
+#define HTTP_HOST_MAX 256
+
 // Socket structure for httpc
 typedef struct {
     compat_socket_t fd;
     tls_socket_t *tls;
+    char domain[HTTP_HOST_MAX];
+    unsigned short port;
+    double idle_since;
 } fuse_http_socket_t;
 
+struct http_session_entry_t
+{
+    char domain[HTTP_HOST_MAX];
+    unsigned short port;
+    mbedtls_ssl_session session;
+    double stamp;
+    int valid;
+};
+
+// Connections released by httpc after a complete keep-alive response;
+// sck_http_open() hands them out again for the same host, port and scheme
+static fuse_http_socket_t* http_pool[HTTP_POOL_SIZE];
+static struct http_session_entry_t http_sessions[HTTP_SESSION_CACHE_SIZE];
+static struct http_sck_stats_t http_stats;
+static pthread_mutex_t http_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void sck_http_destroy(fuse_http_socket_t *sock)
+{
+    if (sock->tls)
+    {
+        tls_close(sock->tls);
+        tls_socket_free(sock->tls);
+        sock->tls = NULL;
+    }
+
+    if (sock->fd != compat_socket_invalid)
+    {
+        compat_socket_close(sock->fd);
+        sock->fd = compat_socket_invalid;
+    }
+
+    libspectrum_free(sock);
+}
+
+// An idle connection is only usable if the server has neither closed it
+// nor sent anything unsolicited; either makes the socket readable
+static int sck_http_is_alive(const fuse_http_socket_t *sock)
+{
+    fd_set readfds;
+    struct timeval timeout = { 0, 0 };
+
+    FD_ZERO(&readfds);
+    FD_SET(sock->fd, &readfds);
+
+    return select(sock->fd + 1, &readfds, NULL, NULL, &timeout) == 0;
+}
+
+// Take a matching idle connection out of the pool, closing expired ones
+static fuse_http_socket_t* sck_http_pool_take(const char *domain, const unsigned short port, const int use_ssl)
+{
+    fuse_http_socket_t *found = NULL;
+    fuse_http_socket_t *expired[HTTP_POOL_SIZE];
+    int expired_count = 0;
+    const double now = compat_timer_get_time();
+
+    pthread_mutex_lock(&http_pool_mutex);
+    for (int i = 0; i < HTTP_POOL_SIZE; i++)
+    {
+        fuse_http_socket_t *sock = http_pool[i];
+        if (!sock)
+            continue;
+
+        if (now - sock->idle_since > HTTP_POOL_IDLE_TIMEOUT)
+        {
+            expired[expired_count++] = sock;
+            http_pool[i] = NULL;
+        }
+        else if (!found && sock->port == port && !sock->tls == !use_ssl &&
+                 strcmp(sock->domain, domain) == 0)
+        {
+            found = sock;
+            http_pool[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&http_pool_mutex);
+
+    for (int i = 0; i < expired_count; i++)
+        sck_http_destroy(expired[i]);
+
+    return found;
+}
+
+static struct http_session_entry_t* sck_http_session_find(const char *domain, const unsigned short port)
+{
+    for (int i = 0; i < HTTP_SESSION_CACHE_SIZE; i++)
+    {
+        if (http_sessions[i].valid && http_sessions[i].port == port &&
+            strcmp(http_sessions[i].domain, domain) == 0)
+            return &http_sessions[i];
+    }
+
+    return NULL;
+}
+
+// Offer the last session negotiated with this host, if any
+static void sck_http_session_offer(tls_socket_t *tls, const char *domain, const unsigned short port)
+{
+    pthread_mutex_lock(&http_pool_mutex);
+    const struct http_session_entry_t *entry = sck_http_session_find(domain, port);
+    if (entry)
+        tls_set_session(tls, &entry->session);
+    pthread_mutex_unlock(&http_pool_mutex);
+}
+
+// Remember the session of a fresh handshake, replacing the oldest host's
+static void sck_http_session_save(tls_socket_t *tls, const char *domain, const unsigned short port)
+{
+    pthread_mutex_lock(&http_pool_mutex);
+    struct http_session_entry_t *entry = sck_http_session_find(domain, port);
+    if (!entry)
+    {
+        entry = &http_sessions[0];
+        for (int i = 1; i < HTTP_SESSION_CACHE_SIZE && entry->valid; i++)
+        {
+            if (!http_sessions[i].valid || http_sessions[i].stamp < entry->stamp)
+                entry = &http_sessions[i];
+        }
+    }
+
+    if (entry->valid)
+        mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+    entry->valid = tls_get_session(tls, &entry->session) == 0;
+    snprintf(entry->domain, sizeof(entry->domain), "%s", domain);
+    entry->port = port;
+    entry->stamp = compat_timer_get_time();
+    if (!entry->valid)
+        mbedtls_ssl_session_free(&entry->session);
+    pthread_mutex_unlock(&http_pool_mutex);
+}
+
 void* malloc_allocator(void *arena, void *ptr, size_t oldsz, size_t newsz)
 {
     (void)arena;
@@ -56,7 +201,21 @@ int sck_http_open(httpc_options_t *os, void **socket_out, void *opts, const char
 {
     (void)os;
     (void)opts;
-    
+
+    fuse_http_socket_t *pooled;
+    while ((pooled = sck_http_pool_take(domain, port, use_ssl)) != NULL)
+    {
+        if (sck_http_is_alive(pooled))
+        {
+            pthread_mutex_lock(&http_pool_mutex);
+            http_stats.reused++;
+            pthread_mutex_unlock(&http_pool_mutex);
+            *socket_out = pooled;
+            return HTTPC_OK;
+        }
+        sck_http_destroy(pooled);
+    }
+
     struct addrinfo hints;
     struct addrinfo *result = NULL;
     int ret;
@@ -116,6 +275,8 @@ int sck_http_open(httpc_options_t *os, void **socket_out, void *opts, const char
             return HTTPC_ERROR;
         }
 
+        sck_http_session_offer(tls, domain, port);
+
         // Perform TLS handshake
         ret = tls_connect(tls);
         if (ret != 0)
@@ -125,7 +286,20 @@ int sck_http_open(httpc_options_t *os, void **socket_out, void *opts, const char
             compat_socket_close(fd);
             return HTTPC_ERROR;
         }
+
+        if (!tls->resumed)
+            sck_http_session_save(tls, domain, port);
+    }
+
+    pthread_mutex_lock(&http_pool_mutex);
+    http_stats.connects++;
+    if (tls)
+    {
+        http_stats.handshakes++;
+        if (tls->resumed)
+            http_stats.resumed++;
     }
+    pthread_mutex_unlock(&http_pool_mutex);
 
     // Allocate socket structure
     sock = libspectrum_malloc(sizeof(fuse_http_socket_t));
@@ -139,6 +313,9 @@ int sck_http_open(httpc_options_t *os, void **socket_out, void *opts, const char
 
     sock->fd = fd;
     sock->tls = tls;
+    snprintf(sock->domain, sizeof(sock->domain), "%s", domain);
+    sock->port = port;
+    sock->idle_since = 0;
     *socket_out = sock;
 
     return HTTPC_OK;
@@ -148,25 +325,48 @@ int sck_http_close(httpc_options_t *os, void *socket)
 {
     (void)os;
     
+    if (!socket)
+        return HTTPC_OK;
+
+    sck_http_destroy((fuse_http_socket_t*)socket);
+    return HTTPC_OK;
+}
+
+// Called by httpc instead of close when the response has been read in full
+// and the server agreed to keep the connection open
+int sck_http_release(httpc_options_t *os, void *socket)
+{
+    (void)os;
+
     if (!socket)
         return HTTPC_OK;
 
     fuse_http_socket_t *sock = (fuse_http_socket_t*)socket;
+    fuse_http_socket_t *victim = NULL;
+    int slot = -1;
 
-    if (sock->tls)
-    {
-        tls_close(sock->tls);
-        tls_socket_free(sock->tls);
-        sock->tls = NULL;
-    }
+    sock->idle_since = compat_timer_get_time();
 
-    if (sock->fd != compat_socket_invalid)
+    pthread_mutex_lock(&http_pool_mutex);
+    for (int i = 0; i < HTTP_POOL_SIZE; i++)
     {
-        compat_socket_close(sock->fd);
-        sock->fd = compat_socket_invalid;
+        if (!http_pool[i])
+        {
+            slot = i;
+            break;
+        }
+        if (slot < 0 || http_pool[i]->idle_since < http_pool[slot]->idle_since)
+            slot = i;
     }
+    victim = http_pool[slot];
+    http_pool[slot] = sock;
+    http_stats.released++;
+    pthread_mutex_unlock(&http_pool_mutex);
+
+    // Pool full: the longest idle connection makes way
+    if (victim)
+        sck_http_destroy(victim);
 
-    libspectrum_free(sock);
     return HTTPC_OK;
 }
 
@@ -262,9 +462,7 @@ int sck_http_time(httpc_options_t *os, unsigned long *millisecond)
     (void)os;
     if (millisecond)
     {
-        // Simple time implementation - just return 0 for now
-        // Could use compat_timer_get_time() if needed
-        *millisecond = 0;
+        *millisecond = (unsigned long)(compat_timer_get_time() * 1000.0);
     }
     return HTTPC_OK;
 }
@@ -280,10 +478,49 @@ httpc_options_t tls_sck = {
     .allocator = malloc_allocator,
     .open = sck_http_open,
     .close = sck_http_close,
+    .release = sck_http_release,
     .read = sck_http_read,
     .write = sck_http_write,
     .sleep = sck_http_sleep,
     .time = sck_http_time,
     .logger = sck_http_logger,
-    .flags = HTTPC_OPT_LOGGING_ON
+    .flags = HTTPC_OPT_LOGGING_ON | HTTPC_OPT_KEEP_ALIVE
 };
+
+void http_sck_get_stats(struct http_sck_stats_t *stats)
+{
+    pthread_mutex_lock(&http_pool_mutex);
+    *stats = http_stats;
+    pthread_mutex_unlock(&http_pool_mutex);
+}
+
+void http_sck_reset_stats(void)
+{
+    pthread_mutex_lock(&http_pool_mutex);
+    memset(&http_stats, 0, sizeof(http_stats));
+    pthread_mutex_unlock(&http_pool_mutex);
+}
+
+void http_sck_end(void)
+{
+    fuse_http_socket_t *idle[HTTP_POOL_SIZE];
+
+    pthread_mutex_lock(&http_pool_mutex);
+    memcpy(idle, http_pool, sizeof(idle));
+    memset(http_pool, 0, sizeof(http_pool));
+    for (int i = 0; i < HTTP_SESSION_CACHE_SIZE; i++)
+    {
+        if (http_sessions[i].valid)
+        {
+            mbedtls_ssl_session_free(&http_sessions[i].session);
+            http_sessions[i].valid = 0;
+        }
+    }
+    pthread_mutex_unlock(&http_pool_mutex);
+
+    for (int i = 0; i < HTTP_POOL_SIZE; i++)
+    {
+        if (idle[i])
+            sck_http_destroy(idle[i]);
+    }
+}
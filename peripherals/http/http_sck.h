@@ -3,3 +3,20 @@
 #include "httpc.h"
 
 extern httpc_options_t tls_sck;
+
+// Connection pool counters, for measuring how often connections and TLS
+// sessions are reused
+struct http_sck_stats_t
+{
+    unsigned long connects;    // New TCP connections
+    unsigned long handshakes;  // TLS handshakes, full or resumed
+    unsigned long resumed;     // TLS handshakes that resumed an earlier session
+    unsigned long reused;      // Requests served on a pooled keep-alive connection
+    unsigned long released;    // Connections returned to the pool
+};
+
+void http_sck_get_stats(struct http_sck_stats_t *stats);
+void http_sck_reset_stats(void);
+
+// Close pooled connections and forget saved TLS sessions
+void http_sck_end(void);
@@ -92,7 +92,9 @@ struct httpc {
 	void *socket; /* socket used to talk to the server (might actually be an SSL/TLS handle). */
 	httpc_length_t position, /* file position */
 			length,  /* length of file, if known */
-			max;     /* maximum read in */
+			max,     /* maximum read in */
+			range_from, /* first byte requested by a ranged GET */
+			range_to;   /* last byte requested by a ranged GET */
 	int state,  /* HTTPC contains a state-machine, the state of which is encoded here. */
 	    status; /* HTTP return code status */
 	unsigned long start_ms, /* Start time of operation */
@@ -111,7 +113,9 @@ struct httpc {
 		 length_set    :1, /* has length been set on a PUT/POST? */
 		 open          :1, /* is the file handle open? */
 		 keep_alive    :1, /* does the server support keep-alive? */
-		 progress      :1; /* are we making progress? */
+		 progress      :1, /* are we making progress? */
+		 ranged        :1, /* if set then only request 'range_from' to 'range_to' */
+		 reusable      :1; /* response fully consumed on a keep-alive connection, may be released */
 };
 
 static inline void httpc_reverse_string(char * const r, const size_t length) {
@@ -161,6 +165,11 @@ static int httpc_is_reuse(httpc_t *h) {
 	return !!(h->os->flags & HTTPC_OPT_REUSE);
 }
 
+static int httpc_is_keep_alive(httpc_t *h) {
+	assert(h);
+	return !!(h->os->flags & HTTPC_OPT_KEEP_ALIVE) && h->os->release;
+}
+
 #ifdef __GNUC__
 static int httpc_log_fmt(httpc_t *h, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
 static int httpc_log_line(httpc_t *h, const char *type, int die, int ret, const unsigned line, const char *fmt, ...) __attribute__ ((format (printf, 6, 7)));
@@ -610,7 +619,22 @@ static int httpc_request_send_header(httpc_t *h, httpc_buffer_t *b0, int op) {
 		goto fail;
 	if (httpc_buffer_add_string(h, b0, "\r\n") < 0)
 		goto fail;
-	if (op == HTTPC_GET && !(h->os->flags & HTTPC_OPT_HTTP_1_0) && h->position && h->accept_ranges) {
+	if (op == HTTPC_GET && h->ranged) { /* resumes from 'position' within the range on retry */
+		char range[64 + 1] = { 0, };
+		if (httpc_buffer_add_string(h, b0, "Range: bytes=") < 0)
+			goto fail;
+		httpc_num_to_str(range, h->range_from + h->position, 10);
+		if (httpc_buffer_add_string(h, b0, range) < 0)
+			goto fail;
+		if (httpc_buffer_add_string(h, b0, "-") < 0)
+			goto fail;
+		memset(range, 0, sizeof range);
+		httpc_num_to_str(range, h->range_to, 10);
+		if (httpc_buffer_add_string(h, b0, range) < 0)
+			goto fail;
+		if (httpc_buffer_add_string(h, b0, "\r\n") < 0)
+			goto fail;
+	} else if (op == HTTPC_GET && !(h->os->flags & HTTPC_OPT_HTTP_1_0) && h->position && h->accept_ranges) {
 		char range[64 + 1] = { 0, };
 		if (httpc_buffer_add_string(h, b0, "Range: bytes=") < 0)
 			goto fail;
@@ -638,7 +662,7 @@ static int httpc_request_send_header(httpc_t *h, httpc_buffer_t *b0, int op) {
 		}
 	}
 
-	if (httpc_is_reuse(h)) {
+	if (httpc_is_reuse(h) || httpc_is_keep_alive(h)) {
 		if (httpc_buffer_add_string(h, b0, "Connection: keep-alive\r\n") < 0)
 			goto fail;
 	} else {
@@ -706,6 +730,20 @@ static int httpc_backoff(httpc_t *h) {
 	return h->os->sleep(h->os, limited);
 }
 
+static void httpc_copy_field_value(char *dst, const size_t size, const char *value) { /* trims whitespace, truncates */
+	assert(dst);
+	assert(value);
+	assert(size > 0);
+	while (C_isspace(*value))
+		value++;
+	size_t l = strlen(value);
+	while (l && C_isspace(value[l - 1]))
+		l--;
+	l = MIN(l, size - 1);
+	memcpy(dst, value, l);
+	dst[l] = '\0';
+}
+
 /* N.B. We could add in a callback to handle unknown fields, however we would
  * need to add infrastructure so an external user could meaningfully interact
  * with the library internals, which would be too invasive. */
@@ -721,8 +759,11 @@ static int httpc_parse_response_field(httpc_t *h, char *line, size_t length) {
 #define X_MACRO_FIELDS \
 	X("Transfer-Encoding:", FLD_TRANSFER_ENCODING) \
 	X("Content-Length:",    FLD_CONTENT_LENGTH)\
+	X("Content-Range:",     FLD_CONTENT_RANGE)\
 	X("Accept-Ranges:",     FLD_ACCEPT_RANGES)\
 	X("Connection:",        FLD_CONNECTION)\
+	X("ETag:",              FLD_ETAG)\
+	X("Last-Modified:",     FLD_LAST_MODIFIED)\
 	X("Location:",          FLD_REDIRECT)
 
 	enum {
@@ -788,6 +829,19 @@ static int httpc_parse_response_field(httpc_t *h, char *line, size_t length) {
 				return error(h, "invalid content length: %s", line);
 			h->length_set = 1;
 			return info(h, "Content Length: %lu", (unsigned long)h->length);
+		case FLD_ETAG:
+			httpc_copy_field_value(h->os->etag, sizeof (h->os->etag), &line[fld->length]);
+			return info(h, "ETag: %s", h->os->etag);
+		case FLD_LAST_MODIFIED:
+			httpc_copy_field_value(h->os->last_modified, sizeof (h->os->last_modified), &line[fld->length]);
+			return info(h, "Last-Modified: %s", h->os->last_modified);
+		case FLD_CONTENT_RANGE: { /* "bytes first-last/total", total may be "*" */
+			const char *total = strchr(&line[fld->length], '/');
+			httpc_length_t t = 0;
+			if (total && httpc_scan_number(total + 1, &t, 10) == 0)
+				h->os->range_total = t;
+			return info(h, "Content Range: %s", &line[fld->length]);
+		}
 		case FLD_REDIRECT:
 			if (h->os->response >= 300 && h->os->response < 399) {
 				if (h->redirects++ > h->redirects_max)
@@ -875,6 +929,7 @@ static int httpc_parse_response_header_start_line(httpc_t *h, char *line, const
 	if (!httpc_case_insensitive_compare(line, v1_0, sizeof (v1_0) - 1)) {
 		h->v1 = 1;
 		h->v2 = 0;
+		h->keep_alive = 0; /* HTTP/1.0 only keeps alive if the server says so */
 		i += sizeof (v1_0) - 1;
 	} else if (!httpc_case_insensitive_compare(line, v1_1, sizeof (v1_1) - 1)) {
 		h->v1 = 1;
@@ -941,6 +996,9 @@ static int httpc_parse_response_header(httpc_t *h, httpc_buffer_t *b0) {
 	h->v1 = 0;
 	h->v2 = 0;
 	os->response = 0;
+	os->range_total = 0;
+	os->etag[0] = '\0';
+	os->last_modified[0] = '\0';
 	h->length = 0;
 	h->identity = 1;
 	h->length_set = 0;
@@ -1183,8 +1241,9 @@ next_state:
 		next        = SM_OPEN;
 		h->open     = 0;
 		h->progress = 0;
+		h->reusable = 0;
 		os->response = 0;
-		if (os->flags & ~(HTTPC_OPT_LOGGING_ON | HTTPC_OPT_HTTP_1_0 | HTTPC_OPT_NON_BLOCKING | HTTPC_OPT_REUSE)) {
+		if (os->flags & ~(HTTPC_OPT_LOGGING_ON | HTTPC_OPT_HTTP_1_0 | HTTPC_OPT_NON_BLOCKING | HTTPC_OPT_REUSE | HTTPC_OPT_KEEP_ALIVE)) {
 			h->status = fatal(h, "unknown option provided %u", os->flags);
 			next      = SM_DONE;
 		}
@@ -1261,7 +1320,9 @@ next_state:
 	}
 	case SM_RCVB:
 		next = SM_DONE;
-		if (op == HTTPC_GET) {
+		/* A 204 or 304 has no body, whatever the headers say, so do not
+		 * wait for one (a kept-alive connection would never reach EOF) */
+		if (op == HTTPC_GET && os->response != 204 && os->response != 304) {
 			const httpc_length_t pos = h->position;
 			h->progress = 0;
 			const int r = httpc_parse_response_body(h);
@@ -1270,7 +1331,12 @@ next_state:
 				next = SM_BCKO;
 			} else if (r == HTTPC_YIELD) {
 				next = SM_RCVB;
+			} else {
+				/* without a length or chunking the body ended at EOF */
+				h->reusable = h->keep_alive && (h->length_set || !h->identity);
 			}
+		} else if (op == HTTPC_GET || op == HTTPC_HEAD) {
+			h->reusable = h->keep_alive;
 		}
 		break;
 	case SM_REDR:
@@ -1327,7 +1393,11 @@ next_state:
 				h->state = next; /* !! */
 				return HTTPC_REUSE; /* !! */
 			}
-			if (os->close(os, h->socket) == HTTPC_YIELD) {
+			if (httpc_is_keep_alive(h) && !httpc_is_dead(h) && h->status == HTTPC_OK && h->reusable) {
+				(void)os->release(os, h->socket); /* connection now belongs to the pool */
+				h->open   = 0;
+				h->socket = NULL;
+			} else if (os->close(os, h->socket) == HTTPC_YIELD) {
 				/* stay in the same state */
 				break; /* !! */
 			} else { /* do not care about errors -- only yield */
@@ -1381,15 +1451,24 @@ int httpc_end_session(httpc_options_t *a) {
 	return HTTPC_OK; /* We might want to return `httpc_state_machine` value here */
 }
 
-static int httpc_op_stack(httpc_options_t *a, const char *url, int op, httpc_callback rcv, void *rcv_param, httpc_callback snd, void *snd_param) {
+static int httpc_op_stack_range(httpc_options_t *a, const char *url, int op, httpc_callback rcv, void *rcv_param, httpc_callback snd, void *snd_param, const httpc_length_t *range) {
 	if (a->state)
 		return HTTPC_ERROR;
 	httpc_t h = { .os = a, .rcv = rcv, .rcv_param = rcv_param, .snd = snd, .snd_param = snd_param, };
+	if (range) {
+		h.ranged     = 1;
+		h.range_from = range[0];
+		h.range_to   = range[1];
+	}
 	assert(httpc_is_yield_on(&h) == 0);
 	assert(httpc_is_reuse(&h)    == 0);
 	return httpc_state_machine(&h, url, op);
 }
 
+static int httpc_op_stack(httpc_options_t *a, const char *url, int op, httpc_callback rcv, void *rcv_param, httpc_callback snd, void *snd_param) {
+	return httpc_op_stack_range(a, url, op, rcv, rcv_param, snd, snd_param, NULL);
+}
+
 static int httpc_op_heap(httpc_options_t *a, const char *url, int op, httpc_callback rcv, void *rcv_param, httpc_callback snd, void *snd_param) {
 	assert(a);
 	assert(url);
@@ -1428,6 +1507,15 @@ int httpc_get(httpc_options_t *a, const char *url, httpc_callback fn, void *para
 	return httpc_operation(a, url, HTTPC_GET, fn, param, NULL, NULL);
 }
 
+int httpc_get_range(httpc_options_t *a, const char *url, unsigned long from, unsigned long to, httpc_callback fn, void *param) {
+	assert(a);
+	assert(url);
+	if (from > to || (a->flags & (HTTPC_OPT_HTTP_1_0 | HTTPC_OPT_NON_BLOCKING | HTTPC_OPT_REUSE)))
+		return HTTPC_ERROR;
+	const httpc_length_t range[2] = { from, to, };
+	return httpc_op_stack_range(a, url, HTTPC_GET, fn, param, NULL, NULL, range);
+}
+
 int httpc_put(httpc_options_t *a, const char *url, httpc_callback fn, void *param) {
 	assert(a);
 	assert(url);
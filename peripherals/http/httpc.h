@@ -25,6 +25,7 @@ enum {
 	HTTPC_OPT_LOGGING_ON   = 1u << 1, /* turn logging on, if compiled in */
 	HTTPC_OPT_NON_BLOCKING = 1u << 2, /* turn on non-blocking mode, library will return HTTPC_YIELD instead of blocking */
 	HTTPC_OPT_REUSE        = 1u << 3, /* turn on connection reuse */
+	HTTPC_OPT_KEEP_ALIVE   = 1u << 4, /* ask for keep-alive, hand finished connections to 'release' instead of closing them */
 };
 
 typedef int (*httpc_callback)(void *param, unsigned char *buf, size_t length, size_t position, size_t content_length);
@@ -37,6 +38,7 @@ struct httpc_options { /* Note that get/put/etcetera functions can *write* to th
 
 	int (*open)(httpc_options_t *os, void **socket, void *opts, const char *domain, unsigned short port, int use_ssl);
 	int (*close)(httpc_options_t *os, void *socket);
+	int (*release)(httpc_options_t *os, void *socket); /* optional: connection still usable, may be returned by a later 'open' */
 	int (*read)(httpc_options_t *os, void *socket, unsigned char *buf, size_t *length);
 	int (*write)(httpc_options_t *os, void *socket, const unsigned char *buf, size_t *length);
 	int (*sleep)(httpc_options_t *os, unsigned long milliseconds );
@@ -55,6 +57,9 @@ struct httpc_options { /* Note that get/put/etcetera functions can *write* to th
 
 	void *context;    /* For your use, feel free to fill with good thoughts and positive affirmations */
 	int response;     /* HTTP response code; set after the header is retrieved. */
+	unsigned long range_total; /* total resource length from "Content-Range", 0 if unknown; set after the header is retrieved. */
+	char etag[128];          /* "ETag" validator, empty if absent; set after the header is retrieved. */
+	char last_modified[128]; /* "Last-Modified" validator, empty if absent; set after the header is retrieved. */
 };
 
 
@@ -70,6 +75,7 @@ typedef struct httpc httpc_t;
 
 /* all functions: return negative on failure, zero or positive on success */
 HTTPC_API int httpc_get(httpc_options_t *a, const char *url, httpc_callback fn, void *param);
+HTTPC_API int httpc_get_range(httpc_options_t *a, const char *url, unsigned long from, unsigned long to, httpc_callback fn, void *param); /* GET bytes 'from' to 'to' inclusive; check 'response' for 206 vs 200 */
 HTTPC_API int httpc_put(httpc_options_t *a, const char *url, httpc_callback fn, void *param); /* fn should return size, 0 on stop, -1 on failure */
 HTTPC_API int httpc_post(httpc_options_t *a, const char *url, httpc_callback fn, void *param); /* fn should return size, 0 on stop, -1 on failure */
 HTTPC_API int httpc_get_buffer(httpc_options_t *a, const char *url, char *buffer, size_t *length); /* store GET to buffer */
@@ -172,7 +172,7 @@ void dns_answers_process_udp(const uint8_t *buf, uint16_t len)
             if (!get_u32(buf, len, rdata_off, &ipv4)) return;
 
             const char *host = have_qname ? qname : owner;
-            dns_response_hostname_identified(host, ipv4);
+            dns_response_hostname_identified(host, ipv4, ttl);
         }
 
         off = (uint16_t)(rdata_off + rdlen);
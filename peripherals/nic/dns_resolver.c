@@ -2,6 +2,7 @@
 
 #include "dns_resolver.h"
 
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,6 +12,9 @@
 #include <ws2tcpip.h>
 #else
 #include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 #endif
 
 #ifdef HAVE_LIB_GLIB
@@ -21,6 +25,21 @@
 
 #include "libspectrum.h"
 
+#include "compat.h"
+#include "ui/ui.h"
+
+/* Number of threads running getaddrinfo() for dns_lookup() */
+#define DNS_RESOLVER_THREADS 2
+
+/* getaddrinfo() doesn't tell us the TTL of its answers, so they're cached
+   for fixed times, in seconds: shorter for failures which may be transient */
+#define DNS_POSITIVE_TTL 300
+#define DNS_NEGATIVE_TTL 30
+#define DNS_FAILURE_TTL 5
+
+/* Expired answers are purged once the forward cache grows beyond this */
+#define DNS_FORWARD_CACHE_MAX 256
+
 /* Debug logging function for DNS resolver */
 static void
 dns_resolver_debug( const char *format, ... )
@@ -36,6 +55,28 @@ dns_resolver_debug( const char *format, ... )
 /* Hash table mapping IP address (uint32_t) to hostname (char*) */
 static GHashTable *dns_reverse_cache = NULL;
 
+/* A forward cache entry */
+typedef struct dns_forward_entry {
+  dns_lookup_result_t result;
+  uint32_t ipv4;                /* Network byte order */
+  double expires;               /* compat_timer_get_time() */
+} dns_forward_entry;
+
+/* Hash table mapping hostname (char*) to dns_forward_entry* */
+static GHashTable *dns_forward_cache = NULL;
+
+/* Hostnames (char*) waiting for a resolver thread */
+static GSList *dns_queue = NULL;
+
+/* Protects both caches and the queue: the reverse cache is updated from
+   the W5100 I/O thread and the resolver threads as well as the emulation */
+static pthread_mutex_t dns_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dns_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t dns_threads[ DNS_RESOLVER_THREADS ];
+static int dns_threads_running = 0;
+static int dns_threads_stop = 0;
+
 /* Hash function for uint32_t IP addresses */
 static guint
 dns_ip_hash( gconstpointer v )
@@ -53,27 +94,77 @@ dns_ip_equal( gconstpointer v1, gconstpointer v2 )
   return ip1 == ip2 ? 1 : 0;
 }
 
-void
-dns_resolver_init()
+static void
+dns_caches_init( void )
 {
   if( !dns_reverse_cache ) {
     dns_reverse_cache = g_hash_table_new_full( dns_ip_hash, dns_ip_equal,
                                                 libspectrum_free, libspectrum_free );
   }
+  if( !dns_forward_cache ) {
+    dns_forward_cache = g_hash_table_new_full( g_str_hash, g_str_equal,
+                                               libspectrum_free, libspectrum_free );
+  }
 }
 
 void
-dns_response_hostname_identified( const char *hostname, uint32_t ipv4 )
+dns_resolver_init()
+{
+  pthread_mutex_lock( &dns_mutex );
+  dns_caches_init();
+  pthread_mutex_unlock( &dns_mutex );
+}
+
+static gboolean
+dns_forward_expired( gpointer key, gpointer value, gpointer user_data )
+{
+  const dns_forward_entry *entry = value;
+  double now = *(const double*)user_data;
+
+  return entry->result != DNS_LOOKUP_PENDING && now >= entry->expires;
+}
+
+/* Record the answer for hostname in the forward cache. Must be called with
+   dns_mutex held */
+static void
+dns_forward_store( const char *hostname, dns_lookup_result_t result,
+                   uint32_t ipv4, uint32_t ttl )
+{
+  dns_forward_entry *entry;
+  double now = compat_timer_get_time();
+
+  entry = g_hash_table_lookup( dns_forward_cache, hostname );
+  if( !entry ) {
+    char *key;
+
+    if( g_hash_table_size( dns_forward_cache ) >= DNS_FORWARD_CACHE_MAX )
+      g_hash_table_foreach_remove( dns_forward_cache, dns_forward_expired,
+                                   &now );
+
+    key = libspectrum_new( char, strlen( hostname ) + 1 );
+    strcpy( key, hostname );
+    entry = libspectrum_new( dns_forward_entry, 1 );
+    g_hash_table_insert( dns_forward_cache, key, entry );
+  }
+
+  entry->result = result;
+  entry->ipv4 = ipv4;
+  entry->expires = now + ttl;
+}
+
+/* Record hostname against ipv4 (host byte order) in the reverse cache. Must
+   be called with dns_mutex held */
+static void
+dns_reverse_store( const char *hostname, uint32_t ipv4 )
 {
   uint32_t *key;
   char *hostname_copy;
-  
-  if( !hostname || !*hostname )
+  const char *current = g_hash_table_lookup( dns_reverse_cache, &ipv4 );
+
+  /* Leave an unchanged mapping alone */
+  if( current && !strcmp( current, hostname ) )
     return;
   
-  if( !dns_reverse_cache )
-    dns_resolver_init();
-  
   /* Allocate key (IP address) - will be freed by g_hash_table_insert if entry exists */
   key = libspectrum_malloc( sizeof( uint32_t ) );
   if( !key )
@@ -111,18 +202,47 @@ dns_response_hostname_identified( const char *hostname, uint32_t ipv4 )
   }
 }
 
-const char*
+void
+dns_response_hostname_identified( const char *hostname, uint32_t ipv4,
+                                  uint32_t ttl )
+{
+  if( !hostname || !*hostname )
+    return;
+
+  pthread_mutex_lock( &dns_mutex );
+
+  dns_caches_init();
+  dns_reverse_store( hostname, ipv4 );
+
+  /* The guest's own queries carry real TTLs, so let them answer later
+     lookups of the same name too */
+  dns_forward_store( hostname, DNS_LOOKUP_FOUND, htonl( ipv4 ), ttl );
+
+  pthread_mutex_unlock( &dns_mutex );
+}
+
+char*
 dns_resolve_hostname( uint32_t ipv4 )
 {
   uint32_t key = ipv4;
-  const char *hostname;
+  const char *cached;
+  char *hostname = NULL;
   struct in_addr addr;
   
   if( !dns_reverse_cache )
     return NULL;
   
   addr.s_addr = htonl( ipv4 );
-  hostname = (const char*)g_hash_table_lookup( dns_reverse_cache, &key );
+
+  /* Copy the name while we hold the lock, as the resolver threads may
+     replace the cache entry as soon as we let go of it */
+  pthread_mutex_lock( &dns_mutex );
+  cached = (const char*)g_hash_table_lookup( dns_reverse_cache, &key );
+  if( cached ) {
+    hostname = libspectrum_new( char, strlen( cached ) + 1 );
+    strcpy( hostname, cached );
+  }
+  pthread_mutex_unlock( &dns_mutex );
   
   if( hostname ) {
     dns_resolver_debug( "dns: cache hit: %s -> %s\n", inet_ntoa( addr ), hostname );
@@ -132,3 +252,173 @@ dns_resolve_hostname( uint32_t ipv4 )
   
   return hostname;
 }
+
+/* Resolve hostname, returning the answer and how long to keep it */
+static dns_lookup_result_t
+dns_resolve( const char *hostname, uint32_t *ipv4, uint32_t *ttl )
+{
+  struct addrinfo hints, *res = NULL, *rp;
+  int error;
+
+  memset( &hints, 0, sizeof( hints ) );
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  error = getaddrinfo( hostname, NULL, &hints, &res );
+  if( error ) {
+    dns_resolver_debug( "dns: lookup of %s failed: %s\n", hostname,
+                        gai_strerror( error ) );
+    *ttl = error == EAI_NONAME ? DNS_NEGATIVE_TTL : DNS_FAILURE_TTL;
+    return DNS_LOOKUP_NOT_FOUND;
+  }
+
+  for( rp = res; rp; rp = rp->ai_next ) {
+    if( rp->ai_family == AF_INET && rp->ai_addr ) {
+      *ipv4 = ( (const struct sockaddr_in*)rp->ai_addr )->sin_addr.s_addr;
+      *ttl = DNS_POSITIVE_TTL;
+      freeaddrinfo( res );
+      return DNS_LOOKUP_FOUND;
+    }
+  }
+
+  freeaddrinfo( res );
+  *ttl = DNS_NEGATIVE_TTL;
+  return DNS_LOOKUP_NOT_FOUND;
+}
+
+static void*
+dns_resolver_thread( void *arg )
+{
+  pthread_mutex_lock( &dns_mutex );
+
+  while( 1 ) {
+    char *hostname;
+    dns_lookup_result_t result;
+    uint32_t ipv4 = 0, ttl;
+
+    while( !dns_queue && !dns_threads_stop )
+      pthread_cond_wait( &dns_cond, &dns_mutex );
+
+    if( dns_threads_stop ) break;
+
+    hostname = dns_queue->data;
+    dns_queue = g_slist_delete_link( dns_queue, dns_queue );
+
+    pthread_mutex_unlock( &dns_mutex );
+    result = dns_resolve( hostname, &ipv4, &ttl );
+    pthread_mutex_lock( &dns_mutex );
+
+    dns_forward_store( hostname, result, ipv4, ttl );
+    if( result == DNS_LOOKUP_FOUND )
+      dns_reverse_store( hostname, ntohl( ipv4 ) );
+
+    libspectrum_free( hostname );
+  }
+
+  pthread_mutex_unlock( &dns_mutex );
+
+  return NULL;
+}
+
+/* Start the resolver threads. Must be called with dns_mutex held */
+static int
+dns_resolver_start( void )
+{
+  int i, error;
+
+  if( dns_threads_running ) return 0;
+
+  dns_threads_stop = 0;
+
+  for( i = 0; i < DNS_RESOLVER_THREADS; i++ ) {
+    error = pthread_create( &dns_threads[i], NULL, dns_resolver_thread, NULL );
+    if( error ) {
+      ui_error( UI_ERROR_ERROR, "dns: error %d creating resolver thread",
+                error );
+      break;
+    }
+    dns_threads_running++;
+  }
+
+  return dns_threads_running == 0;
+}
+
+dns_lookup_result_t
+dns_lookup( const char *hostname, uint32_t *ipv4 )
+{
+  dns_forward_entry *entry;
+  dns_lookup_result_t result;
+
+  pthread_mutex_lock( &dns_mutex );
+
+  dns_caches_init();
+
+  entry = g_hash_table_lookup( dns_forward_cache, hostname );
+
+  if( entry && ( entry->result == DNS_LOOKUP_PENDING ||
+                 compat_timer_get_time() < entry->expires ) ) {
+    result = entry->result;
+    *ipv4 = entry->ipv4;
+  }
+  else if( dns_resolver_start() ) {
+    /* No threads to do the work, so do it ourselves */
+    uint32_t ttl;
+
+    pthread_mutex_unlock( &dns_mutex );
+    result = dns_resolve( hostname, ipv4, &ttl );
+    pthread_mutex_lock( &dns_mutex );
+
+    dns_forward_store( hostname, result, *ipv4, ttl );
+    if( result == DNS_LOOKUP_FOUND )
+      dns_reverse_store( hostname, ntohl( *ipv4 ) );
+  }
+  else {
+    char *queued = libspectrum_new( char, strlen( hostname ) + 1 );
+
+    strcpy( queued, hostname );
+    dns_queue = g_slist_append( dns_queue, queued );
+    dns_forward_store( hostname, DNS_LOOKUP_PENDING, 0, 0 );
+    pthread_cond_signal( &dns_cond );
+
+    result = DNS_LOOKUP_PENDING;
+  }
+
+  pthread_mutex_unlock( &dns_mutex );
+
+  return result;
+}
+
+static void
+dns_free_queued( gpointer data, gpointer user_data )
+{
+  libspectrum_free( data );
+}
+
+void
+dns_resolver_end()
+{
+  int i;
+
+  pthread_mutex_lock( &dns_mutex );
+  dns_threads_stop = 1;
+  pthread_cond_broadcast( &dns_cond );
+  pthread_mutex_unlock( &dns_mutex );
+
+  /* Lookups in progress aren't cancellable, so this waits for them */
+  for( i = 0; i < dns_threads_running; i++ )
+    pthread_join( dns_threads[i], NULL );
+  dns_threads_running = 0;
+
+  g_slist_foreach( dns_queue, dns_free_queued, NULL );
+  g_slist_free( dns_queue );
+  dns_queue = NULL;
+
+  if( dns_forward_cache ) {
+    g_hash_table_destroy( dns_forward_cache );
+    dns_forward_cache = NULL;
+  }
+  if( dns_reverse_cache ) {
+    g_hash_table_destroy( dns_reverse_cache );
+    dns_reverse_cache = NULL;
+  }
+}
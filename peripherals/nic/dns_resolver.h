@@ -4,13 +4,26 @@
 
 #define DNS_DEBUG (1)
 
-// register a hostname to IP. Called by dns_resolve internally or by dns_answers_process
-extern void dns_response_hostname_identified(const char *hostname, uint32_t ipv4);
+// register a hostname to IP, valid for ttl seconds. Called by dns_lookup internally or by dns_answers_process
+extern void dns_response_hostname_identified(const char *hostname, uint32_t ipv4, uint32_t ttl);
 
 // every DNS response requested by clients shall be processed
 extern void dns_answers_process_udp(const uint8_t *buf, uint16_t len);
 
-// lookup hostname by IP
-const char* dns_resolve_hostname(uint32_t ipv4);
+// lookup hostname by IP; the caller must free the result with libspectrum_free
+char* dns_resolve_hostname(uint32_t ipv4);
+
+typedef enum dns_lookup_result_t
+{
+    DNS_LOOKUP_PENDING,
+    DNS_LOOKUP_FOUND,
+    DNS_LOOKUP_NOT_FOUND,
+} dns_lookup_result_t;
+
+// lookup IP (network byte order) by hostname without blocking. If the answer isn't
+// cached, a resolver thread is set to work on it and DNS_LOOKUP_PENDING returned;
+// call again until the answer arrives. Answers, good and bad, are cached until they expire
+dns_lookup_result_t dns_lookup(const char *hostname, uint32_t *ipv4);
 
 extern void dns_resolver_init();
+extern void dns_resolver_end();
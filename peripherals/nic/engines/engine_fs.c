@@ -112,19 +112,39 @@ int engine_fs_write_le_string(struct xfs_engine_mount_t *mnt, struct xfs_handle_
     return 0;
 }
 
+int engine_fs_read(struct xfs_engine_mount_t *mnt, struct xfs_handle_t *h, void *buf, size_t len)
+{
+    if (!mnt || !mnt->engine || !h || !buf)
+        return -1;
+
+    // Engine reads return int16_t, so keep each one well inside that
+    if (len > ENGINE_FS_READ_CHUNK)
+        len = ENGINE_FS_READ_CHUNK;
+
+    const int16_t n = mnt->engine->read(mnt, h, buf, (uint16_t)len);
+    return n < 0 ? -1 : n;
+}
+
 int engine_fs_read_entire(struct xfs_engine_mount_t *mnt, struct xfs_handle_t *h, uint8_t **out, size_t *out_len)
 {
     if (!mnt || !mnt->engine || !h || !out || !out_len)
         return -1;
 
     const size_t max_payload = ENGINE_FS_READ_BUF_SIZE - 1u;
-    const int16_t n = mnt->engine->read(mnt, h, engine_fs_read_buf, (uint16_t)(max_payload > 65535u ? 65535u : max_payload));
-    if (n < 0)
-        return -1;
-    if ((size_t)n >= max_payload)
-        return -1;
+    size_t total = 0;
+
+    while (true)
+    {
+        const int n = engine_fs_read(mnt, h, engine_fs_read_buf + total, max_payload - total);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        total += (size_t)n;
+        if (total >= max_payload)
+            return -1;
+    }
 
-    const size_t total = (size_t)n;
     engine_fs_read_buf[total] = '\0';
     *out = engine_fs_read_buf;
     *out_len = total;
@@ -6,6 +6,9 @@
 /** Max read size for engine input files (see engine_fs_read_entire). */
 #define ENGINE_FS_READ_BUF_SIZE (256u * 1024u)
 
+/** Largest single read passed to an XFS engine by engine_fs_read. */
+#define ENGINE_FS_READ_CHUNK (16u * 1024u)
+
 struct xfs_handle_t;
 struct xfs_engine_mount_t;
 
@@ -22,4 +25,7 @@ int engine_fs_ram_open_write(struct xfs_engine_mount_t *ram, struct xfs_handle_t
 
 int engine_fs_write_le_string(struct xfs_engine_mount_t *mnt, struct xfs_handle_t *fh, const char *s);
 
+/** Read up to len bytes; returns the count, 0 at end of file or -1 on error. */
+int engine_fs_read(struct xfs_engine_mount_t *mnt, struct xfs_handle_t *h, void *buf, size_t len);
+
 int engine_fs_read_entire(struct xfs_engine_mount_t *mnt, struct xfs_handle_t *h, uint8_t **out, size_t *out_len);
@@ -2,6 +2,7 @@
 #include "engine_fs.h"
 #include "engine_utf8.h"
 #include "jsonpath/matcher.h"
+#include "jsonpath/stream.h"
 
 #include "../../fs/xfs.h"
 #include "../spectranext.h"
@@ -23,6 +24,25 @@ enum
     JSON_ENGINE_ERR_NON_SCALAR = -5,
 };
 
+static int number_to_string(double d, char *buf, size_t buf_sz)
+{
+    if (!isfinite(d))
+        return -1;
+    if (d >= (double)INT64_MIN && d <= (double)INT64_MAX)
+    {
+        const int64_t iv = (int64_t)d;
+        if ((double)iv == d)
+        {
+            snprintf(buf, buf_sz, "%" PRId64, (int64_t)iv);
+            engine_utf8_fold(buf, buf_sz);
+            return 0;
+        }
+    }
+    snprintf(buf, buf_sz, "%.17g", d);
+    engine_utf8_fold(buf, buf_sz);
+    return 0;
+}
+
 static int scalar_value_to_string(const JSON_Value *v, char *buf, size_t buf_sz)
 {
     switch (json_value_get_type(v))
@@ -31,24 +51,8 @@ static int scalar_value_to_string(const JSON_Value *v, char *buf, size_t buf_sz)
             snprintf(buf, buf_sz, "%s", json_value_get_string(v));
             engine_utf8_fold(buf, buf_sz);
             return 0;
-        case JSONNumber: {
-            const double d = json_value_get_number(v);
-            if (!isfinite(d))
-                return -1;
-            if (d >= (double)INT64_MIN && d <= (double)INT64_MAX)
-            {
-                const int64_t iv = (int64_t)d;
-                if ((double)iv == d)
-                {
-                    snprintf(buf, buf_sz, "%" PRId64, (int64_t)iv);
-                    engine_utf8_fold(buf, buf_sz);
-                    return 0;
-                }
-            }
-            snprintf(buf, buf_sz, "%.17g", d);
-            engine_utf8_fold(buf, buf_sz);
-            return 0;
-        }
+        case JSONNumber:
+            return number_to_string(json_value_get_number(v), buf, buf_sz);
         case JSONBoolean:
             snprintf(buf, buf_sz, "%s", json_value_get_boolean(v) ? "true" : "false");
             engine_utf8_fold(buf, buf_sz);
@@ -101,6 +105,198 @@ static void eval_path_collect(JSON_Value *root, struct jp_opcode *op, struct col
     (void)jp_match(op, root, collect_cb, ctx);
 }
 
+// Streaming evaluation, used when every path can be decided while the input
+// is tokenised: only the results are held in memory, never the document.
+// Results are kept as the strings to be written; a NULL item is a number
+// which can't be written, reported when the output reaches it.
+#define JSON_ENGINE_STREAM_UNSUPPORTED (1)
+
+struct stream_results
+{
+    char **items;
+    size_t count;
+    size_t cap;
+    int non_scalar;
+};
+
+struct stream_ctx
+{
+    struct xfs_engine_mount_t *in_mnt;
+    struct xfs_handle_t *in_h;
+    struct stream_results *results;
+    char val_buf[512u];
+};
+
+static int stream_value_to_string(const struct jp_stream_value *v, char *buf, size_t buf_sz)
+{
+    switch (v->type)
+    {
+        case JP_STREAM_STRING:
+            snprintf(buf, buf_sz, "%s", v->string);
+            engine_utf8_fold(buf, buf_sz);
+            return 0;
+        case JP_STREAM_NUMBER:
+            return number_to_string(v->number, buf, buf_sz);
+        case JP_STREAM_BOOLEAN:
+            snprintf(buf, buf_sz, "%s", v->boolean ? "true" : "false");
+            engine_utf8_fold(buf, buf_sz);
+            return 0;
+        case JP_STREAM_NULL:
+            snprintf(buf, buf_sz, "null");
+            engine_utf8_fold(buf, buf_sz);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static int stream_read(void *priv, char *buf, size_t len)
+{
+    struct stream_ctx *ctx = (struct stream_ctx *)priv;
+    return engine_fs_read(ctx->in_mnt, ctx->in_h, buf, len);
+}
+
+static void stream_cb(int path, const struct jp_stream_value *v, void *priv)
+{
+    struct stream_ctx *ctx = (struct stream_ctx *)priv;
+    struct stream_results *res = &ctx->results[path];
+    char *item = NULL;
+
+    if (v->type == JP_STREAM_CONTAINER)
+        res->non_scalar = 1;
+    if (res->non_scalar)
+        return;
+
+    if (res->count >= res->cap)
+    {
+        const size_t ncap = res->cap ? res->cap * 2u : 16u;
+        char **nitems = (char **)realloc(res->items, ncap * sizeof(char *));
+        if (!nitems)
+            return;
+        res->items = nitems;
+        res->cap = ncap;
+    }
+
+    if (stream_value_to_string(v, ctx->val_buf, sizeof(ctx->val_buf)) == 0)
+    {
+        item = strdup(ctx->val_buf);
+        if (!item)
+            return;
+    }
+    res->items[res->count++] = item;
+}
+
+static int eval_paths_stream(struct xfs_engine_mount_t *in_mnt, struct xfs_handle_t *in_h, const char *output_file,
+                             struct jp_opcode **paths, int npaths)
+{
+    int rc = 0;
+    struct stream_ctx ctx;
+    struct xfs_engine_mount_t ram = {0};
+    struct xfs_handle_t out_h = {};
+    int out_open = 0;
+    char count_buf[32];
+
+    ctx.in_mnt = in_mnt;
+    ctx.in_h = in_h;
+    ctx.results = (struct stream_results *)calloc((size_t)npaths, sizeof(struct stream_results));
+    if (!ctx.results)
+        return JSON_ENGINE_ERR_OPEN;
+
+    const int er = jp_stream_match(paths, npaths, stream_read, &ctx, stream_cb, &ctx);
+    if (er != 0)
+    {
+        SNX_CTRL_DEBUG("snx: json: stream failed err=%d\n", er);
+        rc = er == JP_STREAM_ERR_PARSE ? JSON_ENGINE_ERR_PARSE : JSON_ENGINE_ERR_OPEN;
+        goto cleanup;
+    }
+
+    if (engine_fs_ram_mount(&ram) != 0 || engine_fs_ram_open_write(&ram, &out_h, output_file) != 0)
+    {
+        SNX_CTRL_DEBUG("snx: json: open write failed out='%s'\n", output_file);
+        rc = JSON_ENGINE_ERR_OPEN;
+        goto cleanup;
+    }
+    out_open = 1;
+
+    for (int pi = 0; pi < npaths; pi++)
+    {
+        const struct stream_results *res = &ctx.results[pi];
+
+        SNX_CTRL_DEBUG("snx: json: path[%d] matched=%zu non_scalar=%d\n", pi, res->count, res->non_scalar);
+
+        if (res->non_scalar)
+        {
+            rc = JSON_ENGINE_ERR_NON_SCALAR;
+            goto cleanup;
+        }
+
+        snprintf(count_buf, sizeof(count_buf), "%zu", res->count);
+        if (engine_fs_write_le_string(&ram, &out_h, count_buf) != 0)
+        {
+            rc = JSON_ENGINE_ERR_OPEN;
+            goto cleanup;
+        }
+
+        for (size_t i = 0; i < res->count; i++)
+        {
+            if (!res->items[i])
+            {
+                SNX_CTRL_DEBUG("snx: json: path[%d] item[%zu] stringify failed\n", pi, i);
+                rc = JSON_ENGINE_ERR_NON_SCALAR;
+                goto cleanup;
+            }
+            if (engine_fs_write_le_string(&ram, &out_h, res->items[i]) != 0)
+            {
+                rc = JSON_ENGINE_ERR_OPEN;
+                goto cleanup;
+            }
+        }
+    }
+
+cleanup:
+    if (out_open)
+        engine_fs_close(&ram, &out_h);
+    for (int pi = 0; pi < npaths; pi++)
+    {
+        for (size_t i = 0; i < ctx.results[pi].count; i++)
+            free(ctx.results[pi].items[i]);
+        free(ctx.results[pi].items);
+    }
+    free(ctx.results);
+    return rc;
+}
+
+// Returns JSON_ENGINE_STREAM_UNSUPPORTED, without reading anything, unless
+// every path is valid and streamable; the DOM evaluator then handles the call
+// so that errors are reported exactly as before
+static int engine_json_call_stream(struct xfs_engine_mount_t *in_mnt, struct xfs_handle_t *in_h,
+                                   const char *output_file, int argc, char *argv[])
+{
+    struct jp_state *states[ENGINE_MAX_ARGS] = {0};
+    struct jp_opcode *paths[ENGINE_MAX_ARGS];
+    const int npaths = argc - 1;
+    int supported = npaths < ENGINE_MAX_ARGS;
+    int rc = JSON_ENGINE_STREAM_UNSUPPORTED;
+
+    for (int pi = 0; supported && pi < npaths; pi++)
+    {
+        states[pi] = jp_parse(argv[pi + 1]);
+        supported = states[pi] && states[pi]->error_code == 0 && states[pi]->path &&
+                    jp_stream_supported(states[pi]->path);
+        if (supported)
+            paths[pi] = states[pi]->path;
+    }
+
+    if (supported)
+        rc = eval_paths_stream(in_mnt, in_h, output_file, paths, npaths);
+
+    for (int pi = 0; pi < npaths && pi < ENGINE_MAX_ARGS; pi++)
+        if (states[pi])
+            jp_free(states[pi]);
+
+    return rc;
+}
+
 int engine_json_call(const char *input_file, const char *output_file, int argc, char *argv[])
 {
     if (argc < 2)
@@ -132,6 +328,14 @@ int engine_json_call(const char *input_file, const char *output_file, int argc,
         return JSON_ENGINE_ERR_OPEN;
     }
 
+    const int stream_rc = engine_json_call_stream(in_mnt, &in_h, output_file, argc, argv);
+    if (stream_rc != JSON_ENGINE_STREAM_UNSUPPORTED)
+    {
+        SNX_CTRL_DEBUG("snx: json: streamed paths=%d rc=%d\n", argc - 1, stream_rc);
+        engine_fs_close(in_mnt, &in_h);
+        return stream_rc;
+    }
+
     SNX_CTRL_DEBUG("snx: open ok, reading..\n");
 
     if (engine_fs_read_entire(in_mnt, &in_h, &buf, &raw_len) != 0)
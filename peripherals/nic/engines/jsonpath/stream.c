@@ -0,0 +1,661 @@
+#include "stream.h"
+#include "parser.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Same limit as parson's MAX_NESTING
+#define JP_STREAM_MAX_NESTING (2048)
+
+#define JP_STREAM_BUFFER_SIZE (16384u)
+
+// Lookahead handed to strtod(); longer numbers are cut short
+#define JP_STREAM_NUMBER_MAX (512u)
+
+struct jp_stream_path
+{
+    struct jp_opcode **steps;
+    int nsteps;
+    // Depth of the innermost value on the current branch which the first
+    // steps of the path have selected
+    int matched;
+};
+
+struct jp_stream_frame
+{
+    bool object;
+    int index;
+};
+
+struct jp_stream
+{
+    jp_stream_read_t read;
+    void *read_priv;
+    int read_error;
+    bool eof;
+    size_t pos;
+    size_t len;
+    char buf[JP_STREAM_BUFFER_SIZE];
+
+    struct jp_stream_path *paths;
+    int npaths;
+    jp_stream_cb_t cb;
+    void *priv;
+
+    // frames[0..depth-1] are the containers enclosing the current value
+    struct jp_stream_frame frames[JP_STREAM_MAX_NESTING + 1];
+    int depth;
+
+    char key[JP_STREAM_STRING_MAX];
+    char string[JP_STREAM_STRING_MAX];
+};
+
+// Make at least want bytes available unless the document ends first;
+// returns the number available
+static size_t jp_stream_fill(struct jp_stream *s, size_t want)
+{
+    while (s->len - s->pos < want && !s->eof)
+    {
+        if (s->pos)
+        {
+            memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+            s->len -= s->pos;
+            s->pos = 0;
+        }
+
+        const int n = s->read(s->read_priv, s->buf + s->len, sizeof(s->buf) - s->len);
+        if (n <= 0)
+        {
+            if (n < 0)
+                s->read_error = 1;
+            s->eof = true;
+            break;
+        }
+
+        // Like json_parse_string(), stop at a NUL
+        const char *nul = (const char *)memchr(s->buf + s->len, '\0', (size_t)n);
+        if (nul)
+        {
+            s->len = (size_t)(nul - s->buf);
+            s->eof = true;
+        }
+        else
+        {
+            s->len += (size_t)n;
+        }
+    }
+
+    return s->len - s->pos;
+}
+
+static int jp_stream_peek(struct jp_stream *s)
+{
+    if (s->pos == s->len && !jp_stream_fill(s, 1))
+        return -1;
+    return (unsigned char)s->buf[s->pos];
+}
+
+static int jp_stream_next(struct jp_stream *s)
+{
+    const int c = jp_stream_peek(s);
+    if (c >= 0)
+        s->pos++;
+    return c;
+}
+
+static void jp_stream_skip_whitespace(struct jp_stream *s)
+{
+    int c;
+    while ((c = jp_stream_peek(s)) >= 0 && isspace(c))
+        s->pos++;
+}
+
+static bool jp_stream_hex4(struct jp_stream *s, unsigned int *result)
+{
+    unsigned int v = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        const int c = jp_stream_next(s);
+        int x;
+
+        if (c >= '0' && c <= '9')
+            x = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            x = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            x = c - 'A' + 10;
+        else
+            return false;
+
+        v = (v << 4) | (unsigned int)x;
+    }
+
+    *result = v;
+    return true;
+}
+
+// Decode a quoted string into out (if not NULL), keeping at most
+// JP_STREAM_STRING_MAX - 1 bytes. *length is set to the full decoded length
+// and *nul to whether it contained an escaped NUL.
+static bool jp_stream_string(struct jp_stream *s, char *out, size_t *length, bool *nul)
+{
+    size_t n = 0;
+
+    *nul = false;
+
+    if (jp_stream_next(s) != '"')
+        return false;
+
+    while (true)
+    {
+        unsigned char utf8[4];
+        size_t ulen = 1;
+        int c = jp_stream_next(s);
+
+        if (c < 0)
+            return false;
+        if (c == '"')
+            break;
+
+        if (c == '\\')
+        {
+            unsigned int cp, trail;
+
+            switch (jp_stream_next(s))
+            {
+                case '"': utf8[0] = '"'; break;
+                case '\\': utf8[0] = '\\'; break;
+                case '/': utf8[0] = '/'; break;
+                case 'b': utf8[0] = '\b'; break;
+                case 'f': utf8[0] = '\f'; break;
+                case 'n': utf8[0] = '\n'; break;
+                case 'r': utf8[0] = '\r'; break;
+                case 't': utf8[0] = '\t'; break;
+                case 'u':
+                    if (!jp_stream_hex4(s, &cp))
+                        return false;
+                    if (cp >= 0xDC00 && cp <= 0xDFFF)
+                        return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF)
+                    {
+                        if (jp_stream_next(s) != '\\' || jp_stream_next(s) != 'u' || !jp_stream_hex4(s, &trail) ||
+                            trail < 0xDC00 || trail > 0xDFFF)
+                            return false;
+                        cp = ((((cp - 0xD800) & 0x3FF) << 10) | ((trail - 0xDC00) & 0x3FF)) + 0x010000;
+                    }
+
+                    if (cp < 0x80)
+                    {
+                        utf8[0] = (unsigned char)cp;
+                        if (!cp)
+                            *nul = true;
+                    }
+                    else if (cp < 0x800)
+                    {
+                        utf8[0] = (unsigned char)(((cp >> 6) & 0x1F) | 0xC0);
+                        utf8[1] = (unsigned char)((cp & 0x3F) | 0x80);
+                        ulen = 2;
+                    }
+                    else if (cp < 0x10000)
+                    {
+                        utf8[0] = (unsigned char)(((cp >> 12) & 0x0F) | 0xE0);
+                        utf8[1] = (unsigned char)(((cp >> 6) & 0x3F) | 0x80);
+                        utf8[2] = (unsigned char)((cp & 0x3F) | 0x80);
+                        ulen = 3;
+                    }
+                    else
+                    {
+                        utf8[0] = (unsigned char)(((cp >> 18) & 0x07) | 0xF0);
+                        utf8[1] = (unsigned char)(((cp >> 12) & 0x3F) | 0x80);
+                        utf8[2] = (unsigned char)(((cp >> 6) & 0x3F) | 0x80);
+                        utf8[3] = (unsigned char)((cp & 0x3F) | 0x80);
+                        ulen = 4;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+        else if (c < 0x20)
+        {
+            return false;
+        }
+        else
+        {
+            utf8[0] = (unsigned char)c;
+        }
+
+        for (size_t i = 0; i < ulen; i++, n++)
+            if (out && n < JP_STREAM_STRING_MAX - 1u)
+                out[n] = (char)utf8[i];
+    }
+
+    if (out)
+        out[n < JP_STREAM_STRING_MAX - 1u ? n : JP_STREAM_STRING_MAX - 1u] = '\0';
+    *length = n;
+    return true;
+}
+
+// parson's is_decimal(): no leading zeros and no hex
+static bool jp_stream_is_decimal(const char *string, size_t length)
+{
+    if (length > 1 && string[0] == '0' && string[1] != '.')
+        return false;
+    if (length > 2 && !strncmp(string, "-0", 2) && string[2] != '.')
+        return false;
+    while (length--)
+        if (string[length] == 'x' || string[length] == 'X')
+            return false;
+    return true;
+}
+
+static bool jp_stream_number(struct jp_stream *s, double *result)
+{
+    char text[JP_STREAM_NUMBER_MAX + 1];
+    size_t avail = jp_stream_fill(s, JP_STREAM_NUMBER_MAX);
+    char *end;
+
+    if (avail > JP_STREAM_NUMBER_MAX)
+        avail = JP_STREAM_NUMBER_MAX;
+    memcpy(text, s->buf + s->pos, avail);
+    text[avail] = '\0';
+
+    errno = 0;
+    const double d = strtod(text, &end);
+    if (errno == ERANGE && (d <= -HUGE_VAL || d >= HUGE_VAL))
+        return false;
+    if ((errno && errno != ERANGE) || !jp_stream_is_decimal(text, (size_t)(end - text)))
+        return false;
+    // parson refuses to store infinities and NaNs ("-inf", "-nan")
+    if (!isfinite(d))
+        return false;
+
+    s->pos += (size_t)(end - text);
+    *result = d;
+    return true;
+}
+
+static bool jp_stream_literal(struct jp_stream *s, const char *word)
+{
+    const size_t n = strlen(word);
+
+    if (jp_stream_fill(s, n) < n || memcmp(s->buf + s->pos, word, n))
+        return false;
+
+    s->pos += n;
+    return true;
+}
+
+// jp_expr() for the operators jp_stream_supported() lets through
+static bool jp_stream_expr(struct jp_opcode *op, int idx, const char *key)
+{
+    struct jp_opcode *sop;
+
+    switch (op->type)
+    {
+        case T_WILDCARD:
+            return true;
+
+        case T_NOT:
+            return !jp_stream_expr(op->down, idx, key);
+
+        case T_AND:
+            for (sop = op->down; sop; sop = sop->sibling)
+                if (!jp_stream_expr(sop, idx, key))
+                    return false;
+            return true;
+
+        case T_OR:
+        case T_UNION:
+            for (sop = op->down; sop; sop = sop->sibling)
+                if (jp_stream_expr(sop, idx, key))
+                    return true;
+            return false;
+
+        case T_STRING:
+            return (key != NULL && !strcmp(op->str, key));
+
+        case T_NUMBER:
+            return (idx == op->num);
+
+        default:
+            return false;
+    }
+}
+
+// Does step select the child of a container with the given index (-1 for
+// object members) or key (NULL for array elements, or keys too long to keep)?
+static bool jp_stream_step(struct jp_opcode *step, bool object, int idx, const char *key)
+{
+    switch (step->type)
+    {
+        case T_STRING:
+        case T_LABEL:
+            return object && key != NULL && !strcmp(step->str, key);
+
+        case T_NUMBER:
+            return !object && idx == step->num;
+
+        default:
+            return jp_stream_expr(step, idx, key);
+    }
+}
+
+static bool jp_stream_expr_supported(struct jp_opcode *op)
+{
+    struct jp_opcode *sop;
+
+    switch (op->type)
+    {
+        // These need the value (or some other part of the document)
+        case T_EQ:
+        case T_NE:
+        case T_LT:
+        case T_LE:
+        case T_GT:
+        case T_GE:
+        case T_ROOT:
+        case T_THIS:
+            return false;
+
+        case T_NOT:
+            return jp_stream_expr_supported(op->down);
+
+        case T_AND:
+        case T_OR:
+        case T_UNION:
+            for (sop = op->down; sop; sop = sop->sibling)
+                if (!jp_stream_expr_supported(sop))
+                    return false;
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+bool jp_stream_supported(struct jp_opcode *path)
+{
+    if (path->type == T_LABEL)
+        path = path->down;
+
+    for (struct jp_opcode *op = path->down; op; op = op->sibling)
+    {
+        switch (op->type)
+        {
+            case T_STRING:
+            case T_LABEL:
+                break;
+
+            case T_NUMBER:
+                // Counting from the end needs the length of the array
+                if (op->num < 0)
+                    return false;
+                break;
+
+            default:
+                if (!jp_stream_expr_supported(op))
+                    return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+// Called once the parser has moved into a child of the innermost container
+static void jp_stream_enter(struct jp_stream *s, int idx, const char *key)
+{
+    const bool object = s->frames[s->depth - 1].object;
+
+    for (int i = 0; i < s->npaths; i++)
+    {
+        struct jp_stream_path *p = &s->paths[i];
+
+        if (p->matched == s->depth - 1 && p->matched < p->nsteps &&
+            jp_stream_step(p->steps[p->matched], object, idx, key))
+            p->matched = s->depth;
+    }
+}
+
+static void jp_stream_leave(struct jp_stream *s)
+{
+    for (int i = 0; i < s->npaths; i++)
+        if (s->paths[i].matched == s->depth)
+            s->paths[i].matched--;
+}
+
+// Is the value about to be parsed selected by any path?
+static bool jp_stream_wanted(const struct jp_stream *s)
+{
+    for (int i = 0; i < s->npaths; i++)
+        if (s->paths[i].matched == s->depth && s->paths[i].nsteps == s->depth)
+            return true;
+    return false;
+}
+
+static void jp_stream_report(struct jp_stream *s, const struct jp_stream_value *value)
+{
+    for (int i = 0; i < s->npaths; i++)
+        if (s->paths[i].matched == s->depth && s->paths[i].nsteps == s->depth)
+            s->cb(i, value, s->priv);
+}
+
+// Parse an object member's key and the colon after it
+static bool jp_stream_member(struct jp_stream *s)
+{
+    size_t length;
+    bool nul;
+
+    // Keys with embedded NULs are rejected, as they are by parson
+    if (!jp_stream_string(s, s->key, &length, &nul) || nul)
+        return false;
+
+    jp_stream_skip_whitespace(s);
+    if (jp_stream_next(s) != ':')
+        return false;
+
+    jp_stream_enter(s, -1, length < JP_STREAM_STRING_MAX ? s->key : NULL);
+    return true;
+}
+
+// Parse one complete value, mirroring parson's parse_value() but without
+// recursion
+static bool jp_stream_parse(struct jp_stream *s)
+{
+    if (jp_stream_fill(s, 3) >= 3 && !memcmp(s->buf + s->pos, "\xEF\xBB\xBF", 3))
+        s->pos += 3;
+
+    while (true)
+    {
+        struct jp_stream_value value = {0};
+        size_t length;
+        bool nul;
+
+        if (s->depth > JP_STREAM_MAX_NESTING)
+            return false;
+
+        jp_stream_skip_whitespace(s);
+        const bool wanted = jp_stream_wanted(s);
+        const int c = jp_stream_peek(s);
+
+        switch (c)
+        {
+            case '{':
+            case '[': {
+                const bool object = c == '{';
+
+                if (wanted)
+                {
+                    value.type = JP_STREAM_CONTAINER;
+                    jp_stream_report(s, &value);
+                }
+
+                s->pos++;
+                s->frames[s->depth].object = object;
+                s->frames[s->depth].index = 0;
+                s->depth++;
+
+                jp_stream_skip_whitespace(s);
+                if (jp_stream_peek(s) == (object ? '}' : ']'))
+                {
+                    s->pos++;
+                    s->depth--;
+                    break;
+                }
+
+                if (object)
+                {
+                    if (!jp_stream_member(s))
+                        return false;
+                }
+                else
+                {
+                    jp_stream_enter(s, 0, NULL);
+                }
+                continue;
+            }
+
+            case '"':
+                if (!jp_stream_string(s, wanted ? s->string : NULL, &length, &nul))
+                    return false;
+                value.type = JP_STREAM_STRING;
+                value.string = s->string;
+                break;
+
+            case 't':
+            case 'f':
+                if (jp_stream_literal(s, "true"))
+                    value.boolean = true;
+                else if (!jp_stream_literal(s, "false"))
+                    return false;
+                value.type = JP_STREAM_BOOLEAN;
+                break;
+
+            case 'n':
+                if (!jp_stream_literal(s, "null"))
+                    return false;
+                value.type = JP_STREAM_NULL;
+                break;
+
+            case '-':
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                if (!jp_stream_number(s, &value.number))
+                    return false;
+                value.type = JP_STREAM_NUMBER;
+                break;
+
+            default:
+                return false;
+        }
+
+        if (wanted && value.type != JP_STREAM_CONTAINER)
+            jp_stream_report(s, &value);
+
+        // The value is complete: move on to the next member of the innermost
+        // container, closing containers as they end
+        while (true)
+        {
+            if (!s->depth)
+                return true;
+
+            jp_stream_leave(s);
+
+            struct jp_stream_frame *frame = &s->frames[s->depth - 1];
+            const int close = frame->object ? '}' : ']';
+
+            jp_stream_skip_whitespace(s);
+            if (jp_stream_peek(s) == ',')
+            {
+                s->pos++;
+                jp_stream_skip_whitespace(s);
+
+                // A trailing comma is allowed
+                if (jp_stream_peek(s) != close)
+                {
+                    frame->index++;
+                    if (frame->object)
+                    {
+                        if (!jp_stream_member(s))
+                            return false;
+                    }
+                    else
+                    {
+                        jp_stream_enter(s, frame->index, NULL);
+                    }
+                    break;
+                }
+            }
+
+            if (jp_stream_peek(s) != close)
+                return false;
+
+            s->pos++;
+            s->depth--;
+        }
+    }
+}
+
+int jp_stream_match(struct jp_opcode **paths, int npaths, jp_stream_read_t read, void *read_priv,
+                    jp_stream_cb_t cb, void *priv)
+{
+    struct jp_stream *s = (struct jp_stream *)calloc(1, sizeof(*s));
+    int result = 0;
+
+    if (!s)
+        return JP_STREAM_ERR_MEMORY;
+
+    s->read = read;
+    s->read_priv = read_priv;
+    s->cb = cb;
+    s->priv = priv;
+    s->npaths = npaths;
+    s->paths = (struct jp_stream_path *)calloc(npaths ? (size_t)npaths : 1u, sizeof(*s->paths));
+    if (!s->paths)
+    {
+        free(s);
+        return JP_STREAM_ERR_MEMORY;
+    }
+
+    for (int i = 0; i < npaths; i++)
+    {
+        struct jp_stream_path *p = &s->paths[i];
+        struct jp_opcode *path = paths[i];
+        struct jp_opcode *op;
+
+        if (path->type == T_LABEL)
+            path = path->down;
+
+        for (op = path->down; op; op = op->sibling)
+            p->nsteps++;
+
+        p->steps = (struct jp_opcode **)malloc((p->nsteps ? (size_t)p->nsteps : 1u) * sizeof(*p->steps));
+        if (!p->steps)
+        {
+            result = JP_STREAM_ERR_MEMORY;
+            break;
+        }
+
+        p->nsteps = 0;
+        for (op = path->down; op; op = op->sibling)
+            p->steps[p->nsteps++] = op;
+    }
+
+    if (!result && !jp_stream_parse(s))
+        result = JP_STREAM_ERR_PARSE;
+    // A failed read can look like a truncated document
+    if (result != JP_STREAM_ERR_MEMORY && s->read_error)
+        result = JP_STREAM_ERR_READ;
+
+    for (int i = 0; i < npaths; i++)
+        free(s->paths[i].steps);
+    free(s->paths);
+    free(s);
+
+    return result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ast.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Streaming JSONPath evaluation: paths from jp_parse() are matched while the
+// document is tokenised, so no DOM is built and memory use depends on the
+// depth of the document and the size of the results rather than its length.
+// The tokeniser accepts exactly what parson's json_parse_string() does, except
+// that duplicate object keys are not detected.
+
+// Matched strings longer than this (including the terminator) are truncated
+#define JP_STREAM_STRING_MAX (1024u)
+
+enum jp_stream_error
+{
+    JP_STREAM_ERR_READ = -1,
+    JP_STREAM_ERR_PARSE = -2,
+    JP_STREAM_ERR_MEMORY = -3,
+};
+
+enum jp_stream_type
+{
+    JP_STREAM_STRING,
+    JP_STREAM_NUMBER,
+    JP_STREAM_BOOLEAN,
+    JP_STREAM_NULL,
+    // An object or array matched; its contents are not reported
+    JP_STREAM_CONTAINER,
+};
+
+struct jp_stream_value
+{
+    enum jp_stream_type type;
+    const char *string;
+    double number;
+    bool boolean;
+};
+
+// Fill buf with up to len bytes of the document; returns the count, 0 at the
+// end of the document or a negative value on error
+typedef int (*jp_stream_read_t)(void *priv, char *buf, size_t len);
+
+// Called for every match of paths[path], in document order
+typedef void (*jp_stream_cb_t)(int path, const struct jp_stream_value *value, void *priv);
+
+// Returns true if path only selects by key, index and wildcard, and so can be
+// decided without looking ahead in the document
+bool jp_stream_supported(struct jp_opcode *path);
+
+// Returns 0, or a jp_stream_error. Matches already reported stand even if the
+// document later turns out to be malformed.
+int jp_stream_match(struct jp_opcode **paths, int npaths, jp_stream_read_t read, void *read_priv,
+                    jp_stream_cb_t cb, void *priv);
@@ -2,21 +2,16 @@
 
 #include "spectranext_controller.h"
 
-#ifdef WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#else
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#endif
+#include <pthread.h>
 #include <string.h>
 
+#include "dns_resolver.h"
 #include "engines/engine.h"
+#include "../fs/xfs_worker.h"
 
 #include "libspectrum.h"
 #include "memory_pages.h"
+#include "ui/ui.h"
 
 spectranext_enginecall_args_t spectranext_enginecall_args;
 
@@ -57,11 +52,181 @@ static void spectranext_set_status(uint8_t status)
     spectranext_controller.status = status;
 }
 
+// DNS_GETHOSTBYNAME doesn't wait for the resolver: the guest sees
+// SPECTRANEXT_STATUS_IN_PROGRESS until the answer is in, which is checked
+// for each time it polls the status register. The hostname is kept here as
+// the answer overwrites it in the workspace.
+static char dns_pending_host[64];
+static bool dns_pending;
+
+static void spectranext_dns_poll(void)
+{
+    uint32_t ipv4_host = 0;
+    const dns_lookup_result_t result = dns_lookup(dns_pending_host, &ipv4_host);
+
+    if (result == DNS_LOOKUP_PENDING)
+    {
+        spectranext_set_status(SPECTRANEXT_STATUS_IN_PROGRESS);
+        return;
+    }
+
+    dns_pending = false;
+
+    if (result != DNS_LOOKUP_FOUND)
+    {
+        spectranext_controller.workspace.dns.io.out.ipv4 = 0;
+        spectranext_set_status(SPECTRANEXT_STATUS_ERROR);
+        return;
+    }
+
+    spectranext_controller.workspace.dns.io.out.ipv4 = ipv4_host;
+    spectranext_state.ipv4_host = ipv4_host;
+    spectranext_set_status(SPECTRANEXT_STATUS_SUCCESS);
+}
+
+// ENGINECALL runs on a worker thread so that parsing a large input doesn't
+// stall the Z80; the guest sees SPECTRANEXT_STATUS_IN_PROGRESS until the
+// engine has returned. Engines read their input through the XFS mounts, so
+// they hold the XFS worker's mount lock while they run.
+static pthread_t enginecall_thread;
+static pthread_mutex_t enginecall_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t enginecall_cond = PTHREAD_COND_INITIALIZER;
+static bool enginecall_running;
+static bool enginecall_stop;
+// True from the command being issued until the engine has returned
+static bool enginecall_busy;
+
+static void spectranext_enginecall_run(void)
+{
+    xfs_worker_lock_mounts();
+    spectranext_enginecall_args.result = spectranext_enginecall_dispatch(
+        spectranext_enginecall_args.input_file,
+        spectranext_enginecall_args.output_file,
+        spectranext_enginecall_args.operation);
+    xfs_worker_unlock_mounts();
+}
+
+static void *spectranext_enginecall_main(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&enginecall_mutex);
+
+    while (true)
+    {
+        while (!enginecall_busy && !enginecall_stop)
+            pthread_cond_wait(&enginecall_cond, &enginecall_mutex);
+
+        if (enginecall_stop)
+            break;
+
+        pthread_mutex_unlock(&enginecall_mutex);
+        spectranext_enginecall_run();
+        pthread_mutex_lock(&enginecall_mutex);
+
+        spectranext_set_status((uint8_t)(int8_t)spectranext_enginecall_args.result);
+        enginecall_busy = false;
+        pthread_cond_broadcast(&enginecall_cond);
+    }
+
+    pthread_mutex_unlock(&enginecall_mutex);
+    return NULL;
+}
+
+// Must be called with enginecall_mutex held
+static int spectranext_enginecall_start(void)
+{
+    int error;
+
+    if (enginecall_running)
+        return 0;
+
+    enginecall_stop = false;
+    error = pthread_create(&enginecall_thread, NULL, spectranext_enginecall_main, NULL);
+    if (error)
+    {
+        ui_error(UI_ERROR_ERROR, "spectranext: error %d creating enginecall thread", error);
+        return 1;
+    }
+
+    enginecall_running = true;
+    return 0;
+}
+
+static void spectranext_enginecall_submit(void)
+{
+    pthread_mutex_lock(&enginecall_mutex);
+
+    if (spectranext_enginecall_start())
+    {
+        pthread_mutex_unlock(&enginecall_mutex);
+        spectranext_enginecall_run();
+        spectranext_set_status((uint8_t)(int8_t)spectranext_enginecall_args.result);
+        return;
+    }
+
+    spectranext_set_status(SPECTRANEXT_STATUS_IN_PROGRESS);
+    enginecall_busy = true;
+    pthread_cond_broadcast(&enginecall_cond);
+
+    pthread_mutex_unlock(&enginecall_mutex);
+}
+
+static bool spectranext_enginecall_busy(void)
+{
+    bool busy;
+
+    pthread_mutex_lock(&enginecall_mutex);
+    busy = enginecall_busy;
+    pthread_mutex_unlock(&enginecall_mutex);
+
+    return busy;
+}
+
+void spectranext_controller_wait_idle(void)
+{
+    pthread_mutex_lock(&enginecall_mutex);
+    while (enginecall_busy)
+        pthread_cond_wait(&enginecall_cond, &enginecall_mutex);
+    pthread_mutex_unlock(&enginecall_mutex);
+}
+
+void spectranext_controller_end(void)
+{
+    pthread_mutex_lock(&enginecall_mutex);
+
+    if (!enginecall_running)
+    {
+        pthread_mutex_unlock(&enginecall_mutex);
+        return;
+    }
+
+    // Engines aren't cancellable, so let any running one finish
+    while (enginecall_busy)
+        pthread_cond_wait(&enginecall_cond, &enginecall_mutex);
+
+    enginecall_stop = true;
+    pthread_cond_broadcast(&enginecall_cond);
+    pthread_mutex_unlock(&enginecall_mutex);
+
+    pthread_join(enginecall_thread, NULL);
+    enginecall_running = false;
+    enginecall_stop = false;
+}
+
 static void spectranext_controller_process_command(void)
 {
     const uint8_t cmd = spectranext_controller.command;
     spectranext_controller.command = SPECTRANEXT_CMD_REG_IDLE;
 
+    // The enginecall worker owns the status register until it has finished;
+    // commands issued before then are dropped
+    if (spectranext_enginecall_busy())
+        return;
+
+    // A new command abandons any lookup the guest was waiting for
+    dns_pending = false;
+
     switch (cmd)
     {
         case SPECTRANEXT_CMD_GET_CONTROLLER_STATUS:
@@ -121,46 +286,9 @@ static void spectranext_controller_process_command(void)
                 break;
             }
 
-            struct addrinfo hints;
-            memset(&hints, 0, sizeof(hints));
-            hints.ai_family = AF_INET;
-            hints.ai_socktype = SOCK_STREAM;
-
-            struct addrinfo *res = NULL;
-            const int gai_err = getaddrinfo(host, NULL, &hints, &res);
-            if (gai_err != 0 || res == NULL)
-            {
-                spectranext_controller.workspace.dns.io.out.ipv4 = 0;
-                spectranext_set_status(SPECTRANEXT_STATUS_ERROR);
-                if (res)
-                    freeaddrinfo(res);
-                break;
-            }
-
-            uint32_t ipv4_host = 0;
-            int found = 0;
-            for (struct addrinfo *rp = res; rp != NULL; rp = rp->ai_next)
-            {
-                if (rp->ai_family == AF_INET && rp->ai_addr != NULL)
-                {
-                    const struct sockaddr_in *sin = (const struct sockaddr_in *)rp->ai_addr;
-                    ipv4_host = (uint32_t)sin->sin_addr.s_addr;
-                    found = 1;
-                    break;
-                }
-            }
-            freeaddrinfo(res);
-
-            if (!found)
-            {
-                spectranext_controller.workspace.dns.io.out.ipv4 = 0;
-                spectranext_set_status(SPECTRANEXT_STATUS_ERROR);
-                break;
-            }
-
-            spectranext_controller.workspace.dns.io.out.ipv4 = ipv4_host;
-            spectranext_state.ipv4_host = ipv4_host;
-            spectranext_set_status(SPECTRANEXT_STATUS_SUCCESS);
+            memcpy(dns_pending_host, host, sizeof(dns_pending_host));
+            dns_pending = true;
+            spectranext_dns_poll();
             break;
         }
 
@@ -180,12 +308,7 @@ static void spectranext_controller_process_command(void)
                    sizeof(spectranext_enginecall_args.operation) - 1u);
             spectranext_enginecall_args.operation[sizeof(spectranext_enginecall_args.operation) - 1u] = '\0';
 
-            spectranext_enginecall_args.result = spectranext_enginecall_dispatch(
-                spectranext_enginecall_args.input_file,
-                spectranext_enginecall_args.output_file,
-                spectranext_enginecall_args.operation);
-
-            spectranext_set_status((uint8_t)(int8_t)spectranext_enginecall_args.result);
+            spectranext_enginecall_submit();
             break;
 
         default:
@@ -202,6 +325,7 @@ void spectranext_controller_init(void)
     spectranext_state.connection_status = WIFI_CONNECT_CONNECT_IP_OBTAINED;
     spectranext_state.ipv4_host = 0x7f000001u;
     scan_ap_count = 0;
+    dns_pending = false;
 }
 
 libspectrum_byte spectranext_controller_read(memory_page *page, libspectrum_word address)
@@ -210,6 +334,21 @@ libspectrum_byte spectranext_controller_read(memory_page *page, libspectrum_word
     uint8_t *registers = (uint8_t *)&spectranext_controller;
     if (offset >= sizeof(spectranext_controller))
         return 0xff;
+    if (offset == offsetof(struct spectranext_controller_t, status))
+    {
+        libspectrum_byte status;
+
+        if (dns_pending)
+            spectranext_dns_poll();
+
+        // Synchronise with the enginecall worker so that once the guest sees
+        // the call complete, its output is visible too
+        pthread_mutex_lock(&enginecall_mutex);
+        status = enginecall_busy ? SPECTRANEXT_STATUS_IN_PROGRESS : registers[offset];
+        pthread_mutex_unlock(&enginecall_mutex);
+
+        return status;
+    }
     return registers[offset];
 }
 
@@ -8,6 +8,9 @@
 extern volatile struct spectranext_controller_t spectranext_controller;
 
 extern void spectranext_controller_init(void);
+// Wait for any ENGINECALL still running on the worker thread
+extern void spectranext_controller_wait_idle(void);
+extern void spectranext_controller_end(void);
 
 libspectrum_byte spectranext_controller_read(memory_page *page, libspectrum_word address);
 void spectranext_controller_write(memory_page *page, libspectrum_word address, libspectrum_byte b);
@@ -26,11 +26,16 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <pthread.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #include "fuse.h"
 #include "utils.h"
 #include "ui/ui.h"
@@ -84,57 +89,236 @@ nic_w5100_reset( nic_w5100_t *self )
     nic_w5100_socket_reset( &self->socket[i] );
 }
 
-static void*
-w5100_io_thread( void *arg )
+/* The I/O thread waits on every socket for which there's something to do,
+   and on the self-pipe, which the emulation uses to tell it that a socket's
+   state has changed. Where epoll is available, the sockets stay registered
+   between waits so that each wait costs nothing for sockets whose state
+   hasn't changed; otherwise, the sets are rebuilt for each select() */
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/* Identifies the self-pipe in the epoll data; sockets use their index */
+#define W5100_IO_WAKE 4
+
+static int
+w5100_io_init( nic_w5100_t *self )
 {
-  nic_w5100_t *self = arg;
-  int i;
+  struct epoll_event event;
 
-  while( !self->stop_io_thread ) {
-    fd_set readfds, writefds;
-    int active;
-    compat_socket_t selfpipe_socket =
-      compat_socket_selfpipe_get_read_fd( self->selfpipe );
-    int max_fd = selfpipe_socket;
+  self->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+  if( self->epoll_fd == -1 ) {
+    ui_error( UI_ERROR_ERROR, "w5100: error %d creating epoll instance",
+              errno );
+    return 1;
+  }
+
+  event.events = EPOLLIN;
+  event.data.u32 = W5100_IO_WAKE;
+  if( epoll_ctl( self->epoll_fd, EPOLL_CTL_ADD,
+                 compat_socket_selfpipe_get_read_fd( self->selfpipe ),
+                 &event ) == -1 ) {
+    ui_error( UI_ERROR_ERROR, "w5100: error %d registering self-pipe",
+              errno );
+    close( self->epoll_fd );
+    return 1;
+  }
+
+  return 0;
+}
+
+static void
+w5100_io_end( nic_w5100_t *self )
+{
+  close( self->epoll_fd );
+}
+
+/* Bring the socket's registration up to date. Registrations are made level
+   triggered, as the sockets are blocking and we read only as much as the
+   receive buffer has room for, so there's no draining a socket until it
+   would block; instead, a socket is removed while it has nothing to wait
+   for, so a full buffer doesn't make the thread spin */
+static void
+w5100_io_register( nic_w5100_t *self, nic_w5100_socket_t *socket )
+{
+  struct epoll_event event;
+  compat_socket_t fd;
+  unsigned generation;
+  int events = nic_w5100_socket_io_events( socket, &fd, &generation ), op;
+
+  /* Closing the fd removes it from the epoll set. That is told by the
+     generation rather than the fd number, as the socket may have been
+     closed and reopened since we last looked and been given the same
+     number; either way we must not try to remove the old fd ourselves */
+  if( generation != socket->registered_generation ) {
+    socket->registered_generation = generation;
+    socket->registered_events = 0;
+  }
 
-    FD_ZERO( &readfds );
-    FD_ZERO( &writefds );
+  if( events == socket->registered_events ) return;
 
-    FD_SET( selfpipe_socket, &readfds );
+  event.events = ( events & W5100_IO_READ ? EPOLLIN : 0 ) |
+                 ( events & W5100_IO_WRITE ? EPOLLOUT : 0 );
+  event.data.u32 = socket->id;
 
-      for( i = 0; i < 4; i++ )
-        nic_w5100_socket_add_to_sets( self, &self->socket[i], &readfds, &writefds,
-          &max_fd );
+  if( !events )
+    op = EPOLL_CTL_DEL;
+  else if( !socket->registered_events )
+    op = EPOLL_CTL_ADD;
+  else
+    op = EPOLL_CTL_MOD;
+
+  if( epoll_ctl( self->epoll_fd, op, fd, &event ) == -1 ) {
+    /* The registration we thought the fd had has gone; closes are
+       counted, so this shouldn't happen, but make a new one if it does */
+    if( errno == ENOENT && op == EPOLL_CTL_MOD )
+      epoll_ctl( self->epoll_fd, EPOLL_CTL_ADD, fd, &event );
+    else if( errno != ENOENT )
+      nic_w5100_debug( "w5100: epoll_ctl %d on fd %d returned errno %d\n",
+                       op, fd, errno );
+  }
 
-    /* Note that if a socket is closed between when we added it to the sets
-       above and when we call select() below, it will cause the select to fail
-       with EBADF. We catch this and just run around the loop again - the
-       offending socket will not be added to the sets again as it's now been
-       closed */
+  socket->registered_events = events;
+}
 
-    nic_w5100_debug( "w5100: io thread select\n" );
+/* Wait until something happens, filling in which sockets are ready for
+   what. Returns 1 if the emulation woke us, 0 if it didn't or -1 if the
+   wait failed */
+static int
+w5100_io_wait( nic_w5100_t *self, int *socket_events )
+{
+  struct epoll_event events[5];
+  int i, active, woken = 0;
 
-    active = select( max_fd + 1, &readfds, &writefds, NULL, NULL );
+  for( i = 0; i < 4; i++ )
+    w5100_io_register( self, &self->socket[i] );
 
-    nic_w5100_debug( "w5100: io thread wake; %d active\n", active );
+  nic_w5100_debug( "w5100: io thread epoll_wait\n" );
 
-    if( active != -1 ) {
-      if( FD_ISSET( selfpipe_socket, &readfds ) ) {
-        nic_w5100_debug( "w5100: discarding selfpipe data\n" );
-        compat_socket_selfpipe_discard_data( self->selfpipe );
-      }
+  active = epoll_wait( self->epoll_fd, events, ARRAY_SIZE( events ), -1 );
 
-      for( i = 0; i < 4; i++ )
-        nic_w5100_socket_process_io( self, &self->socket[i], readfds, writefds );
-    }
-    else if( compat_socket_get_error() == compat_socket_EBADF ) {
-      /* Do nothing - just loop again */
+  nic_w5100_debug( "w5100: io thread wake; %d active\n", active );
+
+  if( active == -1 ) {
+    if( errno != EINTR )
+      nic_w5100_debug( "w5100: epoll_wait returned unexpected errno %d: %s\n",
+                       errno, strerror( errno ) );
+    return -1;
+  }
+
+  for( i = 0; i < active; i++ ) {
+    libspectrum_dword which = events[i].data.u32;
+    libspectrum_dword ready = events[i].events;
+
+    if( which == W5100_IO_WAKE ) {
+      woken = 1;
+      continue;
     }
-    else {
+
+    /* As with select(), an error or hangup makes the socket ready for
+       whatever we're waiting for, so the read or write can report it */
+    if( ready & ( EPOLLERR | EPOLLHUP ) )
+      socket_events[ which ] = self->socket[ which ].registered_events;
+    if( ready & EPOLLIN ) socket_events[ which ] |= W5100_IO_READ;
+    if( ready & EPOLLOUT ) socket_events[ which ] |= W5100_IO_WRITE;
+  }
+
+  return woken;
+}
+
+#else                           /* #ifdef HAVE_SYS_EPOLL_H */
+
+static int
+w5100_io_init( nic_w5100_t *self )
+{
+  return 0;
+}
+
+static void
+w5100_io_end( nic_w5100_t *self )
+{
+}
+
+static int
+w5100_io_wait( nic_w5100_t *self, int *socket_events )
+{
+  fd_set readfds, writefds;
+  int i, active;
+  compat_socket_t selfpipe_socket =
+    compat_socket_selfpipe_get_read_fd( self->selfpipe );
+  compat_socket_t fds[4];
+  int max_fd = selfpipe_socket;
+
+  FD_ZERO( &readfds );
+  FD_ZERO( &writefds );
+
+  FD_SET( selfpipe_socket, &readfds );
+
+  for( i = 0; i < 4; i++ ) {
+    int events = nic_w5100_socket_io_events( &self->socket[i], &fds[i],
+                                             NULL );
+
+    if( events & W5100_IO_READ ) FD_SET( fds[i], &readfds );
+    if( events & W5100_IO_WRITE ) FD_SET( fds[i], &writefds );
+    if( events && fds[i] > max_fd ) max_fd = fds[i];
+    if( !events ) fds[i] = compat_socket_invalid;
+  }
+
+  /* Note that if a socket is closed between when we added it to the sets
+     above and when we call select() below, it will cause the select to fail
+     with EBADF. We catch this and just run around the loop again - the
+     offending socket will not be added to the sets again as it's now been
+     closed */
+
+  nic_w5100_debug( "w5100: io thread select\n" );
+
+  active = select( max_fd + 1, &readfds, &writefds, NULL, NULL );
+
+  nic_w5100_debug( "w5100: io thread wake; %d active\n", active );
+
+  if( active == -1 ) {
+    if( compat_socket_get_error() != compat_socket_EBADF )
       nic_w5100_debug( "w5100: select returned unexpected errno %d: %s\n",
                        compat_socket_get_error(),
                        compat_socket_get_strerror() );
+    return -1;
+  }
+
+  for( i = 0; i < 4; i++ ) {
+    if( fds[i] == compat_socket_invalid ) continue;
+    if( FD_ISSET( fds[i], &readfds ) ) socket_events[i] |= W5100_IO_READ;
+    if( FD_ISSET( fds[i], &writefds ) ) socket_events[i] |= W5100_IO_WRITE;
+  }
+
+  return FD_ISSET( selfpipe_socket, &readfds );
+}
+
+#endif                          /* #ifdef HAVE_SYS_EPOLL_H */
+
+static void*
+w5100_io_thread( void *arg )
+{
+  nic_w5100_t *self = arg;
+  int i;
+
+  while( !self->stop_io_thread ) {
+    int socket_events[4] = { 0, 0, 0, 0 };
+    int woken = w5100_io_wait( self, socket_events );
+
+    if( woken == -1 ) continue;
+
+    if( woken ) {
+      nic_w5100_debug( "w5100: discarding selfpipe data\n" );
+      compat_socket_selfpipe_discard_data( self->selfpipe );
     }
+
+    /* A command from the emulation may have left any socket with work to
+       do that doesn't wait on its fd, such as a TLS handshake or data TLS
+       has already buffered, so give every socket a look then; otherwise,
+       only the sockets which are ready need processing */
+    for( i = 0; i < 4; i++ )
+      if( woken || socket_events[i] )
+        nic_w5100_socket_process_io( self, &self->socket[i],
+                                     socket_events[i] );
   }
 
   return NULL;
@@ -150,6 +334,12 @@ w5100_start_io_thread( nic_w5100_t *self )
   self->selfpipe = compat_socket_selfpipe_alloc();
   if( !self->selfpipe ) return 1;
 
+  if( w5100_io_init( self ) ) {
+    compat_socket_selfpipe_free( self->selfpipe );
+    self->selfpipe = NULL;
+    return 1;
+  }
+
   self->stop_io_thread = 0;
 
   error = pthread_create( &self->thread, NULL, w5100_io_thread, self );
@@ -196,6 +386,7 @@ nic_w5100_free( nic_w5100_t *self )
       compat_socket_selfpipe_wake( self->selfpipe );
 
       pthread_join( self->thread, NULL );
+      w5100_io_end( self );
     }
 
     for( i = 0; i < 4; i++ )
@@ -368,6 +559,14 @@ nic_w5100_write( nic_w5100_t *self, libspectrum_word reg, libspectrum_byte b )
                      b, reg );
 }
 
+libspectrum_byte*
+nic_w5100_buffer( nic_w5100_t *self, libspectrum_word reg )
+{
+  nic_w5100_socket_t *socket = &self->socket[ ( reg & 0x1fff ) / 0x0800 ];
+
+  return reg < 0x6000 ? socket->tx_buffer : socket->rx_buffer;
+}
+
 void
 nic_w5100_from_snapshot( nic_w5100_t *self, libspectrum_byte *data )
 {
@@ -389,24 +588,22 @@ nic_w5100_to_snapshot( nic_w5100_t *self )
   return data;
 }
 
+#if W5100_DEBUG
 void
 nic_w5100_debug( const char *format, ... )
 {
-  if( W5100_DEBUG ) {
-    va_list ap;
-    va_start( ap, format );
-    vprintf( format, ap );
-    va_end( ap );
-  }
+  va_list ap;
+  va_start( ap, format );
+  vprintf( format, ap );
+  va_end( ap );
 }
 
 void
 nic_w5100_vdebug( const char *format, va_list ap )
 {
-  if( W5100_DEBUG ) {
-    vprintf( format, ap );
-  }
+  vprintf( format, ap );
 }
+#endif                          /* #if W5100_DEBUG */
 
 void
 nic_w5100_error( int severity, const char *format, ... )
@@ -41,6 +41,10 @@ void nic_w5100_reset( nic_w5100_t *self );
 libspectrum_byte nic_w5100_read( nic_w5100_t *self, libspectrum_word reg);
 void nic_w5100_write( nic_w5100_t *self, libspectrum_word reg, libspectrum_byte b );
 
+/* The 2K transmit (reg 0x4000 to 0x5fff) or receive (0x6000 to 0x7fff)
+   buffer containing reg, so that it can be mapped directly into memory */
+libspectrum_byte* nic_w5100_buffer( nic_w5100_t *self, libspectrum_word reg );
+
 void nic_w5100_from_snapshot( nic_w5100_t *self, libspectrum_byte *data );
 libspectrum_byte* nic_w5100_to_snapshot( nic_w5100_t *self );
 
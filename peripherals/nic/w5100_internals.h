@@ -28,6 +28,7 @@
 #define FUSE_W5100_INTERNALS_H
 
 #include <signal.h>
+#include <stdio.h>
 
 #ifndef WIN32
 #include <sys/select.h>
@@ -127,10 +128,19 @@ typedef struct nic_w5100_socket_t {
   int datagram_count;
 
   /* Flag used to indicate that a socket has been closed since we started
-     waiting for it in a select() call and therefore the socket should no
+     waiting for it in the I/O thread and therefore the socket should no
      longer be used */
   int ok_for_io;
 
+  /* How many times fd has been closed, so that a new fd can be told from
+     the old one even if it has been given the same number */
+  unsigned fd_generation;
+
+  /* The fd, by its generation, and events the I/O thread has registered
+     with the kernel for this socket; touched only by the I/O thread */
+  unsigned registered_generation;
+  int registered_events;
+
   pthread_mutex_t lock;     /* Mutex for this socket */
 
 } nic_w5100_socket_t;
@@ -147,8 +157,26 @@ struct nic_w5100_t {
   int io_thread_running;    /* True if the I/O thread was started */
   sig_atomic_t stop_io_thread; /* Flag to stop I/O thread */
   compat_socket_selfpipe_t *selfpipe; /* Device for waking I/O thread */
+#ifdef HAVE_SYS_EPOLL_H
+  int epoll_fd;             /* Sockets the I/O thread is waiting on */
+#endif
 };
 
+/* What the I/O thread is waiting for on a socket */
+enum w5100_io_events {
+  W5100_IO_READ = 1 << 0,
+  W5100_IO_WRITE = 1 << 1,
+};
+
+/* Orders the I/O thread's writes to a receive buffer before its update
+   of Sn_RX_RSR, and the emulation's read of Sn_RX_RSR before its reads of
+   the buffer, which it does without taking the socket lock */
+#ifdef __GNUC__
+#define nic_w5100_barrier() __sync_synchronize()
+#else                           /* #ifdef __GNUC__ */
+#define nic_w5100_barrier()
+#endif                          /* #ifdef __GNUC__ */
+
 void nic_w5100_socket_init( nic_w5100_socket_t *socket, int which );
 void nic_w5100_socket_end( nic_w5100_socket_t *socket );
 
@@ -160,20 +188,26 @@ void nic_w5100_socket_write( nic_w5100_t *self, libspectrum_word reg, libspectru
 libspectrum_byte nic_w5100_socket_read_rx_buffer( nic_w5100_t *self, libspectrum_word reg );
 void nic_w5100_socket_write_tx_buffer( nic_w5100_t *self, libspectrum_word reg, libspectrum_byte b );
 
-void nic_w5100_socket_add_to_sets( nic_w5100_t *self, nic_w5100_socket_t *socket, fd_set *readfds,
-  fd_set *writefds, int *max_fd );
-void nic_w5100_socket_process_io( nic_w5100_t *self, nic_w5100_socket_t *socket, fd_set readfds,
-  fd_set writefds );
+int nic_w5100_socket_io_events( nic_w5100_socket_t *socket, compat_socket_t *fd,
+                                unsigned *generation );
+void nic_w5100_socket_process_io( nic_w5100_t *self, nic_w5100_socket_t *socket, int events );
 
 /* Debug routines */
 
 /* Define this to spew debugging info to stdout */
 #define W5100_DEBUG 0
 
+#if W5100_DEBUG
 void nic_w5100_debug( const char *format, ... )
      GCC_PRINTF( 1, 2 );
 void nic_w5100_vdebug( const char *format, va_list ap )
      GCC_PRINTF( 1, 0 );
+#else                           /* #if W5100_DEBUG */
+/* Compiled out so that the per-access paths don't pay for a varargs
+   call which does nothing; the arguments are still type checked */
+#define nic_w5100_debug( ... ) do { if( 0 ) printf( __VA_ARGS__ ); } while( 0 )
+#define nic_w5100_vdebug( format, ap ) do { if( 0 ) vprintf( format, ap ); } while( 0 )
+#endif                          /* #if W5100_DEBUG */
 void nic_w5100_error( int severity, const char *format, ... )
      GCC_PRINTF( 2, 3 );
 
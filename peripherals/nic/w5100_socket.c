@@ -73,6 +73,9 @@ nic_w5100_socket_init( nic_w5100_socket_t *socket, int which )
 {
   socket->id = which;
   w5100_socket_init_common( socket );
+  socket->fd_generation = 0;
+  socket->registered_generation = 0;
+  socket->registered_events = 0;
   pthread_mutex_init( &socket->lock, NULL );
 }
 
@@ -105,6 +108,14 @@ w5100_socket_release_lock( nic_w5100_socket_t *socket )
   }
 }
 
+/* Close the socket's fd; must be called with the lock held */
+static int
+w5100_socket_close_fd( nic_w5100_socket_t *socket )
+{
+  socket->fd_generation++;
+  return compat_socket_close( socket->fd );
+}
+
 static void
 w5100_socket_clean( nic_w5100_socket_t *socket )
 {
@@ -125,7 +136,7 @@ w5100_socket_clean( nic_w5100_socket_t *socket )
   }
 
   if( socket->fd != compat_socket_invalid ) {
-    compat_socket_close( socket->fd );
+    w5100_socket_close_fd( socket );
     w5100_socket_init_common( socket );
   }
 }
@@ -300,9 +311,10 @@ w5100_socket_connect( nic_w5100_t *self, nic_w5100_socket_t *socket )
     if( socket->mode == W5100_SOCKET_MODE_TCP && port == 443 ) {
       /* Look up hostname from DNS cache for SNI */
       uint32_t ipv4_host = ntohl( sa.sin_addr.s_addr );
-      const char *hostname = dns_resolve_hostname( ipv4_host );
+      char *hostname = dns_resolve_hostname( ipv4_host );
       
       socket->tls_socket = tls_socket_alloc( socket->fd, hostname );
+      libspectrum_free( hostname );
       if( !socket->tls_socket ) {
         nic_w5100_error( UI_ERROR_ERROR,
           "w5100: failed to allocate TLS socket for socket %d\n", socket->id );
@@ -345,6 +357,10 @@ w5100_socket_connect( nic_w5100_t *self, nic_w5100_socket_t *socket )
 
     socket->ir |= 1 << 0;
     socket->state = W5100_SOCKET_STATE_ESTABLISHED;
+
+    /* Start waiting for data straight away, rather than after the next
+       command */
+    compat_socket_selfpipe_wake( self->selfpipe );
   }
 }
 
@@ -370,7 +386,7 @@ w5100_socket_close( nic_w5100_t *self, nic_w5100_socket_t *socket )
       tls_socket_free( socket->tls_socket );
       socket->tls_socket = NULL;
     }
-    compat_socket_close( socket->fd );
+    w5100_socket_close_fd( socket );
     socket->fd = compat_socket_invalid;
     socket->socket_bound = 0;
     socket->ok_for_io = 0;
@@ -464,6 +480,9 @@ w5100_write_socket_port( nic_w5100_t *self, nic_w5100_socket_t *socket, int whic
   }
 }
 
+/* Register reads don't take the socket lock, as guest code polls them
+   constantly: each is a single byte or word which is only changed under
+   the lock, so a read sees either its old or its new value */
 libspectrum_byte
 nic_w5100_socket_read( nic_w5100_t *self, libspectrum_word reg )
 {
@@ -473,8 +492,6 @@ nic_w5100_socket_read( nic_w5100_t *self, libspectrum_word reg )
   libspectrum_word fsr;
   libspectrum_byte b;
 
-  w5100_socket_acquire_lock( socket );
-
   switch( socket_reg ) {
     case W5100_SOCKET_MR:
       b = socket->mode;
@@ -511,6 +528,7 @@ nic_w5100_socket_read( nic_w5100_t *self, libspectrum_word reg )
     case W5100_SOCKET_RX_RSR0: case W5100_SOCKET_RX_RSR1:
       reg_offset = socket_reg - W5100_SOCKET_RX_RSR0;
       b = ( socket->rx_rsr >> ( 8 * ( 1 - reg_offset ) ) ) & 0xff;
+      nic_w5100_barrier();
       nic_w5100_debug( "w5100: reading 0x%02x from S%d_RX_RSR%d\n", b, socket->id, reg_offset );
       break;
     case W5100_SOCKET_RX_RD0: case W5100_SOCKET_RX_RD1:
@@ -524,8 +542,6 @@ nic_w5100_socket_read( nic_w5100_t *self, libspectrum_word reg )
       break;
   }
 
-  w5100_socket_release_lock( socket );
-
   return b;
 }
 
@@ -605,12 +621,19 @@ nic_w5100_socket_write_tx_buffer( nic_w5100_t *self, libspectrum_word reg, libsp
   socket->tx_buffer[offset] = b;
 }
 
-void
-nic_w5100_socket_add_to_sets( nic_w5100_t *self, nic_w5100_socket_t *socket, fd_set *readfds,
-  fd_set *writefds, int *max_fd )
+/* Returns what the I/O thread should wait for on this socket, and the fd
+   to wait on */
+int
+nic_w5100_socket_io_events( nic_w5100_socket_t *socket, compat_socket_t *fd,
+                            unsigned *generation )
 {
+  int events = 0;
+
   w5100_socket_acquire_lock( socket );
 
+  *fd = socket->fd;
+  if( generation ) *generation = socket->fd_generation;
+
   if( socket->fd != compat_socket_invalid ) {
     /* We can process a UDP read if we're in a UDP state and there are at least
        9 bytes free in our buffer (8 byte UDP header and 1 byte of actual
@@ -627,21 +650,19 @@ nic_w5100_socket_add_to_sets( nic_w5100_t *self, nic_w5100_socket_t *socket, fd_
     socket->ok_for_io = 1;
 
     if( udp_read || tcp_read || tcp_listen ) {
-      FD_SET( socket->fd, readfds );
-      if( socket->fd > *max_fd )
-        *max_fd = socket->fd;
-      nic_w5100_debug( "w5100: checking for read on socket %d with fd %d; max fd %d\n", socket->id, socket->fd, *max_fd );
+      events |= W5100_IO_READ;
+      nic_w5100_debug( "w5100: checking for read on socket %d with fd %d\n", socket->id, socket->fd );
     }
 
     if( socket->write_pending ) {
-      FD_SET( socket->fd, writefds );
-      if( socket->fd > *max_fd )
-        *max_fd = socket->fd;
-      nic_w5100_debug( "w5100: write pending on socket %d with fd %d; max fd %d\n", socket->id, socket->fd, *max_fd );
+      events |= W5100_IO_WRITE;
+      nic_w5100_debug( "w5100: write pending on socket %d with fd %d\n", socket->id, socket->fd );
     }
   }
 
   w5100_socket_release_lock( socket );
+
+  return events;
 }
 
 static void
@@ -663,7 +684,7 @@ w5100_socket_process_accept( nic_w5100_socket_t *socket )
 
   nic_w5100_debug( "w5100: accepted connection from %s:%d on socket %d\n", inet_ntoa(sa.sin_addr), ntohs(sa.sin_port), socket->id );
 
-  if( compat_socket_close( socket->fd ) == -1 )
+  if( w5100_socket_close_fd( socket ) == -1 )
     nic_w5100_debug( "w5100: error attempting to close fd %d for socket %d\n", socket->fd, socket->id );
 
   socket->fd = new_fd;
@@ -723,9 +744,6 @@ w5100_socket_process_read( nic_w5100_t *self, nic_w5100_socket_t *socket )
       bytes_read += 8;
     }
 
-    socket->rx_rsr += bytes_read;
-    socket->ir |= 1 << 2;
-
     if( offset + bytes_read <= 0x800 ) {
       memcpy( dest, buffer, bytes_read );
     }
@@ -734,6 +752,11 @@ w5100_socket_process_read( nic_w5100_t *self, nic_w5100_socket_t *socket )
       memcpy( dest, buffer, first_chunk );
       memcpy( socket->rx_buffer, buffer + first_chunk, bytes_read - first_chunk );
     }
+
+    /* The emulation may read the data as soon as it sees Sn_RX_RSR change */
+    nic_w5100_barrier();
+    socket->rx_rsr += bytes_read;
+    socket->ir |= 1 << 2;
   }
   else if( bytes_read == 0 ) {  /* TCP */
     socket->state = W5100_SOCKET_STATE_CLOSE_WAIT;
@@ -840,13 +863,12 @@ w5100_socket_process_tcp_write( nic_w5100_t *self, nic_w5100_socket_t *socket )
 }
 
 void
-nic_w5100_socket_process_io( nic_w5100_t *self, nic_w5100_socket_t *socket, fd_set readfds,
-  fd_set writefds )
+nic_w5100_socket_process_io( nic_w5100_t *self, nic_w5100_socket_t *socket, int events )
 {
   w5100_socket_acquire_lock( socket );
 
   /* Process only if we're an open socket, and we haven't been closed and
-     re-opened since the select() started */
+     re-opened since the I/O thread started waiting */
   if( socket->fd != compat_socket_invalid && socket->ok_for_io ) {
     /* Handle TLS handshake if needed */
     if( socket->tls_socket && !socket->tls_socket->handshake_complete ) {
@@ -858,7 +880,7 @@ nic_w5100_socket_process_io( nic_w5100_t *self, nic_w5100_socket_t *socket, fd_s
         socket->ir |= 1 << 0;
       }
       else if( ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE ) {
-        /* Handshake needs more I/O, will be retried on next select */
+        /* Handshake needs more I/O, will be retried on next wake */
         socket->write_pending = 1;
       }
       else {
@@ -872,14 +894,14 @@ nic_w5100_socket_process_io( nic_w5100_t *self, nic_w5100_socket_t *socket, fd_s
       }
     }
 
-    if( FD_ISSET( socket->fd, &readfds ) ) {
+    if( events & W5100_IO_READ ) {
       if( socket->state == W5100_SOCKET_STATE_LISTEN )
         w5100_socket_process_accept( socket );
       else
         w5100_socket_process_read( self, socket );
     }
 
-    if( FD_ISSET( socket->fd, &writefds ) ) {
+    if( events & W5100_IO_WRITE ) {
       if( socket->state == W5100_SOCKET_STATE_UDP ) {
         w5100_socket_process_udp_write( socket );
       }
@@ -13,6 +13,7 @@
 #define MBEDTLS_PKCS1_V15
 // Removed MBEDTLS_SHA256_SMALLER for better performance (uses more RAM but much faster)
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION
+#define MBEDTLS_SSL_SESSION_TICKETS
 #define MBEDTLS_AES_C
 #define MBEDTLS_ASN1_PARSE_C
 #define MBEDTLS_BIGNUM_C
@@ -112,6 +112,8 @@ tls_socket_alloc( compat_socket_t fd, const char *hostname )
   tls->fd = fd;
   tls->handshake_complete = 0;
   tls->has_pending_data = 0;
+  tls->resumed = 0;
+  tls->offered_id_len = 0;
 
   mbedtls_ssl_init( &tls->ssl );
   mbedtls_ssl_config_init( &tls->conf );
@@ -130,6 +132,9 @@ tls_socket_alloc( compat_socket_t fd, const char *hostname )
   /* Disable certificate verification for now */
   mbedtls_ssl_conf_authmode( &tls->conf, MBEDTLS_SSL_VERIFY_NONE );
 
+  /* Accept session tickets so later connections can skip the full handshake */
+  mbedtls_ssl_conf_session_tickets( &tls->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED );
+
   /* Set RNG callback using platform RNG */
   mbedtls_ssl_conf_rng( &tls->conf, tls_rng, NULL );
 
@@ -234,6 +239,19 @@ tls_connect( tls_socket_t *tls )
   /* Restore socket to non-blocking mode */
   compat_socket_blocking_mode( tls->fd, 0 );
 
+  /* The server echoes the offered session ID when it accepts resumption */
+  if( ret == 0 && tls->offered_id_len ) {
+    mbedtls_ssl_session session;
+
+    mbedtls_ssl_session_init( &session );
+    if( mbedtls_ssl_get_session( &tls->ssl, &session ) == 0 &&
+        mbedtls_ssl_session_get_id_len( &session ) == tls->offered_id_len &&
+        !memcmp( mbedtls_ssl_session_get_id( &session ), tls->offered_id,
+                 tls->offered_id_len ) )
+      tls->resumed = 1;
+    mbedtls_ssl_session_free( &session );
+  }
+
   if( ret == 0 ) {
     return 0;
   }
@@ -242,6 +260,35 @@ tls_connect( tls_socket_t *tls )
   }
 }
 
+int
+tls_set_session( tls_socket_t *tls, const mbedtls_ssl_session *session )
+{
+  size_t id_len;
+
+  if( !tls || !session || tls->handshake_complete )
+    return -1;
+
+  if( mbedtls_ssl_set_session( &tls->ssl, session ) != 0 )
+    return -1;
+
+  id_len = mbedtls_ssl_session_get_id_len( session );
+  if( id_len > sizeof( tls->offered_id ) )
+    id_len = 0;
+  memcpy( tls->offered_id, mbedtls_ssl_session_get_id( session ), id_len );
+  tls->offered_id_len = id_len;
+
+  return 0;
+}
+
+int
+tls_get_session( tls_socket_t *tls, mbedtls_ssl_session *session )
+{
+  if( !tls || !session || !tls->handshake_complete )
+    return -1;
+
+  return mbedtls_ssl_get_session( &tls->ssl, session ) == 0 ? 0 : -1;
+}
+
 ssize_t
 tls_read( tls_socket_t *tls, void *buf, size_t len )
 {
@@ -32,6 +32,9 @@ typedef struct tls_socket_t {
   compat_socket_t fd;                 /* Underlying POSIX socket */
   int handshake_complete;             /* Flag for handshake status */
   int has_pending_data;               /* Flag indicating more data available after read */
+  int resumed;                        /* Handshake resumed an earlier session */
+  unsigned char offered_id[32];       /* Session ID offered for resumption */
+  size_t offered_id_len;
 } tls_socket_t;
 
 /* Allocate and initialize a TLS socket from a POSIX socket */
@@ -44,6 +47,14 @@ void tls_socket_free( tls_socket_t *tls );
 /* Perform blocking TLS handshake (called after connect) */
 int tls_connect( tls_socket_t *tls );
 
+/* Offer a session saved by tls_get_session for resumption; call before
+   tls_connect. Returns 0 on success */
+int tls_set_session( tls_socket_t *tls, const mbedtls_ssl_session *session );
+
+/* Save the negotiated session (including any session ticket) so a later
+   connection to the same server can resume it. Returns 0 on success */
+int tls_get_session( tls_socket_t *tls, mbedtls_ssl_session *session );
+
 /* Read from TLS socket, sets has_pending_data if more data available */
 ssize_t tls_read( tls_socket_t *tls, void *buf, size_t len );
 
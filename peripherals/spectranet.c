@@ -44,12 +44,15 @@
 #include "peripherals/ula.h"
 #include "peripherals/nic/dns_resolver.h"
 #include "peripherals/fs/xfs.h"
+#include "peripherals/fs/xfs_cache.h"
 #include "peripherals/fs/xfs_worker.h"
+#include "peripherals/http/http_sck.h"
 #include "peripherals/nic/spectranext_controller.h"
 #include "peripherals/nic/spectranext_stdout.h"
 #include "settings.h"
 #include "utils.h"
 #include "ui/ui.h"
+#include "z80/z80.h"
 
 #define SPECTRANET_PAGES 256
 #define SPECTRANET_PAGE_LENGTH 0x1000
@@ -152,7 +155,7 @@ static void
 spectranet_map_page( int dest, int source )
 {
   int i;
-  int w5100_page = source >= 0x40 && source < 0x48;
+  int w5100_page = source >= 0x40 && source < 0x44;
   int xfs_page = (source == XFS_SPECTRANET_PAGE);
   int spectranext_config_page = (source == SPECTRANEXT_CONTROLLER_PAGE);
   int flash_page = source >= 0x00 && source < 0x20;
@@ -221,6 +224,7 @@ spectranet_reset( int hard_reset )
   
   // Reset XFS filesystem whenever Spectranet resets (hard or soft)
   // This ensures XFS state is clean on Spectrum reboot
+  spectranext_controller_wait_idle();
   xfs_reset();
 
   if( spectranet_paged ) {
@@ -281,8 +285,19 @@ spectranet_activate( void )
 
     flash_am29f010_init( flash_rom, rom );
 
-    /* Pages 0x40 to 0x47 are the W5100 registers - handled in readbyte()
-       and writebyte() */
+    /* Pages 0x40 to 0x43 are the W5100 registers - handled in readbyte()
+       and writebyte(). Pages 0x44 to 0x47 are its transmit and receive
+       buffers, which are plain memory and so mapped directly; each
+       memory page is one socket's 2K buffer */
+    for( i = 0x44; i < 0x48; i++ ) {
+      for( j = 0; j < MEMORY_PAGES_IN_4K; j++ ) {
+        memory_page *page = &spectranet_full_map[i * MEMORY_PAGES_IN_4K + j];
+        libspectrum_word reg = ( i - SPECTRANET_BUFFER_BASE ) *
+          SPECTRANET_PAGE_LENGTH + j * MEMORY_PAGE_SIZE;
+        page->writable = reg < 0x6000;
+        page->page = nic_w5100_buffer( w5100, reg );
+      }
+    }
 
     /* Pages 0xc0 to 0xff are the RAM */
     ram = memory_pool_allocate_persistent( SPECTRANET_RAM_LENGTH, 1 );
@@ -446,6 +461,8 @@ spectranet_trap( libspectrum_word port, libspectrum_byte data )
       (spectranet_programmable_trap & 0xff00) | data;
 
   trap_write_msb = !trap_write_msb;
+
+  z80_traps_update();
 }
 
 static libspectrum_byte
@@ -478,6 +495,8 @@ spectranet_control_write( libspectrum_word port, libspectrum_byte data )
     spectranet_unpage();
 
   spectranet_programmable_trap_active = data & 0x08;
+
+  z80_traps_update();
 }
 
 static const periph_port_t spectranet_ports[] = {
@@ -507,6 +526,8 @@ spectranet_init( void *context )
 
   dns_resolver_init();
   spectranext_controller_init();
+  xfs_worker_init();
+  xfs_cache_init();
   w5100 = nic_w5100_alloc();
   flash_rom = flash_am29f010_alloc();
 
@@ -516,7 +537,11 @@ spectranet_init( void *context )
 static void
 spectranet_end( void )
 {
+  spectranext_controller_end();
+  xfs_worker_end();
+  http_sck_end();
   nic_w5100_free( w5100 );
+  dns_resolver_end();
   flash_am29f010_free( flash_rom );
 }
 
@@ -23,14 +23,44 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define POKEFINDER_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#if defined( __ARM_NEON ) && defined( __aarch64__ )
+#define POKEFINDER_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 #include "libspectrum.h"
 
+#include "compat.h"
 #include "machine.h"
 #include "memory_pages.h"
 #include "pokefinder.h"
 #include "spectrum.h"
+#include "ui/ui.h"
+
+#define PAGE_COUNT ( MEMORY_PAGES_IN_16K * SPECTRUM_RAM_PAGES )
+#define BITMAP_SIZE ( MEMORY_PAGE_SIZE / 8 )
+
+/* The comparisons which can be made between the current value of each byte
+   and either the values being searched for or the byte's value at the time
+   of the previous search */
+typedef enum pokefinder_test {
+  TEST_EQUAL,			/* current == low */
+  TEST_RANGE,			/* low <= current <= high */
+  TEST_INCREMENTED,		/* current > previous */
+  TEST_DECREMENTED,		/* current < previous */
+  TEST_CHANGED,			/* current != previous */
+  TEST_UNCHANGED,		/* current == previous */
+} pokefinder_test;
 
 libspectrum_byte pokefinder_possible[ MEMORY_PAGES_IN_16K * SPECTRUM_RAM_PAGES ][ MEMORY_PAGE_SIZE ] = { { 0 } };
 libspectrum_byte pokefinder_impossible[ MEMORY_PAGES_IN_16K * SPECTRUM_RAM_PAGES ][ MEMORY_PAGE_SIZE / 8 ] = { { 0 } };
@@ -52,22 +82,395 @@ pokefinder_clear( void )
       memset( pokefinder_impossible[page], 255, MEMORY_PAGE_SIZE / 8 );
 }
 
+static inline int
+bits_set( libspectrum_byte byte )
+{
+#ifdef __GNUC__
+  return __builtin_popcount( byte );
+#else				/* #ifdef __GNUC__ */
+  static const libspectrum_byte nibble[16] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+  };
+  return nibble[ byte & 0x0f ] + nibble[ byte >> 4 ];
+#endif				/* #ifdef __GNUC__ */
+}
+
+/* Are all the bytes covered by this part of the impossible bitmap already
+   ruled out? */
+static inline int
+all_impossible( const libspectrum_byte *impossible, size_t length )
+{
+  size_t i;
+
+  for( i = 0; i < length; i++ )
+    if( impossible[i] != 0xff ) return 0;
+
+  return 1;
+}
+
+/* Test every block of a page with test_block_<name>(), which compares
+   block_size bytes at once, setting the corresponding bits in match for
+   those bytes which pass the test. Blocks whose bytes have all already
+   been ruled out are skipped (and their match bits left clear) unless
+   test_all is set */
+#define TEST_PAGE( name, block_size, target )				\
+static target void							\
+test_page_##name( pokefinder_test test, const libspectrum_byte *current,	\
+		  const libspectrum_byte *previous,			\
+		  const libspectrum_byte *impossible, libspectrum_byte low,	\
+		  libspectrum_byte high, int test_all,			\
+		  libspectrum_byte *match )				\
+{									\
+  size_t offset;							\
+									\
+  for( offset = 0; offset < MEMORY_PAGE_SIZE; offset += (block_size) ) {	\
+    size_t bitmap = offset / 8;						\
+									\
+    if( !test_all &&							\
+	all_impossible( &impossible[ bitmap ], (block_size) / 8 ) ) {	\
+      memset( &match[ bitmap ], 0, (block_size) / 8 );			\
+      continue;								\
+    }									\
+									\
+    test_block_##name( test, &current[ offset ], &previous[ offset ],	\
+		       low, high, &match[ bitmap ] );			\
+  }									\
+}
+
+static inline void
+test_block_scalar( pokefinder_test test, const libspectrum_byte *current,
+		   const libspectrum_byte *previous, libspectrum_byte low,
+		   libspectrum_byte high, libspectrum_byte *match )
+{
+  libspectrum_byte mask = 0;
+  size_t i;
+
+  /* Keep the switch outside the loops so each one can be unrolled */
+  switch( test ) {
+  case TEST_EQUAL:
+    for( i = 0; i < 8; i++ ) mask |= ( current[i] == low ) << i;
+    break;
+  case TEST_RANGE:
+    for( i = 0; i < 8; i++ )
+      mask |= ( (libspectrum_byte)( current[i] - low ) <=
+		(libspectrum_byte)( high - low ) ) << i;
+    break;
+  case TEST_INCREMENTED:
+    for( i = 0; i < 8; i++ ) mask |= ( current[i] > previous[i] ) << i;
+    break;
+  case TEST_DECREMENTED:
+    for( i = 0; i < 8; i++ ) mask |= ( current[i] < previous[i] ) << i;
+    break;
+  case TEST_CHANGED:
+    for( i = 0; i < 8; i++ ) mask |= ( current[i] != previous[i] ) << i;
+    break;
+  case TEST_UNCHANGED:
+  default:
+    for( i = 0; i < 8; i++ ) mask |= ( current[i] == previous[i] ) << i;
+    break;
+  }
+
+  match[0] = mask;
+}
+
+TEST_PAGE( scalar, 8, )
+
+#ifdef POKEFINDER_SIMD_X86
+
+/* These are compiled for their instruction set whatever the compiler's
+   target, and used only if the CPU we're running on supports it */
+#define SSE2_TARGET __attribute__(( target( "sse2" ) ))
+#define AVX2_TARGET __attribute__(( target( "avx2" ) ))
+
+static inline SSE2_TARGET void
+test_block_sse2( pokefinder_test test, const libspectrum_byte *current,
+		 const libspectrum_byte *previous, libspectrum_byte low,
+		 libspectrum_byte high, libspectrum_byte *match )
+{
+  __m128i c = _mm_loadu_si128( (const __m128i*)current ), p, d, result;
+  unsigned int mask;
+
+  switch( test ) {
+  case TEST_EQUAL:
+    result = _mm_cmpeq_epi8( c, _mm_set1_epi8( low ) );
+    break;
+  case TEST_RANGE:
+    d = _mm_sub_epi8( c, _mm_set1_epi8( low ) );
+    result = _mm_cmpeq_epi8( _mm_min_epu8( d, _mm_set1_epi8( high - low ) ),
+			     d );
+    break;
+  case TEST_INCREMENTED:
+    p = _mm_loadu_si128( (const __m128i*)previous );
+    result = _mm_andnot_si128( _mm_cmpeq_epi8( c, p ),
+			       _mm_cmpeq_epi8( _mm_max_epu8( c, p ), c ) );
+    break;
+  case TEST_DECREMENTED:
+    p = _mm_loadu_si128( (const __m128i*)previous );
+    result = _mm_andnot_si128( _mm_cmpeq_epi8( c, p ),
+			       _mm_cmpeq_epi8( _mm_min_epu8( c, p ), c ) );
+    break;
+  case TEST_CHANGED:
+    p = _mm_loadu_si128( (const __m128i*)previous );
+    result = _mm_xor_si128( _mm_cmpeq_epi8( c, p ), _mm_set1_epi8( -1 ) );
+    break;
+  case TEST_UNCHANGED:
+  default:
+    p = _mm_loadu_si128( (const __m128i*)previous );
+    result = _mm_cmpeq_epi8( c, p );
+    break;
+  }
+
+  mask = _mm_movemask_epi8( result );
+  match[0] = mask; match[1] = mask >> 8;
+}
+
+TEST_PAGE( sse2, 16, SSE2_TARGET )
+
+static inline AVX2_TARGET void
+test_block_avx2( pokefinder_test test, const libspectrum_byte *current,
+		 const libspectrum_byte *previous, libspectrum_byte low,
+		 libspectrum_byte high, libspectrum_byte *match )
+{
+  __m256i c = _mm256_loadu_si256( (const __m256i*)current ), p, d, result;
+  unsigned int mask;
+
+  switch( test ) {
+  case TEST_EQUAL:
+    result = _mm256_cmpeq_epi8( c, _mm256_set1_epi8( low ) );
+    break;
+  case TEST_RANGE:
+    d = _mm256_sub_epi8( c, _mm256_set1_epi8( low ) );
+    result = _mm256_cmpeq_epi8(
+      _mm256_min_epu8( d, _mm256_set1_epi8( high - low ) ), d );
+    break;
+  case TEST_INCREMENTED:
+    p = _mm256_loadu_si256( (const __m256i*)previous );
+    result = _mm256_andnot_si256( _mm256_cmpeq_epi8( c, p ),
+				  _mm256_cmpeq_epi8( _mm256_max_epu8( c, p ), c ) );
+    break;
+  case TEST_DECREMENTED:
+    p = _mm256_loadu_si256( (const __m256i*)previous );
+    result = _mm256_andnot_si256( _mm256_cmpeq_epi8( c, p ),
+				  _mm256_cmpeq_epi8( _mm256_min_epu8( c, p ), c ) );
+    break;
+  case TEST_CHANGED:
+    p = _mm256_loadu_si256( (const __m256i*)previous );
+    result = _mm256_xor_si256( _mm256_cmpeq_epi8( c, p ),
+			       _mm256_set1_epi8( -1 ) );
+    break;
+  case TEST_UNCHANGED:
+  default:
+    p = _mm256_loadu_si256( (const __m256i*)previous );
+    result = _mm256_cmpeq_epi8( c, p );
+    break;
+  }
+
+  mask = _mm256_movemask_epi8( result );
+  match[0] = mask; match[1] = mask >> 8;
+  match[2] = mask >> 16; match[3] = mask >> 24;
+}
+
+TEST_PAGE( avx2, 32, AVX2_TARGET )
+
+#endif				/* #ifdef POKEFINDER_SIMD_X86 */
+
+#ifdef POKEFINDER_SIMD_NEON
+
+static inline void
+test_block_neon( pokefinder_test test, const libspectrum_byte *current,
+		 const libspectrum_byte *previous, libspectrum_byte low,
+		 libspectrum_byte high, libspectrum_byte *match )
+{
+  /* NEON has no movemask, so weight each lane by its bit and add across
+     each half of the vector instead */
+  static const libspectrum_byte weights[16] = {
+    1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+  };
+  uint8x16_t c = vld1q_u8( current ), result;
+
+  switch( test ) {
+  case TEST_EQUAL:
+    result = vceqq_u8( c, vdupq_n_u8( low ) );
+    break;
+  case TEST_RANGE:
+    result = vcleq_u8( vsubq_u8( c, vdupq_n_u8( low ) ),
+		       vdupq_n_u8( high - low ) );
+    break;
+  case TEST_INCREMENTED:
+    result = vcgtq_u8( c, vld1q_u8( previous ) );
+    break;
+  case TEST_DECREMENTED:
+    result = vcltq_u8( c, vld1q_u8( previous ) );
+    break;
+  case TEST_CHANGED:
+    result = vmvnq_u8( vceqq_u8( c, vld1q_u8( previous ) ) );
+    break;
+  case TEST_UNCHANGED:
+  default:
+    result = vceqq_u8( c, vld1q_u8( previous ) );
+    break;
+  }
+
+  result = vandq_u8( result, vld1q_u8( weights ) );
+  match[0] = vaddv_u8( vget_low_u8( result ) );
+  match[1] = vaddv_u8( vget_high_u8( result ) );
+}
+
+TEST_PAGE( neon, 16, )
+
+#endif				/* #ifdef POKEFINDER_SIMD_NEON */
+
+typedef void (*test_page_fn)( pokefinder_test test,
+			      const libspectrum_byte *current,
+			      const libspectrum_byte *previous,
+			      const libspectrum_byte *impossible,
+			      libspectrum_byte low, libspectrum_byte high,
+			      int test_all, libspectrum_byte *match );
+
+/* The ways of testing a page we have, from slowest to fastest */
+static const struct {
+
+  const char *name;
+  test_page_fn test_page;
+
+} engines[] = {
+
+  { "scalar", test_page_scalar },
+#ifdef POKEFINDER_SIMD_X86
+  { "SSE2",   test_page_sse2   },
+  { "AVX2",   test_page_avx2   },
+#endif
+#ifdef POKEFINDER_SIMD_NEON
+  { "NEON",   test_page_neon   },
+#endif
+
+};
+
+/* The engine in use, or -1 before the first search picks one */
+static int engine = -1;
+
+static int
+engine_supported( size_t which )
+{
+#ifdef POKEFINDER_SIMD_X86
+  __builtin_cpu_init();
+  if( engines[ which ].test_page == test_page_sse2 )
+    return __builtin_cpu_supports( "sse2" );
+  if( engines[ which ].test_page == test_page_avx2 )
+    return __builtin_cpu_supports( "avx2" );
+#endif
+
+  return 1;
+}
+
+/* Use the fastest engine this CPU supports */
+static void
+engine_init( void )
+{
+  engine = ARRAY_SIZE( engines ) - 1;
+  while( engine > 0 && !engine_supported( engine ) ) engine--;
+}
+
+static void
+test_page( pokefinder_test test, size_t page, libspectrum_byte low,
+	   libspectrum_byte high, int test_all, libspectrum_byte *match )
+{
+  if( engine < 0 ) engine_init();
+
+  engines[ engine ].test_page( test, memory_map_ram[ page ].page,
+			       pokefinder_possible[ page ],
+			       pokefinder_impossible[ page ], low, high,
+			       test_all, match );
+}
+
+/* Rule out every still possible byte in a page which did not match */
+static void
+apply_page( size_t page, const libspectrum_byte *match )
+{
+  libspectrum_byte *impossible = pokefinder_impossible[ page ];
+  size_t i;
+
+  for( i = 0; i < BITMAP_SIZE; i++ ) {
+    libspectrum_byte ruled_out = ~( match[i] | impossible[i] );
+
+    if( ruled_out ) {
+      impossible[i] |= ruled_out;
+      pokefinder_count -= bits_set( ruled_out );
+    }
+  }
+}
+
+/* Run one test over all of RAM. If update is set, the current contents of
+   memory become the "previous" values for the next search */
+static int
+narrow( pokefinder_test test, libspectrum_byte low, libspectrum_byte high,
+	int update )
+{
+  libspectrum_byte match[ BITMAP_SIZE ];
+  size_t page;
+
+  for( page = 0; page < PAGE_COUNT; page++ ) {
+    if( all_impossible( pokefinder_impossible[ page ], BITMAP_SIZE ) )
+      continue;
+
+    test_page( test, page, low, high, 0, match );
+    apply_page( page, match );
+
+    if( update )
+      memcpy( pokefinder_possible[ page ], memory_map_ram[ page ].page,
+	      MEMORY_PAGE_SIZE );
+  }
+
+  return 0;
+}
+
 int
 pokefinder_search( libspectrum_byte value )
 {
-  size_t page, offset;
+  return narrow( TEST_EQUAL, value, value, 0 );
+}
 
-  for( page = 0; page < MEMORY_PAGES_IN_16K * SPECTRUM_RAM_PAGES; page++ ) {
-    memory_page *mapping = &memory_map_ram[ page ];
+int
+pokefinder_search_range( libspectrum_byte low, libspectrum_byte high )
+{
+  if( low > high ) {
+    libspectrum_byte temp = low; low = high; high = temp;
+  }
 
-    for( offset = 0; offset < MEMORY_PAGE_SIZE; offset++ ) {
-      if( pokefinder_impossible[page][offset/8] & 1 << (offset & 7) ) continue;
+  return narrow( TEST_RANGE, low, high, 0 );
+}
 
-      if( mapping->page[offset] != value ) {
-	pokefinder_impossible[page][offset/8] |= 1 << (offset & 7);
-	pokefinder_count--;
-      }
+/* A 16-bit value is found at the address of its low byte; the high byte
+   must follow it in the same 16K RAM page */
+int
+pokefinder_search_word( libspectrum_word value )
+{
+  libspectrum_byte match[ BITMAP_SIZE ], high_match[ BITMAP_SIZE ];
+  libspectrum_byte low = value & 0xff, high = value >> 8;
+  size_t page, i;
+
+  for( page = 0; page < PAGE_COUNT; page++ ) {
+    int next_high = 0;
+
+    if( all_impossible( pokefinder_impossible[ page ], BITMAP_SIZE ) )
+      continue;
+
+    test_page( TEST_EQUAL, page, low, low, 0, match );
+    test_page( TEST_EQUAL, page, high, high, 1, high_match );
+
+    /* The byte after the last one in this page is the first byte of the
+       next page, as long as that's in the same 16K page */
+    if( ( page + 1 ) % MEMORY_PAGES_IN_16K )
+      next_high = memory_map_ram[ page + 1 ].page[0] == high;
+
+    /* Shift the high byte matches down by one place so they line up with
+       the low byte they follow */
+    for( i = 0; i < BITMAP_SIZE; i++ ) {
+      int carry = i + 1 < BITMAP_SIZE ? high_match[ i + 1 ] & 1 : next_high;
+      match[i] &= ( high_match[i] >> 1 ) | ( carry << 7 );
     }
+
+    apply_page( page, match );
   }
 
   return 0;
@@ -76,47 +479,292 @@ pokefinder_search( libspectrum_byte value )
 int
 pokefinder_incremented( void )
 {
-  size_t page, offset;
+  return narrow( TEST_INCREMENTED, 0, 0, 1 );
+}
 
-  for( page = 0; page < MEMORY_PAGES_IN_16K * SPECTRUM_RAM_PAGES; page++ ) {
-    memory_page *mapping = &memory_map_ram[ page ];
+int
+pokefinder_decremented( void )
+{
+  return narrow( TEST_DECREMENTED, 0, 0, 1 );
+}
 
-    for( offset = 0; offset < MEMORY_PAGE_SIZE; offset++ ) {
-      if( pokefinder_impossible[page][offset/8] & 1 << (offset & 7) ) continue;
+int
+pokefinder_changed( void )
+{
+  return narrow( TEST_CHANGED, 0, 0, 1 );
+}
 
-      if( mapping->page[offset] > pokefinder_possible[page][offset] ) {
-        pokefinder_possible[page][offset] = mapping->page[offset];
-      } else {
-	pokefinder_impossible[page][offset/8] |= 1 << (offset & 7);
-	pokefinder_count--;
-      }
+int
+pokefinder_unchanged( void )
+{
+  return narrow( TEST_UNCHANGED, 0, 0, 1 );
+}
 
+static int
+parse_value( const char *text, long *value, char **endptr )
+{
+  int base;
+
+  errno = 0;
+  base = !strncmp( text, "0x", 2 ) ? 16 : 10;
+  *value = strtol( text, endptr, base );
+
+  return errno != 0 || *endptr == text;
+}
+
+/* Search for what the user typed: a byte value, a range of byte values
+   written as "low-high" or a 16-bit value, which is searched for in
+   little-endian order. Values are decimal, or hex with a "0x" prefix.
+   Returns non-zero, having reported the problem, if the text isn't one
+   of those */
+int
+pokefinder_search_text( const char *text )
+{
+  long value, high;
+  char *endptr;
+
+  if( parse_value( text, &value, &endptr ) || value < 0 || value > 65535 ||
+      ( *endptr && *endptr != '-' ) ) {
+    ui_error( UI_ERROR_ERROR,
+	      "Invalid value: use an integer from 0 to 65535 or a range" );
+    return 1;
+  }
+
+  if( *endptr == '-' ) {
+    if( parse_value( endptr + 1, &high, &endptr ) || *endptr ||
+	value > 255 || high < 0 || high > 255 ) {
+      ui_error( UI_ERROR_ERROR,
+		"Invalid range: use two integers from 0 to 255" );
+      return 1;
     }
+    return pokefinder_search_range( value, high );
+  }
+
+  if( value > 255 ) return pokefinder_search_word( value );
+
+  return pokefinder_search( value );
+}
+
+/*
+ * Unit tests
+ */
+
+/* Does one byte pass a test? The slow way */
+static int
+unittest_match( pokefinder_test test, libspectrum_byte current,
+		libspectrum_byte previous, libspectrum_byte low,
+		libspectrum_byte high )
+{
+  switch( test ) {
+  case TEST_EQUAL: return current == low;
+  case TEST_RANGE: return current >= low && current <= high;
+  case TEST_INCREMENTED: return current > previous;
+  case TEST_DECREMENTED: return current < previous;
+  case TEST_CHANGED: return current != previous;
+  case TEST_UNCHANGED: return current == previous;
   }
 
   return 0;
 }
 
-int
-pokefinder_decremented( void )
+/* Check that every engine this CPU supports matches the same bytes as the
+   slow way, including either side of the signed/unsigned boundary */
+static int
+unittest_engines( void )
 {
-  size_t page, offset;
+  static const libspectrum_byte bounds[][2] = {
+    { 0x00, 0x00 }, { 0x30, 0x3f }, { 0x7f, 0x80 }, { 0x80, 0xff },
+    { 0x01, 0xfe }, { 0xff, 0xff },
+  };
+  libspectrum_byte current[ MEMORY_PAGE_SIZE ], previous[ MEMORY_PAGE_SIZE ];
+  libspectrum_byte impossible[ BITMAP_SIZE ], match[ BITMAP_SIZE ];
+  libspectrum_dword seed = 1;
+  size_t which, i, offset;
+  int test, test_all, expected, matched;
+
+  for( offset = 0; offset < MEMORY_PAGE_SIZE; offset++ ) {
+    seed = seed * 1103515245 + 12345;
+    current[ offset ] = seed >> 16;
+    previous[ offset ] = offset % 3 ? seed >> 24 : current[ offset ];
+  }
 
-  for( page = 0; page < MEMORY_PAGES_IN_16K * SPECTRUM_RAM_PAGES; page++ ) {
-    memory_page *mapping = &memory_map_ram[ page ];
+  /* Some blocks already entirely ruled out, some partly and some not at
+     all */
+  for( i = 0; i < BITMAP_SIZE; i++ )
+    impossible[i] = i < BITMAP_SIZE / 4 ? 0xff :
+                    i < BITMAP_SIZE / 2 ? i * 37 : 0x00;
 
-    for( offset = 0; offset < MEMORY_PAGE_SIZE; offset++ ) {
-      if( pokefinder_impossible[page][offset/8] & 1 << (offset & 7) ) continue;
+  for( which = 0; which < ARRAY_SIZE( engines ); which++ ) {
+    if( !engine_supported( which ) ) continue;
 
-      if( mapping->page[offset] < pokefinder_possible[page][offset] ) {
-        pokefinder_possible[page][offset] = mapping->page[offset];
-      } else {
-	pokefinder_impossible[page][offset/8] |= 1 << (offset & 7);
-	pokefinder_count--;
-      }
+    for( test = TEST_EQUAL; test <= TEST_UNCHANGED; test++ ) {
+      for( i = 0; i < ARRAY_SIZE( bounds ); i++ ) {
+        for( test_all = 0; test_all <= 1; test_all++ ) {
+
+          engines[ which ].test_page( test, current, previous, impossible,
+                                      bounds[i][0], bounds[i][1], test_all,
+                                      match );
 
+          /* Bytes already ruled out may or may not match unless every
+             byte was tested */
+          for( offset = 0; offset < MEMORY_PAGE_SIZE; offset++ ) {
+            if( !test_all && impossible[ offset / 8 ] & ( 1 << offset % 8 ) )
+              continue;
+
+            expected = unittest_match( test, current[ offset ],
+                                       previous[ offset ], bounds[i][0],
+                                       bounds[i][1] );
+            matched = !!( match[ offset / 8 ] & ( 1 << offset % 8 ) );
+
+            if( matched != expected ) {
+              printf( "pokefinder test: %s engine, test %d, 0x%02x-0x%02x: "
+                      "offset 0x%03x %s\n", engines[ which ].name, test,
+                      bounds[i][0], bounds[i][1], (unsigned)offset,
+                      expected ? "missed" : "wrongly matched" );
+              return 1;
+            }
+          }
+        }
+      }
     }
   }
 
   return 0;
 }
+
+/* A byte of RAM by 16K page and offset */
+static libspectrum_byte*
+unittest_ram( size_t page, libspectrum_word offset )
+{
+  return &memory_map_ram[ page * MEMORY_PAGES_IN_16K +
+                          offset / MEMORY_PAGE_SIZE ].page[ offset %
+                                                            MEMORY_PAGE_SIZE ];
+}
+
+/* Check that a 16-bit search finds a value whose bytes are in different
+   memory pages of the same 16K page, but not one split across two 16K
+   pages */
+static int
+unittest_search_word( void )
+{
+  static const libspectrum_word offsets[] = {
+    0x0000, MEMORY_PAGE_SIZE - 1, 0x1234, 0x3ffd, 0x3fff,
+  };
+  libspectrum_byte saved[ ARRAY_SIZE( offsets ) ][2], saved_next = 0;
+  libspectrum_byte low = 0x34, high = 0x12, *next = NULL;
+  size_t page, pages, i, which;
+  libspectrum_word offset;
+  int saved_engine = engine, r = 0, expected, possible;
+
+  /* Use the first 16K page the poke finder searches all of */
+  pages = machine_current->ram.valid_pages;
+  for( page = 0; page < pages; page++ ) {
+    for( i = 0; i < MEMORY_PAGES_IN_16K; i++ )
+      if( !memory_map_ram[ page * MEMORY_PAGES_IN_16K + i ].writable ) break;
+    if( i == MEMORY_PAGES_IN_16K ) break;
+  }
+  if( page == pages ) return 0;
+
+  if( page + 1 < SPECTRUM_RAM_PAGES &&
+      memory_map_ram[ ( page + 1 ) * MEMORY_PAGES_IN_16K ].page ) {
+    next = unittest_ram( page + 1, 0 );
+    saved_next = *next;
+    *next = high;
+  }
+
+  for( i = 0; i < ARRAY_SIZE( offsets ); i++ ) {
+    saved[i][0] = *unittest_ram( page, offsets[i] );
+    saved[i][1] = offsets[i] < 0x3fff ? *unittest_ram( page, offsets[i] + 1 )
+                                      : 0;
+  }
+  for( i = 0; i < ARRAY_SIZE( offsets ); i++ ) {
+    *unittest_ram( page, offsets[i] ) = low;
+    if( offsets[i] < 0x3fff ) *unittest_ram( page, offsets[i] + 1 ) = high;
+  }
+
+  for( which = 0; which < ARRAY_SIZE( engines ) && !r; which++ ) {
+    if( !engine_supported( which ) ) continue;
+    engine = which;
+
+    pokefinder_clear();
+    pokefinder_search_word( ( high << 8 ) | low );
+
+    for( offset = 0; ; offset++ ) {
+      size_t ram_page = page * MEMORY_PAGES_IN_16K + offset / MEMORY_PAGE_SIZE;
+      size_t bit = offset % MEMORY_PAGE_SIZE;
+
+      expected = *unittest_ram( page, offset ) == low && offset < 0x3fff &&
+                 *unittest_ram( page, offset + 1 ) == high;
+      possible =
+        !( pokefinder_impossible[ ram_page ][ bit / 8 ] & ( 1 << bit % 8 ) );
+
+      if( possible != expected ) {
+        printf( "pokefinder test: %s engine: 0x%04x at offset 0x%04x %s\n",
+                engines[ which ].name, ( high << 8 ) | low, offset,
+                expected ? "missed" : "wrongly found" );
+        r = 1;
+        break;
+      }
+
+      if( offset == 0x3fff ) break;
+    }
+
+    if( !r && pokefinder_impossible[ page * MEMORY_PAGES_IN_16K ][0] & 1 ) {
+      printf( "pokefinder test: %s engine: planted value not found\n",
+              engines[ which ].name );
+      r = 1;
+    }
+  }
+
+  /* Put memory back as it was */
+  for( i = ARRAY_SIZE( offsets ); i > 0; i-- ) {
+    *unittest_ram( page, offsets[ i - 1 ] ) = saved[ i - 1 ][0];
+    if( offsets[ i - 1 ] < 0x3fff )
+      *unittest_ram( page, offsets[ i - 1 ] + 1 ) = saved[ i - 1 ][1];
+  }
+  if( next ) *next = saved_next;
+
+  engine = saved_engine;
+  pokefinder_clear();
+
+  return r;
+}
+
+int
+pokefinder_unittest( void )
+{
+  int r = 0;
+
+  r += unittest_engines();
+  r += unittest_search_word();
+
+  return r;
+}
+
+#ifdef POKEFINDERBENCH
+
+/* Helper functions for the benchmark */
+int
+pokefinder_engine_select( const char *name )
+{
+  size_t i;
+
+  for( i = 0; i < ARRAY_SIZE( engines ); i++ )
+    if( !strcmp( engines[i].name, name ) ) {
+      if( !engine_supported( i ) ) return 1;
+      engine = i;
+      return 0;
+    }
+
+  return 1;
+}
+
+const char *
+pokefinder_engine_name( void )
+{
+  if( engine < 0 ) engine_init();
+
+  return engines[ engine ].name;
+}
+
+#endif				/* #ifdef POKEFINDERBENCH */
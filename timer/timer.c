@@ -115,7 +115,8 @@ timer_init( void *context )
 
   timer_event = event_register( timer_frame, "Timer" );
 
-  event_add( 0, timer_event );
+  /* In batch mode we run as fast as possible */
+  if( !settings_current.batch ) event_add( 0, timer_event );
 
   return timer_estimate_reset();
 }
@@ -45,6 +45,7 @@
 #include "ui/ui.h"
 #include "ui/scaler/scaler.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
 #include "utils.h"
 
 /* The current size of the display (in units of DISPLAY_SCREEN_*) */
@@ -355,14 +356,15 @@ uidisplay_hotswap_gfx_mode( void )
       r.w = display_current_size * image_width;
       r.h = display_current_size * image_height;
       pig_dirty_add( scaled_screen.dirty, &r );
-      scaler_proc16( unscaled_screen.pixels +
-                       unscaled_screen.image_yoffset * unscaled_screen.pitch +
-                       sizeof(uint16_t) * unscaled_screen.image_xoffset,
-                     unscaled_screen.pitch,
-                     scaled_screen.pixels +
-                       scaled_screen.image_yoffset * scaled_screen.pitch +
-                       sizeof(uint16_t) * scaled_screen.image_xoffset,
-                     scaled_screen.pitch, image_width, image_height );
+      scaler_run( current_scaler, scaler_proc16,
+                  unscaled_screen.pixels +
+                    unscaled_screen.image_yoffset * unscaled_screen.pitch +
+                    sizeof(uint16_t) * unscaled_screen.image_xoffset,
+                  unscaled_screen.pitch,
+                  scaled_screen.pixels +
+                    scaled_screen.image_yoffset * scaled_screen.pitch +
+                    sizeof(uint16_t) * scaled_screen.image_xoffset,
+                  scaled_screen.pitch, image_width, image_height );
     }
 
     for( i = 0; i < screen->dirty->count; ++i )
@@ -426,51 +428,24 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   uint16_t palette_paper = palette_values[ paper ];
 
   if( machine_current->timex ) {
-    int i;
-    uint16_t *dest_base;
-
     x <<= 4; y <<= 1;
 
-    dest_base = (uint16_t*)( (uint8_t*)unscaled_screen.pixels +
-                             (x+unscaled_screen.image_xoffset) * sizeof(uint16_t) +
-                             (y+unscaled_screen.image_yoffset) * unscaled_screen.pitch );
-
-    for( i=0; i<2; i++ ) {
-      dest = dest_base;
-
-      *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x01 ) ? palette_ink : palette_paper;
-      *dest     = ( data & 0x01 ) ? palette_ink : palette_paper;
-
-      dest_base = (uint16_t*)( (uint8_t*)dest_base + unscaled_screen.pitch );
-    }
+    dest = (uint16_t*)( (uint8_t*)unscaled_screen.pixels +
+                        (x+unscaled_screen.image_xoffset) * sizeof(uint16_t) +
+                        (y+unscaled_screen.image_yoffset) * unscaled_screen.pitch );
+
+    uiplot_bits_word_wide( dest, data, palette_ink, palette_paper );
+
+    dest = (uint16_t*)( (uint8_t*)dest + unscaled_screen.pitch );
+
+    uiplot_bits_word_wide( dest, data, palette_ink, palette_paper );
   } else {
     x <<= 3;
     dest = (uint16_t*)( (uint8_t*)unscaled_screen.pixels +
                         (x+unscaled_screen.image_xoffset) * sizeof(uint16_t) +
                         (y+unscaled_screen.image_yoffset) * unscaled_screen.pitch );
 
-    *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
-    *dest     = ( data & 0x01 ) ? palette_ink : palette_paper;
+    uiplot_bits_word( dest, data, palette_ink, palette_paper );
   }
 }
 
@@ -480,38 +455,22 @@ void
 uidisplay_plot16( int x, int y, libspectrum_word data,
 		  libspectrum_byte ink, libspectrum_byte paper )
 {
-  uint16_t *dest_base, *dest;
+  uint16_t *dest;
   int i; 
   uint16_t *palette_values = settings_current.bw_tv ? bw_values : colour_values;
   uint16_t palette_ink = palette_values[ ink ];
   uint16_t palette_paper = palette_values[ paper ];
   x <<= 4; y <<= 1;
 
-  dest_base = (uint16_t*)( (uint8_t*)unscaled_screen.pixels + (x+unscaled_screen.image_xoffset) *
-                           sizeof(uint16_t) + (y+unscaled_screen.image_yoffset) *
-                           unscaled_screen.pitch );
+  dest = (uint16_t*)( (uint8_t*)unscaled_screen.pixels + (x+unscaled_screen.image_xoffset) *
+                      sizeof(uint16_t) + (y+unscaled_screen.image_yoffset) *
+                      unscaled_screen.pitch );
 
   for( i=0; i<2; i++ ) {
-    dest = dest_base;
-
-    *(dest++) = ( data & 0x8000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x4000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x2000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x1000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0800 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0400 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0200 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0100 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0080 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0040 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0020 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0010 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0008 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0004 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0002 ) ? palette_ink : palette_paper;
-    *dest     = ( data & 0x0001 ) ? palette_ink : palette_paper;
-
-    dest_base = (uint16_t*)( (uint8_t*)dest_base + unscaled_screen.pitch );
+    uiplot_bits_word( dest,     data >> 8,   palette_ink, palette_paper );
+    uiplot_bits_word( dest + 8, data & 0xff, palette_ink, palette_paper );
+
+    dest = (uint16_t*)( (uint8_t*)dest + unscaled_screen.pitch );
   }
 }
 
@@ -580,14 +539,15 @@ uidisplay_area( int x, int y, int width, int height )
   pig_dirty_add( scaled_screen.dirty, &r );
 
   /* Create scaled image */
-  scaler_proc16( unscaled_screen.pixels + ( y + unscaled_screen.image_yoffset ) *
-                   unscaled_screen.pitch + sizeof(uint16_t) *
-                   ( x + unscaled_screen.image_xoffset ),
-                 unscaled_screen.pitch,
-                 scaled_screen.pixels + ( r.y + scaled_screen.image_yoffset ) *
-                   scaled_screen.pitch + sizeof(uint16_t) *
-                   ( r.x + scaled_screen.image_xoffset ),
-                 scaled_screen.pitch, width, height );
+  scaler_run( current_scaler, scaler_proc16,
+              unscaled_screen.pixels + ( y + unscaled_screen.image_yoffset ) *
+                unscaled_screen.pitch + sizeof(uint16_t) *
+                ( x + unscaled_screen.image_xoffset ),
+              unscaled_screen.pitch,
+              scaled_screen.pixels + ( r.y + scaled_screen.image_yoffset ) *
+                scaled_screen.pitch + sizeof(uint16_t) *
+                ( r.x + scaled_screen.image_xoffset ),
+              scaled_screen.pitch, width, height );
 }
 
 int
@@ -43,6 +43,7 @@
 #include "screenshot.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
 #include "settings.h"
 
 /* A copy of every pixel on the screen */
@@ -472,36 +473,11 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   x <<= 3;
 
   if( machine_current->timex ) {
-    int i;
-
     x <<= 1; y <<= 1;
-    for( i=0; i<2; i++,y++ ) {
-      fbdisplay_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-      fbdisplay_image[y][x+ 1] = ( data & 0x80 ) ? ink : paper;
-      fbdisplay_image[y][x+ 2] = ( data & 0x40 ) ? ink : paper;
-      fbdisplay_image[y][x+ 3] = ( data & 0x40 ) ? ink : paper;
-      fbdisplay_image[y][x+ 4] = ( data & 0x20 ) ? ink : paper;
-      fbdisplay_image[y][x+ 5] = ( data & 0x20 ) ? ink : paper;
-      fbdisplay_image[y][x+ 6] = ( data & 0x10 ) ? ink : paper;
-      fbdisplay_image[y][x+ 7] = ( data & 0x10 ) ? ink : paper;
-      fbdisplay_image[y][x+ 8] = ( data & 0x08 ) ? ink : paper;
-      fbdisplay_image[y][x+ 9] = ( data & 0x08 ) ? ink : paper;
-      fbdisplay_image[y][x+10] = ( data & 0x04 ) ? ink : paper;
-      fbdisplay_image[y][x+11] = ( data & 0x04 ) ? ink : paper;
-      fbdisplay_image[y][x+12] = ( data & 0x02 ) ? ink : paper;
-      fbdisplay_image[y][x+13] = ( data & 0x02 ) ? ink : paper;
-      fbdisplay_image[y][x+14] = ( data & 0x01 ) ? ink : paper;
-      fbdisplay_image[y][x+15] = ( data & 0x01 ) ? ink : paper;
-    }
+    uiplot_bits_word_wide( &fbdisplay_image[y  ][x], data, ink, paper );
+    uiplot_bits_word_wide( &fbdisplay_image[y+1][x], data, ink, paper );
   } else {
-    fbdisplay_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-    fbdisplay_image[y][x+ 1] = ( data & 0x40 ) ? ink : paper;
-    fbdisplay_image[y][x+ 2] = ( data & 0x20 ) ? ink : paper;
-    fbdisplay_image[y][x+ 3] = ( data & 0x10 ) ? ink : paper;
-    fbdisplay_image[y][x+ 4] = ( data & 0x08 ) ? ink : paper;
-    fbdisplay_image[y][x+ 5] = ( data & 0x04 ) ? ink : paper;
-    fbdisplay_image[y][x+ 6] = ( data & 0x02 ) ? ink : paper;
-    fbdisplay_image[y][x+ 7] = ( data & 0x01 ) ? ink : paper;
+    uiplot_bits_word( &fbdisplay_image[y][x], data, ink, paper );
   }
 }
 
@@ -515,22 +491,8 @@ uidisplay_plot16( int x, int y, libspectrum_word data,
   x <<= 4; y <<= 1;
 
   for( i=0; i<2; i++,y++ ) {
-    fbdisplay_image[y][x+ 0] = ( data & 0x8000 ) ? ink : paper;
-    fbdisplay_image[y][x+ 1] = ( data & 0x4000 ) ? ink : paper;
-    fbdisplay_image[y][x+ 2] = ( data & 0x2000 ) ? ink : paper;
-    fbdisplay_image[y][x+ 3] = ( data & 0x1000 ) ? ink : paper;
-    fbdisplay_image[y][x+ 4] = ( data & 0x0800 ) ? ink : paper;
-    fbdisplay_image[y][x+ 5] = ( data & 0x0400 ) ? ink : paper;
-    fbdisplay_image[y][x+ 6] = ( data & 0x0200 ) ? ink : paper;
-    fbdisplay_image[y][x+ 7] = ( data & 0x0100 ) ? ink : paper;
-    fbdisplay_image[y][x+ 8] = ( data & 0x0080 ) ? ink : paper;
-    fbdisplay_image[y][x+ 9] = ( data & 0x0040 ) ? ink : paper;
-    fbdisplay_image[y][x+10] = ( data & 0x0020 ) ? ink : paper;
-    fbdisplay_image[y][x+11] = ( data & 0x0010 ) ? ink : paper;
-    fbdisplay_image[y][x+12] = ( data & 0x0008 ) ? ink : paper;
-    fbdisplay_image[y][x+13] = ( data & 0x0004 ) ? ink : paper;
-    fbdisplay_image[y][x+14] = ( data & 0x0002 ) ? ink : paper;
-    fbdisplay_image[y][x+15] = ( data & 0x0001 ) ? ink : paper;
+    uiplot_bits_word( &fbdisplay_image[y][x    ], data >> 8,   ink, paper );
+    uiplot_bits_word( &fbdisplay_image[y][x + 8], data & 0xff, ink, paper );
   }
 }
 
@@ -39,6 +39,8 @@
 #include "screenshot.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
+#include "ui/uirender.h"
 #include "ui/scaler/scaler.h"
 #include "settings.h"
 
@@ -54,11 +56,10 @@ int image_scale;
 /* The height and width of a 1x1 image in pixels */
 int image_width, image_height;
 
-/* A copy of every pixel on the screen, replaceable by plotting directly into
-   rgb_image below */
-libspectrum_word
-  gtkdisplay_image[ 2 * DISPLAY_SCREEN_HEIGHT ][ DISPLAY_SCREEN_WIDTH ];
-ptrdiff_t gtkdisplay_pitch = DISPLAY_SCREEN_WIDTH * sizeof( libspectrum_word );
+/* The screen is plotted as palette indices into uirender_image; everything
+   from here down to the Cairo surface belongs to the render thread, and is
+   only touched elsewhere under the render lock */
+#define PIXEL( x, y ) uirender_image[ (y) * uirender_pitch + (x) ]
 
 /* An RGB image of the Spectrum screen; slightly bigger than the real
    screen to handle the smoothing filters which read around each pixel */
@@ -103,7 +104,12 @@ typedef enum {
   FORMAT_x8b8g8r8     /* GdkRGB */
 } colour_format_t;
 
-static int display_updated = 0;
+/* Areas of scaled_image the render thread has updated but which have not
+   yet been redrawn on the GTK thread */
+static uirender_rect pending_rects[ UIRENDER_MAX_RECTS ];
+static size_t pending_rect_count;
+static int pending_full_redraw;
+static int pending_idle_added = 0;
 
 static cairo_surface_t *surface = NULL;
 
@@ -114,6 +120,7 @@ static int gtkdisplay_current_size=1;
 static int extra_height = 0;
 
 static int init_colours( colour_format_t format );
+static void gtkdisplay_render( const uirender_frame *frame );
 static void gtkdisplay_area(int x, int y, int width, int height);
 static void register_scalers( int force_scaler );
 static void gtkdisplay_load_gfx_mode( void );
@@ -203,6 +210,12 @@ uidisplay_init( int width, int height )
   image_width = width; image_height = height;
   image_scale = width / DISPLAY_ASPECT_WIDTH;
 
+  error = uirender_init( width, height, gtkdisplay_render );
+  if( error ) return error;
+
+  /* The render thread scales with whatever scaler is current */
+  scaler_set_lock( uirender_lock, uirender_unlock );
+
   register_scalers( 0 );
 
   display_refresh_all();
@@ -248,6 +261,8 @@ drawing_area_resize( int width, int height, int force_scaler )
   /* If we're the same size as before, no need to do anything else */
   if( size == gtkdisplay_current_size ) return 0;
 
+  uirender_lock();
+
   gtkdisplay_current_size = size;
 
   register_scalers( force_scaler );
@@ -256,6 +271,8 @@ drawing_area_resize( int width, int height, int force_scaler )
 
   ensure_appropriate_surface();
 
+  uirender_unlock();
+
   display_refresh_all();
 
   return 0;
@@ -327,62 +344,115 @@ register_scalers( int force_scaler )
 void
 uidisplay_frame_end( void )
 {
-  if( display_updated ) {
-    gdk_window_process_updates( gtk_widget_get_window( gtkui_drawing_area ),
-                                FALSE );
-    display_updated = 0;
-  }
-
-  return;
+  uirender_frame_end();
 }
 
 void
 uidisplay_area( int x, int y, int w, int h )
 {
-  float scale = (float)gtkdisplay_current_size / image_scale;
-  int scaled_x, scaled_y, i, yy;
-  libspectrum_dword *palette;
-
   /* Extend the dirty region by 1 pixel for scalers
      that "smear" the screen, e.g. 2xSAI */
   if( scaler_flags & SCALER_FLAGS_EXPAND )
     scaler_expander( &x, &y, &w, &h, image_width, image_height );
 
-  scaled_x = scale * x; scaled_y = scale * y;
+  uirender_area( x, y, w, h );
+}
 
-  palette = settings_current.bw_tv ? bw_colours : gtkdisplay_colours;
+/* Queue redraws of the areas the render thread has finished with; widgets
+   may only be touched on the GTK thread */
+static gboolean
+gtkdisplay_redraw_pending( gpointer user_data GCC_UNUSED )
+{
+  size_t i;
+
+  uirender_lock();
+
+  if( pending_full_redraw ) {
+    gtk_widget_queue_draw( gtkui_drawing_area );
+  } else {
+    for( i = 0; i < pending_rect_count; i++ )
+      gtkdisplay_area( pending_rects[i].x, pending_rects[i].y,
+                       pending_rects[i].w, pending_rects[i].h );
+  }
+
+  pending_rect_count = 0;
+  pending_full_redraw = 0;
+  pending_idle_added = 0;
+
+  uirender_unlock();
+
+  return FALSE;
+}
+
+static void
+render_area( const uirender_frame *frame, libspectrum_dword *palette,
+             int x, int y, int w, int h )
+{
+  float scale = (float)gtkdisplay_current_size / image_scale;
+  int scaled_x, scaled_y, yy;
+  uirender_rect *pending;
+
+  scaled_x = scale * x; scaled_y = scale * y;
 
   /* Create the RGB image */
   for( yy = y; yy < y + h; yy++ ) {
 
-    libspectrum_dword *rgb; libspectrum_word *display;
+    libspectrum_dword *rgb; const libspectrum_byte *display;
 
     rgb = (libspectrum_dword*)( rgb_image + ( yy + 2 ) * rgb_pitch );
     rgb += x + 1;
 
-    display = &gtkdisplay_image[yy][x];
+    display = frame->pixels + yy * frame->pitch + x;
 
-    for( i = 0; i < w; i++, rgb++, display++ ) *rgb = palette[ *display ];
+    uiplot_convert_dword( rgb, display, palette, w );
   }
 
   /* Create scaled image */
-  scaler_proc32( &rgb_image[ ( y + 2 ) * rgb_pitch + 4 * ( x + 1 ) ],
-                 rgb_pitch,
-                 &scaled_image[ scaled_y * scaled_pitch + 4 * scaled_x ],
-                 scaled_pitch, w, h );
+  scaler_run( current_scaler, scaler_proc32,
+              &rgb_image[ ( y + 2 ) * rgb_pitch + 4 * ( x + 1 ) ],
+              rgb_pitch,
+              &scaled_image[ scaled_y * scaled_pitch + 4 * scaled_x ],
+              scaled_pitch, w, h );
+
+  if( pending_full_redraw ) return;
+
+  if( pending_rect_count == UIRENDER_MAX_RECTS ) {
+    pending_full_redraw = 1;
+    return;
+  }
+
+  pending = &pending_rects[ pending_rect_count++ ];
+  pending->x = scaled_x; pending->y = scaled_y;
+  pending->w = w * scale; pending->h = h * scale;
+}
+
+/* Called on the render thread with the render lock held */
+static void
+gtkdisplay_render( const uirender_frame *frame )
+{
+  libspectrum_dword *palette;
+  size_t i;
+
+  palette = frame->bw_tv ? bw_colours : gtkdisplay_colours;
 
-  w *= scale; h *= scale;
+  if( frame->full_refresh ) {
+    render_area( frame, palette, 0, 0, image_width, image_height );
+  } else {
+    for( i = 0; i < frame->rect_count; i++ )
+      render_area( frame, palette, frame->rects[i].x, frame->rects[i].y,
+                   frame->rects[i].w, frame->rects[i].h );
+  }
 
-  /* Blit to the real screen */
-  gtkdisplay_area( scaled_x, scaled_y, w, h );
+  if( !pending_idle_added ) {
+    pending_idle_added = 1;
+    g_idle_add( gtkdisplay_redraw_pending, NULL );
+  }
 }
 
 static void gtkdisplay_area(int x, int y, int width, int height)
 {
   int max_width, max_height;
 
-  display_updated = 1;
-
   if( width <= 0 || height <= 0 ) return;
 
   max_width = surface ? cairo_image_surface_get_width( surface ) : width;
@@ -414,7 +484,8 @@ uidisplay_hotswap_gfx_mode( void )
 int
 uidisplay_end( void )
 {
-  return 0;
+  scaler_set_lock( NULL, NULL );
+  return uirender_end();
 }
 
 /* Set one pixel in the display */
@@ -423,12 +494,12 @@ uidisplay_putpixel( int x, int y, int colour )
 {
   if( machine_current->timex ) {
     x <<= 1; y <<= 1;
-    gtkdisplay_image[y  ][x  ] = colour;
-    gtkdisplay_image[y  ][x+1] = colour;
-    gtkdisplay_image[y+1][x  ] = colour;
-    gtkdisplay_image[y+1][x+1] = colour;
+    PIXEL( x, y ) = colour;
+    PIXEL( x+1, y ) = colour;
+    PIXEL( x, y+1 ) = colour;
+    PIXEL( x+1, y+1 ) = colour;
   } else {
-    gtkdisplay_image[y][x] = colour;
+    PIXEL( x, y ) = colour;
   }
 }
 
@@ -441,36 +512,11 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   x <<= 3;
 
   if( machine_current->timex ) {
-    int i;
-
     x <<= 1; y <<= 1;
-    for( i=0; i<2; i++,y++ ) {
-      gtkdisplay_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 1] = ( data & 0x80 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 2] = ( data & 0x40 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 3] = ( data & 0x40 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 4] = ( data & 0x20 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 5] = ( data & 0x20 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 6] = ( data & 0x10 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 7] = ( data & 0x10 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 8] = ( data & 0x08 ) ? ink : paper;
-      gtkdisplay_image[y][x+ 9] = ( data & 0x08 ) ? ink : paper;
-      gtkdisplay_image[y][x+10] = ( data & 0x04 ) ? ink : paper;
-      gtkdisplay_image[y][x+11] = ( data & 0x04 ) ? ink : paper;
-      gtkdisplay_image[y][x+12] = ( data & 0x02 ) ? ink : paper;
-      gtkdisplay_image[y][x+13] = ( data & 0x02 ) ? ink : paper;
-      gtkdisplay_image[y][x+14] = ( data & 0x01 ) ? ink : paper;
-      gtkdisplay_image[y][x+15] = ( data & 0x01 ) ? ink : paper;
-    }
+    uiplot_bits_byte_wide( &PIXEL( x, y     ), data, ink, paper );
+    uiplot_bits_byte_wide( &PIXEL( x, y + 1 ), data, ink, paper );
   } else {
-    gtkdisplay_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 1] = ( data & 0x40 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 2] = ( data & 0x20 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 3] = ( data & 0x10 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 4] = ( data & 0x08 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 5] = ( data & 0x04 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 6] = ( data & 0x02 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 7] = ( data & 0x01 ) ? ink : paper;
+    uiplot_bits_byte( &PIXEL( x, y ), data, ink, paper );
   }
 }
 
@@ -484,22 +530,8 @@ uidisplay_plot16( int x, int y, libspectrum_word data,
   x <<= 4; y <<= 1;
 
   for( i=0; i<2; i++,y++ ) {
-    gtkdisplay_image[y][x+ 0] = ( data & 0x8000 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 1] = ( data & 0x4000 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 2] = ( data & 0x2000 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 3] = ( data & 0x1000 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 4] = ( data & 0x0800 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 5] = ( data & 0x0400 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 6] = ( data & 0x0200 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 7] = ( data & 0x0100 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 8] = ( data & 0x0080 ) ? ink : paper;
-    gtkdisplay_image[y][x+ 9] = ( data & 0x0040 ) ? ink : paper;
-    gtkdisplay_image[y][x+10] = ( data & 0x0020 ) ? ink : paper;
-    gtkdisplay_image[y][x+11] = ( data & 0x0010 ) ? ink : paper;
-    gtkdisplay_image[y][x+12] = ( data & 0x0008 ) ? ink : paper;
-    gtkdisplay_image[y][x+13] = ( data & 0x0004 ) ? ink : paper;
-    gtkdisplay_image[y][x+14] = ( data & 0x0002 ) ? ink : paper;
-    gtkdisplay_image[y][x+15] = ( data & 0x0001 ) ? ink : paper;
+    uiplot_bits_byte( &PIXEL( x,     y ), data >> 8,   ink, paper );
+    uiplot_bits_byte( &PIXEL( x + 8, y ), data & 0xff, ink, paper );
   }
 }
 
@@ -509,6 +541,8 @@ uidisplay_plot16( int x, int y, libspectrum_word data,
 static gboolean
 gtkdisplay_draw( GtkWidget *widget, cairo_t *cr, gpointer user_data )
 {
+  uirender_lock();
+
   /* Create a new surface for this gfx mode */
   if( !surface ) ensure_appropriate_surface();
 
@@ -517,6 +551,8 @@ gtkdisplay_draw( GtkWidget *widget, cairo_t *cr, gpointer user_data )
   cairo_set_operator( cr, CAIRO_OPERATOR_SOURCE );
   cairo_paint( cr );
 
+  uirender_unlock();
+
   return FALSE;
 }
 
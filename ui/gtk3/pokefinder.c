@@ -43,6 +43,10 @@ static void gtkui_pokefinder_incremented( GtkWidget *widget,
 					  gpointer user_data GCC_UNUSED );
 static void gtkui_pokefinder_decremented( GtkWidget *widget,
 					  gpointer user_data GCC_UNUSED );
+static void gtkui_pokefinder_changed( GtkWidget *widget,
+				      gpointer user_data GCC_UNUSED );
+static void gtkui_pokefinder_unchanged( GtkWidget *widget,
+					gpointer user_data GCC_UNUSED );
 static void gtkui_pokefinder_search( GtkWidget *widget, gpointer user_data );
 static void gtkui_pokefinder_reset( GtkWidget *widget, gpointer user_data );
 static void gtkui_pokefinder_close( GtkWidget *widget, gpointer user_data );
@@ -164,10 +168,12 @@ create_dialog( void )
     static gtkstock_button btn[] = {
       { "Incremented", G_CALLBACK( gtkui_pokefinder_incremented ), NULL, NULL, 0, 0, 0, 0, GTK_RESPONSE_NONE },
       { "Decremented", G_CALLBACK( gtkui_pokefinder_decremented ), NULL, NULL, 0, 0, 0, 0, GTK_RESPONSE_NONE },
+      { "Changed", G_CALLBACK( gtkui_pokefinder_changed ), NULL, NULL, 0, 0, 0, 0, GTK_RESPONSE_NONE },
+      { "Unchanged", G_CALLBACK( gtkui_pokefinder_unchanged ), NULL, NULL, 0, 0, 0, 0, GTK_RESPONSE_NONE },
       { "!Search", G_CALLBACK( gtkui_pokefinder_search ), NULL, NULL, GDK_KEY_Return, 0, 0, 0, GTK_RESPONSE_NONE },
       { "Reset", G_CALLBACK( gtkui_pokefinder_reset ), NULL, NULL, 0, 0, 0, 0, GTK_RESPONSE_NONE }
     };
-    btn[2].actiondata = G_OBJECT( entry );
+    btn[4].actiondata = G_OBJECT( entry );
     accel_group = gtkstock_create_buttons( dialog, NULL, btn,
 					   ARRAY_SIZE( btn ) );
     gtkstock_create_close( dialog, accel_group,
@@ -198,25 +204,28 @@ gtkui_pokefinder_decremented( GtkWidget *widget GCC_UNUSED,
   update_pokefinder();
 }
 
+static void
+gtkui_pokefinder_changed( GtkWidget *widget GCC_UNUSED,
+			  gpointer user_data GCC_UNUSED )
+{
+  pokefinder_changed();
+  update_pokefinder();
+}
+
+static void
+gtkui_pokefinder_unchanged( GtkWidget *widget GCC_UNUSED,
+			    gpointer user_data GCC_UNUSED )
+{
+  pokefinder_unchanged();
+  update_pokefinder();
+}
+
 static void
 gtkui_pokefinder_search( GtkWidget *widget, gpointer user_data GCC_UNUSED )
 {
-  long value;
-  const gchar *entry;
-  char *endptr;
-  int base;
-
-  errno = 0;
-  entry = gtk_entry_get_text( GTK_ENTRY( widget ) );
-  base = ( g_str_has_prefix( entry, "0x" ) )? 16 : 10;
-  value = strtol( entry, &endptr, base );
-
-  if( errno != 0 || value < 0 || value > 255 || endptr == entry ) {
-    ui_error( UI_ERROR_ERROR, "Invalid value: use an integer from 0 to 255" );
+  if( pokefinder_search_text( gtk_entry_get_text( GTK_ENTRY( widget ) ) ) )
     return;
-  }
 
-  pokefinder_search( value );
   update_pokefinder();
 }
 
@@ -34,6 +34,7 @@
 #include "machine.h"
 #include "scaler.h"
 #include "scaler_internals.h"
+#include "scaler_simd.h"
 #include "settings.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
@@ -138,13 +139,26 @@ ScalerProc *scaler_proc16, *scaler_proc32;
 scaler_flags_t scaler_flags;
 scaler_expand_fn *scaler_expander;
 
+static scaler_lock_fn scaler_lock, scaler_unlock;
+
+void
+scaler_set_lock( scaler_lock_fn lock, scaler_lock_fn unlock )
+{
+  scaler_lock = lock;
+  scaler_unlock = unlock;
+}
+
 int
 scaler_activate_scaler( scaler_type scaler )
 {
   if( !scaler_is_supported( scaler ) ) return 1;
 
+  scaler_simd_init();
+
   if( current_scaler == scaler ) return 0;
 
+  if( scaler_lock ) scaler_lock();
+
   current_scaler = scaler;
 
   if( settings_current.start_scaler_mode ) libspectrum_free( settings_current.start_scaler_mode );
@@ -156,6 +170,8 @@ scaler_activate_scaler( scaler_type scaler )
   scaler_flags = scaler_get_flags( current_scaler );
   scaler_expander = scaler_get_expander( current_scaler );
 
+  if( scaler_unlock ) scaler_unlock();
+
   return 0;
 }
 
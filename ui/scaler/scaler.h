@@ -88,6 +88,12 @@ extern int scalers_registered;
 
 typedef int (*scaler_available_fn)( scaler_type scaler );
 
+/* Held around changes to the current scaler. UIs which scale on another
+   thread set these so that thread never sees half a change; NULL if
+   there's nothing to lock */
+typedef void (*scaler_lock_fn)( void );
+void scaler_set_lock( scaler_lock_fn lock, scaler_lock_fn unlock );
+
 int scaler_select_id( const char *scaler_mode );
 int scaler_get_type( const char *scaler_mode );
 void scaler_register_clear( void );
@@ -101,8 +107,17 @@ ScalerProc *scaler_get_proc16( scaler_type scaler );
 ScalerProc *scaler_get_proc32( scaler_type scaler );
 scaler_flags_t scaler_get_flags( scaler_type scaler );
 float scaler_get_scaling_factor( scaler_type scaler );
+int scaler_scale_number( scaler_type scaler, int num );
 scaler_expand_fn* scaler_get_expander( scaler_type scaler );
 
 int scaler_select_bitformat( libspectrum_dword BitFormat );
 
+/* Scale an area with `proc', the 16 or 32 bit version of `scaler', sharing
+   the work between the scaler threads if the area is large enough */
+void scaler_run( scaler_type scaler, ScalerProc *proc,
+		 const libspectrum_byte *srcPtr, libspectrum_dword srcPitch,
+		 libspectrum_byte *dstPtr, libspectrum_dword dstPitch,
+		 int width, int height );
+void scaler_threads_end( void );
+
 #endif
@@ -68,4 +68,41 @@ DECLARE_SCALER(HQ2x);
 DECLARE_SCALER(HQ3x);
 DECLARE_SCALER(HQ4x);
 
+#ifndef MIN
+#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef ABS
+#define ABS(x)     ((x)>=0?(x):-(x))
+#endif
+
+/*
+    Y  =  0.29900 * R + 0.58700 * G + 0.11400 * B
+    U  = -0.16874 * R - 0.33126 * G + 0.50000 * B  (+ 128)
+    V  =  0.50000 * R - 0.41869 * G - 0.08131 * B  (+ 128)
+*/
+
+#define RGB_TO_Y(r, g, b) ( ( 2449L * r + 4809L * g + 934L * b + 1024 ) >> 11 )
+#define RGB_TO_U(r, g, b) ( ( 4096L * b - 1383L * r - 2713L * g + 1024 ) >> 11 )
+#define RGB_TO_V(r, g, b) ( ( 4096L * r - 3430L * g - 666L * b +  1024 ) >> 11 )
+
+/*
+    R = Y + 1.402 (V-128)
+    G = Y - 0.34414 (U-128) - 0.71414 (V-128)
+    B = Y + 1.772 (U-128)
+*/
+
+#define YUV_TO_R(y, u, v) ( MIN( ABS( ( 8192L * y              + 11485L * v + 16384 ) >> 15 ), 255 ) )
+#define YUV_TO_G(y, u, v) ( MIN( ABS( ( 8192L * y - 2819L  * u -  5850L * v + 16384 ) >> 15 ), 255 ) )
+#define YUV_TO_B(y, u, v) ( MIN( ABS( ( 8192L * y + 14516L * u              + 16384 ) >> 15 ), 255 ) )
+
+#define HQ_trY 0x00000030
+#define HQ_trU 0x00000007
+#define HQ_trV 0x00000006
+
+#define HQ_YUVDIFF(y1,u1,v1,y2,u2,v2) \
+  ( ( ABS( y1 - y2 ) > HQ_trY ) || \
+    ( ABS( u1 - u2 ) > HQ_trU ) || \
+    ( ABS( v1 - v2 ) > HQ_trV ) )
+
 #endif				/* #ifndef FUSE_SCALER_INTERNALS_H */
@@ -0,0 +1,506 @@
+/* scaler_simd.c: vectorized kernels for the HQ and PAL TV scalers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/*
+  The HQ scalers spend most of their time converting each pixel to YUV and
+  comparing it with its neighbours, and the PAL TV scalers converting to YUV
+  and back. Both are done here a row at a time, eight or sixteen pixels to a
+  vector, which the scalers then use for their per-pixel work.
+
+  Every component fits in 16 bits, and every sum of products in 32, so the
+  SSE2 and AVX2 kernels work with 16-bit lanes, widened to 32 bits by pmaddwd
+  for the multiplies, and give exactly the results of the scalar macros.
+  They are compiled with per-function target attributes and only used if the
+  CPU has the instructions.
+
+  The HQ interpolation itself, which blends the pixels chosen by each
+  pattern, is still done pixel by pixel by the scalers.
+*/
+
+#include "config.h"
+
+#include "libspectrum.h"
+
+#include "scaler_internals.h"
+#include "scaler_simd.h"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define SCALER_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/* Scalar kernels; also used for the ends of rows by the others */
+
+static void
+rgb_to_yuv_scalar( const libspectrum_byte *r, const libspectrum_byte *g,
+                   const libspectrum_byte *b, libspectrum_signed_word *y,
+                   libspectrum_signed_word *u, libspectrum_signed_word *v,
+                   int n )
+{
+  int i;
+
+  for( i = 0; i < n; i++ ) {
+    y[i] = RGB_TO_Y( r[i], g[i], b[i] );
+    u[i] = RGB_TO_U( r[i], g[i], b[i] );
+    v[i] = RGB_TO_V( r[i], g[i], b[i] );
+  }
+}
+
+static void
+yuv_to_rgb_scalar( const libspectrum_signed_word *y,
+                   const libspectrum_signed_word *u,
+                   const libspectrum_signed_word *v, libspectrum_byte *r,
+                   libspectrum_byte *g, libspectrum_byte *b, int n )
+{
+  int i;
+
+  for( i = 0; i < n; i++ ) {
+    r[i] = YUV_TO_R( y[i], u[i], v[i] );
+    g[i] = YUV_TO_G( y[i], u[i], v[i] );
+    b[i] = YUV_TO_B( y[i], u[i], v[i] );
+  }
+}
+
+#define HQ_NEIGHBOUR( bit, r, x ) \
+  if( HQ_YUVDIFF( y, u, v, (r)->y[x], (r)->u[x], (r)->v[x] ) ) pattern |= bit;
+
+static libspectrum_byte
+hq_pattern_pixel( const scaler_yuv_row *above, const scaler_yuv_row *row,
+                  const scaler_yuv_row *below, int i )
+{
+  libspectrum_signed_dword y = row->y[ i + 1 ], u = row->u[ i + 1 ],
+                           v = row->v[ i + 1 ];
+  int pattern = 0;
+
+  HQ_NEIGHBOUR( 0x01, above, i     );
+  HQ_NEIGHBOUR( 0x02, above, i + 1 );
+  HQ_NEIGHBOUR( 0x04, above, i + 2 );
+  HQ_NEIGHBOUR( 0x08, row,   i     );
+  HQ_NEIGHBOUR( 0x10, row,   i + 2 );
+  HQ_NEIGHBOUR( 0x20, below, i     );
+  HQ_NEIGHBOUR( 0x40, below, i + 1 );
+  HQ_NEIGHBOUR( 0x80, below, i + 2 );
+
+  return pattern;
+}
+
+static void
+hq_pattern_scalar( const scaler_yuv_row *above, const scaler_yuv_row *row,
+                   const scaler_yuv_row *below, libspectrum_byte *pattern,
+                   int n )
+{
+  int i;
+
+  for( i = 0; i < n; i++ )
+    pattern[i] = hq_pattern_pixel( above, row, below, i );
+}
+
+static const scaler_simd_kernels scalar_kernels = {
+  rgb_to_yuv_scalar, yuv_to_rgb_scalar, hq_pattern_scalar
+};
+
+#ifdef SCALER_SIMD_X86
+
+#define SSE2_TARGET __attribute__(( target( "sse2" ) ))
+#define AVX2_TARGET __attribute__(( target( "avx2" ) ))
+
+/* Coefficients for each pair of 16-bit lanes */
+#define SSE2_PAIR( a, b ) _mm_set_epi16( b, a, b, a, b, a, b, a )
+#define AVX2_PAIR( a, b ) \
+  _mm256_set_epi16( b, a, b, a, b, a, b, a, b, a, b, a, b, a, b, a )
+
+/* ( a * ka + b * kb + c * kc + d * kd ) >> shift for each lane */
+static inline __m128i SSE2_TARGET
+madd_sse2( __m128i a, __m128i b, __m128i c, __m128i d, __m128i k_ab,
+           __m128i k_cd, int shift )
+{
+  __m128i lo, hi;
+
+  lo = _mm_add_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( a, b ), k_ab ),
+                      _mm_madd_epi16( _mm_unpacklo_epi16( c, d ), k_cd ) );
+  hi = _mm_add_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( a, b ), k_ab ),
+                      _mm_madd_epi16( _mm_unpackhi_epi16( c, d ), k_cd ) );
+
+  return _mm_packs_epi32( _mm_srai_epi32( lo, shift ),
+                          _mm_srai_epi32( hi, shift ) );
+}
+
+static inline __m128i SSE2_TARGET
+load_bytes_sse2( const libspectrum_byte *p )
+{
+  return _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)p ),
+                            _mm_setzero_si128() );
+}
+
+static void SSE2_TARGET
+rgb_to_yuv_sse2( const libspectrum_byte *r, const libspectrum_byte *g,
+                 const libspectrum_byte *b, libspectrum_signed_word *y,
+                 libspectrum_signed_word *u, libspectrum_signed_word *v,
+                 int n )
+{
+  const __m128i one = _mm_set1_epi16( 1 );
+  __m128i r16, g16, b16;
+  int i;
+
+  for( i = 0; i + 8 <= n; i += 8 ) {
+    r16 = load_bytes_sse2( r + i );
+    g16 = load_bytes_sse2( g + i );
+    b16 = load_bytes_sse2( b + i );
+
+    _mm_storeu_si128( (__m128i*)( y + i ),
+                      madd_sse2( r16, g16, b16, one, SSE2_PAIR( 2449, 4809 ),
+                                 SSE2_PAIR( 934, 1024 ), 11 ) );
+    _mm_storeu_si128( (__m128i*)( u + i ),
+                      madd_sse2( r16, g16, b16, one, SSE2_PAIR( -1383, -2713 ),
+                                 SSE2_PAIR( 4096, 1024 ), 11 ) );
+    _mm_storeu_si128( (__m128i*)( v + i ),
+                      madd_sse2( r16, g16, b16, one, SSE2_PAIR( 4096, -3430 ),
+                                 SSE2_PAIR( -666, 1024 ), 11 ) );
+  }
+
+  rgb_to_yuv_scalar( r + i, g + i, b + i, y + i, u + i, v + i, n - i );
+}
+
+/* MIN( ABS( x ), 255 ) as bytes */
+static inline void SSE2_TARGET
+store_clamped_sse2( libspectrum_byte *p, __m128i x )
+{
+  x = _mm_max_epi16( x, _mm_sub_epi16( _mm_setzero_si128(), x ) );
+  x = _mm_min_epi16( x, _mm_set1_epi16( 255 ) );
+  _mm_storel_epi64( (__m128i*)p, _mm_packus_epi16( x, x ) );
+}
+
+static void SSE2_TARGET
+yuv_to_rgb_sse2( const libspectrum_signed_word *y,
+                 const libspectrum_signed_word *u,
+                 const libspectrum_signed_word *v, libspectrum_byte *r,
+                 libspectrum_byte *g, libspectrum_byte *b, int n )
+{
+  const __m128i one = _mm_set1_epi16( 1 );
+  __m128i y16, u16, v16;
+  int i;
+
+  for( i = 0; i + 8 <= n; i += 8 ) {
+    y16 = _mm_loadu_si128( (const __m128i*)( y + i ) );
+    u16 = _mm_loadu_si128( (const __m128i*)( u + i ) );
+    v16 = _mm_loadu_si128( (const __m128i*)( v + i ) );
+
+    store_clamped_sse2( r + i,
+                        madd_sse2( y16, v16, one, one, SSE2_PAIR( 8192, 11485 ),
+                                   SSE2_PAIR( 16384, 0 ), 15 ) );
+    store_clamped_sse2( g + i,
+                        madd_sse2( y16, u16, v16, one, SSE2_PAIR( 8192, -2819 ),
+                                   SSE2_PAIR( -5850, 16384 ), 15 ) );
+    store_clamped_sse2( b + i,
+                        madd_sse2( y16, u16, one, one, SSE2_PAIR( 8192, 14516 ),
+                                   SSE2_PAIR( 16384, 0 ), 15 ) );
+  }
+
+  yuv_to_rgb_scalar( y + i, u + i, v + i, r + i, g + i, b + i, n - i );
+}
+
+/* ABS( a - b ) > threshold for each lane */
+static inline __m128i SSE2_TARGET
+absdiff_gt_sse2( __m128i a, const libspectrum_signed_word *b, int threshold )
+{
+  __m128i d = _mm_sub_epi16( a, _mm_loadu_si128( (const __m128i*)b ) );
+
+  d = _mm_max_epi16( d, _mm_sub_epi16( _mm_setzero_si128(), d ) );
+  return _mm_cmpgt_epi16( d, _mm_set1_epi16( threshold ) );
+}
+
+static inline __m128i SSE2_TARGET
+hq_neighbour_sse2( __m128i y, __m128i u, __m128i v, const scaler_yuv_row *r,
+                   int x, int bit )
+{
+  __m128i diff = _mm_or_si128(
+    _mm_or_si128( absdiff_gt_sse2( y, r->y + x, HQ_trY ),
+                  absdiff_gt_sse2( u, r->u + x, HQ_trU ) ),
+    absdiff_gt_sse2( v, r->v + x, HQ_trV ) );
+
+  return _mm_and_si128( diff, _mm_set1_epi16( bit ) );
+}
+
+static void SSE2_TARGET
+hq_pattern_sse2( const scaler_yuv_row *above, const scaler_yuv_row *row,
+                 const scaler_yuv_row *below, libspectrum_byte *pattern,
+                 int n )
+{
+  __m128i y, u, v, p;
+  int i;
+
+  for( i = 0; i + 8 <= n; i += 8 ) {
+    y = _mm_loadu_si128( (const __m128i*)( row->y + i + 1 ) );
+    u = _mm_loadu_si128( (const __m128i*)( row->u + i + 1 ) );
+    v = _mm_loadu_si128( (const __m128i*)( row->v + i + 1 ) );
+
+    p =                   hq_neighbour_sse2( y, u, v, above, i,     0x01 );
+    p = _mm_or_si128( p,  hq_neighbour_sse2( y, u, v, above, i + 1, 0x02 ) );
+    p = _mm_or_si128( p,  hq_neighbour_sse2( y, u, v, above, i + 2, 0x04 ) );
+    p = _mm_or_si128( p,  hq_neighbour_sse2( y, u, v, row,   i,     0x08 ) );
+    p = _mm_or_si128( p,  hq_neighbour_sse2( y, u, v, row,   i + 2, 0x10 ) );
+    p = _mm_or_si128( p,  hq_neighbour_sse2( y, u, v, below, i,     0x20 ) );
+    p = _mm_or_si128( p,  hq_neighbour_sse2( y, u, v, below, i + 1, 0x40 ) );
+    p = _mm_or_si128( p,  hq_neighbour_sse2( y, u, v, below, i + 2, 0x80 ) );
+
+    _mm_storel_epi64( (__m128i*)( pattern + i ), _mm_packus_epi16( p, p ) );
+  }
+
+  for( ; i < n; i++ ) pattern[i] = hq_pattern_pixel( above, row, below, i );
+}
+
+static const scaler_simd_kernels sse2_kernels = {
+  rgb_to_yuv_sse2, yuv_to_rgb_sse2, hq_pattern_sse2
+};
+
+/* The AVX2 kernels are the SSE2 ones with twice the lanes. The 256-bit
+   unpacks and packs both work within each 128-bit half, so they still
+   leave the pixels in order */
+
+static inline __m256i AVX2_TARGET
+madd_avx2( __m256i a, __m256i b, __m256i c, __m256i d, __m256i k_ab,
+           __m256i k_cd, int shift )
+{
+  __m256i lo, hi;
+
+  lo = _mm256_add_epi32(
+    _mm256_madd_epi16( _mm256_unpacklo_epi16( a, b ), k_ab ),
+    _mm256_madd_epi16( _mm256_unpacklo_epi16( c, d ), k_cd ) );
+  hi = _mm256_add_epi32(
+    _mm256_madd_epi16( _mm256_unpackhi_epi16( a, b ), k_ab ),
+    _mm256_madd_epi16( _mm256_unpackhi_epi16( c, d ), k_cd ) );
+
+  return _mm256_packs_epi32( _mm256_srai_epi32( lo, shift ),
+                             _mm256_srai_epi32( hi, shift ) );
+}
+
+static inline __m256i AVX2_TARGET
+load_bytes_avx2( const libspectrum_byte *p )
+{
+  return _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)p ) );
+}
+
+/* Sixteen 16-bit lanes known to be 0-255 as bytes */
+static inline void AVX2_TARGET
+store_bytes_avx2( libspectrum_byte *p, __m256i x )
+{
+  _mm_storeu_si128( (__m128i*)p,
+                    _mm_packus_epi16( _mm256_castsi256_si128( x ),
+                                      _mm256_extracti128_si256( x, 1 ) ) );
+}
+
+static void AVX2_TARGET
+rgb_to_yuv_avx2( const libspectrum_byte *r, const libspectrum_byte *g,
+                 const libspectrum_byte *b, libspectrum_signed_word *y,
+                 libspectrum_signed_word *u, libspectrum_signed_word *v,
+                 int n )
+{
+  const __m256i one = _mm256_set1_epi16( 1 );
+  __m256i r16, g16, b16;
+  int i;
+
+  for( i = 0; i + 16 <= n; i += 16 ) {
+    r16 = load_bytes_avx2( r + i );
+    g16 = load_bytes_avx2( g + i );
+    b16 = load_bytes_avx2( b + i );
+
+    _mm256_storeu_si256( (__m256i*)( y + i ),
+                         madd_avx2( r16, g16, b16, one,
+                                    AVX2_PAIR( 2449, 4809 ),
+                                    AVX2_PAIR( 934, 1024 ), 11 ) );
+    _mm256_storeu_si256( (__m256i*)( u + i ),
+                         madd_avx2( r16, g16, b16, one,
+                                    AVX2_PAIR( -1383, -2713 ),
+                                    AVX2_PAIR( 4096, 1024 ), 11 ) );
+    _mm256_storeu_si256( (__m256i*)( v + i ),
+                         madd_avx2( r16, g16, b16, one,
+                                    AVX2_PAIR( 4096, -3430 ),
+                                    AVX2_PAIR( -666, 1024 ), 11 ) );
+  }
+
+  rgb_to_yuv_scalar( r + i, g + i, b + i, y + i, u + i, v + i, n - i );
+}
+
+static inline void AVX2_TARGET
+store_clamped_avx2( libspectrum_byte *p, __m256i x )
+{
+  x = _mm256_min_epi16( _mm256_abs_epi16( x ), _mm256_set1_epi16( 255 ) );
+  store_bytes_avx2( p, x );
+}
+
+static void AVX2_TARGET
+yuv_to_rgb_avx2( const libspectrum_signed_word *y,
+                 const libspectrum_signed_word *u,
+                 const libspectrum_signed_word *v, libspectrum_byte *r,
+                 libspectrum_byte *g, libspectrum_byte *b, int n )
+{
+  const __m256i one = _mm256_set1_epi16( 1 );
+  __m256i y16, u16, v16;
+  int i;
+
+  for( i = 0; i + 16 <= n; i += 16 ) {
+    y16 = _mm256_loadu_si256( (const __m256i*)( y + i ) );
+    u16 = _mm256_loadu_si256( (const __m256i*)( u + i ) );
+    v16 = _mm256_loadu_si256( (const __m256i*)( v + i ) );
+
+    store_clamped_avx2( r + i,
+                        madd_avx2( y16, v16, one, one,
+                                   AVX2_PAIR( 8192, 11485 ),
+                                   AVX2_PAIR( 16384, 0 ), 15 ) );
+    store_clamped_avx2( g + i,
+                        madd_avx2( y16, u16, v16, one,
+                                   AVX2_PAIR( 8192, -2819 ),
+                                   AVX2_PAIR( -5850, 16384 ), 15 ) );
+    store_clamped_avx2( b + i,
+                        madd_avx2( y16, u16, one, one,
+                                   AVX2_PAIR( 8192, 14516 ),
+                                   AVX2_PAIR( 16384, 0 ), 15 ) );
+  }
+
+  yuv_to_rgb_scalar( y + i, u + i, v + i, r + i, g + i, b + i, n - i );
+}
+
+static inline __m256i AVX2_TARGET
+absdiff_gt_avx2( __m256i a, const libspectrum_signed_word *b, int threshold )
+{
+  __m256i d = _mm256_sub_epi16( a, _mm256_loadu_si256( (const __m256i*)b ) );
+
+  return _mm256_cmpgt_epi16( _mm256_abs_epi16( d ),
+                             _mm256_set1_epi16( threshold ) );
+}
+
+static inline __m256i AVX2_TARGET
+hq_neighbour_avx2( __m256i y, __m256i u, __m256i v, const scaler_yuv_row *r,
+                   int x, int bit )
+{
+  __m256i diff = _mm256_or_si256(
+    _mm256_or_si256( absdiff_gt_avx2( y, r->y + x, HQ_trY ),
+                     absdiff_gt_avx2( u, r->u + x, HQ_trU ) ),
+    absdiff_gt_avx2( v, r->v + x, HQ_trV ) );
+
+  return _mm256_and_si256( diff, _mm256_set1_epi16( bit ) );
+}
+
+static void AVX2_TARGET
+hq_pattern_avx2( const scaler_yuv_row *above, const scaler_yuv_row *row,
+                 const scaler_yuv_row *below, libspectrum_byte *pattern,
+                 int n )
+{
+  __m256i y, u, v, p;
+  int i;
+
+  for( i = 0; i + 16 <= n; i += 16 ) {
+    y = _mm256_loadu_si256( (const __m256i*)( row->y + i + 1 ) );
+    u = _mm256_loadu_si256( (const __m256i*)( row->u + i + 1 ) );
+    v = _mm256_loadu_si256( (const __m256i*)( row->v + i + 1 ) );
+
+    p =                     hq_neighbour_avx2( y, u, v, above, i,     0x01 );
+    p = _mm256_or_si256( p, hq_neighbour_avx2( y, u, v, above, i + 1, 0x02 ) );
+    p = _mm256_or_si256( p, hq_neighbour_avx2( y, u, v, above, i + 2, 0x04 ) );
+    p = _mm256_or_si256( p, hq_neighbour_avx2( y, u, v, row,   i,     0x08 ) );
+    p = _mm256_or_si256( p, hq_neighbour_avx2( y, u, v, row,   i + 2, 0x10 ) );
+    p = _mm256_or_si256( p, hq_neighbour_avx2( y, u, v, below, i,     0x20 ) );
+    p = _mm256_or_si256( p, hq_neighbour_avx2( y, u, v, below, i + 1, 0x40 ) );
+    p = _mm256_or_si256( p, hq_neighbour_avx2( y, u, v, below, i + 2, 0x80 ) );
+
+    store_bytes_avx2( pattern + i, p );
+  }
+
+  for( ; i < n; i++ ) pattern[i] = hq_pattern_pixel( above, row, below, i );
+}
+
+static const scaler_simd_kernels avx2_kernels = {
+  rgb_to_yuv_avx2, yuv_to_rgb_avx2, hq_pattern_avx2
+};
+
+#endif			/* #ifdef SCALER_SIMD_X86 */
+
+/* Make sure this array stays in the same order as scaler_simd_type */
+static const struct {
+
+  const char *name;
+  const scaler_simd_kernels *kernels;	/* NULL if not compiled in */
+
+} simd_info[ SCALER_SIMD_NUM ] = {
+
+  { "scalar", &scalar_kernels },
+#ifdef SCALER_SIMD_X86
+  { "SSE2",   &sse2_kernels   },
+  { "AVX2",   &avx2_kernels   },
+#else
+  { "SSE2",   NULL            },
+  { "AVX2",   NULL            },
+#endif
+
+};
+
+const scaler_simd_kernels *scaler_simd = &scalar_kernels;
+
+static scaler_simd_type current_type = SCALER_SIMD_SCALAR;
+
+int
+scaler_simd_supported( scaler_simd_type type )
+{
+  if( type >= SCALER_SIMD_NUM || !simd_info[ type ].kernels ) return 0;
+
+#ifdef SCALER_SIMD_X86
+  __builtin_cpu_init();
+  if( type == SCALER_SIMD_SSE2 ) return __builtin_cpu_supports( "sse2" );
+  if( type == SCALER_SIMD_AVX2 ) return __builtin_cpu_supports( "avx2" );
+#endif
+
+  return 1;
+}
+
+int
+scaler_simd_select( scaler_simd_type type )
+{
+  if( !scaler_simd_supported( type ) ) return 1;
+
+  current_type = type;
+  scaler_simd = simd_info[ type ].kernels;
+
+  return 0;
+}
+
+void
+scaler_simd_init( void )
+{
+  static int initialised = 0;
+  int type;
+
+  /* Only ever done once, before anything is scaled, so that the kernels
+     don't change under a scaler running on another thread */
+  if( initialised ) return;
+  initialised = 1;
+
+  for( type = SCALER_SIMD_NUM - 1; type > SCALER_SIMD_SCALAR; type-- )
+    if( !scaler_simd_select( type ) ) return;
+}
+
+scaler_simd_type
+scaler_simd_current( void )
+{
+  return current_type;
+}
+
+const char *
+scaler_simd_name( scaler_simd_type type )
+{
+  return simd_info[ type ].name;
+}
@@ -0,0 +1,76 @@
+/* scaler_simd.h: vectorized kernels for the HQ and PAL TV scalers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#ifndef FUSE_SCALER_SIMD_H
+#define FUSE_SCALER_SIMD_H
+
+#include "libspectrum.h"
+
+typedef enum scaler_simd_type {
+  SCALER_SIMD_SCALAR = 0,
+  SCALER_SIMD_SSE2,
+  SCALER_SIMD_AVX2,
+
+  SCALER_SIMD_NUM		/* End marker; do not remove */
+} scaler_simd_type;
+
+/* A row of pixels in YUV, as given by RGB_TO_Y(), RGB_TO_U() and
+   RGB_TO_V() */
+typedef struct scaler_yuv_row {
+  libspectrum_signed_word *y, *u, *v;
+} scaler_yuv_row;
+
+/* The kernels work on whole rows, so each of them gives exactly the same
+   results as the macros in scaler_internals.h would pixel by pixel */
+typedef struct scaler_simd_kernels {
+
+  /* Convert `n' pixels given as 8-bit components to YUV */
+  void (*rgb_to_yuv)( const libspectrum_byte *r, const libspectrum_byte *g,
+                      const libspectrum_byte *b, libspectrum_signed_word *y,
+                      libspectrum_signed_word *u, libspectrum_signed_word *v,
+                      int n );
+
+  /* And back again */
+  void (*yuv_to_rgb)( const libspectrum_signed_word *y,
+                      const libspectrum_signed_word *u,
+                      const libspectrum_signed_word *v, libspectrum_byte *r,
+                      libspectrum_byte *g, libspectrum_byte *b, int n );
+
+  /* The HQ pattern of each of `n' pixels: bit k is set if HQ_YUVDIFF() finds
+     the pixel differs from its kth neighbour, in the order used by the
+     scaler_hq*.c switches. The rows are those above, through and below the
+     pixels and each has `n' + 2 entries, starting one pixel to the left */
+  void (*hq_pattern)( const scaler_yuv_row *above, const scaler_yuv_row *row,
+                      const scaler_yuv_row *below, libspectrum_byte *pattern,
+                      int n );
+
+} scaler_simd_kernels;
+
+/* The kernels in use; always valid, but scalar until scaler_simd_init() has
+   been called */
+extern const scaler_simd_kernels *scaler_simd;
+
+/* Select the fastest kernels the CPU supports */
+void scaler_simd_init( void );
+
+int scaler_simd_supported( scaler_simd_type type );
+int scaler_simd_select( scaler_simd_type type );
+scaler_simd_type scaler_simd_current( void );
+const char *scaler_simd_name( scaler_simd_type type );
+
+#endif			/* #ifndef FUSE_SCALER_SIMD_H */
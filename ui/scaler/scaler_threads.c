@@ -0,0 +1,262 @@
+/* scaler_threads.c: run the scalers on several threads at once
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/*
+  A large area is split into horizontal bands which are scaled by separate
+  calls to the scaler. The bands only ever write to their own rows of the
+  output; the rows around a band which a scaler reads (the same ones the
+  SCALER_FLAGS_EXPAND expanders allow for) come from the source image,
+  which nothing changes while it is being scaled.
+
+  Every band but the last starts and ends on an even row, so the scalers
+  which work on pairs of rows or use the row number for their pattern see
+  the same rows as they would for the whole area. The scalers which halve
+  the height count their pairs from the bottom of the area, so an area with
+  an odd number of rows is always scaled in one piece.
+
+  The calling thread scales bands itself alongside the workers, and doesn't
+  return until every band has been done. Without POSIX threads, it scales
+  the whole area itself.
+*/
+
+#include "config.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif				/* #ifdef HAVE_PTHREAD */
+#include <unistd.h>
+
+#include "libspectrum.h"
+
+#include "scaler.h"
+#include "settings.h"
+#include "ui/ui.h"
+
+#ifdef HAVE_PTHREAD
+
+/* The most threads, including the calling one, an area is split between */
+#define SCALER_THREADS_MAX 8
+
+/* Don't bother splitting off bands with fewer output pixels than this; the
+   cost of waking a worker outweighs the time saved */
+#define SCALER_BAND_MIN_PIXELS 32768
+
+typedef struct scaler_job {
+  ScalerProc *proc;
+  const libspectrum_byte *src;
+  libspectrum_dword src_pitch;
+  libspectrum_byte *dst;
+  libspectrum_dword dst_pitch;
+  int width, height;
+  scaler_type scaler;
+
+  int band_height;
+  int bands;
+  int next_band;		/* The next band not yet taken */
+  int bands_left;		/* Bands not yet finished */
+} scaler_job;
+
+static scaler_job job;
+
+static pthread_t workers[ SCALER_THREADS_MAX - 1 ];
+static size_t worker_count;
+static int pool_started, pool_stop;
+
+/* Protects `job' and the pool state */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+/* Held for the whole of a job, so only one area is split at once */
+static pthread_mutex_t run_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+get_threads( void )
+{
+  long threads = settings_current.scaler_threads;
+
+  if( threads <= 0 ) {
+    threads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+    threads = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+    if( threads <= 0 ) threads = 1;
+  }
+
+  if( threads > SCALER_THREADS_MAX ) threads = SCALER_THREADS_MAX;
+
+  return threads;
+}
+
+static void
+run_band( const scaler_job *j, int band )
+{
+  int y = band * j->band_height;
+  int height = j->height - y;
+
+  if( height > j->band_height ) height = j->band_height;
+
+  j->proc( j->src + y * j->src_pitch, j->src_pitch,
+           j->dst + scaler_scale_number( j->scaler, y ) * j->dst_pitch,
+           j->dst_pitch, j->width, height );
+}
+
+/* Scale bands of the current job until none are left to take; called with
+   pool_mutex held */
+static void
+take_bands( void )
+{
+  int band;
+
+  while( job.next_band < job.bands ) {
+    band = job.next_band++;
+
+    pthread_mutex_unlock( &pool_mutex );
+    run_band( &job, band );
+    pthread_mutex_lock( &pool_mutex );
+
+    if( !--job.bands_left ) pthread_cond_broadcast( &done_cond );
+  }
+}
+
+static void*
+worker_main( void *arg GCC_UNUSED )
+{
+  pthread_mutex_lock( &pool_mutex );
+
+  while( !pool_stop ) {
+    take_bands();
+    if( !pool_stop ) pthread_cond_wait( &work_cond, &pool_mutex );
+  }
+
+  pthread_mutex_unlock( &pool_mutex );
+
+  return NULL;
+}
+
+/* Start the workers; called with run_mutex held */
+static void
+pool_start( void )
+{
+  size_t wanted = get_threads() - 1;
+
+  pool_started = 1;
+  pool_stop = 0;
+
+  for( worker_count = 0; worker_count < wanted; worker_count++ )
+    if( pthread_create( &workers[ worker_count ], NULL, worker_main, NULL ) )
+      break;
+
+  /* Not fatal: the calling thread can scale everything itself */
+  if( worker_count < wanted )
+    ui_error( UI_ERROR_WARNING,
+              "couldn't start scaler threads; using %lu of %lu",
+              (unsigned long)worker_count + 1, (unsigned long)wanted + 1 );
+}
+
+void
+scaler_run( scaler_type scaler, ScalerProc *proc,
+            const libspectrum_byte *srcPtr, libspectrum_dword srcPitch,
+            libspectrum_byte *dstPtr, libspectrum_dword dstPitch,
+            int width, int height )
+{
+  long pixels;
+  int bands;
+
+  pthread_mutex_lock( &run_mutex );
+
+  if( !pool_started ) pool_start();
+
+  pixels = (long)scaler_scale_number( scaler, width ) *
+           scaler_scale_number( scaler, height );
+
+  bands = worker_count + 1;
+  if( bands > pixels / SCALER_BAND_MIN_PIXELS )
+    bands = pixels / SCALER_BAND_MIN_PIXELS;
+  if( bands > height / 2 ) bands = height / 2;
+
+  if( bands < 2 || height & 1 ) {
+    pthread_mutex_unlock( &run_mutex );
+    proc( srcPtr, srcPitch, dstPtr, dstPitch, width, height );
+    return;
+  }
+
+  pthread_mutex_lock( &pool_mutex );
+
+  job.proc = proc;
+  job.src = srcPtr; job.src_pitch = srcPitch;
+  job.dst = dstPtr; job.dst_pitch = dstPitch;
+  job.width = width; job.height = height;
+  job.scaler = scaler;
+
+  /* Round up to an even number of rows, then drop any bands that leaves
+     with nothing to do */
+  job.band_height = ( ( height + bands - 1 ) / bands + 1 ) & ~1;
+  job.bands = ( height + job.band_height - 1 ) / job.band_height;
+  job.next_band = 0;
+  job.bands_left = job.bands;
+
+  pthread_cond_broadcast( &work_cond );
+
+  take_bands();
+  while( job.bands_left ) pthread_cond_wait( &done_cond, &pool_mutex );
+
+  pthread_mutex_unlock( &pool_mutex );
+
+  pthread_mutex_unlock( &run_mutex );
+}
+
+void
+scaler_threads_end( void )
+{
+  size_t i;
+
+  pthread_mutex_lock( &run_mutex );
+
+  if( pool_started ) {
+    pthread_mutex_lock( &pool_mutex );
+    pool_stop = 1;
+    pthread_cond_broadcast( &work_cond );
+    pthread_mutex_unlock( &pool_mutex );
+
+    for( i = 0; i < worker_count; i++ ) pthread_join( workers[i], NULL );
+
+    worker_count = 0;
+    pool_started = 0;
+  }
+
+  pthread_mutex_unlock( &run_mutex );
+}
+
+#else				/* #ifdef HAVE_PTHREAD */
+
+void
+scaler_run( scaler_type scaler GCC_UNUSED, ScalerProc *proc,
+            const libspectrum_byte *srcPtr, libspectrum_dword srcPitch,
+            libspectrum_byte *dstPtr, libspectrum_dword dstPitch,
+            int width, int height )
+{
+  proc( srcPtr, srcPitch, dstPtr, dstPitch, width, height );
+}
+
+void
+scaler_threads_end( void )
+{
+}
+
+#endif				/* #ifdef HAVE_PTHREAD */
@@ -32,18 +32,11 @@
 
 #include "scaler.h"
 #include "scaler_internals.h"
+#include "scaler_simd.h"
 #include "settings.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
 
-#ifndef MIN
-#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
-#endif
-
-#ifndef ABS
-#define ABS(x)     ((x)>=0?(x):-(x))
-#endif
-
 /* The actual code for the scalers starts here */
 
 #if SCALER_DATA_SIZE == 2
@@ -567,15 +560,6 @@ HQ_INTERPOLATE_10( libspectrum_dword A, libspectrum_dword B,
 #define HQ4X_PIXEL33_81    HQ_INTERPOLATE_8(w[5], w[6])
 #define HQ4X_PIXEL33_82    HQ_INTERPOLATE_8(w[5], w[8])
 
-#define HQ_trY 0x00000030
-#define HQ_trU 0x00000007
-#define HQ_trV 0x00000006
-
-#define HQ_YUVDIFF(y1,u1,v1,y2,u2,v2) \
-  ( ( ABS( y1 - y2 ) > HQ_trY ) || \
-    ( ABS( u1 - u2 ) > HQ_trU ) || \
-    ( ABS( v1 - v2 ) > HQ_trV ) )
-
 void 
 FUNCTION( scaler_Super2xSaI )( const libspectrum_byte *srcPtr,
 			       libspectrum_dword srcPitch,
@@ -1442,26 +1426,6 @@ FUNCTION( scaler_DotMatrix )( const libspectrum_byte *srcPtr,
   }
 }
 
-/*
-    Y  =  0.29900 * R + 0.58700 * G + 0.11400 * B
-    U  = -0.16874 * R - 0.33126 * G + 0.50000 * B  (+ 128)
-    V  =  0.50000 * R - 0.41869 * G - 0.08131 * B  (+ 128)
-*/
-
-#define RGB_TO_Y(r, g, b) ( ( 2449L * r + 4809L * g + 934L * b + 1024 ) >> 11 )
-#define RGB_TO_U(r, g, b) ( ( 4096L * b - 1383L * r - 2713L * g + 1024 ) >> 11 )
-#define RGB_TO_V(r, g, b) ( ( 4096L * r - 3430L * g - 666L * b +  1024 ) >> 11 )
-
-/*
-    R = Y + 1.402 (V-128)
-    G = Y - 0.34414 (U-128) - 0.71414 (V-128)
-    B = Y + 1.772 (U-128)
-*/
-
-#define YUV_TO_R(y, u, v) ( MIN( ABS( ( 8192L * y              + 11485L * v + 16384 ) >> 15 ), 255 ) )
-#define YUV_TO_G(y, u, v) ( MIN( ABS( ( 8192L * y - 2819L  * u -  5850L * v + 16384 ) >> 15 ), 255 ) )
-#define YUV_TO_B(y, u, v) ( MIN( ABS( ( 8192L * y + 14516L * u              + 16384 ) >> 15 ), 255 ) )
-
 #define RGB_TO_PIXEL_555(r,g,b) \
         (((r * 125) >> 10) + (((g * 125) >> 5) & greenMask) + \
                 ((b * 125) & blueMask))
@@ -1483,6 +1447,78 @@ FUNCTION( scaler_DotMatrix )( const libspectrum_byte *srcPtr,
         ( ( ( (b) & blueMask ) >> 11 ) * 8424 ) >> 10 : \
         ( ( ( (b) & blueMask ) >> 10 ) * 8424 ) >> 10 )
 
+/* The PAL TV and HQ scalers work through the image a row at a time,
+   converting the row to YUV with the kernels from scaler_simd.c. Wider
+   areas than this are done in strips */
+#define SCALER_STRIP 320
+
+/* Split `n' pixels into 8-bit components */
+static void
+unpack_row( const scaler_data_type *p, libspectrum_byte *r,
+            libspectrum_byte *g, libspectrum_byte *b, int n )
+{
+  int i;
+
+  for( i = 0; i < n; i++ ) {
+#if SCALER_DATA_SIZE == 2
+    r[i] = R_TO_R( p[i] );
+    g[i] = G_TO_G( p[i] );
+    b[i] = B_TO_B( p[i] );
+#else
+    r[i] =   p[i] & redMask;
+    g[i] = ( p[i] & greenMask ) >> 8;
+    b[i] = ( p[i] & blueMask  ) >> 16;
+#endif
+  }
+}
+
+/* And put them back together again */
+static void
+pack_row( scaler_data_type *q, const libspectrum_byte *r,
+          const libspectrum_byte *g, const libspectrum_byte *b, int n )
+{
+  int i;
+
+#if SCALER_DATA_SIZE == 2
+  if( green6bit ) {
+    for( i = 0; i < n; i++ ) q[i] = RGB_TO_PIXEL_565( r[i], g[i], b[i] );
+  } else {
+    for( i = 0; i < n; i++ ) q[i] = RGB_TO_PIXEL_555( r[i], g[i], b[i] );
+  }
+#else
+  for( i = 0; i < n; i++ ) q[i] = r[i] + ( g[i] << 8 ) + ( b[i] << 16 );
+#endif
+}
+
+/* Convert `n' pixels, at most SCALER_STRIP + 3, to YUV */
+static void
+convert_row( const scaler_data_type *p, libspectrum_signed_word *y,
+             libspectrum_signed_word *u, libspectrum_signed_word *v, int n )
+{
+  libspectrum_byte r[ SCALER_STRIP + 3 ], g[ SCALER_STRIP + 3 ],
+                   b[ SCALER_STRIP + 3 ];
+
+  unpack_row( p, r, g, b, n );
+  scaler_simd->rgb_to_yuv( r, g, b, y, u, v, n );
+}
+
+/* The extra lines of the PAL TV scalers: either copies of the first line,
+   or with the "scanlines" setting, a darker version of it */
+static void
+paltv_scanline( scaler_data_type *q, const scaler_data_type *src, int n )
+{
+  int i;
+
+  if( !settings_current.pal_tv2x ) {
+    memcpy( q, src, n * sizeof( scaler_data_type ) );
+    return;
+  }
+
+  for( i = 0; i < n; i++ )
+    q[i] = ((((src[i] & redblueMask) * 7) >> 3) & redblueMask) |
+               ((((src[i] & greenMask  ) * 7) >> 3) & greenMask);
+}
+
 void
 FUNCTION( scaler_PalTV )( const libspectrum_byte *srcPtr,
                               libspectrum_dword srcPitch,
@@ -1497,18 +1533,17 @@ FUNCTION( scaler_PalTV )( const libspectrum_byte *srcPtr,
    3.a. YUV => RGB
    3.b  255,255,255 RGB => RGB
 */
-  int i, j;
+  int i, j, x, n;
   unsigned int nextlineSrc = srcPitch / sizeof( scaler_data_type );
-  const scaler_data_type *p, *p0 = (const scaler_data_type *)srcPtr;
+  const scaler_data_type *p = (const scaler_data_type *)srcPtr;
 
   unsigned int nextlineDst = dstPitch / sizeof( scaler_data_type );
-  scaler_data_type *q, *q0 = (scaler_data_type *)dstPtr;
-  
-  libspectrum_byte  r0, g0, b0,
-                    r1, g1, b1,
-                    r2, g2, b2,
-                    r3, g3, b3;
-  libspectrum_signed_word y1, y2, u1, u2, v1, v2;
+  scaler_data_type *q = (scaler_data_type *)dstPtr;
+
+  libspectrum_signed_word y[ SCALER_STRIP + 3 ], u[ SCALER_STRIP + 3 ],
+                          v[ SCALER_STRIP + 3 ], cu[ SCALER_STRIP + 1 ],
+                          cv[ SCALER_STRIP + 1 ];
+  libspectrum_byte r[ SCALER_STRIP ], g[ SCALER_STRIP ], b[ SCALER_STRIP ];
 
 /*
  422 cosited
@@ -1521,107 +1556,38 @@ FUNCTION( scaler_PalTV )( const libspectrum_byte *srcPtr,
 
 */
   for( j = height; j; j-- ) {
-    p = p0 - 1; q = q0;
-#if SCALER_DATA_SIZE == 2
-    /* 1.a. RGB => RGB */
-    r2 = R_TO_R( *p );
-    g2 = G_TO_G( *p );
-    b2 = B_TO_B( *p );
-    p++;
-    r0 = R_TO_R( *p );
-    g0 = G_TO_G( *p );
-    b0 = B_TO_B( *p );
-    p++;
-    r1 = R_TO_R( *p );
-    g1 = G_TO_G( *p );
-    b1 = B_TO_B( *p );
-    p++;
-#else
-    r2 = (*p & redMask);
-    g2 = (*p & greenMask) >> 8;
-    b2 = (*p & blueMask) >> 16;
-    p++;
-    r0 = (*p & redMask);
-    g0 = (*p & greenMask) >> 8;
-    b0 = (*p & blueMask) >> 16;
-    p++;
-    r1 = (*p & redMask);
-    g1 = (*p & greenMask) >> 8;
-    b1 = (*p & blueMask) >> 16;
-    p++;
-#endif
-    u1 = ( RGB_TO_U( r2, g2, b2 ) + 2 * RGB_TO_U( r0, g0, b0 ) +
-            RGB_TO_U( r1, g1, b1 ) ) >> 2;
-    v1 = ( RGB_TO_V( r2, g2, b2 ) + 2 * RGB_TO_V( r0, g0, b0 ) +
-            RGB_TO_V( r1, g1, b1 ) ) >> 2;
-    for( i = width; i; i -= 2 ) {
-#if SCALER_DATA_SIZE == 2
-      /* 1.a. RGB => RGB */
-      r2 = R_TO_R( *p );
-      g2 = G_TO_G( *p );
-      b2 = B_TO_B( *p );
-      p++;
-      r3 = R_TO_R( *p );
-      g3 = G_TO_G( *p );
-      b3 = B_TO_B( *p );
-      p++;
-#else
-      r2 = (*p & redMask);
-      g2 = (*p & greenMask) >> 8;
-      b2 = (*p & blueMask) >> 16;
-      p++;
-      r3 = (*p & redMask);
-      g3 = (*p & greenMask) >> 8;
-      b3 = (*p & blueMask) >> 16;
-      p++;
-#endif
-/* 1.b. RGB => YUV && 2. YUV subsampling */
-      y1 = RGB_TO_Y( r0, g0, b0 );
-      y2 = RGB_TO_Y( r1, g1, b1 );
-
-      u2 = ( RGB_TO_U( r1, g1, b1 ) + 2 * RGB_TO_U( r2, g2, b2 ) +
-            RGB_TO_U( r3, g3, b3 ) ) >> 2;
-      v2 = ( RGB_TO_V( r1, g1, b1 ) + 2 * RGB_TO_V( r2, g2, b2 ) +
-            RGB_TO_V( r3, g3, b3 ) ) >> 2;
-/* 3.a. YUV => RGB  */
-      r0 = YUV_TO_R(y1, u1, v1);
-      g0 = YUV_TO_G(y1, u1, v1);
-      b0 = YUV_TO_B(y1, u1, v1);
-      
-      u1 = (u1 + u2) >> 1;
-      v1 = (v1 + v2) >> 1;
-
-      r1 = YUV_TO_R(y2, u1, v1);
-      g1 = YUV_TO_G(y2, u1, v1);
-      b1 = YUV_TO_B(y2, u1, v1);
-#if SCALER_DATA_SIZE == 2
-/* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q++ = RGB_TO_PIXEL_565( r0, g0, b0 );
-        *q++ = RGB_TO_PIXEL_565( r1, g1, b1 );
-      } else {
-        *q++ = RGB_TO_PIXEL_555( r0, g0, b0 );
-        *q++ = RGB_TO_PIXEL_555( r1, g1, b1 );
+    /* Strips start on even pixels, so the subsampling is unchanged */
+    for( x = 0; x < width; x += SCALER_STRIP ) {
+      n = MIN( width - x, SCALER_STRIP );
+
+/* 1. RGB => YUV, from one pixel left of the strip to two right of it */
+      convert_row( p + x - 1, y, u, v, n + 3 );
+
+/* 2. YUV subsampling */
+      for( i = 0; i <= n; i += 2 ) {
+        cu[i] = ( u[i] + 2 * u[ i + 1 ] + u[ i + 2 ] ) >> 2;
+        cv[i] = ( v[i] + 2 * v[ i + 1 ] + v[ i + 2 ] ) >> 2;
       }
-#else
-      *q++ = r0 + (g0 << 8) + (b0 << 16);
-      *q++ = r1 + (g1 << 8) + (b1 << 16);
-#endif
-      u1 = u2; v1 = v2;
-      r0 = r2; g0 = g2; b0 = b2;
-      r1 = r3; g1 = g3; b1 = b3;
+      for( i = 1; i < n; i += 2 ) {
+        cu[i] = ( cu[ i - 1 ] + cu[ i + 1 ] ) >> 1;
+        cv[i] = ( cv[ i - 1 ] + cv[ i + 1 ] ) >> 1;
+      }
+
+/* 3. YUV => RGB */
+      scaler_simd->yuv_to_rgb( y + 1, cu, cv, r, g, b, n );
+      pack_row( q + x, r, g, b, n );
     }
-    p0 += nextlineSrc;
-    q0 += nextlineDst;
+    p += nextlineSrc;
+    q += nextlineDst;
   }
 }
 
-void
-FUNCTION( scaler_PalTV2x )( const libspectrum_byte *srcPtr,
-                              libspectrum_dword srcPitch,
-                              libspectrum_byte *dstPtr,
-                              libspectrum_dword dstPitch,
-                              int width, int height )
+/* One row of a strip of `n' pixels for the PAL TV 2x, 3x and 4x scalers,
+   as 2 * `n' pixels: the left half of each source pixel has the chroma of
+   the pixel and the right half that halfway to the next one */
+static void
+paltv_row( const scaler_data_type *p, libspectrum_byte *r,
+           libspectrum_byte *g, libspectrum_byte *b, int n )
 {
 /*
    1.a. RGB => 255,255,255 RGB
@@ -1630,120 +1596,65 @@ FUNCTION( scaler_PalTV2x )( const libspectrum_byte *srcPtr,
    3.a. YUV => RGB
    3.b  255,255,255 RGB => RGB
 */
-  int i, j;
+  int i;
+  libspectrum_signed_word y[ SCALER_STRIP + 2 ], u[ SCALER_STRIP + 2 ],
+                          v[ SCALER_STRIP + 2 ], y2[ 2 * SCALER_STRIP ],
+                          cu[ 2 * SCALER_STRIP ], cv[ 2 * SCALER_STRIP ];
+  libspectrum_signed_dword u1, v1, u2, v2;
+
+/* 1. RGB => YUV, from one pixel left of the strip to one right of it */
+  convert_row( p - 1, y, u, v, n + 2 );
+
+/* 2. YUV subsampling */
+  u1 = ( u[0] + 3 * u[1] ) >> 2;
+  v1 = ( v[0] + 3 * v[1] ) >> 2;
+  for( i = 0; i < n; i++ ) {
+    u2 = ( u[ i + 1 ] + 3 * u[ i + 2 ] ) >> 2;
+    v2 = ( v[ i + 1 ] + 3 * v[ i + 2 ] ) >> 2;
+
+    y2[ 2 * i ] = y2[ 2 * i + 1 ] = y[ i + 1 ];
+    cu[ 2 * i ] = u1;   cu[ 2 * i + 1 ] = ( u1 + u2 ) >> 1;
+    cv[ 2 * i ] = v1;   cv[ 2 * i + 1 ] = ( v1 + v2 ) >> 1;
+
+    u1 = u2; v1 = v2;
+  }
+
+/* 3.a. YUV => RGB */
+  scaler_simd->yuv_to_rgb( y2, cu, cv, r, g, b, 2 * n );
+}
+
+void
+FUNCTION( scaler_PalTV2x )( const libspectrum_byte *srcPtr,
+                              libspectrum_dword srcPitch,
+                              libspectrum_byte *dstPtr,
+                              libspectrum_dword dstPitch,
+                              int width, int height )
+{
+  int j, x, n;
   unsigned int nextlineSrc = srcPitch / sizeof( scaler_data_type );
-  const scaler_data_type *p, *p0 = (const scaler_data_type *)srcPtr;
+  const scaler_data_type *p = (const scaler_data_type *)srcPtr;
 
   unsigned int nextlineDst = dstPitch / sizeof( scaler_data_type );
   scaler_data_type *q, *q0 = (scaler_data_type *)dstPtr;
-  
-  libspectrum_byte  r0, g0, b0,
-                    r1, g1, b1,
-                    rx, gx, bx;
-  libspectrum_signed_dword y1, y2, u1, v1, u2, v2;
 
-/*
- 422 cosited
-    # + # +             + only Y
-                        # Y and Cb Cr
-    # + # +
-    
-    abcd...    =>  1/2a + a + 1/2b / 2; ...; 1/2a + b + 1/2c; ... ; ...
-    always 3 sample/proc
+  libspectrum_byte r[ 2 * SCALER_STRIP ], g[ 2 * SCALER_STRIP ],
+                   b[ 2 * SCALER_STRIP ];
 
+/*
+    a  =>  Aa
+           aa      (a darker with scanlines on)
 */
   for( j = height; j; j-- ) {
-    p = p0 - 1; q = q0;
-#if SCALER_DATA_SIZE == 2
-    r0 = R_TO_R( *p );
-    g0 = G_TO_G( *p );
-    b0 = B_TO_B( *p );
-    p++;
-    r1 = R_TO_R( *p );
-    g1 = G_TO_G( *p );
-    b1 = B_TO_B( *p );
-#else
-    r0 = *p & redMask;
-    g0 = (*p & greenMask) >> 8;
-    b0 = (*p & blueMask) >> 16;
-    p++;
-    r1 = *(p) & redMask;
-    g1 = (*(p) & greenMask) >> 8;
-    b1 = (*(p) & blueMask) >> 16;
-#endif
-    y1 = RGB_TO_Y( r1, g1, b1 );
-    u1 = ( RGB_TO_U( r0, g0, b0 ) + 3 * RGB_TO_U( r1, g1, b1 ) ) >> 2;
-    v1 = ( RGB_TO_V( r0, g0, b0 ) + 3 * RGB_TO_V( r1, g1, b1 ) ) >> 2;
-    for( i = width; i; i-- ) {
-      p++;      /* next point */
-#if SCALER_DATA_SIZE == 2
-      /* 1.a. RGB => RGB */
-      r0 = R_TO_R( *p );
-      g0 = G_TO_G( *p );
-      b0 = B_TO_B( *p );
-#else
-      r0 = (*p & redMask);
-      g0 = (*p & greenMask) >> 8;
-      b0 = (*p & blueMask) >> 16;
-#endif
-/* 1.b. RGB => YUV && 2. YUV subsampling */
-      y2 = RGB_TO_Y( r0, g0, b0 );
-      u2 = ( RGB_TO_U( r1, g1, b1 ) + 3 * RGB_TO_U( r0, g0, b0 ) ) >> 2;
-      v2 = ( RGB_TO_V( r1, g1, b1 ) + 3 * RGB_TO_V( r0, g0, b0 ) ) >> 2;
+    for( x = 0; x < width; x += SCALER_STRIP ) {
+      n = MIN( width - x, SCALER_STRIP );
+      q = q0 + 2 * x;
 
-/* 3.a. YUV => RGB  */
-      rx = YUV_TO_R( y1, u1, v1 );      /* [x0][  ]*/
-      gx = YUV_TO_G( y1, u1, v1 );
-      bx = YUV_TO_B( y1, u1, v1 );
-
-      u1 = ( u1 + u2 ) >> 1;
-      v1 = ( v1 + v2 ) >> 1;
-
-      r1 = YUV_TO_R( y1, u1, v1 );
-      g1 = YUV_TO_G( y1, u1, v1 );
-      b1 = YUV_TO_B( y1, u1, v1 );
-
-#if SCALER_DATA_SIZE == 2
-/* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q = RGB_TO_PIXEL_565( rx, gx, bx );
-      } else {
-        *q = RGB_TO_PIXEL_555( rx, gx, bx );
-      }
-#else
-      *q = rx + ( gx << 8 ) + ( bx << 16 );
-#endif
-
-      if( settings_current.pal_tv2x )
-        *(q + nextlineDst) =
-            ((((*q & redblueMask) * 7) >> 3) & redblueMask) |
-                ((((*q & greenMask  ) * 7) >> 3) & greenMask);
-      else
-        *(q + nextlineDst) = *q;
-
-      q++;
-#if SCALER_DATA_SIZE == 2
+      paltv_row( p + x, r, g, b, n );
 /* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q = RGB_TO_PIXEL_565( r1, g1, b1 );
-      } else {
-        *q = RGB_TO_PIXEL_555( r1, g1, b1 );
-      }
-#else
-      *q = r1 + ( g1 << 8 ) + ( b1 << 16 );
-#endif
-      if( settings_current.pal_tv2x )
-        *(q + nextlineDst) =
-            ((((*q & redblueMask) * 7) >> 3) & redblueMask) |
-                ((((*q & greenMask  ) * 7) >> 3) & greenMask);
-      else
-        *(q + nextlineDst) = *q;
-
-      q++;
-      y1 = y2; u1 = u2; v1 = v2;        /* save for next point */
-      r1 = r0; g1 = g0; b1 = b0;
+      pack_row( q, r, g, b, 2 * n );
+      paltv_scanline( q + nextlineDst, q, 2 * n );
     }
-    p0 += nextlineSrc;
+    p += nextlineSrc;
     q0 += nextlineDst << 1;
   }
 }
@@ -1755,159 +1666,46 @@ FUNCTION( scaler_PalTV3x )( const libspectrum_byte *srcPtr,
                               libspectrum_dword dstPitch,
                               int width, int height )
 {
-/*
-   1.a. RGB => 255,255,255 RGB
-   1.b. RGB => YUV
-   2. 4:2:2 cosited color subsampling 
-   3.a. YUV => RGB
-   3.b  255,255,255 RGB => RGB
-*/
-  int i, j;
+  int i, j, x, n;
   unsigned int nextlineSrc = srcPitch / sizeof( scaler_data_type );
-  const scaler_data_type *p, *p0 = (const scaler_data_type *)srcPtr;
+  const scaler_data_type *p = (const scaler_data_type *)srcPtr;
 
   unsigned int nextlineDst = dstPitch / sizeof( scaler_data_type );
   scaler_data_type *q, *q0 = (scaler_data_type *)dstPtr;
-  
-  libspectrum_byte  r0, g0, b0,
-                    r1, g1, b1,
-                    r2, g2, b2,
-                    rx, gx, bx;
-  libspectrum_signed_dword y1, y2, u1, v1, u2, v2;
-
-/*
- 422 cosited
-    # + # +             + only Y
-                        # Y and Cb Cr
-    # + # +
-    
-    abcd...    =>  1/2a + a + 1/2b / 2; ...; 1/2a + b + 1/2c; ... ; ...
-    always 3 sample/proc
 
-*/
-  for( j = height; j; j-- ) {
-    p = p0 - 1; q = q0;
-#if SCALER_DATA_SIZE == 2
-    r0 = R_TO_R( *p );
-    g0 = G_TO_G( *p );
-    b0 = B_TO_B( *p );
-    p++;
-    r1 = R_TO_R( *p );
-    g1 = G_TO_G( *p );
-    b1 = B_TO_B( *p );
-#else
-    r0 = *p & redMask;
-    g0 = (*p & greenMask) >> 8;
-    b0 = (*p & blueMask) >> 16;
-    p++;        /* next point */
-    r1 = *(p) & redMask;
-    g1 = (*(p) & greenMask) >> 8;
-    b1 = (*(p) & blueMask) >> 16;
-#endif
-    y1 = RGB_TO_Y( r1, g1, b1 );
-    u1 = ( RGB_TO_U( r0, g0, b0 ) + 3 * RGB_TO_U( r1, g1, b1 ) ) >> 2;
-    v1 = ( RGB_TO_V( r0, g0, b0 ) + 3 * RGB_TO_V( r1, g1, b1 ) ) >> 2;
-    for( i = width; i; i-- ) {
-      p++;
-#if SCALER_DATA_SIZE == 2
-      /* 1.a. RGB => RGB */
-      r0 = R_TO_R( *p );
-      g0 = G_TO_G( *p );
-      b0 = B_TO_B( *p );
-#else
-      r0 = (*p & redMask);
-      g0 = (*p & greenMask) >> 8;
-      b0 = (*p & blueMask) >> 16;
-#endif
-/* 1.b. RGB => YUV && 2. YUV subsampling */
-      y2 = RGB_TO_Y( r0, g0, b0 );
-      u2 = ( RGB_TO_U( r1, g1, b1 ) + 3 * RGB_TO_U( r0, g0, b0 ) ) >> 2;
-      v2 = ( RGB_TO_V( r1, g1, b1 ) + 3 * RGB_TO_V( r0, g0, b0 ) ) >> 2;
-
-/* 3.a. YUV => RGB  */
-      rx = YUV_TO_R( y1, u1, v1 );      /* [x0][  ]*/
-      gx = YUV_TO_G( y1, u1, v1 );
-      bx = YUV_TO_B( y1, u1, v1 );
-
-      u1 = ( u1 + u2 ) >> 1;
-      v1 = ( v1 + v2 ) >> 1;
-
-      r1 = YUV_TO_R( y1, u1, v1 );
-      g1 = YUV_TO_G( y1, u1, v1 );
-      b1 = YUV_TO_B( y1, u1, v1 );
+  libspectrum_byte r[ 2 * SCALER_STRIP ], g[ 2 * SCALER_STRIP ],
+                   b[ 2 * SCALER_STRIP ], r3[ 3 * SCALER_STRIP ],
+                   g3[ 3 * SCALER_STRIP ], b3[ 3 * SCALER_STRIP ];
 
 /*
     ab  => EFG         
     ab     EFG
            efg
 */
-      r2 = ((int)rx + r1) >> 1;                 /* F */
-      g2 = ((int)gx + g1) >> 1;
-      b2 = ((int)bx + b1) >> 1;
-
-#if SCALER_DATA_SIZE == 2
-/* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q = RGB_TO_PIXEL_565( rx, gx, bx);
-      } else {
-        *q = RGB_TO_PIXEL_555( rx, gx, bx);
-      }
-#else
-      *q = rx + ( gx << 8 ) + ( bx << 16 );     /* E, E, e */
-#endif
-      *(q + nextlineDst) = *q;
-
-      if( settings_current.pal_tv2x )
-        *(q + (nextlineDst << 1)) =
-            ((((*q & redblueMask) * 7) >> 3) & redblueMask) |
-                ((((*q & greenMask  ) * 7) >> 3) & greenMask);
-      else
-        *(q + (nextlineDst << 1)) = *q;
-
-      q++;
-#if SCALER_DATA_SIZE == 2
-/* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q = RGB_TO_PIXEL_565( r2, g2, b2 );
-      } else {
-        *q = RGB_TO_PIXEL_555( r2, g2, b2 );
+  for( j = height; j; j-- ) {
+    for( x = 0; x < width; x += SCALER_STRIP ) {
+      n = MIN( width - x, SCALER_STRIP );
+      q = q0 + 3 * x;
+
+      paltv_row( p + x, r, g, b, n );
+      for( i = 0; i < n; i++ ) {
+        r3[ 3 * i ] = r[ 2 * i ];                             /* E */
+        g3[ 3 * i ] = g[ 2 * i ];
+        b3[ 3 * i ] = b[ 2 * i ];
+        r3[ 3 * i + 1 ] = ( (int)r[ 2 * i ] + r[ 2 * i + 1 ] ) >> 1;  /* F */
+        g3[ 3 * i + 1 ] = ( (int)g[ 2 * i ] + g[ 2 * i + 1 ] ) >> 1;
+        b3[ 3 * i + 1 ] = ( (int)b[ 2 * i ] + b[ 2 * i + 1 ] ) >> 1;
+        r3[ 3 * i + 2 ] = r[ 2 * i + 1 ];                     /* G */
+        g3[ 3 * i + 2 ] = g[ 2 * i + 1 ];
+        b3[ 3 * i + 2 ] = b[ 2 * i + 1 ];
       }
-#else
-      *q = r2 + ( g2 << 8 ) + ( b2 << 16 );     /* F, F, f*/
-#endif
-      *(q + nextlineDst) = *q;
-
-      if( settings_current.pal_tv2x )
-        *(q + (nextlineDst << 1)) =
-            ((((*q & redblueMask) * 7) >> 3) & redblueMask) |
-                ((((*q & greenMask  ) * 7) >> 3) & greenMask);
-      else
-        *(q + (nextlineDst << 1)) = *q;
 
-      q++;
-#if SCALER_DATA_SIZE == 2
 /* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q = RGB_TO_PIXEL_565( r1, g1, b1 );
-      } else {
-        *q = RGB_TO_PIXEL_555( r1, g1, b1 );
-      }
-#else
-      *q = r1 + ( g1 << 8 ) + ( b1 << 16 );     /* G, G, g*/
-#endif
-      *(q + nextlineDst) = *q;
-      if( settings_current.pal_tv2x )
-        *(q + (nextlineDst << 1)) =
-            ((((*q & redblueMask) * 7) >> 3) & redblueMask) |
-                ((((*q & greenMask  ) * 7) >> 3) & greenMask);
-      else
-        *(q + (nextlineDst << 1)) = *q;
-
-      q++;
-      y1 = y2; u1 = u2; v1 = v2;        /* save for next point */
-      r1 = r0; g1 = g0; b1 = b0;
+      pack_row( q, r3, g3, b3, 3 * n );
+      memcpy( q + nextlineDst, q, 3 * n * sizeof( scaler_data_type ) );
+      paltv_scanline( q + ( nextlineDst << 1 ), q, 3 * n );
     }
-    p0 += nextlineSrc;
+    p += nextlineSrc;
     q0 += (nextlineDst << 1) + nextlineDst;
   }
 }
@@ -1919,156 +1717,109 @@ FUNCTION( scaler_PalTV4x )( const libspectrum_byte *srcPtr,
                               libspectrum_dword dstPitch,
                               int width, int height )
 {
-/*
-   1.a. RGB => 255,255,255 RGB
-   1.b. RGB => YUV
-   2. 4:2:2 cosited color subsampling
-   3.a. YUV => RGB
-   3.b  255,255,255 RGB => RGB
-*/
-  int i, j;
+  int i, j, x, n;
   unsigned int nextlineSrc = srcPitch / sizeof( scaler_data_type );
-  const scaler_data_type *p, *p0 = (const scaler_data_type *)srcPtr;
+  const scaler_data_type *p = (const scaler_data_type *)srcPtr;
 
   unsigned int nextlineDst = dstPitch / sizeof( scaler_data_type );
   scaler_data_type *q, *q0 = (scaler_data_type *)dstPtr;
 
-  libspectrum_byte  r0, g0, b0,
-                    r1, g1, b1,
-                    rx, gx, bx;
-  libspectrum_signed_dword y1, y2, u1, v1, u2, v2;
+  libspectrum_byte r[ 2 * SCALER_STRIP ], g[ 2 * SCALER_STRIP ],
+                   b[ 2 * SCALER_STRIP ];
+  scaler_data_type pixels[ 2 * SCALER_STRIP ];
 
-/*
- 422 cosited
-    # + # +             + only Y
-                        # Y and Cb Cr
-    # + # +
-
-    abcd...    =>  1/2a + a + 1/2b / 2; ...; 1/2a + b + 1/2c; ... ; ...
-    always 3 sample/proc
-
-*/
-  for( j = height; j; j-- ) {
-    p = p0 - 1; q = q0;
-#if SCALER_DATA_SIZE == 2
-    r0 = R_TO_R( *p );
-    g0 = G_TO_G( *p );
-    b0 = B_TO_B( *p );
-    p++;
-    r1 = R_TO_R( *p );
-    g1 = G_TO_G( *p );
-    b1 = B_TO_B( *p );
-#else
-    r0 = *p & redMask;
-    g0 = (*p & greenMask) >> 8;
-    b0 = (*p & blueMask) >> 16;
-    p++;
-    r1 = *(p) & redMask;
-    g1 = (*(p) & greenMask) >> 8;
-    b1 = (*(p) & blueMask) >> 16;
-#endif
-    y1 = RGB_TO_Y( r1, g1, b1 );
-    u1 = ( RGB_TO_U( r0, g0, b0 ) + 3 * RGB_TO_U( r1, g1, b1 ) ) >> 2;
-    v1 = ( RGB_TO_V( r0, g0, b0 ) + 3 * RGB_TO_V( r1, g1, b1 ) ) >> 2;
-    for( i = width; i; i-- ) {
-      p++;      /* next point */
-#if SCALER_DATA_SIZE == 2
-      /* 1.a. RGB => RGB */
-      r0 = R_TO_R( *p );
-      g0 = G_TO_G( *p );
-      b0 = B_TO_B( *p );
-#else
-      r0 = (*p & redMask);
-      g0 = (*p & greenMask) >> 8;
-      b0 = (*p & blueMask) >> 16;
-#endif
-/* 1.b. RGB => YUV && 2. YUV subsampling */
-      y2 = RGB_TO_Y( r0, g0, b0 );
-      u2 = ( RGB_TO_U( r1, g1, b1 ) + 3 * RGB_TO_U( r0, g0, b0 ) ) >> 2;
-      v2 = ( RGB_TO_V( r1, g1, b1 ) + 3 * RGB_TO_V( r0, g0, b0 ) ) >> 2;
-
-/* 3.a. YUV => RGB  */
-      rx = YUV_TO_R( y1, u1, v1 );      /* [x0][  ]*/
-      gx = YUV_TO_G( y1, u1, v1 );
-      bx = YUV_TO_B( y1, u1, v1 );
-
-      u1 = ( u1 + u2 ) >> 1;
-      v1 = ( v1 + v2 ) >> 1;
-
-      r1 = YUV_TO_R( y1, u1, v1 );
-      g1 = YUV_TO_G( y1, u1, v1 );
-      b1 = YUV_TO_B( y1, u1, v1 );
-
-#if SCALER_DATA_SIZE == 2
 /*
    q q+1 | q+2 q+3
    q q+1 | q+2 q+3
    _______________
 
 */
-/* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q = *(q+1) = RGB_TO_PIXEL_565( rx, gx, bx );
-      } else {
-        *q = *(q+1) = RGB_TO_PIXEL_555( rx, gx, bx );
-      }
-#else
-      *q = *(q+1) = rx + ( gx << 8 ) + ( bx << 16 );
-#endif
+  for( j = height; j; j-- ) {
+    for( x = 0; x < width; x += SCALER_STRIP ) {
+      n = MIN( width - x, SCALER_STRIP );
+      q = q0 + 4 * x;
 
-      if( settings_current.pal_tv2x )
-        *(q + nextlineDst) = *(q + nextlineDst + 1) =
-        *(q + 2 * nextlineDst) = *(q + 2 * nextlineDst + 1) =
-        *(q + 3 * nextlineDst) = *(q + 3 * nextlineDst + 1) =
-            ((((*q & redblueMask) * 7) >> 3) & redblueMask) |
-                ((((*q & greenMask  ) * 7) >> 3) & greenMask);
-      else
-        *(q + nextlineDst) = *(q + nextlineDst + 1) =
-        *(q + 2 * nextlineDst) = *(q + 2 * nextlineDst + 1) =
-        *(q + 3 * nextlineDst) = *(q + 3 * nextlineDst + 1) = *q;
-
-      q++; q++;
-#if SCALER_DATA_SIZE == 2
+      paltv_row( p + x, r, g, b, n );
 /* 3.b. RGB => RGB */
-      if( green6bit ) {
-        *q = *(q + 1) = RGB_TO_PIXEL_565( r1, g1, b1 );
-      } else {
-        *q = *(q + 1) = RGB_TO_PIXEL_555( r1, g1, b1 );
-      }
-#else
-      *q = *(q + 1) = r1 + ( g1 << 8 ) + ( b1 << 16 );
-#endif
-      if( settings_current.pal_tv2x )
-        *(q + nextlineDst) = *(q + nextlineDst + 1) =
-        *(q + 2 * nextlineDst) = *(q + 2 * nextlineDst + 1) =
-        *(q + 3 * nextlineDst) = *(q + 3 * nextlineDst + 1) =
-            ((((*q & redblueMask) * 7) >> 3) & redblueMask) |
-                ((((*q & greenMask  ) * 7) >> 3) & greenMask);
-      else
-        *(q + nextlineDst) = *(q + nextlineDst + 1) =
-        *(q + 2 * nextlineDst) = *(q + 2 * nextlineDst + 1) =
-        *(q + 3 * nextlineDst) = *(q + 3 * nextlineDst + 1) = *q;
-
-      q++; q++;
-      y1 = y2; u1 = u2; v1 = v2;        /* save for next point */
-      r1 = r0; g1 = g0; b1 = b0;
+      pack_row( pixels, r, g, b, 2 * n );
+      for( i = 0; i < 2 * n; i++ )
+        q[ 2 * i ] = q[ 2 * i + 1 ] = pixels[i];
+
+      paltv_scanline( q + nextlineDst, q, 4 * n );
+      memcpy( q + 2 * nextlineDst, q + nextlineDst,
+              4 * n * sizeof( scaler_data_type ) );
+      memcpy( q + 3 * nextlineDst, q + nextlineDst,
+              4 * n * sizeof( scaler_data_type ) );
     }
-    p0 += nextlineSrc;
+    p += nextlineSrc;
     q0 += nextlineDst << 2;
   }
 }
 
+/* The YUV of the rows above, through and below the current one, and the
+   HQ patterns of its pixels */
+typedef struct hq_rows {
+  libspectrum_signed_word yuv[3][3][ SCALER_STRIP + 2 ];
+  scaler_yuv_row row[3];
+  libspectrum_byte pattern[ SCALER_STRIP ];
+} hq_rows;
+
+static void
+hq_convert( scaler_yuv_row *row, const scaler_data_type *p, int n )
+{
+  convert_row( p - 1, row->y, row->u, row->v, n + 2 );
+}
+
+/* Start on a strip of `n' pixels from `p' */
+static void
+hq_rows_start( hq_rows *rows, const scaler_data_type *p, int nextlineSrc,
+               int n )
+{
+  int k;
+
+  for( k = 0; k < 3; k++ ) {
+    rows->row[k].y = rows->yuv[k][0];
+    rows->row[k].u = rows->yuv[k][1];
+    rows->row[k].v = rows->yuv[k][2];
+    hq_convert( &rows->row[k], p + ( k - 1 ) * nextlineSrc, n );
+  }
+
+  scaler_simd->hq_pattern( &rows->row[0], &rows->row[1], &rows->row[2],
+                           rows->pattern, n );
+}
+
+/* Move down to the row at `p', reusing the conversions of the rows which
+   are still needed */
+static void
+hq_rows_next( hq_rows *rows, const scaler_data_type *p, int nextlineSrc,
+              int n )
+{
+  scaler_yuv_row above = rows->row[0];
+
+  rows->row[0] = rows->row[1];
+  rows->row[1] = rows->row[2];
+  rows->row[2] = above;
+  hq_convert( &rows->row[2], p + nextlineSrc, n );
+
+  scaler_simd->hq_pattern( &rows->row[0], &rows->row[1], &rows->row[2],
+                           rows->pattern, n );
+}
+
 #define prevline (-nextlineSrc)
 #define nextline nextlineSrc
-#define MOVE_B_TO_A(A,B) \
-		w[A] = w[B]; y[A] = y[B]; u[A] = u[B]; v[A] = v[B];
 #define MOVE_P_RIGHT \
-	MOVE_B_TO_A(1,2) \
-	MOVE_B_TO_A(4,5) \
-	MOVE_B_TO_A(7,8) \
-	MOVE_B_TO_A(2,3) \
-	MOVE_B_TO_A(5,6) \
-	MOVE_B_TO_A(8,9)
+	w[1] = w[2]; w[4] = w[5]; w[7] = w[8]; \
+	w[2] = w[3]; w[5] = w[6]; w[8] = w[9];
+
+/* The switches in scaler_hq*.c compare the pixels above, left, right and
+   below the current one with each other */
+#define HQ_LOAD_YUV( k, r, x ) \
+	y[k] = rows.row[r].y[x]; u[k] = rows.row[r].u[x]; v[k] = rows.row[r].v[x];
+#define HQ_LOAD_CROSS \
+	HQ_LOAD_YUV( 2, 0, i + 1 ) \
+	HQ_LOAD_YUV( 4, 1, i     ) \
+	HQ_LOAD_YUV( 6, 1, i + 2 ) \
+	HQ_LOAD_YUV( 8, 2, i + 1 )
 
 void
 FUNCTION( scaler_HQ2x ) ( const libspectrum_byte *srcPtr,
@@ -2077,15 +1828,14 @@ FUNCTION( scaler_HQ2x ) ( const libspectrum_byte *srcPtr,
                           libspectrum_dword dstPitch,
                           int width, int height )
 {
-  int i, j, k, pattern;
+  int i, j, x, n, pattern;
   int nextlineSrc = srcPitch / sizeof( scaler_data_type );
-  const scaler_data_type *p, *p0 = (const scaler_data_type *)srcPtr;
+  const scaler_data_type *p, *p0;
   int nextlineDst = dstPitch / sizeof( scaler_data_type );
-  scaler_data_type *q, *q1, *qN, *qN1, *q0 = (scaler_data_type *)dstPtr;
+  scaler_data_type *q, *q1, *qN, *qN1, *q0;
   libspectrum_qword w[10];
-  
-  libspectrum_byte  r, g, b;
   libspectrum_signed_dword y[10], u[10], v[10];
+  hq_rows rows;
 
   /*   +----+----+----+
        |    |    |    |
@@ -2097,71 +1847,45 @@ FUNCTION( scaler_HQ2x ) ( const libspectrum_byte *srcPtr,
        |    |    |    |
        | w7 | w8 | w9 |
        +----+----+----+ */
-  for( j = 0; j < height; j++ ) {
-    p = p0;
-    q = q0; q1 = q + 1;
-    qN = q + nextlineDst; qN1 = qN + 1;
-    w[2] = *(p + prevline);
-    w[5] = *p;
-    w[8] = *(p + nextline);
-    w[1] = *(p + prevline - 1);
-    w[4] = *(p - 1);
-    w[7] = *(p + nextline - 1);
-    w[3] = *(p + prevline + 1);
-    w[6] = *(p + 1);
-    w[9] = *(p + nextline + 1);
-    for( k = 1; k <= 9; k++ ) {
-#if SCALER_DATA_SIZE == 2
-      r = R_TO_R( w[k] );
-      g = G_TO_G( w[k] );
-      b = B_TO_B( w[k] );
-#else
-      r =  w[k] & redMask;
-      g = (w[k] & greenMask) >> 8;
-      b = (w[k] & blueMask) >> 16;
-#endif
-      y[k] = RGB_TO_Y( r, g, b );
-      u[k] = RGB_TO_U( r, g, b );
-      v[k] = RGB_TO_V( r, g, b );
-    }
+  for( x = 0; x < width; x += SCALER_STRIP ) {
+    n = MIN( width - x, SCALER_STRIP );
+    p0 = (const scaler_data_type *)srcPtr + x;
+    q0 = (scaler_data_type *)dstPtr + 2 * x;
+    hq_rows_start( &rows, p0, nextlineSrc, n );
+
+    for( j = 0; j < height; j++ ) {
+      if( j ) hq_rows_next( &rows, p0, nextlineSrc, n );
+
+      p = p0;
+      q = q0; q1 = q + 1;
+      qN = q + nextlineDst; qN1 = qN + 1;
+      w[2] = *(p + prevline);
+      w[5] = *p;
+      w[8] = *(p + nextline);
+      w[1] = *(p + prevline - 1);
+      w[4] = *(p - 1);
+      w[7] = *(p + nextline - 1);
+      w[3] = *(p + prevline + 1);
+      w[6] = *(p + 1);
+      w[9] = *(p + nextline + 1);
 
-    for( i = 0; i < width; i++ ) {
-      pattern = 0;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[1], u[1], v[1] ) ) pattern |= 0x01;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[2], u[2], v[2] ) ) pattern |= 0x02;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[3], u[3], v[3] ) ) pattern |= 0x04;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[4], u[4], v[4] ) ) pattern |= 0x08;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[6], u[6], v[6] ) ) pattern |= 0x10;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[7], u[7], v[7] ) ) pattern |= 0x20;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[8], u[8], v[8] ) ) pattern |= 0x40;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[9], u[9], v[9] ) ) pattern |= 0x80;
+      for( i = 0; i < n; i++ ) {
+        pattern = rows.pattern[i];
+        HQ_LOAD_CROSS
 
 #include "scaler_hq2x.c"
 
-      p++;
-      q  += 2; q1  += 2;
-      qN += 2; qN1 += 2;
-      MOVE_P_RIGHT
-      w[3] = *(p + prevline + 1);
-      w[6] = *(p + 1);
-      w[9] = *(p + nextline + 1);
-      for( k = 3; k <= 9; k += 3 ) {
-#if SCALER_DATA_SIZE == 2
-        r = R_TO_R( w[k] );
-        g = G_TO_G( w[k] );
-        b = B_TO_B( w[k] );
-#else
-        r =   w[k] & redMask;
-        g = ( w[k] & greenMask ) >> 8;
-        b = ( w[k] & blueMask  ) >> 16;
-#endif
-        y[k] = RGB_TO_Y( r, g, b );
-        u[k] = RGB_TO_U( r, g, b );
-        v[k] = RGB_TO_V( r, g, b );
+        p++;
+        q  += 2; q1  += 2;
+        qN += 2; qN1 += 2;
+        MOVE_P_RIGHT
+        w[3] = *(p + prevline + 1);
+        w[6] = *(p + 1);
+        w[9] = *(p + nextline + 1);
       }
+      p0 += nextlineSrc;
+      q0 += nextlineDst << 1;
     }
-    p0 += nextlineSrc;
-    q0 += nextlineDst << 1;
   }
 }
 
@@ -2172,16 +1896,14 @@ FUNCTION( scaler_HQ3x ) ( const libspectrum_byte *srcPtr,
                           libspectrum_dword dstPitch,
                           int width, int height )
 {
-  int i, j, k, pattern;
+  int i, j, x, n, pattern;
   int nextlineSrc = srcPitch / sizeof( scaler_data_type );
-  const scaler_data_type *p, *p0 = (const scaler_data_type *)srcPtr;
+  const scaler_data_type *p, *p0;
   int nextlineDst = dstPitch / sizeof( scaler_data_type );
-  scaler_data_type *q, *qN, *qNN, *q1, *qN1, *qNN1, *q2, *qN2, *qNN2, 
-		   *q0 = (scaler_data_type *)dstPtr;
+  scaler_data_type *q, *qN, *qNN, *q1, *qN1, *qNN1, *q2, *qN2, *qNN2, *q0;
   libspectrum_qword w[10];
-  
-  libspectrum_byte  r, g, b;
   libspectrum_signed_dword y[10], u[10], v[10];
+  hq_rows rows;
 
   /*   +----+----+----+
        |    |    |    |
@@ -2193,75 +1915,49 @@ FUNCTION( scaler_HQ3x ) ( const libspectrum_byte *srcPtr,
        |    |    |    |
        | w7 | w8 | w9 |
        +----+----+----+ */
-  for( j = 0; j < height; j++ ) {
-    p = p0;
-    q = q0;
-    q1 = q + 1; q2 = q + 2;
-    qN = q + nextlineDst; qN1 = qN + 1; qN2 = qN + 2;
-    qNN = qN + nextlineDst;  qNN1 = qNN + 1; qNN2 = qNN + 2;
-
-    w[2] = *(p + prevline);
-    w[5] = *p;
-    w[8] = *(p + nextline);
-    w[1] = *(p + prevline - 1);
-    w[4] = *(p - 1);
-    w[7] = *(p + nextline - 1);
-    w[3] = *(p + prevline + 1);
-    w[6] = *(p + 1);
-    w[9] = *(p + nextline + 1);
-    for( k = 1; k <= 9; k++ ) {
-#if SCALER_DATA_SIZE == 2
-      r = R_TO_R( w[k] );
-      g = G_TO_G( w[k] );
-      b = B_TO_B( w[k] );
-#else
-      r =  w[k] & redMask;
-      g = (w[k] & greenMask) >> 8;
-      b = (w[k] & blueMask) >> 16;
-#endif
-      y[k] = RGB_TO_Y( r, g, b );
-      u[k] = RGB_TO_U( r, g, b );
-      v[k] = RGB_TO_V( r, g, b );
-    }
+  for( x = 0; x < width; x += SCALER_STRIP ) {
+    n = MIN( width - x, SCALER_STRIP );
+    p0 = (const scaler_data_type *)srcPtr + x;
+    q0 = (scaler_data_type *)dstPtr + 3 * x;
+    hq_rows_start( &rows, p0, nextlineSrc, n );
+
+    for( j = 0; j < height; j++ ) {
+      if( j ) hq_rows_next( &rows, p0, nextlineSrc, n );
+
+      p = p0;
+      q = q0;
+      q1 = q + 1; q2 = q + 2;
+      qN = q + nextlineDst; qN1 = qN + 1; qN2 = qN + 2;
+      qNN = qN + nextlineDst;  qNN1 = qNN + 1; qNN2 = qNN + 2;
+
+      w[2] = *(p + prevline);
+      w[5] = *p;
+      w[8] = *(p + nextline);
+      w[1] = *(p + prevline - 1);
+      w[4] = *(p - 1);
+      w[7] = *(p + nextline - 1);
+      w[3] = *(p + prevline + 1);
+      w[6] = *(p + 1);
+      w[9] = *(p + nextline + 1);
 
-    for( i = 0; i < width; i++ ) {
-      pattern = 0;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[1], u[1], v[1] ) ) pattern |= 0x01;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[2], u[2], v[2] ) ) pattern |= 0x02;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[3], u[3], v[3] ) ) pattern |= 0x04;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[4], u[4], v[4] ) ) pattern |= 0x08;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[6], u[6], v[6] ) ) pattern |= 0x10;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[7], u[7], v[7] ) ) pattern |= 0x20;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[8], u[8], v[8] ) ) pattern |= 0x40;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[9], u[9], v[9] ) ) pattern |= 0x80;
+      for( i = 0; i < n; i++ ) {
+        pattern = rows.pattern[i];
+        HQ_LOAD_CROSS
 
 #include "scaler_hq3x.c"
 
-      p++;
-      q   += 3; q1   += 3; q2   += 3;
-      qN  += 3; qN1  += 3; qN2  += 3;
-      qNN += 3; qNN1 += 3; qNN2 += 3;
-      MOVE_P_RIGHT
-      w[3] = *(p + prevline + 1);
-      w[6] = *(p + 1);
-      w[9] = *(p + nextline + 1);
-      for( k = 3; k <= 9; k += 3 ) {
-#if SCALER_DATA_SIZE == 2
-        r = R_TO_R( w[k] );
-        g = G_TO_G( w[k] );
-        b = B_TO_B( w[k] );
-#else
-        r =   w[k] & redMask;
-        g = ( w[k] & greenMask ) >> 8;
-        b = ( w[k] & blueMask  ) >> 16;
-#endif
-        y[k] = RGB_TO_Y( r, g, b );
-        u[k] = RGB_TO_U( r, g, b );
-        v[k] = RGB_TO_V( r, g, b );
+        p++;
+        q   += 3; q1   += 3; q2   += 3;
+        qN  += 3; qN1  += 3; qN2  += 3;
+        qNN += 3; qNN1 += 3; qNN2 += 3;
+        MOVE_P_RIGHT
+        w[3] = *(p + prevline + 1);
+        w[6] = *(p + 1);
+        w[9] = *(p + nextline + 1);
       }
+      p0 += nextlineSrc;
+      q0 += ( nextlineDst << 1 ) + nextlineDst;
     }
-    p0 += nextlineSrc;
-    q0 += ( nextlineDst << 1 ) + nextlineDst;
   }
 }
 
@@ -2272,19 +1968,18 @@ FUNCTION( scaler_HQ4x ) ( const libspectrum_byte *srcPtr,
                           libspectrum_dword dstPitch,
                           int width, int height )
 {
-  int i, j, k, pattern;
+  int i, j, x, n, pattern;
   int nextlineSrc = srcPitch / sizeof( scaler_data_type );
-  const scaler_data_type *p, *p0 = (const scaler_data_type *)srcPtr;
+  const scaler_data_type *p, *p0;
   int nextlineDst = dstPitch / sizeof( scaler_data_type );
   scaler_data_type *q,  *qN,  *qNN,  *qNNN,
                    *q1, *qN1, *qNN1, *qNNN1,
                    *q2, *qN2, *qNN2, *qNNN2,
                    *q3, *qN3, *qNN3, *qNNN3,
-                   *q0 = (scaler_data_type *)dstPtr;
+                   *q0;
   libspectrum_qword w[10];
-
-  libspectrum_byte  r, g, b;
   libspectrum_signed_dword y[10], u[10], v[10];
+  hq_rows rows;
 
   /*   +----+----+----+
        |    |    |    |
@@ -2296,76 +1991,51 @@ FUNCTION( scaler_HQ4x ) ( const libspectrum_byte *srcPtr,
        |    |    |    |
        | w7 | w8 | w9 |
        +----+----+----+ */
-  for( j = 0; j < height; j++ ) {
-    p = p0;
-    q = q0;
-    q1 = q + 1; q2 = q + 2; q3 = q + 3;
-    qN = q + nextlineDst; qN1 = qN + 1; qN2 = qN + 2; qN3 = qN + 3;
-    qNN = qN + nextlineDst; qNN1 = qNN + 1; qNN2 = qNN + 2; qNN3 = qNN + 3;
-    qNNN = qNN + nextlineDst; qNNN1 = qNNN + 1; qNNN2 = qNNN + 2; qNNN3 = qNNN + 3;
-
-    w[2] = *(p + prevline);
-    w[5] = *p;
-    w[8] = *(p + nextline);
-    w[1] = *(p + prevline - 1);
-    w[4] = *(p - 1);
-    w[7] = *(p + nextline - 1);
-    w[3] = *(p + prevline + 1);
-    w[6] = *(p + 1);
-    w[9] = *(p + nextline + 1);
-    for( k = 1; k <= 9; k++ ) {
-#if SCALER_DATA_SIZE == 2
-      r = R_TO_R( w[k] );
-      g = G_TO_G( w[k] );
-      b = B_TO_B( w[k] );
-#else
-      r =  w[k] & redMask;
-      g = (w[k] & greenMask) >> 8;
-      b = (w[k] & blueMask) >> 16;
-#endif
-      y[k] = RGB_TO_Y( r, g, b );
-      u[k] = RGB_TO_U( r, g, b );
-      v[k] = RGB_TO_V( r, g, b );
-    }
+  for( x = 0; x < width; x += SCALER_STRIP ) {
+    n = MIN( width - x, SCALER_STRIP );
+    p0 = (const scaler_data_type *)srcPtr + x;
+    q0 = (scaler_data_type *)dstPtr + 4 * x;
+    hq_rows_start( &rows, p0, nextlineSrc, n );
+
+    for( j = 0; j < height; j++ ) {
+      if( j ) hq_rows_next( &rows, p0, nextlineSrc, n );
+
+      p = p0;
+      q = q0;
+      q1 = q + 1; q2 = q + 2; q3 = q + 3;
+      qN = q + nextlineDst; qN1 = qN + 1; qN2 = qN + 2; qN3 = qN + 3;
+      qNN = qN + nextlineDst; qNN1 = qNN + 1; qNN2 = qNN + 2; qNN3 = qNN + 3;
+      qNNN = qNN + nextlineDst; qNNN1 = qNNN + 1; qNNN2 = qNNN + 2;
+      qNNN3 = qNNN + 3;
+
+      w[2] = *(p + prevline);
+      w[5] = *p;
+      w[8] = *(p + nextline);
+      w[1] = *(p + prevline - 1);
+      w[4] = *(p - 1);
+      w[7] = *(p + nextline - 1);
+      w[3] = *(p + prevline + 1);
+      w[6] = *(p + 1);
+      w[9] = *(p + nextline + 1);
 
-    for( i = 0; i < width; i++ ) {
-      pattern = 0;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[1], u[1], v[1] ) ) pattern |= 0x01;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[2], u[2], v[2] ) ) pattern |= 0x02;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[3], u[3], v[3] ) ) pattern |= 0x04;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[4], u[4], v[4] ) ) pattern |= 0x08;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[6], u[6], v[6] ) ) pattern |= 0x10;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[7], u[7], v[7] ) ) pattern |= 0x20;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[8], u[8], v[8] ) ) pattern |= 0x40;
-      if( HQ_YUVDIFF( y[5], u[5], v[5], y[9], u[9], v[9] ) ) pattern |= 0x80;
+      for( i = 0; i < n; i++ ) {
+        pattern = rows.pattern[i];
+        HQ_LOAD_CROSS
 
 #include "scaler_hq4x.c"
 
-      p++;
-      q    += 4; q1    += 4; q2    += 4; q3    += 4;
-      qN   += 4; qN1   += 4; qN2   += 4; qN3   += 4;
-      qNN  += 4; qNN1  += 4; qNN2  += 4; qNN3  += 4;
-      qNNN += 4; qNNN1 += 4; qNNN2 += 4; qNNN3 += 4;
-      MOVE_P_RIGHT
-      w[3] = *(p + prevline + 1);
-      w[6] = *(p + 1);
-      w[9] = *(p + nextline + 1);
-      for( k = 3; k <= 9; k += 3 ) {
-#if SCALER_DATA_SIZE == 2
-        r = R_TO_R( w[k] );
-        g = G_TO_G( w[k] );
-        b = B_TO_B( w[k] );
-#else
-        r =   w[k] & redMask;
-        g = ( w[k] & greenMask ) >> 8;
-        b = ( w[k] & blueMask  ) >> 16;
-#endif
-        y[k] = RGB_TO_Y( r, g, b );
-        u[k] = RGB_TO_U( r, g, b );
-        v[k] = RGB_TO_V( r, g, b );
+        p++;
+        q    += 4; q1    += 4; q2    += 4; q3    += 4;
+        qN   += 4; qN1   += 4; qN2   += 4; qN3   += 4;
+        qNN  += 4; qNN1  += 4; qNN2  += 4; qNN3  += 4;
+        qNNN += 4; qNNN1 += 4; qNNN2 += 4; qNNN3 += 4;
+        MOVE_P_RIGHT
+        w[3] = *(p + prevline + 1);
+        w[6] = *(p + 1);
+        w[9] = *(p + nextline + 1);
       }
+      p0 += nextlineSrc;
+      q0 += ( nextlineDst << 2 );
     }
-    p0 += nextlineSrc;
-    q0 += ( nextlineDst << 2 );
   }
 }
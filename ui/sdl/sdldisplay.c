@@ -40,6 +40,7 @@
 #include "ui/ui.h"
 #include "ui/scaler/scaler.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
 #include "utils.h"
 
 SDL_Surface *sdldisplay_gc = NULL;   /* Hardware screen */
@@ -536,7 +537,7 @@ sdl_blit_icon( SDL_Surface **icon,
   dst_h = h;
   dst_x = x * sdldisplay_current_size + fullscreen_x_off;
 
-  scaler_proc16(
+  scaler_run( current_scaler, scaler_proc16,
 	(libspectrum_byte*)tmp_screen->pixels +
 			(x+1) * tmp_screen->format->BytesPerPixel +
 	                (y+1) * tmp_screen_pitch,
@@ -658,39 +659,19 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   Uint32 palette_paper = palette_values[ paper ];
 
   if( machine_current->timex ) {
-    int i;
-    libspectrum_word *dest_base;
-
     x <<= 4; y <<= 1;
 
-    dest_base =
+    dest =
       (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
                            (x+1) * tmp_screen->format->BytesPerPixel +
                            (y+1) * tmp_screen->pitch);
 
-    for( i=0; i<2; i++ ) {
-      dest = dest_base;
-
-      *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
-      *(dest++) = ( data & 0x01 ) ? palette_ink : palette_paper;
-      *dest     = ( data & 0x01 ) ? palette_ink : palette_paper;
-
-      dest_base = (libspectrum_word*)
-        ( (libspectrum_byte*)dest_base + tmp_screen->pitch);
-    }
+    uiplot_bits_word_wide( dest, data, palette_ink, palette_paper );
+
+    dest = (libspectrum_word*)
+      ( (libspectrum_byte*)dest + tmp_screen->pitch);
+
+    uiplot_bits_word_wide( dest, data, palette_ink, palette_paper );
   } else {
     x <<= 3;
 
@@ -699,14 +680,7 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
                            (x+1) * tmp_screen->format->BytesPerPixel +
                            (y+1) * tmp_screen->pitch);
 
-    *(dest++) = ( data & 0x80 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x40 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x20 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x10 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x08 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x04 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x02 ) ? palette_ink : palette_paper;
-    *dest     = ( data & 0x01 ) ? palette_ink : palette_paper;
+    uiplot_bits_word( dest, data, palette_ink, palette_paper );
   }
 }
 
@@ -716,7 +690,7 @@ void
 uidisplay_plot16( int x, int y, libspectrum_word data,
 		  libspectrum_byte ink, libspectrum_byte paper )
 {
-  libspectrum_word *dest_base, *dest;
+  libspectrum_word *dest;
   int i;
   Uint32 *palette_values = settings_current.bw_tv ? bw_values :
                            colour_values;
@@ -724,33 +698,17 @@ uidisplay_plot16( int x, int y, libspectrum_word data,
   Uint32 palette_paper = palette_values[ paper ];
   x <<= 4; y <<= 1;
 
-  dest_base =
+  dest =
     (libspectrum_word*)( (libspectrum_byte*)tmp_screen->pixels +
                          (x+1) * tmp_screen->format->BytesPerPixel +
                          (y+1) * tmp_screen->pitch);
 
   for( i=0; i<2; i++ ) {
-    dest = dest_base;
-
-    *(dest++) = ( data & 0x8000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x4000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x2000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x1000 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0800 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0400 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0200 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0100 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0080 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0040 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0020 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0010 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0008 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0004 ) ? palette_ink : palette_paper;
-    *(dest++) = ( data & 0x0002 ) ? palette_ink : palette_paper;
-    *dest     = ( data & 0x0001 ) ? palette_ink : palette_paper;
-
-    dest_base = (libspectrum_word*)
-      ( (libspectrum_byte*)dest_base + tmp_screen->pitch);
+    uiplot_bits_word( dest,     data >> 8,   palette_ink, palette_paper );
+    uiplot_bits_word( dest + 8, data & 0xff, palette_ink, palette_paper );
+
+    dest = (libspectrum_word*)
+      ( (libspectrum_byte*)dest + tmp_screen->pitch);
   }
 }
 
@@ -797,7 +755,7 @@ uidisplay_frame_end( void )
     int dst_h = r->h;
     int dst_x = r->x * sdldisplay_current_size + fullscreen_x_off;
 
-    scaler_proc16(
+    scaler_run( current_scaler, scaler_proc16,
       (libspectrum_byte*)tmp_screen->pixels +
                         (r->x+1) * tmp_screen->format->BytesPerPixel +
 	                (r->y+1)*tmp_screen_pitch,
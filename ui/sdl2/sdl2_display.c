@@ -21,6 +21,8 @@
 #include "ui/ui.h"
 #include "ui/scaler/scaler.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
+#include "ui/uirender.h"
 #include "utils.h"
 #include "sdl2_display_internal.h"
 #include "sdl2_display.h"
@@ -29,7 +31,8 @@ static SDL_Window *sdl2_window;
 static SDL_Surface *sdl2_window_surface;
 static SDL_Surface *tmp_screen;
 static SDL_Surface *scaled_screen;
-static SDL_Surface *saved;
+static libspectrum_byte *saved;
+static size_t saved_size;
 static libspectrum_byte sdl2display_is_full_screen;
 static int fullscreen_x_off;
 static int fullscreen_y_off;
@@ -43,12 +46,15 @@ static SDL_Surface *red_disk[ 2 ], *green_disk[ 2 ];
 static ui_statusbar_state sdl2_disk_state, sdl2_mdr_state, sdl2_tape_state;
 static int sdl2_status_updated;
 
-static Uint32 colour_values[ 16 ];
-static Uint32 bw_values[ 16 ];
+/* tmp_screen is always 16 bits deep */
+static libspectrum_word colour_values[ 16 ];
+static libspectrum_word bw_values[ 16 ];
 
-static SDL_Rect updated_rects[ 300 ];
+/* Parts of the window the render thread has redrawn in scaled_screen but
+   which have not been presented yet; protected by the render lock */
+static SDL_Rect updated_rects[ UIRENDER_MAX_RECTS ];
 static int num_rects;
-static libspectrum_byte sdl2display_force_full_refresh = 1;
+static int sdl2display_present_full;
 
 static int image_width;
 static int image_height;
@@ -56,6 +62,7 @@ static int tmp_screen_width;
 static float sdl2display_current_size = 1.0f;
 
 static void sdl2display_init_fullscreen_mode( void );
+static void sdl2display_render( const uirender_frame *frame );
 static int sdl2display_get_fullscreen_modes(
   sdl2_fullscreen_mode_info **modes_out,
   int *count_out );
@@ -401,20 +408,20 @@ sdl2display_free_status_icons( void )
 }
 
 static void
-sdl2display_add_scaled_rect( int x, int y, int w, int h )
+sdl2display_add_presented_rect( const sdl2_display_rect *rect )
 {
-  if( sdl2display_force_full_refresh ) return;
+  if( sdl2display_present_full ) return;
 
   if( num_rects ==
       (int)( sizeof( updated_rects ) / sizeof( updated_rects[0] ) ) ){
-    sdl2display_force_full_refresh = 1;
+    sdl2display_present_full = 1;
     return;
   }
 
-  updated_rects[num_rects].x = x;
-  updated_rects[num_rects].y = y;
-  updated_rects[num_rects].w = w;
-  updated_rects[num_rects].h = h;
+  updated_rects[num_rects].x = rect->x;
+  updated_rects[num_rects].y = rect->y;
+  updated_rects[num_rects].w = rect->w;
+  updated_rects[num_rects].h = rect->h;
   num_rects++;
 }
 
@@ -424,19 +431,19 @@ sdl2display_queue_status_rects( void )
   int scale = machine_current->timex ? 2 : 1;
 
   if( red_disk[ machine_current->timex ] ) {
-    sdl2display_add_scaled_rect( 243 * scale, 218 * scale,
-                                 red_disk[ machine_current->timex ]->w,
-                                 red_disk[ machine_current->timex ]->h );
+    uirender_area( 243 * scale, 218 * scale,
+                   red_disk[ machine_current->timex ]->w,
+                   red_disk[ machine_current->timex ]->h );
   }
   if( red_mdr[ machine_current->timex ] ) {
-    sdl2display_add_scaled_rect( 264 * scale, 218 * scale,
-                                 red_mdr[ machine_current->timex ]->w,
-                                 red_mdr[ machine_current->timex ]->h );
+    uirender_area( 264 * scale, 218 * scale,
+                   red_mdr[ machine_current->timex ]->w,
+                   red_mdr[ machine_current->timex ]->h );
   }
   if( red_cassette[ machine_current->timex ] ) {
-    sdl2display_add_scaled_rect( 285 * scale, 220 * scale,
-                                 red_cassette[ machine_current->timex ]->w,
-                                 red_cassette[ machine_current->timex ]->h );
+    uirender_area( 285 * scale, 220 * scale,
+                   red_cassette[ machine_current->timex ]->w,
+                   red_cassette[ machine_current->timex ]->h );
   }
 }
 
@@ -463,10 +470,7 @@ sdl2display_status_icon( SDL_Surface **icon, int x, int y )
 static void
 sdl2display_icon_overlay( void )
 {
-  if( !settings_current.statusbar ) {
-    sdl2_status_updated = 0;
-    return;
-  }
+  if( !settings_current.statusbar ) return;
 
   switch( sdl2_disk_state ) {
   case UI_STATUSBAR_STATE_ACTIVE:
@@ -499,8 +503,6 @@ sdl2display_icon_overlay( void )
     sdl2display_status_icon( red_cassette, 285, 220 );
     break;
   }
-
-  sdl2_status_updated = 0;
 }
 
 static void
@@ -568,7 +570,7 @@ sdl2display_sync_presentation_surfaces( void )
       scaled_screen->h != sdl2_window_surface->h ) {
     sdl2display_create_scaled_screen( sdl2_window_surface->w,
                                       sdl2_window_surface->h );
-    sdl2display_force_full_refresh = 1;
+    uirender_refresh_all();
   }
 
   sdl2display_compute_offsets( sdl2_window_surface->w, sdl2_window_surface->h,
@@ -684,7 +686,12 @@ sdl2display_create_window( void )
 static void
 sdl2display_recreate( void )
 {
-  sdl2display_force_full_refresh = 1;
+  /* Everything the render thread draws with is about to be replaced */
+  uirender_lock();
+
+  uirender_refresh_all();
+  num_rects = 0;
+  sdl2display_present_full = 0;
   sdl2display_create_window();
   sdl2display_create_tmp_screen();
   sdl2display_free_status_icons();
@@ -692,6 +699,8 @@ sdl2display_recreate( void )
   sdl2display_load_status_icon( "microdrive.bmp", red_mdr, green_mdr );
   sdl2display_load_status_icon( "plus3disk.bmp", red_disk, green_disk );
 
+  uirender_unlock();
+
   /* Reapply mouse grab state after recreating the SDL window. */
   if( ui_mouse_grabbed ) ui_mouse_grabbed = ui_mouse_grab( 0 );
 
@@ -723,6 +732,11 @@ uidisplay_init( int width, int height )
   if( scaler_activate_scaler( current_scaler ) )
     scaler_activate_scaler( SCALER_NORMAL );
 
+  if( uirender_init( width, height, sdl2display_render ) ) return 1;
+
+  /* The render thread scales with whatever scaler is current */
+  scaler_set_lock( uirender_lock, uirender_unlock );
+
   sdl2display_recreate();
   display_ui_initialised = 1;
 
@@ -740,50 +754,41 @@ uidisplay_hotswap_gfx_mode( void )
 void
 uidisplay_frame_save( void )
 {
-  if( saved ) {
-    SDL_FreeSurface( saved );
-    saved = NULL;
-  }
+  if( !uirender_image ) return;
 
-  saved = SDL_ConvertSurface( tmp_screen, tmp_screen->format, 0 );
+  saved_size = uirender_pitch * image_height;
+  saved = libspectrum_renew( libspectrum_byte, saved, saved_size );
+  memcpy( saved, uirender_image, saved_size );
 }
 
 void
 uidisplay_frame_restore( void )
 {
-  if( saved ) {
-    SDL_BlitSurface( saved, NULL, tmp_screen, NULL );
-    sdl2display_force_full_refresh = 1;
+  if( saved && uirender_image &&
+      saved_size == (size_t)uirender_pitch * image_height ) {
+    memcpy( uirender_image, saved, saved_size );
+    uirender_refresh_all();
   }
 }
 
 void
 uidisplay_putpixel( int x, int y, int colour )
 {
-  libspectrum_word *dest_base, *dest;
-  Uint32 *palette_values = settings_current.bw_tv ? bw_values : colour_values;
-  Uint32 palette_colour = palette_values[ colour ];
+  libspectrum_byte *dest_base, *dest;
 
   if( machine_current->timex ) {
     x <<= 1;
     y <<= 1;
-    dest_base = dest =
-      (libspectrum_word *)( (libspectrum_byte *)tmp_screen->pixels +
-                            ( x + 1 ) * tmp_screen->format->BytesPerPixel +
-                            ( y + 1 ) * tmp_screen->pitch );
-
-    *( dest++ ) = palette_colour;
-    *( dest++ ) = palette_colour;
-    dest = (libspectrum_word *)( (libspectrum_byte *)dest_base +
-                                 tmp_screen->pitch );
-    *( dest++ ) = palette_colour;
-    *( dest++ ) = palette_colour;
+    dest_base = dest = uirender_image + x + y * uirender_pitch;
+
+    *( dest++ ) = colour;
+    *( dest++ ) = colour;
+    dest = dest_base + uirender_pitch;
+    *( dest++ ) = colour;
+    *( dest++ ) = colour;
   } else {
-    dest =
-      (libspectrum_word *)( (libspectrum_byte *)tmp_screen->pixels +
-                            ( x + 1 ) * tmp_screen->format->BytesPerPixel +
-                            ( y + 1 ) * tmp_screen->pitch );
-    *dest = palette_colour;
+    dest = uirender_image + x + y * uirender_pitch;
+    *dest = colour;
   }
 }
 
@@ -791,62 +796,22 @@ void
 uidisplay_plot8( int x, int y, libspectrum_byte data,
                  libspectrum_byte ink, libspectrum_byte paper )
 {
-  libspectrum_word *dest;
-  Uint32 *palette_values = settings_current.bw_tv ? bw_values : colour_values;
-  Uint32 palette_ink = palette_values[ ink ];
-  Uint32 palette_paper = palette_values[ paper ];
+  libspectrum_byte *dest;
 
   if( machine_current->timex ) {
-    int i;
-    libspectrum_word *dest_base;
-
     x <<= 4;
     y <<= 1;
 
-    dest_base =
-      (libspectrum_word *)( (libspectrum_byte *)tmp_screen->pixels +
-                            ( x + 1 ) * tmp_screen->format->BytesPerPixel +
-                            ( y + 1 ) * tmp_screen->pitch );
-
-    for( i = 0; i < 2; i++ ) {
-      dest = dest_base;
-
-      *( dest++ ) = ( data & 0x80 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x80 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x40 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x40 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x20 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x20 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x10 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x10 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x08 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x08 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x04 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x04 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x02 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x02 ) ? palette_ink : palette_paper;
-      *( dest++ ) = ( data & 0x01 ) ? palette_ink : palette_paper;
-      *dest = ( data & 0x01 ) ? palette_ink : palette_paper;
-
-      dest_base = (libspectrum_word *)( (libspectrum_byte *)dest_base +
-                                        tmp_screen->pitch );
-    }
+    dest = uirender_image + x + y * uirender_pitch;
+
+    uiplot_bits_byte_wide( dest, data, ink, paper );
+    uiplot_bits_byte_wide( dest + uirender_pitch, data, ink, paper );
   } else {
     x <<= 3;
 
-    dest =
-      (libspectrum_word *)( (libspectrum_byte *)tmp_screen->pixels +
-                            ( x + 1 ) * tmp_screen->format->BytesPerPixel +
-                            ( y + 1 ) * tmp_screen->pitch );
-
-    *( dest++ ) = ( data & 0x80 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x40 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x20 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x10 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x08 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x04 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x02 ) ? palette_ink : palette_paper;
-    *dest = ( data & 0x01 ) ? palette_ink : palette_paper;
+    dest = uirender_image + x + y * uirender_pitch;
+
+    uiplot_bits_byte( dest, data, ink, paper );
   }
 }
 
@@ -854,107 +819,63 @@ void
 uidisplay_plot16( int x, int y, libspectrum_word data,
                   libspectrum_byte ink, libspectrum_byte paper )
 {
-  libspectrum_word *dest_base, *dest;
+  libspectrum_byte *dest_base;
   int i;
-  Uint32 *palette_values = settings_current.bw_tv ? bw_values : colour_values;
-  Uint32 palette_ink = palette_values[ ink ];
-  Uint32 palette_paper = palette_values[ paper ];
 
   x <<= 4;
   y <<= 1;
-  dest_base =
-    (libspectrum_word *)( (libspectrum_byte *)tmp_screen->pixels +
-                          ( x + 1 ) * tmp_screen->format->BytesPerPixel +
-                          ( y + 1 ) * tmp_screen->pitch );
+  dest_base = uirender_image + x + y * uirender_pitch;
 
   for( i = 0; i < 2; i++ ) {
-    dest = dest_base;
-
-    *( dest++ ) = ( data & 0x8000 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x4000 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x2000 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x1000 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0800 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0400 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0200 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0100 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0080 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0040 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0020 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0010 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0008 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0004 ) ? palette_ink : palette_paper;
-    *( dest++ ) = ( data & 0x0002 ) ? palette_ink : palette_paper;
-    *dest = ( data & 0x0001 ) ? palette_ink : palette_paper;
-
-    dest_base = (libspectrum_word *)( (libspectrum_byte *)dest_base +
-                                      tmp_screen->pitch );
+    uiplot_bits_byte( dest_base,     data >> 8,   ink, paper );
+    uiplot_bits_byte( dest_base + 8, data & 0xff, ink, paper );
+
+    dest_base += uirender_pitch;
   }
 }
 
 void
 uidisplay_area( int x, int y, int width, int height )
 {
-  if( sdl2display_force_full_refresh ) return;
-
-  if( num_rects ==
-      (int)( sizeof( updated_rects ) / sizeof( updated_rects[0] ) ) ){
-    sdl2display_force_full_refresh = 1;
-    return;
-  }
-
   if( scaler_flags & SCALER_FLAGS_EXPAND )
     scaler_expander( &x, &y, &width, &height, image_width, image_height );
 
-  updated_rects[num_rects].x = x;
-  updated_rects[num_rects].y = y;
-  updated_rects[num_rects].w = width;
-  updated_rects[num_rects].h = height;
-  num_rects++;
+  uirender_area( x, y, width, height );
 }
 
-void
-uidisplay_frame_end( void )
+/* Convert, scale and overlay the changed parts of a frame into
+   scaled_screen. Called on the render thread with the render lock held */
+static void
+sdl2display_render( const uirender_frame *frame )
 {
-  SDL_Rect *rects;
-  int i;
-  int full_refresh;
-
-  if( !sdl2_window || !scaled_screen ) return;
+  libspectrum_word *palette_values = frame->bw_tv ? bw_values : colour_values;
+  uirender_rect whole = { 0, 0, image_width, image_height };
+  const uirender_rect *rects = frame->full_refresh ? &whole : frame->rects;
+  size_t count = frame->full_refresh ? 1 : frame->rect_count;
+  size_t i;
+  int y;
 
-  if( sdl2display_is_full_screen != settings_current.full_screen ) {
-    if( uidisplay_hotswap_gfx_mode() ) {
-      fprintf( stderr, "%s: Error switching to fullscreen\n", fuse_progname );
-      fuse_abort();
-    }
-  }
-
-  full_refresh = sdl2display_force_full_refresh;
-
-  if( sdl2_status_updated ) sdl2display_queue_status_rects();
-
-  if( sdl2display_force_full_refresh ) {
-    num_rects = 1;
-    updated_rects[0].x = 0;
-    updated_rects[0].y = 0;
-    updated_rects[0].w = image_width;
-    updated_rects[0].h = image_height;
-  }
-
-  if( !( ui_widget_level >= 0 ) && num_rects == 0 &&
-      !sdl2_status_updated ) return;
-
-  sdl2display_sync_presentation_surfaces();
+  if( !tmp_screen || !scaled_screen ) return;
 
   if( SDL_MUSTLOCK( scaled_screen ) ) SDL_LockSurface( scaled_screen );
 
-  if( full_refresh ) SDL_FillRect( scaled_screen, NULL, 0 );
+  if( frame->full_refresh ) SDL_FillRect( scaled_screen, NULL, 0 );
 
-  for( i = 0; i < num_rects; i++ ) {
-    SDL_Rect *r = &updated_rects[i];
+  for( i = 0; i < count; i++ ) {
+    const uirender_rect *r = &rects[i];
     sdl2_display_rect dst;
 
-    scaler_proc16(
+    for( y = r->y; y < r->y + r->h; y++ ) {
+      const libspectrum_byte *src = frame->pixels + y * frame->pitch + r->x;
+      libspectrum_word *dest =
+        (libspectrum_word *)( (libspectrum_byte *)tmp_screen->pixels +
+                              ( r->x + 1 ) * tmp_screen->format->BytesPerPixel +
+                              ( y + 1 ) * tmp_screen->pitch );
+
+      uiplot_convert_word( dest, src, palette_values, r->w );
+    }
+
+    scaler_run( current_scaler, scaler_proc16,
       (libspectrum_byte *)tmp_screen->pixels +
       ( r->x + 1 ) * tmp_screen->format->BytesPerPixel +
       ( r->y + 1 ) * tmp_screen->pitch,
@@ -971,39 +892,76 @@ uidisplay_frame_end( void )
     sdl2display_update_rect( r->x, r->y, r->w, r->h,
                              sdl2display_current_size,
                              fullscreen_x_off, fullscreen_y_off, &dst );
-    r->x = dst.x;
-    r->y = dst.y;
-    r->w = dst.w;
-    r->h = dst.h;
+    sdl2display_add_presented_rect( &dst );
   }
 
   if( SDL_MUSTLOCK( scaled_screen ) ) SDL_UnlockSurface( scaled_screen );
 
   sdl2display_icon_overlay();
 
-  if( !full_refresh ) {
-    for( i = 0; i < num_rects; i++ ) {
-      SDL_Rect *r = &updated_rects[i];
-      SDL_Rect dst_rect = *r;
+  if( frame->full_refresh ) sdl2display_present_full = 1;
+}
 
-      SDL_BlitSurface( scaled_screen, r, sdl2_window_surface, &dst_rect );
-    }
-  }
+/* Put whatever the render thread has finished on the screen. The window
+   surface is only ever updated from the main thread */
+void
+sdl2display_present( void )
+{
+  int i;
 
-  if( full_refresh ) {
+  if( !sdl2_window || !scaled_screen ) return;
+
+  uirender_lock();
+
+  if( sdl2display_present_full ) {
     SDL_BlitSurface( scaled_screen, NULL, sdl2_window_surface, NULL );
     updated_rects[0].x = 0;
     updated_rects[0].y = 0;
     updated_rects[0].w = sdl2_window_surface->w;
     updated_rects[0].h = sdl2_window_surface->h;
     num_rects = 1;
+  } else {
+    for( i = 0; i < num_rects; i++ ) {
+      SDL_Rect *r = &updated_rects[i];
+      SDL_Rect dst_rect = *r;
+
+      SDL_BlitSurface( scaled_screen, r, sdl2_window_surface, &dst_rect );
+    }
   }
 
-  rects = num_rects ? updated_rects : NULL;
-  SDL_UpdateWindowSurfaceRects( sdl2_window, rects, num_rects );
+  if( num_rects )
+    SDL_UpdateWindowSurfaceRects( sdl2_window, updated_rects, num_rects );
 
   num_rects = 0;
-  sdl2display_force_full_refresh = 0;
+  sdl2display_present_full = 0;
+
+  uirender_unlock();
+}
+
+void
+uidisplay_frame_end( void )
+{
+  if( !sdl2_window || !scaled_screen ) return;
+
+  if( sdl2display_is_full_screen != settings_current.full_screen ) {
+    if( uidisplay_hotswap_gfx_mode() ) {
+      fprintf( stderr, "%s: Error switching to fullscreen\n", fuse_progname );
+      fuse_abort();
+    }
+  }
+
+  if( sdl2_status_updated ) {
+    sdl2display_queue_status_rects();
+    sdl2_status_updated = 0;
+  }
+
+  uirender_lock();
+  sdl2display_sync_presentation_surfaces();
+  uirender_unlock();
+
+  uirender_frame_end();
+
+  sdl2display_present();
 }
 
 int
@@ -1011,6 +969,11 @@ uidisplay_end( void )
 {
   display_ui_initialised = 0;
 
+  scaler_set_lock( NULL, NULL );
+  uirender_end();
+  num_rects = 0;
+  sdl2display_present_full = 0;
+
   if( tmp_screen ) {
     free( tmp_screen->pixels );
     SDL_FreeSurface( tmp_screen );
@@ -1024,10 +987,9 @@ uidisplay_end( void )
 
   sdl2display_free_status_icons();
 
-  if( saved ) {
-    SDL_FreeSurface( saved );
-    saved = NULL;
-  }
+  libspectrum_free( saved );
+  saved = NULL;
+  saved_size = 0;
 
   if( sdl2_window ) {
     SDL_DestroyWindow( sdl2_window );
@@ -9,5 +9,6 @@
 
 SDL_Window *sdl2display_get_window( void );
 void sdl2display_set_title( const char *title );
+void sdl2display_present( void );
 
 #endif
@@ -157,6 +157,10 @@ ui_event( void )
     }
   }
 
+  /* Frames finished by the render thread while a widget is waiting for
+     input have no later frame end to show them */
+  sdl2display_present();
+
   return 0;
 }
 
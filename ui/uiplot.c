@@ -0,0 +1,182 @@
+/* uiplot.c: Pixel expansion and palette conversion shared by the UIs
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#include "config.h"
+
+#include "libspectrum.h"
+
+#include "uiplot.h"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define UIPLOT_SSSE3
+#include <tmmintrin.h>
+#endif
+
+/* The mask tables */
+
+#define BIT( n, b ) ( (n) & (b) ? 0xff : 0x00 )
+
+#define MASK8( n ) { \
+  BIT( n, 0x80 ), BIT( n, 0x40 ), BIT( n, 0x20 ), BIT( n, 0x10 ), \
+  BIT( n, 0x08 ), BIT( n, 0x04 ), BIT( n, 0x02 ), BIT( n, 0x01 ) }
+
+#define BIT2( n, b ) BIT( n, b ), BIT( n, b )
+
+#define MASK16( n ) { \
+  BIT2( n, 0x80 ), BIT2( n, 0x40 ), BIT2( n, 0x20 ), BIT2( n, 0x10 ), \
+  BIT2( n, 0x08 ), BIT2( n, 0x04 ), BIT2( n, 0x02 ), BIT2( n, 0x01 ) }
+
+#define BIT4( n, b ) BIT2( n, b ), BIT2( n, b )
+
+#define MASK32( n ) { \
+  BIT4( n, 0x80 ), BIT4( n, 0x40 ), BIT4( n, 0x20 ), BIT4( n, 0x10 ), \
+  BIT4( n, 0x08 ), BIT4( n, 0x04 ), BIT4( n, 0x02 ), BIT4( n, 0x01 ) }
+
+#define ROWS4( mask, n ) \
+  mask( (n) ), mask( (n) + 1 ), mask( (n) + 2 ), mask( (n) + 3 )
+#define ROWS16( mask, n ) \
+  ROWS4( mask, (n) ), ROWS4( mask, (n) + 4 ), \
+  ROWS4( mask, (n) + 8 ), ROWS4( mask, (n) + 12 )
+#define ROWS64( mask, n ) \
+  ROWS16( mask, (n) ), ROWS16( mask, (n) + 16 ), \
+  ROWS16( mask, (n) + 32 ), ROWS16( mask, (n) + 48 )
+#define ROWS256( mask ) \
+  ROWS64( mask, 0 ), ROWS64( mask, 64 ), \
+  ROWS64( mask, 128 ), ROWS64( mask, 192 )
+
+const libspectrum_byte uiplot_mask8[ 256 ][ 8 ] = { ROWS256( MASK8 ) };
+const libspectrum_byte uiplot_mask16[ 256 ][ 16 ] = { ROWS256( MASK16 ) };
+const libspectrum_byte uiplot_mask32[ 256 ][ 32 ] = { ROWS256( MASK32 ) };
+
+/* Palette conversion. The palettes only have 16 entries, so with SSSE3 each
+   byte of the colours can be looked up for 16 pixels at once by a single
+   shuffle */
+
+#ifdef UIPLOT_SSSE3
+
+#define SSSE3_TARGET __attribute__(( target( "ssse3" ) ))
+
+/* Split the colours into planes holding each of their bytes */
+SSSE3_TARGET static void
+planes_ssse3( __m128i *planes, const void *palette, size_t size )
+{
+  libspectrum_byte bytes[ 4 ][ 16 ];
+  const libspectrum_byte *colour = palette;
+  size_t i, j;
+
+  for( i = 0; i < 16; i++, colour += size )
+    for( j = 0; j < size; j++ ) bytes[j][i] = colour[j];
+
+  for( j = 0; j < size; j++ )
+    planes[j] = _mm_loadu_si128( (const __m128i*)bytes[j] );
+}
+
+SSSE3_TARGET static void
+convert_word_ssse3( libspectrum_word *dest, const libspectrum_byte *src,
+                    const libspectrum_word *palette, size_t n )
+{
+  __m128i planes[2], index, lo, hi;
+  size_t i;
+
+  planes_ssse3( planes, palette, sizeof( *palette ) );
+
+  for( i = 0; i + 16 <= n; i += 16 ) {
+    index = _mm_loadu_si128( (const __m128i*)( src + i ) );
+    lo = _mm_shuffle_epi8( planes[0], index );
+    hi = _mm_shuffle_epi8( planes[1], index );
+
+    _mm_storeu_si128( (__m128i*)( dest + i ), _mm_unpacklo_epi8( lo, hi ) );
+    _mm_storeu_si128( (__m128i*)( dest + i + 8 ),
+                      _mm_unpackhi_epi8( lo, hi ) );
+  }
+
+  for( ; i < n; i++ ) dest[i] = palette[ src[i] ];
+}
+
+SSSE3_TARGET static void
+convert_dword_ssse3( libspectrum_dword *dest, const libspectrum_byte *src,
+                     const libspectrum_dword *palette, size_t n )
+{
+  __m128i planes[4], index, b0, b1, b2, b3, lo01, hi01, lo23, hi23;
+  size_t i;
+
+  planes_ssse3( planes, palette, sizeof( *palette ) );
+
+  for( i = 0; i + 16 <= n; i += 16 ) {
+    index = _mm_loadu_si128( (const __m128i*)( src + i ) );
+    b0 = _mm_shuffle_epi8( planes[0], index );
+    b1 = _mm_shuffle_epi8( planes[1], index );
+    b2 = _mm_shuffle_epi8( planes[2], index );
+    b3 = _mm_shuffle_epi8( planes[3], index );
+
+    lo01 = _mm_unpacklo_epi8( b0, b1 ); hi01 = _mm_unpackhi_epi8( b0, b1 );
+    lo23 = _mm_unpacklo_epi8( b2, b3 ); hi23 = _mm_unpackhi_epi8( b2, b3 );
+
+    _mm_storeu_si128( (__m128i*)( dest + i ),
+                      _mm_unpacklo_epi16( lo01, lo23 ) );
+    _mm_storeu_si128( (__m128i*)( dest + i + 4 ),
+                      _mm_unpackhi_epi16( lo01, lo23 ) );
+    _mm_storeu_si128( (__m128i*)( dest + i + 8 ),
+                      _mm_unpacklo_epi16( hi01, hi23 ) );
+    _mm_storeu_si128( (__m128i*)( dest + i + 12 ),
+                      _mm_unpackhi_epi16( hi01, hi23 ) );
+  }
+
+  for( ; i < n; i++ ) dest[i] = palette[ src[i] ];
+}
+
+static int
+have_ssse3( void )
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports( "ssse3" );
+}
+
+#endif			/* #ifdef UIPLOT_SSSE3 */
+
+void
+uiplot_convert_word( libspectrum_word *dest, const libspectrum_byte *src,
+                     const libspectrum_word *palette, size_t n )
+{
+  size_t i;
+
+#ifdef UIPLOT_SSSE3
+  if( n >= 16 && have_ssse3() ) {
+    convert_word_ssse3( dest, src, palette, n );
+    return;
+  }
+#endif
+
+  for( i = 0; i < n; i++ ) dest[i] = palette[ src[i] ];
+}
+
+void
+uiplot_convert_dword( libspectrum_dword *dest, const libspectrum_byte *src,
+                      const libspectrum_dword *palette, size_t n )
+{
+  size_t i;
+
+#ifdef UIPLOT_SSSE3
+  if( n >= 16 && have_ssse3() ) {
+    convert_dword_ssse3( dest, src, palette, n );
+    return;
+  }
+#endif
+
+  for( i = 0; i < n; i++ ) dest[i] = palette[ src[i] ];
+}
@@ -0,0 +1,107 @@
+/* uiplot.h: Pixel expansion and palette conversion shared by the UIs
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#ifndef FUSE_UIPLOT_H
+#define FUSE_UIPLOT_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include "libspectrum.h"
+
+/* For every value of a byte of screen data, a mask with all the bits set
+   in the pixels for its set bits, most significant bit first. The tables
+   are for pixels of one, two and four bytes; the wider tables also serve
+   for pixels plotted twice over */
+extern const libspectrum_byte uiplot_mask8[ 256 ][ 8 ];
+extern const libspectrum_byte uiplot_mask16[ 256 ][ 16 ];
+extern const libspectrum_byte uiplot_mask32[ 256 ][ 32 ];
+
+/* Fill `size' bytes at `dest' with `ink' where `mask' is set and `paper'
+   elsewhere, eight bytes at a time; `ink' and `paper' are the colours
+   repeated to fill a qword */
+static inline void
+uiplot_blend( void *dest, const libspectrum_byte *mask, size_t size,
+              libspectrum_qword ink, libspectrum_qword paper )
+{
+  libspectrum_qword bits, pixels;
+  size_t i;
+
+  for( i = 0; i < size; i += 8 ) {
+    memcpy( &bits, mask + i, 8 );
+    pixels = paper ^ ( ( ink ^ paper ) & bits );
+    memcpy( (libspectrum_byte*)dest + i, &pixels, 8 );
+  }
+}
+
+#define UIPLOT_REPEAT8( c ) ( (libspectrum_qword)(c) * 0x0101010101010101ULL )
+#define UIPLOT_REPEAT16( c ) ( (libspectrum_qword)(c) * 0x0001000100010001ULL )
+#define UIPLOT_REPEAT32( c ) ( (libspectrum_qword)(c) * 0x0000000100000001ULL )
+
+/* Plot the eight pixels in `data' as palette indices */
+static inline void
+uiplot_bits_byte( libspectrum_byte *dest, libspectrum_byte data,
+                  libspectrum_byte ink, libspectrum_byte paper )
+{
+  uiplot_blend( dest, uiplot_mask8[ data ], 8, UIPLOT_REPEAT8( ink ),
+                UIPLOT_REPEAT8( paper ) );
+}
+
+/* The same, but each pixel twice as wide */
+static inline void
+uiplot_bits_byte_wide( libspectrum_byte *dest, libspectrum_byte data,
+                       libspectrum_byte ink, libspectrum_byte paper )
+{
+  uiplot_blend( dest, uiplot_mask16[ data ], 16, UIPLOT_REPEAT8( ink ),
+                UIPLOT_REPEAT8( paper ) );
+}
+
+/* Plot the eight pixels in `data' as 16-bit colours */
+static inline void
+uiplot_bits_word( libspectrum_word *dest, libspectrum_byte data,
+                  libspectrum_word ink, libspectrum_word paper )
+{
+  uiplot_blend( dest, uiplot_mask16[ data ], 16, UIPLOT_REPEAT16( ink ),
+                UIPLOT_REPEAT16( paper ) );
+}
+
+static inline void
+uiplot_bits_word_wide( libspectrum_word *dest, libspectrum_byte data,
+                       libspectrum_word ink, libspectrum_word paper )
+{
+  uiplot_blend( dest, uiplot_mask32[ data ], 32, UIPLOT_REPEAT16( ink ),
+                UIPLOT_REPEAT16( paper ) );
+}
+
+/* Plot the eight pixels in `data' as 32-bit colours */
+static inline void
+uiplot_bits_dword( libspectrum_dword *dest, libspectrum_byte data,
+                   libspectrum_dword ink, libspectrum_dword paper )
+{
+  uiplot_blend( dest, uiplot_mask32[ data ], 32, UIPLOT_REPEAT32( ink ),
+                UIPLOT_REPEAT32( paper ) );
+}
+
+/* Convert `n' palette indices, each below 16, to colours from `palette' */
+void uiplot_convert_word( libspectrum_word *dest, const libspectrum_byte *src,
+                          const libspectrum_word *palette, size_t n );
+void uiplot_convert_dword( libspectrum_dword *dest,
+                           const libspectrum_byte *src,
+                           const libspectrum_dword *palette, size_t n );
+
+#endif			/* #ifndef FUSE_UIPLOT_H */
@@ -0,0 +1,481 @@
+/* uirender.c: Render thread shared by the UIs which scale in software
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/*
+  The emulation thread plots palette indices into uirender_image and notes
+  the areas it changed. At the end of each frame, those areas are copied
+  into the back one of three frame buffers, which is then swapped with the
+  ready buffer and the render thread woken. The render thread swaps the
+  ready buffer with its own front buffer and hands it to the UI to do the
+  palette conversion, scaling and presentation, so none of that is done on
+  the emulation thread.
+
+  If the renderer falls behind, a newly published frame replaces the one
+  still waiting in the ready buffer. The replaced frame is counted as
+  dropped and its dirty areas are carried over into the new one, so the
+  UI's copy of the screen never misses a change.
+
+  Without POSIX threads, or if the thread can't be started, each frame is
+  rendered on the emulation thread as soon as it ends.
+*/
+
+#include "config.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif				/* #ifdef HAVE_PTHREAD */
+#include <string.h>
+
+#include "libspectrum.h"
+
+#include "debugger/debugger.h"
+#include "fuse.h"
+#include "settings.h"
+#include "timer/timer.h"
+#include "ui/ui.h"
+#include "uirender.h"
+
+#define FRAME_COUNT 3
+
+libspectrum_byte *uirender_image = NULL;
+ptrdiff_t uirender_pitch;
+
+static uirender_frame frames[ FRAME_COUNT ];
+
+/* The emulation thread owns the back frame and the render thread the front
+   one; the ready frame is shared and only changes hands under
+   render_mutex */
+static int back_frame, ready_frame, front_frame;
+
+/* Set while the ready frame has been published but not yet taken */
+static int ready_pending;
+
+/* Set while the render thread is rendering the front frame */
+static int rendering;
+
+static uirender_render_fn render_fn;
+
+#ifdef HAVE_PTHREAD
+static pthread_t render_thread;
+static pthread_mutex_t render_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_cond = PTHREAD_COND_INITIALIZER;
+static int render_stop;
+
+/* Held while the UI's render function runs. It's recursive, as the UI may
+   change scaler, which takes it too, while already holding it */
+static pthread_once_t output_mutex_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t output_mutex;
+#endif				/* #ifdef HAVE_PTHREAD */
+static int render_running;
+
+static const char * const debugger_type_string = "render";
+static int variables_registered = 0;
+
+/* Statistics, all protected by render_mutex */
+static libspectrum_dword frames_rendered, frames_dropped;
+static libspectrum_dword frame_time_us, frame_time_max_us;
+
+static void
+frame_clear( uirender_frame *frame )
+{
+  frame->rect_count = 0;
+  frame->full_refresh = 0;
+}
+
+static void
+frame_add_rect( uirender_frame *frame, int x, int y, int w, int h )
+{
+  uirender_rect *rect;
+
+  if( frame->full_refresh ) return;
+
+  if( frame->rect_count == UIRENDER_MAX_RECTS ) {
+    frame->full_refresh = 1;
+    return;
+  }
+
+  rect = &frame->rects[ frame->rect_count++ ];
+  rect->x = x; rect->y = y; rect->w = w; rect->h = h;
+}
+
+#ifdef HAVE_PTHREAD
+/* Add the dirty areas of `src' to those of `dest' */
+static void
+frame_merge( uirender_frame *dest, const uirender_frame *src )
+{
+  size_t i;
+
+  if( src->full_refresh ) {
+    dest->full_refresh = 1;
+    return;
+  }
+
+  for( i = 0; i < src->rect_count; i++ )
+    frame_add_rect( dest, src->rects[i].x, src->rects[i].y, src->rects[i].w,
+                    src->rects[i].h );
+}
+#endif				/* #ifdef HAVE_PTHREAD */
+
+/* Copy the dirty areas of the emulated screen into `frame' */
+static void
+frame_fill( uirender_frame *frame )
+{
+  size_t i;
+  int y;
+
+  if( frame->full_refresh ) {
+    memcpy( frame->pixels, uirender_image,
+            uirender_pitch * frame->height );
+    return;
+  }
+
+  for( i = 0; i < frame->rect_count; i++ ) {
+    const uirender_rect *rect = &frame->rects[i];
+
+    for( y = rect->y; y < rect->y + rect->h; y++ )
+      memcpy( frame->pixels + y * frame->pitch + rect->x,
+              uirender_image + y * uirender_pitch + rect->x, rect->w );
+  }
+}
+
+/* The statistics and frame handover need locking only when there's a
+   render thread to share them with */
+static void
+state_lock( void )
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock( &render_mutex );
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+static void
+state_unlock( void )
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock( &render_mutex );
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+static void
+record_frame_time( double elapsed )
+{
+  libspectrum_dword us = elapsed > 0 ? elapsed * 1000000.0 : 0;
+
+  frames_rendered++;
+  frame_time_us = us;
+  if( us > frame_time_max_us ) frame_time_max_us = us;
+}
+
+static double
+render_frame( const uirender_frame *frame )
+{
+  double start = timer_get_time();
+
+  uirender_lock();
+  render_fn( frame );
+  uirender_unlock();
+
+  return timer_get_time() - start;
+}
+
+#ifdef HAVE_PTHREAD
+static void*
+render_main( void *arg GCC_UNUSED )
+{
+  double elapsed;
+  int frame;
+
+  pthread_mutex_lock( &render_mutex );
+
+  while( 1 ) {
+    if( !ready_pending ) {
+      if( render_stop ) break;
+      pthread_cond_wait( &render_cond, &render_mutex );
+      continue;
+    }
+
+    frame = front_frame; front_frame = ready_frame; ready_frame = frame;
+    ready_pending = 0;
+    rendering = 1;
+
+    pthread_mutex_unlock( &render_mutex );
+    elapsed = render_frame( &frames[ front_frame ] );
+    pthread_mutex_lock( &render_mutex );
+
+    record_frame_time( elapsed );
+    rendering = 0;
+    pthread_cond_broadcast( &render_cond );
+  }
+
+  pthread_mutex_unlock( &render_mutex );
+
+  return NULL;
+}
+
+static void
+output_mutex_init( void )
+{
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init( &attr );
+  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+  pthread_mutex_init( &output_mutex, &attr );
+  pthread_mutexattr_destroy( &attr );
+}
+#endif				/* #ifdef HAVE_PTHREAD */
+
+static libspectrum_dword
+get_frames( void )
+{
+  libspectrum_dword value;
+
+  state_lock();
+  value = frames_rendered;
+  state_unlock();
+
+  return value;
+}
+
+static libspectrum_dword
+get_dropped( void )
+{
+  libspectrum_dword value;
+
+  state_lock();
+  value = frames_dropped;
+  state_unlock();
+
+  return value;
+}
+
+static libspectrum_dword
+get_frame_time( void )
+{
+  libspectrum_dword value;
+
+  state_lock();
+  value = frame_time_us;
+  state_unlock();
+
+  return value;
+}
+
+static libspectrum_dword
+get_frame_time_max( void )
+{
+  libspectrum_dword value;
+
+  state_lock();
+  value = frame_time_max_us;
+  state_unlock();
+
+  return value;
+}
+
+static void
+reset_stats( libspectrum_dword value GCC_UNUSED )
+{
+  state_lock();
+  frames_rendered = frames_dropped = 0;
+  frame_time_us = frame_time_max_us = 0;
+  state_unlock();
+}
+
+static void
+register_variables( void )
+{
+  debugger_system_variable_register( debugger_type_string, "frames",
+                                     get_frames, reset_stats );
+  debugger_system_variable_register( debugger_type_string, "dropped",
+                                     get_dropped, reset_stats );
+  debugger_system_variable_register( debugger_type_string, "frametime",
+                                     get_frame_time, reset_stats );
+  debugger_system_variable_register( debugger_type_string, "frametimemax",
+                                     get_frame_time_max, reset_stats );
+}
+
+int
+uirender_init( int width, int height, uirender_render_fn render )
+{
+  size_t i;
+
+  if( !variables_registered ) {
+    register_variables();
+    variables_registered = 1;
+  }
+
+  uirender_pitch = width;
+  uirender_image = libspectrum_new0( libspectrum_byte, width * height );
+
+  for( i = 0; i < FRAME_COUNT; i++ ) {
+    frames[i].pixels = libspectrum_new0( libspectrum_byte, width * height );
+    frames[i].pitch = width;
+    frames[i].width = width;
+    frames[i].height = height;
+    frame_clear( &frames[i] );
+  }
+
+  back_frame = 0; ready_frame = 1; front_frame = 2;
+  ready_pending = 0;
+  rendering = 0;
+  render_fn = render;
+
+  /* The first frame has to draw everything */
+  frames[ back_frame ].full_refresh = 1;
+
+#ifdef HAVE_PTHREAD
+  render_stop = 0;
+  render_running = !pthread_create( &render_thread, NULL, render_main, NULL );
+
+  /* Not fatal: we can still render everything on this thread */
+  if( !render_running )
+    ui_error( UI_ERROR_WARNING,
+              "couldn't start render thread; rendering synchronously" );
+#else				/* #ifdef HAVE_PTHREAD */
+  render_running = 0;
+#endif				/* #ifdef HAVE_PTHREAD */
+
+  return 0;
+}
+
+void
+uirender_area( int x, int y, int w, int h )
+{
+  if( !uirender_image || w <= 0 || h <= 0 ) return;
+
+  frame_add_rect( &frames[ back_frame ], x, y, w, h );
+}
+
+void
+uirender_refresh_all( void )
+{
+  if( !uirender_image ) return;
+
+  frames[ back_frame ].full_refresh = 1;
+}
+
+void
+uirender_frame_end( void )
+{
+  uirender_frame *back;
+#ifdef HAVE_PTHREAD
+  int frame;
+#endif				/* #ifdef HAVE_PTHREAD */
+
+  if( !uirender_image ) return;
+
+  back = &frames[ back_frame ];
+  if( !back->full_refresh && !back->rect_count ) return;
+
+  back->bw_tv = settings_current.bw_tv;
+
+  if( !render_running ) {
+    double elapsed;
+
+    frame_fill( back );
+    elapsed = render_frame( back );
+    record_frame_time( elapsed );
+    frame_clear( back );
+    return;
+  }
+
+#ifdef HAVE_PTHREAD
+  /* If the last frame is still waiting, this one is about to replace it and
+     so has to bring its changes along too. Should the renderer take it in
+     the meantime, all that costs is redrawing those areas again */
+  pthread_mutex_lock( &render_mutex );
+  if( ready_pending ) frame_merge( back, &frames[ ready_frame ] );
+  pthread_mutex_unlock( &render_mutex );
+
+  frame_fill( back );
+
+  pthread_mutex_lock( &render_mutex );
+
+  if( ready_pending ) frames_dropped++;
+
+  frame = ready_frame; ready_frame = back_frame; back_frame = frame;
+  ready_pending = 1;
+  pthread_cond_broadcast( &render_cond );
+
+  pthread_mutex_unlock( &render_mutex );
+
+  /* Either a dropped frame or one the renderer has finished with */
+  frame_clear( &frames[ back_frame ] );
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+void
+uirender_wait_idle( void )
+{
+  if( !render_running ) return;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock( &render_mutex );
+  while( ready_pending || rendering )
+    pthread_cond_wait( &render_cond, &render_mutex );
+  pthread_mutex_unlock( &render_mutex );
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+void
+uirender_lock( void )
+{
+#ifdef HAVE_PTHREAD
+  pthread_once( &output_mutex_once, output_mutex_init );
+  pthread_mutex_lock( &output_mutex );
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+void
+uirender_unlock( void )
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock( &output_mutex );
+#endif				/* #ifdef HAVE_PTHREAD */
+}
+
+int
+uirender_end( void )
+{
+  size_t i;
+
+  if( !uirender_image ) return 0;
+
+#ifdef HAVE_PTHREAD
+  /* Let the renderer finish off anything already published */
+  if( render_running ) {
+    pthread_mutex_lock( &render_mutex );
+    render_stop = 1;
+    pthread_cond_broadcast( &render_cond );
+    pthread_mutex_unlock( &render_mutex );
+
+    pthread_join( render_thread, NULL );
+    render_running = 0;
+  }
+#endif				/* #ifdef HAVE_PTHREAD */
+
+  for( i = 0; i < FRAME_COUNT; i++ ) {
+    libspectrum_free( frames[i].pixels );
+    frames[i].pixels = NULL;
+  }
+
+  libspectrum_free( uirender_image );
+  uirender_image = NULL;
+
+  return 0;
+}
@@ -0,0 +1,74 @@
+/* uirender.h: Render thread shared by the UIs which scale in software
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#ifndef FUSE_UIRENDER_H
+#define FUSE_UIRENDER_H
+
+#include <stddef.h>
+
+#include "libspectrum.h"
+
+/* The most dirty rectangles a frame can carry before it becomes a full
+   refresh; the same limit the UIs had for their own update lists */
+#define UIRENDER_MAX_RECTS 300
+
+typedef struct uirender_rect {
+  int x, y, w, h;
+} uirender_rect;
+
+/* A completed frame as handed to the render thread. Only the pixels inside
+   the dirty rectangles are valid; everything else is left over from an
+   earlier frame and must be taken from the UI's own copy of the screen */
+typedef struct uirender_frame {
+  libspectrum_byte *pixels;	/* One palette index per pixel */
+  ptrdiff_t pitch;
+  int width, height;
+
+  uirender_rect rects[ UIRENDER_MAX_RECTS ];
+  size_t rect_count;
+  int full_refresh;		/* Every pixel is valid and changed */
+
+  int bw_tv;			/* Which palette to convert with */
+} uirender_frame;
+
+/* Converts, scales and presents the dirty parts of a frame. Called on the
+   render thread, with the output lock held */
+typedef void (*uirender_render_fn)( const uirender_frame *frame );
+
+/* The emulated screen, one palette index per pixel; written by the
+   uidisplay_plot* functions on the emulation thread */
+extern libspectrum_byte *uirender_image;
+extern ptrdiff_t uirender_pitch;
+
+int uirender_init( int width, int height, uirender_render_fn render );
+int uirender_end( void );
+
+/* Emulation thread side */
+void uirender_area( int x, int y, int w, int h );
+void uirender_refresh_all( void );
+void uirender_frame_end( void );
+
+/* Wait until every published frame has been rendered */
+void uirender_wait_idle( void );
+
+/* Held by the render thread while it is rendering; the UI takes it before
+   touching anything the render function uses */
+void uirender_lock( void );
+void uirender_unlock( void );
+
+#endif			/* #ifndef FUSE_UIRENDER_H */
@@ -51,7 +51,7 @@ static const char * const title = "Poke finder";
 int
 widget_pokefinder_draw( void *data )
 {
-  widget_dialog_with_border( 1, 2, 30, 12 );
+  widget_dialog_with_border( 1, 2, 30, 13 );
   widget_printstring( 10, 16, WIDGET_COLOUR_TITLE, title );
   widget_printstring( 16, 24, WIDGET_COLOUR_FOREGROUND, "Possible: " );
   widget_printstring( 16, 32, WIDGET_COLOUR_FOREGROUND, "Value: " );
@@ -62,9 +62,11 @@ widget_pokefinder_draw( void *data )
 
   widget_printstring( 16, 88, WIDGET_COLOUR_FOREGROUND,
 		      "\x0AI\x01nc'd \x0A" "D\x01" "ec'd \x0AS\x01" "earch" );
-  widget_printstring( 16, 96, WIDGET_COLOUR_FOREGROUND, "\x0AR\x01" "eset \x0A" "C\x01lose" );
+  widget_printstring( 16, 96, WIDGET_COLOUR_FOREGROUND,
+		      "C\x0Ah\x01" "anged \x0AU\x01nchanged" );
+  widget_printstring( 16, 104, WIDGET_COLOUR_FOREGROUND, "\x0AR\x01" "eset \x0A" "C\x01lose" );
 
-  widget_display_lines( 2, 12 );
+  widget_display_lines( 2, 13 );
 
   return 0;
 }
@@ -103,7 +105,7 @@ display_possible( void )
   widget_rectangle(  96,  24,  48,  8, WIDGET_COLOUR_BACKGROUND );
   widget_rectangle(  16,  48, 128, 32, WIDGET_COLOUR_BACKGROUND );
   widget_rectangle(  16,  80, 136,  8, WIDGET_COLOUR_BACKGROUND );
-  widget_rectangle(  82,  96,  56,  8, WIDGET_COLOUR_BACKGROUND );
+  widget_rectangle(  82, 104,  56,  8, WIDGET_COLOUR_BACKGROUND );
 
   snprintf( buf, sizeof( buf ), "%lu", (unsigned long)pokefinder_count );
   widget_printstring( 96, 24, WIDGET_COLOUR_FOREGROUND, buf );
@@ -128,10 +130,10 @@ display_possible( void )
       widget_printstring( x * 8, y * 8, colour, buf );
     }
 
-    widget_printstring( 83, 96, WIDGET_COLOUR_FOREGROUND, "\x0A" "B\x01reak" );
+    widget_printstring( 83, 104, WIDGET_COLOUR_FOREGROUND, "\x0A" "B\x01reak" );
   }
 
-  widget_display_lines( 3, 10 );
+  widget_display_lines( 3, 11 );
 }
 
 static void
@@ -140,7 +142,7 @@ display_value( void )
   char buf[16];
 
   snprintf( buf, sizeof( buf ), "%d", value );
-  widget_rectangle( 72, 32, 24, 8, WIDGET_COLOUR_BACKGROUND );
+  widget_rectangle( 72, 32, 40, 8, WIDGET_COLOUR_BACKGROUND );
   widget_printstring( 72, 32, WIDGET_COLOUR_FOREGROUND, buf );
   widget_display_lines( 4, 1 );
 }
@@ -183,11 +185,27 @@ widget_pokefinder_keyhandler( input_key key )
     display_possible();
     break;
 
+  case INPUT_KEY_h:		/* Search for changed */
+    pokefinder_changed();
+    update_possible();
+    display_possible();
+    break;
+
+  case INPUT_KEY_u:		/* Search for unchanged */
+    pokefinder_unchanged();
+    update_possible();
+    display_possible();
+    break;
+
   case INPUT_KEY_Return:
   case INPUT_KEY_KP_Enter:
   case INPUT_KEY_s:		/* Search */
-    if( value < 256 ) {
-      pokefinder_search( value );
+    /* Values which don't fit in a byte are searched for as 16-bit ones */
+    if( value < 0x10000 ) {
+      if( value < 0x100 )
+	pokefinder_search( value );
+      else
+	pokefinder_search_word( value );
       update_possible();
       display_possible();
     }
@@ -237,7 +255,7 @@ widget_pokefinder_keyhandler( input_key key )
   case INPUT_KEY_7:
   case INPUT_KEY_8:
   case INPUT_KEY_9:
-    value = (value % 100) * 10 + key - INPUT_KEY_0;
+    value = (value % 10000) * 10 + key - INPUT_KEY_0;
     display_value();
     break;
 
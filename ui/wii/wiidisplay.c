@@ -37,6 +37,7 @@
 #include "screenshot.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
 #include "settings.h"
 #include "ui/wii/wiimouse.h"
 
@@ -481,36 +482,11 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   x <<= 3;
 
   if( machine_current->timex ) {
-    int i;
-
     x <<= 1; y <<= 1;
-    for( i=0; i<2; i++,y++ ) {
-      display_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-      display_image[y][x+ 1] = ( data & 0x80 ) ? ink : paper;
-      display_image[y][x+ 2] = ( data & 0x40 ) ? ink : paper;
-      display_image[y][x+ 3] = ( data & 0x40 ) ? ink : paper;
-      display_image[y][x+ 4] = ( data & 0x20 ) ? ink : paper;
-      display_image[y][x+ 5] = ( data & 0x20 ) ? ink : paper;
-      display_image[y][x+ 6] = ( data & 0x10 ) ? ink : paper;
-      display_image[y][x+ 7] = ( data & 0x10 ) ? ink : paper;
-      display_image[y][x+ 8] = ( data & 0x08 ) ? ink : paper;
-      display_image[y][x+ 9] = ( data & 0x08 ) ? ink : paper;
-      display_image[y][x+10] = ( data & 0x04 ) ? ink : paper;
-      display_image[y][x+11] = ( data & 0x04 ) ? ink : paper;
-      display_image[y][x+12] = ( data & 0x02 ) ? ink : paper;
-      display_image[y][x+13] = ( data & 0x02 ) ? ink : paper;
-      display_image[y][x+14] = ( data & 0x01 ) ? ink : paper;
-      display_image[y][x+15] = ( data & 0x01 ) ? ink : paper;
-    }
+    uiplot_bits_word_wide( &display_image[y  ][x], data, ink, paper );
+    uiplot_bits_word_wide( &display_image[y+1][x], data, ink, paper );
   } else {
-    display_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-    display_image[y][x+ 1] = ( data & 0x40 ) ? ink : paper;
-    display_image[y][x+ 2] = ( data & 0x20 ) ? ink : paper;
-    display_image[y][x+ 3] = ( data & 0x10 ) ? ink : paper;
-    display_image[y][x+ 4] = ( data & 0x08 ) ? ink : paper;
-    display_image[y][x+ 5] = ( data & 0x04 ) ? ink : paper;
-    display_image[y][x+ 6] = ( data & 0x02 ) ? ink : paper;
-    display_image[y][x+ 7] = ( data & 0x01 ) ? ink : paper;
+    uiplot_bits_word( &display_image[y][x], data, ink, paper );
   }
 }
 
@@ -40,6 +40,8 @@ static void possible_click( LPNMITEMACTIVATE lpnmitem );
 static void update_pokefinder( void );
 static void win32ui_pokefinder_incremented( void );
 static void win32ui_pokefinder_decremented( void );
+static void win32ui_pokefinder_changed( void );
+static void win32ui_pokefinder_unchanged( void );
 static void win32ui_pokefinder_search( void );
 static void win32ui_pokefinder_reset( void );
 static void win32ui_pokefinder_close( void );
@@ -76,6 +78,12 @@ win32ui_pokefinder_proc( HWND hWnd GCC_UNUSED, UINT msg,
         case IDC_PF_DEC:
           win32ui_pokefinder_decremented();
           return TRUE;
+        case IDC_PF_CHANGED:
+          win32ui_pokefinder_changed();
+          return TRUE;
+        case IDC_PF_UNCHANGED:
+          win32ui_pokefinder_unchanged();
+          return TRUE;
         case IDC_PF_SEARCH:
           win32ui_pokefinder_search();
           return TRUE;
@@ -89,6 +97,8 @@ win32ui_pokefinder_proc( HWND hWnd GCC_UNUSED, UINT msg,
       height = HIWORD( lParam );
       move_button( IDC_PF_INC, height );
       move_button( IDC_PF_DEC, height );
+      move_button( IDC_PF_CHANGED, height );
+      move_button( IDC_PF_UNCHANGED, height );
       move_button( IDC_PF_SEARCH, height );
       move_button( IDC_PF_RESET, height );
       move_button( IDCLOSE, height );
@@ -233,8 +243,8 @@ menu_machine_pokefinder( int action GCC_UNUSED )
     initial_width = rect.right - rect.left;
     initial_height = rect.bottom - rect.top;
 
-    /* Set text limit */
-    SendDlgItemMessage( fuse_hPFWnd, IDC_PF_EDIT, EM_LIMITTEXT, 4, 0 );
+    /* Set text limit; long enough for a range such as "0x10-0x20" */
+    SendDlgItemMessage( fuse_hPFWnd, IDC_PF_EDIT, EM_LIMITTEXT, 9, 0 );
 
     /* set extended listview style to select full row, when an item
        is selected */
@@ -288,12 +298,25 @@ win32ui_pokefinder_decremented( void )
   update_pokefinder();
 }
 
+static void
+win32ui_pokefinder_changed( void )
+{
+  pokefinder_changed();
+  update_pokefinder();
+}
+
+static void
+win32ui_pokefinder_unchanged( void )
+{
+  pokefinder_unchanged();
+  update_pokefinder();
+}
+
 static void
 win32ui_pokefinder_search( void )
 {
-  long value;
-  TCHAR *buffer, *endptr;
-  int buffer_size, base;
+  TCHAR *buffer;
+  int buffer_size, error;
   HWND hwnd_control;
 
   /* poll the size of the value in Search box first */
@@ -313,20 +336,16 @@ win32ui_pokefinder_search( void )
     return;
   }
 
-  errno = 0;
-  base = ( !_tcsncmp( _T("0x"), buffer, strlen( _T("0x") ) ) )? 16 : 10;
-  value = _tcstol( buffer, &endptr, base );
+  /* FIXME This is asuming SendDlgItemMessage is not UNICODE */
+  error = pokefinder_search_text( buffer );
+  free( buffer );
 
-  if( errno || value < 0 || value > 255 || endptr == buffer ) {
-    free( buffer );
-    ui_error( UI_ERROR_ERROR, "Invalid value: use an integer from 0 to 255" );
+  if( error ) {
     hwnd_control = GetDlgItem( fuse_hPFWnd, IDC_PF_EDIT );
     SendMessage( fuse_hPFWnd, WM_NEXTDLGCTL, (WPARAM) hwnd_control, TRUE );
     return;
   }
-  free( buffer );
 
-  pokefinder_search( value );
   update_pokefinder();
 }
 
@@ -30,3 +30,5 @@
 #define IDC_PF_DEC        1506
 #define IDC_PF_SEARCH     1507
 #define IDC_PF_RESET      1508
+#define IDC_PF_CHANGED    1509
+#define IDC_PF_UNCHANGED  1510
@@ -29,6 +29,7 @@
 #include "settings.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
 #include "ui/scaler/scaler.h"
 #include "win32internals.h"
 
@@ -347,10 +348,11 @@ uidisplay_area( int x, int y, int w, int h )
   }
 
   /* Create scaled image */
-  scaler_proc32( &rgb_image[ ( y + 2 ) * rgb_pitch + 4 * ( x + 1 ) ],
-                 rgb_pitch,
-                 &scaled_image[ scaled_y * scaled_pitch + 4 * scaled_x ],
-                 scaled_pitch, w, h );
+  scaler_run( current_scaler, scaler_proc32,
+              &rgb_image[ ( y + 2 ) * rgb_pitch + 4 * ( x + 1 ) ],
+              rgb_pitch,
+              &scaled_image[ scaled_y * scaled_pitch + 4 * scaled_x ],
+              scaled_pitch, w, h );
 
   w *= scale; h *= scale;
 
@@ -437,36 +439,11 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
   x <<= 3;
 
   if( machine_current->timex ) {
-    int i;
-
     x <<= 1; y <<= 1;
-    for( i=0; i<2; i++,y++ ) {
-      win32display_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-      win32display_image[y][x+ 1] = ( data & 0x80 ) ? ink : paper;
-      win32display_image[y][x+ 2] = ( data & 0x40 ) ? ink : paper;
-      win32display_image[y][x+ 3] = ( data & 0x40 ) ? ink : paper;
-      win32display_image[y][x+ 4] = ( data & 0x20 ) ? ink : paper;
-      win32display_image[y][x+ 5] = ( data & 0x20 ) ? ink : paper;
-      win32display_image[y][x+ 6] = ( data & 0x10 ) ? ink : paper;
-      win32display_image[y][x+ 7] = ( data & 0x10 ) ? ink : paper;
-      win32display_image[y][x+ 8] = ( data & 0x08 ) ? ink : paper;
-      win32display_image[y][x+ 9] = ( data & 0x08 ) ? ink : paper;
-      win32display_image[y][x+10] = ( data & 0x04 ) ? ink : paper;
-      win32display_image[y][x+11] = ( data & 0x04 ) ? ink : paper;
-      win32display_image[y][x+12] = ( data & 0x02 ) ? ink : paper;
-      win32display_image[y][x+13] = ( data & 0x02 ) ? ink : paper;
-      win32display_image[y][x+14] = ( data & 0x01 ) ? ink : paper;
-      win32display_image[y][x+15] = ( data & 0x01 ) ? ink : paper;
-    }
+    uiplot_bits_word_wide( &win32display_image[y  ][x], data, ink, paper );
+    uiplot_bits_word_wide( &win32display_image[y+1][x], data, ink, paper );
   } else {
-    win32display_image[y][x+ 0] = ( data & 0x80 ) ? ink : paper;
-    win32display_image[y][x+ 1] = ( data & 0x40 ) ? ink : paper;
-    win32display_image[y][x+ 2] = ( data & 0x20 ) ? ink : paper;
-    win32display_image[y][x+ 3] = ( data & 0x10 ) ? ink : paper;
-    win32display_image[y][x+ 4] = ( data & 0x08 ) ? ink : paper;
-    win32display_image[y][x+ 5] = ( data & 0x04 ) ? ink : paper;
-    win32display_image[y][x+ 6] = ( data & 0x02 ) ? ink : paper;
-    win32display_image[y][x+ 7] = ( data & 0x01 ) ? ink : paper;
+    uiplot_bits_word( &win32display_image[y][x], data, ink, paper );
   }
 }
 
@@ -480,22 +457,8 @@ uidisplay_plot16( int x, int y, libspectrum_word data,
   x <<= 4; y <<= 1;
 
   for( i=0; i<2; i++,y++ ) {
-    win32display_image[y][x+ 0] = ( data & 0x8000 ) ? ink : paper;
-    win32display_image[y][x+ 1] = ( data & 0x4000 ) ? ink : paper;
-    win32display_image[y][x+ 2] = ( data & 0x2000 ) ? ink : paper;
-    win32display_image[y][x+ 3] = ( data & 0x1000 ) ? ink : paper;
-    win32display_image[y][x+ 4] = ( data & 0x0800 ) ? ink : paper;
-    win32display_image[y][x+ 5] = ( data & 0x0400 ) ? ink : paper;
-    win32display_image[y][x+ 6] = ( data & 0x0200 ) ? ink : paper;
-    win32display_image[y][x+ 7] = ( data & 0x0100 ) ? ink : paper;
-    win32display_image[y][x+ 8] = ( data & 0x0080 ) ? ink : paper;
-    win32display_image[y][x+ 9] = ( data & 0x0040 ) ? ink : paper;
-    win32display_image[y][x+10] = ( data & 0x0020 ) ? ink : paper;
-    win32display_image[y][x+11] = ( data & 0x0010 ) ? ink : paper;
-    win32display_image[y][x+12] = ( data & 0x0008 ) ? ink : paper;
-    win32display_image[y][x+13] = ( data & 0x0004 ) ? ink : paper;
-    win32display_image[y][x+14] = ( data & 0x0002 ) ? ink : paper;
-    win32display_image[y][x+15] = ( data & 0x0001 ) ? ink : paper;
+    uiplot_bits_word( &win32display_image[y][x    ], data >> 8,   ink, paper );
+    uiplot_bits_word( &win32display_image[y][x + 8], data & 0xff, ink, paper );
   }
 }
 
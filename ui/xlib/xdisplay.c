@@ -62,6 +62,7 @@
 #include "ui/scaler/scaler.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
+#include "ui/uiplot.h"
 
 void xstatusbar_init( int size );
 
@@ -860,7 +861,7 @@ xdisplay_update_rect_scale( int x, int y, int w, int h )
 
   y = y * image_scale >> 2;
   x = x * image_scale >> 2;
-  scaler_proc16(
+  scaler_run( current_scaler, scaler_proc16,
         (libspectrum_byte *)&(rgb_image[yy + 2][xx + 1]),
         rgb_pitch * sizeof(rgb_image[0][0]),
         (libspectrum_byte *)&(scaled_image[y][x]),
@@ -1096,35 +1097,14 @@ uidisplay_plot8( int x, int y, libspectrum_byte data,
 
     dest = &(rgb_image[y + 2][x + 1]);
 
-    *(dest + rgb_pitch) = *dest = ( data & 0x80 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x80 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x40 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x40 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x20 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x20 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x10 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x10 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x08 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x08 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x04 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x04 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x02 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x02 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x01 ) ? pi : pp; dest++;
-    *(dest + rgb_pitch) = *dest = ( data & 0x01 ) ? pi : pp;
+    uiplot_bits_word_wide( dest, data, pi, pp );
+    uiplot_bits_word_wide( dest + rgb_pitch, data, pi, pp );
   } else {
     x <<= 3;
 
     dest = &(rgb_image[y + 2][x + 1]);
 
-    *(dest++) = ( data & 0x80 ) ? pi : pp;
-    *(dest++) = ( data & 0x40 ) ? pi : pp;
-    *(dest++) = ( data & 0x20 ) ? pi : pp;
-    *(dest++) = ( data & 0x10 ) ? pi : pp;
-    *(dest++) = ( data & 0x08 ) ? pi : pp;
-    *(dest++) = ( data & 0x04 ) ? pi : pp;
-    *(dest++) = ( data & 0x02 ) ? pi : pp;
-    *dest     = ( data & 0x01 ) ? pi : pp;
+    uiplot_bits_word( dest, data, pi, pp );
   }
 }
 
@@ -1142,22 +1122,10 @@ uidisplay_plot16( int x, int y, libspectrum_word data,
   x <<= 4; y <<= 1;
 
   dest = &(rgb_image[y + 2][x + 1]);
-  *(dest + rgb_pitch) = *dest = ( data & 0x8000 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x4000 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x2000 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x1000 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0800 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0400 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0200 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0100 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0080 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0040 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0020 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0010 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0008 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0004 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0002 ) ? pi : pp; dest++;
-  *(dest + rgb_pitch) = *dest = ( data & 0x0001 ) ? pi : pp;
+  uiplot_bits_word( dest,                 data >> 8,   pi, pp );
+  uiplot_bits_word( dest + 8,             data & 0xff, pi, pp );
+  uiplot_bits_word( dest + rgb_pitch,     data >> 8,   pi, pp );
+  uiplot_bits_word( dest + rgb_pitch + 8, data & 0xff, pi, pp );
 }
 
 int
@@ -0,0 +1,59 @@
+#!/bin/sh
+# batchtest.sh: check Fuse's batch mode
+#
+# Runs the 48K ROM for 500 frames, ten seconds of emulated time, and
+# fails if that took ten seconds or more of wall-clock time, as it would
+# if the speed-limiting timer were still running. Then runs a manifest
+# of two jobs, and checks that both succeed and run the frames they ask
+# for.
+#
+# Usage: batchtest.sh [fuse binary]
+
+fuse=${1:-./fuse}
+frames=500
+limit=10
+
+fail() {
+  echo "batchtest: $*" >&2
+  rm -rf "$tmp"
+  exit 1
+}
+
+tmp=`mktemp -d` || fail "couldn't make a temporary directory"
+
+start=`date +%s`
+registers=`"$fuse" --machine 48 --batch --batch-frames $frames \
+  --batch-dump-registers -` || fail "batch run failed"
+elapsed=$(( `date +%s` - start ))
+
+case "$registers" in
+  *"FRAMES=$frames "*) ;;
+  *) fail "expected $frames frames, got: $registers" ;;
+esac
+
+if [ $elapsed -ge $limit ]; then
+  fail "$frames frames took ${elapsed}s, not less than ${limit}s"
+fi
+
+# A blank screen is the simplest file a job can open
+dd if=/dev/zero of="$tmp/blank.scr" bs=6912 count=1 2>/dev/null ||
+  fail "couldn't write $tmp/blank.scr"
+
+cat > "$tmp/manifest" <<MANIFEST
+# Two jobs, run at once
+$tmp/blank.scr frames=100 registers=$tmp/job1.txt
+$tmp/blank.scr frames=200 registers=$tmp/job2.txt
+MANIFEST
+
+"$fuse" --machine 48 --batch-manifest "$tmp/manifest" --batch-workers 2 \
+  > "$tmp/results" || fail "manifest run failed: `cat "$tmp/results"`"
+
+[ `grep -c "	ok	" "$tmp/results"` -eq 2 ] ||
+  fail "expected two jobs ok, got: `cat "$tmp/results"`"
+
+grep -q "FRAMES=100 " "$tmp/job1.txt" || fail "job 1 didn't run 100 frames"
+grep -q "FRAMES=200 " "$tmp/job2.txt" || fail "job 2 didn't run 200 frames"
+
+rm -rf "$tmp"
+
+exit 0
@@ -989,6 +989,11 @@ libspectrum_byte hires_convert_dec( libspectrum_byte attr )
 
 settings_info settings_current;
 
+double timer_get_time( void )
+{
+  return 0;
+}
+
 void startup_manager_register_no_dependencies(
   startup_manager_module module, startup_manager_init_fn init_fn,
   void *init_context, startup_manager_end_fn end_fn )
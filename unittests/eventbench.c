@@ -0,0 +1,253 @@
+/* eventbench.c: Microbenchmark for the event queue
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Keeps a fixed number of events pending, each of which reschedules
+   itself a pseudo-random number of tstates later when it fires, and
+   times the event queue in event.c against the sorted GSList it
+   replaced. Also checks that, once the events have been added, the
+   queue makes no further allocations. Usage: eventbench [events fired] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../event.h"
+#include "../infrastructure/startup_manager.h"
+#include "../machine.h"
+#include "../ui/ui.h"
+
+#define FRAME_LENGTH 69888
+
+/* Mocks for the Fuse functions used by event.c and the timer code */
+
+libspectrum_dword tstates;
+
+fuse_machine_info *machine_current;
+
+static startup_manager_init_fn event_init_fn;
+static startup_manager_end_fn event_end_fn;
+
+void
+startup_manager_register( startup_manager_module module,
+                          startup_manager_module *dependencies,
+                          size_t dependency_count,
+                          startup_manager_init_fn init_fn,
+                          void *init_context, startup_manager_end_fn end_fn )
+{
+  event_init_fn = init_fn;
+  event_end_fn = end_fn;
+}
+
+char*
+utils_safe_strdup( const char *src )
+{
+  char *dest = NULL;
+  if( src ) {
+    dest = libspectrum_new( char, strlen( src ) + 1 );
+    strcpy( dest, src );
+  }
+  return dest;
+}
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+static libspectrum_dword random_state;
+
+static libspectrum_dword
+next_delay( void )
+{
+  random_state = random_state * 1103515245 + 12345;
+  return 1 + ( ( random_state >> 8 ) % 20000 );
+}
+
+/* The queue under test */
+
+static int bench_event;
+static unsigned long fired;
+
+static void
+bench_event_fn( libspectrum_dword event_tstates, int type, void *user_data )
+{
+  fired++;
+  event_add_with_data( event_tstates + next_delay(), type, user_data );
+}
+
+static void
+fire_events( unsigned long target )
+{
+  while( fired < target ) {
+    tstates = event_next_event;
+    if( tstates >= FRAME_LENGTH ) {
+      event_frame( FRAME_LENGTH );
+      continue;
+    }
+    event_do_events();
+  }
+}
+
+static double
+run_queue( int pending, unsigned long target, unsigned long *allocations )
+{
+  event_pool_stats_t before, after;
+  double start, time;
+  int i;
+
+  random_state = 1; fired = 0; tstates = 0;
+  for( i = 0; i < pending; i++ ) event_add( next_delay(), bench_event );
+
+  /* Let each event fire once so the pool reaches its working size */
+  fire_events( pending );
+  fired = 0;
+
+  event_pool_stats( &before );
+  start = compat_timer_get_time();
+  fire_events( target );
+  time = compat_timer_get_time() - start;
+  event_pool_stats( &after );
+
+  *allocations = after.allocations - before.allocations;
+
+  event_remove_type( bench_event );
+  return time;
+}
+
+/* The previous implementation: a GSList kept sorted on insertion, with
+   every entry adjusted at the end of each frame */
+
+static GSList *list;
+static libspectrum_dword list_next_event;
+
+static gint
+list_cmp( gconstpointer a1, gconstpointer b1 )
+{
+  const event_t *a = a1, *b = b1;
+  return a->tstates != b->tstates ?
+    (a->tstates > b->tstates) - (a->tstates < b->tstates) : a->type - b->type;
+}
+
+static void
+list_add( libspectrum_dword event_time, int type )
+{
+  event_t *ptr = libspectrum_new( event_t, 1 );
+
+  ptr->tstates = event_time;
+  ptr->type = type;
+  ptr->user_data = NULL;
+
+  if( event_time < list_next_event ) {
+    list_next_event = event_time;
+    list = g_slist_prepend( list, ptr );
+  } else {
+    list = g_slist_insert_sorted( list, ptr, list_cmp );
+  }
+}
+
+static void
+list_reduce_tstates( gpointer data, gpointer user_data )
+{
+  ( (event_t*)data )->tstates -= FRAME_LENGTH;
+}
+
+static void
+list_free_entry( gpointer data, gpointer user_data )
+{
+  libspectrum_free( data );
+}
+
+static double
+run_list( int pending, unsigned long target )
+{
+  double start;
+  int i;
+
+  random_state = 1; fired = 0; list_next_event = 0xffffffff;
+  for( i = 0; i < pending; i++ ) list_add( next_delay(), bench_event );
+
+  start = compat_timer_get_time();
+  while( fired < target ) {
+    event_t *ptr = list->data;
+
+    if( ptr->tstates >= FRAME_LENGTH ) {
+      g_slist_foreach( list, list_reduce_tstates, NULL );
+      list_next_event = ( (event_t*)list->data )->tstates;
+      continue;
+    }
+
+    list = g_slist_remove( list, ptr );
+    list_next_event = list ? ( (event_t*)list->data )->tstates : 0xffffffff;
+    fired++;
+    list_add( ptr->tstates + next_delay(), ptr->type );
+    libspectrum_free( ptr );
+  }
+
+  g_slist_foreach( list, list_free_entry, NULL );
+  g_slist_free( list );
+  list = NULL;
+  return compat_timer_get_time() - start;
+}
+
+int
+main( int argc, char **argv )
+{
+  static const int pendings[] = { 4, 16, 64, 256, 1024 };
+  unsigned long target = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 2000000;
+  size_t i;
+
+  event_register_startup();
+  if( event_init_fn( NULL ) ) return 1;
+  bench_event = event_register( bench_event_fn, "Benchmark" );
+
+  printf( "%8s %14s %14s %8s %7s\n", "pending", "list Mev/s", "heap Mev/s",
+          "speedup", "allocs" );
+
+  for( i = 0; i < ARRAY_SIZE( pendings ); i++ ) {
+    unsigned long allocations;
+    double list_time = run_list( pendings[i], target );
+    double heap_time = run_queue( pendings[i], target, &allocations );
+
+    printf( "%8d %14.2f %14.2f %7.2fx %7lu\n", pendings[i],
+            target / list_time / 1e6, target / heap_time / 1e6,
+            list_time / heap_time, allocations );
+
+    if( allocations ) {
+      fprintf( stderr, "%s: event queue allocated while running\n",
+               argv[0] );
+      return 1;
+    }
+  }
+
+  event_end_fn();
+
+  return 0;
+}
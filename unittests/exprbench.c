@@ -0,0 +1,241 @@
+/* exprbench.c: Microbenchmark for debugger expression evaluation
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Builds some typical breakpoint conditions and times evaluating them with
+   the tree walker against evaluating their compiled form, checking that
+   both give the same answers. Usage: exprbench [evaluations] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../debugger/debugger_internals.h"
+#include "../infrastructure/startup_manager.h"
+#include "../memory_pages.h"
+#include "../mempool.h"
+#include "../ui/ui.h"
+
+/* Mocks for the Fuse functions used by the debugger expression code */
+
+int debugger_output_base = 16;
+
+memory_page memory_map_read[ MEMORY_PAGES_IN_64K ];
+
+static libspectrum_byte memory[ 0x10000 ];
+
+void
+startup_manager_register( startup_manager_module module,
+                          startup_manager_module *dependencies,
+                          size_t dependency_count,
+                          startup_manager_init_fn init_fn,
+                          void *init_context, startup_manager_end_fn end_fn )
+{
+}
+
+void
+fuse_abort( void )
+{
+  abort();
+}
+
+char*
+utils_safe_strdup( const char *src )
+{
+  char *dest = NULL;
+  if( src ) {
+    dest = libspectrum_new( char, strlen( src ) + 1 );
+    strcpy( dest, src );
+  }
+  return dest;
+}
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+/* Registers which change as the benchmark runs */
+
+static libspectrum_dword pc, a, bc, hl;
+
+static libspectrum_dword get_pc( void ) { return pc; }
+static libspectrum_dword get_a( void ) { return a; }
+static libspectrum_dword get_bc( void ) { return bc; }
+static libspectrum_dword get_hl( void ) { return hl; }
+
+static debugger_expression*
+number( libspectrum_dword value )
+{
+  return debugger_expression_new_number( value, MEMPOOL_UNTRACKED );
+}
+
+static debugger_expression*
+sysvar( const char *detail )
+{
+  return debugger_expression_new_system_variable( "z80", detail,
+                                                  MEMPOOL_UNTRACKED );
+}
+
+static debugger_expression*
+variable( const char *name )
+{
+  return debugger_expression_new_variable( name, MEMPOOL_UNTRACKED );
+}
+
+static debugger_expression*
+unaryop( int operation, debugger_expression *operand )
+{
+  return debugger_expression_new_unaryop( operation, operand,
+                                          MEMPOOL_UNTRACKED );
+}
+
+static debugger_expression*
+binaryop( int operation, debugger_expression *operand1,
+          debugger_expression *operand2 )
+{
+  return debugger_expression_new_binaryop( operation, operand1, operand2,
+                                           MEMPOOL_UNTRACKED );
+}
+
+static void
+step( unsigned long i )
+{
+  pc = 0x8000 + ( i & 0x0f );
+  a = ( i >> 4 ) & 0x03;
+  bc = i & 0xff;
+  hl = 0x9000 + ( i & 0x3f );
+}
+
+static double
+run( debugger_expression *exp, unsigned long evaluations,
+     libspectrum_dword *checksum )
+{
+  double start = compat_timer_get_time();
+  unsigned long i;
+
+  *checksum = 0;
+  for( i = 0; i < evaluations; i++ ) {
+    step( i );
+    *checksum = *checksum * 31 + debugger_expression_evaluate( exp );
+  }
+
+  return compat_timer_get_time() - start;
+}
+
+int
+main( int argc, char **argv )
+{
+  unsigned long evaluations =
+    argc > 1 ? strtoul( argv[1], NULL, 10 ) : 10000000;
+  debugger_expression *expressions[3];
+  static const char * const names[] = {
+    "PC == 0x8000 && A == 3",
+    "(HL + 2) * 3 - 1 == $target || BC > 100",
+    "*(HL + 1) == 0x3c && (4 * 1024) / 2 != BC",
+  };
+  size_t i;
+  int page;
+
+  for( page = 0; page < MEMORY_PAGES_IN_64K; page++ )
+    memory_map_read[ page ].page = &memory[ page * MEMORY_PAGE_SIZE ];
+  for( i = 0; i < sizeof( memory ); i++ ) memory[i] = i;
+
+  debugger_system_variable_init();
+  debugger_system_variable_register( "z80", "pc", get_pc, NULL );
+  debugger_system_variable_register( "z80", "a", get_a, NULL );
+  debugger_system_variable_register( "z80", "bc", get_bc, NULL );
+  debugger_system_variable_register( "z80", "hl", get_hl, NULL );
+  debugger_variable_init();
+  debugger_variable_set( "target", 0x1b035 );
+
+  expressions[0] =
+    binaryop( DEBUGGER_TOKEN_LOGICAL_AND,
+              binaryop( DEBUGGER_TOKEN_EQUAL_TO, sysvar( "pc" ),
+                        number( 0x8000 ) ),
+              binaryop( DEBUGGER_TOKEN_EQUAL_TO, sysvar( "a" ), number( 3 ) ) );
+
+  expressions[1] =
+    binaryop( DEBUGGER_TOKEN_LOGICAL_OR,
+              binaryop( DEBUGGER_TOKEN_EQUAL_TO,
+                        binaryop( '-',
+                                  binaryop( '*',
+                                            binaryop( '+', sysvar( "hl" ),
+                                                      number( 2 ) ),
+                                            number( 3 ) ),
+                                  number( 1 ) ),
+                        variable( "target" ) ),
+              binaryop( '>', sysvar( "bc" ), number( 100 ) ) );
+
+  expressions[2] =
+    binaryop( DEBUGGER_TOKEN_LOGICAL_AND,
+              binaryop( DEBUGGER_TOKEN_EQUAL_TO,
+                        unaryop( DEBUGGER_TOKEN_DEREFERENCE,
+                                 binaryop( '+', sysvar( "hl" ),
+                                           number( 1 ) ) ),
+                        number( 0x3c ) ),
+              binaryop( DEBUGGER_TOKEN_NOT_EQUAL_TO,
+                        binaryop( '/',
+                                  binaryop( '*', number( 4 ),
+                                            number( 1024 ) ),
+                                  number( 2 ) ),
+                        sysvar( "bc" ) ) );
+
+  printf( "%-42s %12s %12s %8s\n", "expression", "tree Mev/s",
+          "code Mev/s", "speedup" );
+
+  for( i = 0; i < ARRAY_SIZE( expressions ); i++ ) {
+    debugger_expression *tree = debugger_expression_copy( expressions[i] );
+    debugger_expression *code = debugger_expression_copy( expressions[i] );
+    libspectrum_dword tree_checksum, code_checksum;
+    double tree_time, code_time;
+
+    debugger_expression_compile( code );
+
+    tree_time = run( tree, evaluations, &tree_checksum );
+    code_time = run( code, evaluations, &code_checksum );
+
+    if( tree_checksum != code_checksum ) {
+      fprintf( stderr, "%s: results differ for %s\n", argv[0], names[i] );
+      return 1;
+    }
+
+    printf( "%-42s %12.2f %12.2f %7.2fx\n", names[i],
+            evaluations / tree_time / 1e6, evaluations / code_time / 1e6,
+            tree_time / code_time );
+
+    debugger_expression_delete( tree );
+    debugger_expression_delete( code );
+  }
+
+  debugger_variable_end();
+
+  return 0;
+}
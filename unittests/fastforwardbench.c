@@ -0,0 +1,283 @@
+/* fastforwardbench.c: Benchmark for the display code when fast-forwarding
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Runs frames back to back as fast as the display code will go, as Fuse
+   does at a high emulation speed, with each frame writing to pseudo-random
+   places in video memory and changing the border colour as it goes. This
+   is done once drawing every frame and once with adaptive frame skipping,
+   giving the frames emulated per second and how many were sent to the UI,
+   and checking that the image left when emulation stops after the last
+   frame is the same either way. Usage: fastforwardbench [frames] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../display.h"
+#include "../infrastructure/startup_manager.h"
+#include "../machine.h"
+#include "../memory_pages.h"
+#include "../peripherals/scld.h"
+#include "../rectangle.h"
+#include "../settings.h"
+#include "../ui/ui.h"
+#include "../ui/uiplot.h"
+
+libspectrum_dword tstates;
+
+scld scld_last_dec;
+
+int memory_current_screen;
+
+libspectrum_byte RAM[ SPECTRUM_RAM_PAGES ][0x4000] = { { 0 } };
+
+fuse_machine_info *machine_current;
+
+const int LINE_TIME = 224;
+const int TOP_BORDER = 24;
+
+#define FRAME_LENGTH ( 312 * LINE_TIME )
+
+/* The work done by each frame */
+#define SCREEN_WRITES 1024
+#define BORDER_CHANGES 64
+
+/* Helper function from display.c */
+void display_reset_frame_count( void );
+
+/* The image the display code draws, in palette indices */
+static libspectrum_byte image[ DISPLAY_SCREEN_HEIGHT ][ DISPLAY_ASPECT_WIDTH ];
+static libspectrum_byte final_image[2][ DISPLAY_SCREEN_HEIGHT ]
+                                      [ DISPLAY_ASPECT_WIDTH ];
+
+static int frames_shown;
+
+static void
+create_fake_machine( void )
+{
+  size_t y;
+
+  machine_current = libspectrum_malloc( sizeof( *machine_current ) );
+
+  machine_current->timex = 0;
+  machine_current->timings.tstates_per_line = LINE_TIME;
+
+  for( y = 0; y < ARRAY_SIZE( machine_current->line_times ); y++ )
+    machine_current->line_times[y] = y * LINE_TIME;
+
+  display_dirty = display_dirty_sinclair;
+  display_write_if_dirty = display_write_if_dirty_sinclair;
+  display_dirty_flashing = display_dirty_flashing_sinclair;
+}
+
+/* Do the video memory writes and border changes of one frame, in the
+   order the beam would meet them */
+static void
+emulate_frame( void )
+{
+  int i;
+
+  for( i = 0; i < SCREEN_WRITES; i++ ) {
+    libspectrum_word offset = rand() % 0x1b00;
+
+    tstates = (libspectrum_dword)i * FRAME_LENGTH / SCREEN_WRITES;
+
+    if( i % ( SCREEN_WRITES / BORDER_CHANGES ) == 0 )
+      display_set_lores_border( rand() % 8 );
+
+    RAM[0][ offset ] = rand();
+    display_dirty( offset );
+  }
+
+  tstates = 0;
+}
+
+/* Run `frames' frames, returning the seconds taken and the number of
+   frames shown, and leaving the final image in final_image[ adaptive ] */
+static double
+run( int adaptive, int frames, int *shown )
+{
+  double start, taken;
+  int i;
+
+  srand( 1 );
+  memset( RAM[0], 0, sizeof( RAM[0] ) );
+  display_set_lores_border( 0 );
+  display_reset_frame_count();
+
+  /* Start from a fully drawn screen */
+  settings_current.adaptive_frame_skip = 0;
+  display_refresh_all();
+  display_frame();
+
+  settings_current.adaptive_frame_skip = adaptive;
+  frames_shown = 0;
+
+  start = compat_timer_get_time();
+
+  for( i = 0; i < frames; i++ ) {
+    emulate_frame();
+    display_frame();
+  }
+
+  taken = compat_timer_get_time() - start;
+  *shown = frames_shown;
+
+  /* Stop as emulation does when paused, which must bring the image up to
+     date with what was skipped without emulating another frame */
+  display_stop_adaptive_skip();
+  settings_current.adaptive_frame_skip = 0;
+
+  /* Drawing every frame leaves writes behind the beam to the next frame,
+     so let that catch up to compare like with like */
+  if( *shown == frames ) {
+    display_frame();
+    display_frame();
+  }
+
+  memcpy( final_image[ adaptive ], image, sizeof( image ) );
+
+  return taken;
+}
+
+#ifdef main
+/* SDL headers redefine main on Windows, but this needs a normal entry point */
+#undef main
+#endif
+
+int
+main( int argc, char *argv[] )
+{
+  int frames = argc > 1 ? atoi( argv[1] ) : 5000;
+  double times[2];
+  int shown[2], adaptive, differ;
+
+  if( frames <= 0 ) frames = 1;
+
+  if( display_init( &argc, &argv ) ) {
+    fprintf( stderr, "Error from display_init()\n");
+    return 1;
+  }
+
+  create_fake_machine();
+
+  printf( "%d frames of %d screen writes and %d border changes\n", frames,
+          SCREEN_WRITES, BORDER_CHANGES );
+  printf( "%-16s %10s %10s %10s\n", "", "frames/s", "us/frame", "shown" );
+
+  for( adaptive = 0; adaptive < 2; adaptive++ ) {
+    times[ adaptive ] = run( adaptive, frames, &shown[ adaptive ] );
+
+    printf( "%-16s %10.0f %10.2f %10d\n",
+            adaptive ? "adaptive skip" : "every frame",
+            frames / times[ adaptive ], times[ adaptive ] * 1000000 / frames,
+            shown[ adaptive ] );
+  }
+
+  printf( "%-16s %9.2fx\n", "speedup", times[0] / times[1] );
+
+  differ = memcmp( final_image[0], final_image[1], sizeof( final_image[0] ) );
+  if( differ ) printf( "final image differs\n" );
+
+  return differ ? 1 : 0;
+}
+
+/* The UI, drawing into the image */
+
+int
+ui_init( int *argc, char ***argv )
+{
+  return 0;
+}
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+void
+uidisplay_plot8( int x, int y, libspectrum_byte data, libspectrum_byte ink,
+                 libspectrum_byte paper )
+{
+  uiplot_bits_byte( &image[y][ 8 * x ], data, ink, paper );
+}
+
+void uidisplay_area( int x, int y, int w, int h ) {}
+void uidisplay_frame_end( void ) { frames_shown++; }
+void uidisplay_putpixel( int x, int y, int colour ) {}
+
+void
+uidisplay_plot16( int x, int y, libspectrum_word data, libspectrum_byte ink,
+                  libspectrum_byte paper )
+{
+}
+
+/* Dummy movie code */
+
+int movie_recording;
+
+void movie_start_frame( void ) {}
+void movie_add_area( int x, int y, int w, int h ) {}
+
+/* Dummy rectangle code */
+
+struct rectangle *rectangle_inactive;
+size_t rectangle_inactive_count, rectangle_inactive_allocated;
+
+void rectangle_add( int y, int x, int w ) {}
+void rectangle_end_line( int y ) {}
+
+/* Dummy SCLD code */
+
+libspectrum_byte hires_get_attr( void )
+{
+  return 0;
+}
+
+libspectrum_byte hires_convert_dec( libspectrum_byte attr )
+{
+  return 0;
+}
+
+/* Miscellaneous dummy code */
+
+settings_info settings_current;
+
+double timer_get_time( void )
+{
+  return compat_timer_get_time();
+}
+
+void startup_manager_register_no_dependencies(
+  startup_manager_module module, startup_manager_init_fn init_fn,
+  void *init_context, startup_manager_end_fn end_fn )
+{
+}
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# httpbench-server.py: local HTTPS stand-in server for unittests/httpbench
+#
+# Serves /index.txt and /file<N>.bin over HTTP/1.1 keep-alive with a
+# throwaway self-signed certificate (needs the openssl command).
+#
+# Usage: httpbench-server.py [port] [file size]
+
+import http.server
+import os
+import ssl
+import subprocess
+import sys
+import tempfile
+
+port = int(sys.argv[1]) if len(sys.argv) > 1 else 8443
+size = int(sys.argv[2]) if len(sys.argv) > 2 else 2048
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        name = self.path.lstrip("/")
+        if name == "index.txt":
+            body = "".join("file%d.bin %d\n" % (i, size) for i in range(100)).encode()
+        elif name.startswith("file") and name.endswith(".bin"):
+            body = b"x" * size
+        else:
+            self.send_error(404)
+            return
+        self.send_response(200)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+
+with tempfile.TemporaryDirectory() as tmp:
+    cert = os.path.join(tmp, "cert.pem")
+    key = os.path.join(tmp, "key.pem")
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes",
+                    "-subj", "/CN=localhost", "-days", "1",
+                    "-keyout", key, "-out", cert],
+                   check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    context.load_cert_chain(cert, key)
+
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", port), Handler)
+    server.socket = context.wrap_socket(server.socket, server_side=True)
+    print("httpbench-server: https://localhost:%d" % port)
+    server.serve_forever()
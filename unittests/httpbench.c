@@ -0,0 +1,131 @@
+/* httpbench.c: Benchmark for the HTTP connection pool
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Does what an HTTPS XFS mount does when a directory is listed and its
+   files opened: fetch index.txt, then N small files, and reports how many
+   connections and TLS handshakes that took. Run against
+   unittests/httpbench-server.py:
+
+     python3 unittests/httpbench-server.py 8443 &
+     unittests/httpbench https://localhost:8443 10
+
+   Pass -c to close every connection, as Fuse used to. */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../compat.h"
+#include "../peripherals/http/http_sck.h"
+#include "../ui/ui.h"
+
+/* Mocks for the Fuse functions used by the HTTP and compat code */
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+void
+fuse_abort( void )
+{
+  abort();
+}
+
+static int
+fetch( const char *base, const char *file )
+{
+  static char buffer[ 65536 ];
+  char url[ 512 ];
+  size_t length = sizeof( buffer );
+
+  snprintf( url, sizeof( url ), "%s/%s", base, file );
+  if( httpc_get_buffer( &tls_sck, url, buffer, &length ) != HTTPC_OK ) {
+    fprintf( stderr, "httpbench: failed to fetch %s\n", url );
+    return 1;
+  }
+
+  return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+  struct http_sck_stats_t stats;
+  const char *base;
+  double start, elapsed;
+  int c, i, files = 10, operations;
+
+  while( ( c = getopt( argc, argv, "c" ) ) != -1 ) {
+    switch( c ) {
+    case 'c': tls_sck.flags &= ~HTTPC_OPT_KEEP_ALIVE; break;
+    default:
+      fprintf( stderr, "usage: %s [-c] url [files]\n", argv[0] );
+      return 1;
+    }
+  }
+
+  if( optind >= argc ) {
+    fprintf( stderr, "usage: %s [-c] url [files]\n", argv[0] );
+    return 1;
+  }
+  base = argv[ optind ];
+  if( optind + 1 < argc ) files = atoi( argv[ optind + 1 ] );
+
+  tls_sck.flags &= ~HTTPC_OPT_LOGGING_ON;
+  http_sck_reset_stats();
+
+  start = compat_timer_get_time();
+
+  if( fetch( base, "index.txt" ) ) return 1;
+  for( i = 0; i < files; i++ ) {
+    char file[ 32 ];
+    snprintf( file, sizeof( file ), "file%d.bin", i );
+    if( fetch( base, file ) ) return 1;
+  }
+
+  elapsed = compat_timer_get_time() - start;
+  http_sck_get_stats( &stats );
+  http_sck_end();
+
+  operations = files + 1;
+  printf( "operations:      %d\n", operations );
+  printf( "connections:     %lu\n", stats.connects );
+  printf( "handshakes:      %lu (%lu resumed)\n", stats.handshakes,
+          stats.resumed );
+  printf( "reused:          %lu\n", stats.reused );
+  printf( "handshakes/op:   %.2f\n", (double)stats.handshakes / operations );
+  printf( "full hs/op:      %.2f\n",
+          (double)( stats.handshakes - stats.resumed ) / operations );
+  printf( "time/op:         %.2f ms\n", elapsed * 1000.0 / operations );
+
+  return 0;
+}
@@ -0,0 +1,276 @@
+/* jsonpathbench.c: Benchmark for the Spectranext JSONPath evaluators
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Builds an API response style document with the given number of records
+   and evaluates some typical enginecall paths over it, first with the
+   streaming matcher reading it in 16K chunks, then by parsing it into a
+   parson DOM and matching against that, checking that both find the same
+   values.
+   Usage: jsonpathbench [records] */
+
+#include <config.h>
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../peripherals/nic/engines/jsonpath/matcher.h"
+#include "../peripherals/nic/engines/jsonpath/stream.h"
+#include "../peripherals/nic/engines/parson.h"
+#include "../ui/ui.h"
+
+#define CHUNK 16384
+
+static const char * const paths[] = {
+  "$.items[*].id",
+  "$.items[*].name",
+  "$.items[*].tags[0]",
+  "$.total",
+};
+
+/* What each path matched: a count and a hash of the values */
+struct results {
+  unsigned long count[ ARRAY_SIZE( paths ) ];
+  uint32_t hash[ ARRAY_SIZE( paths ) ];
+};
+
+/* Mock for the Fuse function used by the timer code */
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+static size_t heap_current, heap_peak;
+
+/* parson allocator which tracks the size of the DOM */
+static void*
+counting_malloc( size_t size )
+{
+  size_t *block = malloc( sizeof( size_t ) + size );
+
+  if( !block ) return NULL;
+  *block = size;
+  heap_current += size;
+  if( heap_current > heap_peak ) heap_peak = heap_current;
+  return block + 1;
+}
+
+static void
+counting_free( void *ptr )
+{
+  size_t *block;
+
+  if( !ptr ) return;
+  block = (size_t*)ptr - 1;
+  heap_current -= *block;
+  free( block );
+}
+
+static uint32_t
+hash_string( uint32_t hash, const char *s )
+{
+  while( *s ) hash = hash * 31 + (unsigned char)*s++;
+  return hash * 31;
+}
+
+static void
+record( struct results *results, int path, const char *string, double number )
+{
+  uint32_t *hash = &results->hash[ path ];
+
+  results->count[ path ]++;
+  *hash = string ? hash_string( *hash, string ) : *hash * 31 + (uint32_t)number;
+}
+
+static char*
+make_document( unsigned long records, size_t *length )
+{
+  size_t capacity = 128 + records * 160;
+  char *document = malloc( capacity );
+  size_t used = 0;
+  unsigned long i;
+
+  if( !document ) return NULL;
+
+  used += sprintf( document + used, "{\"page\":1,\"items\":[" );
+  for( i = 0; i < records; i++ ) {
+    used += sprintf( document + used,
+                     "%s{\"id\":%lu,\"name\":\"record %lu\",\"score\":%lu.%02lu,"
+                     "\"active\":%s,\"tags\":[\"t%lu\",\"u%lu\"],"
+                     "\"owner\":{\"id\":%lu,\"email\":null}}",
+                     i ? "," : "", i, i, i % 100, i % 97,
+                     i & 1 ? "true" : "false", i % 7, i % 11, i % 13 );
+  }
+  used += sprintf( document + used, "],\"total\":%lu}", records );
+
+  *length = used;
+  return document;
+}
+
+struct dom_context {
+  struct results *results;
+  int path;
+};
+
+static void
+dom_match( JSON_Value *value, void *priv )
+{
+  struct dom_context *context = priv;
+
+  if( json_value_get_type( value ) == JSONString )
+    record( context->results, context->path, json_value_get_string( value ),
+            0 );
+  else
+    record( context->results, context->path, NULL,
+            json_value_get_number( value ) );
+}
+
+static int
+run_dom( const char *document, struct jp_state **states,
+         struct results *results )
+{
+  struct dom_context context = { results, 0 };
+  JSON_Value *root = json_parse_string( document );
+  size_t i;
+
+  if( !root ) return 1;
+
+  for( i = 0; i < ARRAY_SIZE( paths ); i++ ) {
+    context.path = i;
+    jp_match( states[i]->path, root, dom_match, &context );
+  }
+
+  json_value_free( root );
+  return 0;
+}
+
+struct stream_input {
+  const char *document;
+  size_t length;
+  size_t position;
+};
+
+static int
+stream_read( void *priv, char *buf, size_t len )
+{
+  struct stream_input *input = priv;
+  size_t remaining = input->length - input->position;
+
+  if( len > CHUNK ) len = CHUNK;
+  if( len > remaining ) len = remaining;
+  memcpy( buf, input->document + input->position, len );
+  input->position += len;
+  return len;
+}
+
+static void
+stream_match( int path, const struct jp_stream_value *value, void *priv )
+{
+  if( value->type == JP_STREAM_STRING )
+    record( priv, path, value->string, 0 );
+  else
+    record( priv, path, NULL, value->number );
+}
+
+static int
+run_stream( const char *document, size_t length, struct jp_opcode **ops,
+            struct results *results )
+{
+  struct stream_input input = { document, length, 0 };
+
+  return jp_stream_match( ops, ARRAY_SIZE( paths ), stream_read, &input,
+                          stream_match, results );
+}
+
+int
+main( int argc, char **argv )
+{
+  unsigned long records = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 100000;
+  struct jp_state *states[ ARRAY_SIZE( paths ) ];
+  struct jp_opcode *ops[ ARRAY_SIZE( paths ) ];
+  struct results dom_results, stream_results;
+  double start, dom_time, stream_time;
+  size_t length, i;
+  char *document;
+
+  document = make_document( records, &length );
+  if( !document ) {
+    fprintf( stderr, "%s: out of memory\n", argv[0] );
+    return 1;
+  }
+
+  for( i = 0; i < ARRAY_SIZE( paths ); i++ ) {
+    states[i] = jp_parse( paths[i] );
+    if( !states[i] || states[i]->error_code || !states[i]->path ||
+        !jp_stream_supported( states[i]->path ) ) {
+      fprintf( stderr, "%s: can't stream '%s'\n", argv[0], paths[i] );
+      return 1;
+    }
+    ops[i] = states[i]->path;
+  }
+
+  /* Stream first, as freeing a large DOM leaves the heap slow to work with */
+  memset( &stream_results, 0, sizeof( stream_results ) );
+  start = compat_timer_get_time();
+  if( run_stream( document, length, ops, &stream_results ) ) {
+    fprintf( stderr, "%s: streaming parse failed\n", argv[0] );
+    return 1;
+  }
+  stream_time = compat_timer_get_time() - start;
+
+  json_set_allocation_functions( counting_malloc, counting_free );
+
+  memset( &dom_results, 0, sizeof( dom_results ) );
+  start = compat_timer_get_time();
+  if( run_dom( document, states, &dom_results ) ) {
+    fprintf( stderr, "%s: DOM parse failed\n", argv[0] );
+    return 1;
+  }
+  dom_time = compat_timer_get_time() - start;
+
+  if( memcmp( &dom_results, &stream_results, sizeof( dom_results ) ) ) {
+    fprintf( stderr, "%s: results differ\n", argv[0] );
+    return 1;
+  }
+
+  printf( "%lu records, %lu KB, %lu matches\n", records,
+          (unsigned long)( length / 1024 ),
+          dom_results.count[0] + dom_results.count[1] + dom_results.count[2] +
+          dom_results.count[3] );
+  printf( "%-8s %10s %10s\n", "", "ms", "MB/s" );
+  printf( "%-8s %10.1f %10.1f  (DOM peak %lu KB)\n", "DOM", dom_time * 1000,
+          length / dom_time / 1e6, (unsigned long)( heap_peak / 1024 ) );
+  printf( "%-8s %10.1f %10.1f\n", "stream", stream_time * 1000,
+          length / stream_time / 1e6 );
+
+  for( i = 0; i < ARRAY_SIZE( paths ); i++ ) jp_free( states[i] );
+  free( document );
+
+  return 0;
+}
@@ -0,0 +1,438 @@
+/* periphbench.c: Microbenchmark for port decoding
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Activates the port responses of a 128K with a typical set of
+   interfaces attached and times loops of IN and OUT instructions through
+   periph.c's decode table against the walk over every active response
+   which it replaced, checking that both give the same results.
+   Usage: periphbench [accesses] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../debugger/debugger.h"
+#include "../event.h"
+#include "../machine.h"
+#include "../periph.h"
+#include "../peripherals/ula.h"
+#include "../rzx.h"
+#include "settings.h"
+#include "../ui/ui.h"
+
+/* Mocks for the Fuse functions used by periph.c */
+
+libspectrum_dword tstates;
+
+fuse_machine_info *machine_current;
+
+enum debugger_mode_t debugger_mode = DEBUGGER_MODE_INACTIVE;
+int rzx_playback = 0, rzx_recording = 0;
+libspectrum_rzx *rzx;
+int event_type_null;
+int ui_mouse_present = 0, ui_mouse_grabbed = 0;
+settings_info settings_current;
+
+int
+debugger_check( debugger_breakpoint_type type, libspectrum_dword value )
+{
+  return 0;
+}
+
+int
+debugger_event_register( const char *type, const char *detail )
+{
+  return 0;
+}
+
+void
+event_add_with_data( libspectrum_dword event_time, int type, void *user_data )
+{
+}
+
+int
+rzx_stop_playback( int add_interrupt )
+{
+  return 0;
+}
+
+int
+rzx_store_byte( libspectrum_byte value )
+{
+  return 0;
+}
+
+void
+ula_contend_port_early( libspectrum_word port )
+{
+}
+
+void
+ula_contend_port_late( libspectrum_word port )
+{
+}
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+int
+ui_menu_activate( ui_menu_item item, int active )
+{
+  return 0;
+}
+
+int
+ui_mouse_grab( int startup )
+{
+  return 0;
+}
+
+int
+ui_mouse_release( int suspend )
+{
+  return 0;
+}
+
+void
+if1_update_menu( void )
+{
+}
+
+void
+multiface_status_update( void )
+{
+}
+
+void
+specplus3_765_update_fdd( void )
+{
+}
+
+int
+machine_reset( int hard_reset )
+{
+  return 0;
+}
+
+static int
+memory_map( void )
+{
+  return 0;
+}
+
+static libspectrum_byte
+unattached_port( void )
+{
+  return 0xff;
+}
+
+/* The port handlers. Reads return something depending on the port but
+   leave the attached bits alone, so that the result is the AND of every
+   response whichever order they were activated in */
+
+static libspectrum_dword checksum;
+
+static libspectrum_byte
+read_port( libspectrum_word port, libspectrum_byte *attached GCC_UNUSED )
+{
+  return ~( port ^ ( port >> 8 ) );
+}
+
+static void
+write_port( libspectrum_word port, libspectrum_byte b )
+{
+  checksum = checksum * 31 + ( port ^ b );
+}
+
+static const periph_port_t ula_ports[] = {
+  { 0x0001, 0x0000, read_port, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t memory_ports[] = {
+  { 0x8002, 0x0000, NULL, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t ay_ports[] = {
+  { 0xc002, 0xc000, read_port, write_port },
+  { 0xc002, 0x8000, NULL, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t kempston_ports[] = {
+  { 0x00e0, 0x0000, read_port, NULL },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t mouse_ports[] = {
+  { 0x0121, 0x0001, read_port, NULL },
+  { 0x0521, 0x0101, read_port, NULL },
+  { 0x0521, 0x0501, read_port, NULL },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t divide_ports[] = {
+  { 0x00e3, 0x00a3, read_port, write_port },
+  { 0x00ff, 0x00e3, NULL, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t beta_ports[] = {
+  { 0x00ff, 0x001f, read_port, write_port },
+  { 0x00ff, 0x003f, read_port, write_port },
+  { 0x00ff, 0x005f, read_port, write_port },
+  { 0x00ff, 0x007f, read_port, write_port },
+  { 0x00ff, 0x00ff, read_port, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t multiface_ports[] = {
+  { 0x0072, 0x0032, read_port, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t specdrum_ports[] = {
+  { 0x00ff, 0x00df, NULL, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t zxatasp_ports[] = {
+  { 0x039f, 0x009f, read_port, write_port },
+  { 0x039f, 0x019f, read_port, write_port },
+  { 0x039f, 0x029f, read_port, write_port },
+  { 0x039f, 0x039f, read_port, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t simpleide_ports[] = {
+  { 0x0010, 0x0000, read_port, write_port },
+  { 0, 0, NULL, NULL }
+};
+
+static const struct {
+  periph_type type;
+  periph_t periph;
+} peripherals[] = {
+  { PERIPH_TYPE_ULA, { NULL, ula_ports, 0, NULL } },
+  { PERIPH_TYPE_128_MEMORY, { NULL, memory_ports, 0, NULL } },
+  { PERIPH_TYPE_AY, { NULL, ay_ports, 0, NULL } },
+  { PERIPH_TYPE_KEMPSTON, { NULL, kempston_ports, 0, NULL } },
+  { PERIPH_TYPE_KEMPSTON_MOUSE, { NULL, mouse_ports, 0, NULL } },
+  { PERIPH_TYPE_DIVIDE, { NULL, divide_ports, 0, NULL } },
+  { PERIPH_TYPE_BETA128, { NULL, beta_ports, 0, NULL } },
+  { PERIPH_TYPE_MULTIFACE_128, { NULL, multiface_ports, 0, NULL } },
+  { PERIPH_TYPE_SPECDRUM, { NULL, specdrum_ports, 0, NULL } },
+  { PERIPH_TYPE_ZXATASP, { NULL, zxatasp_ports, 0, NULL } },
+  { PERIPH_TYPE_SIMPLEIDE, { NULL, simpleide_ports, 0, NULL } },
+};
+
+/* The loops: keyboard and joystick polling, AY register streaming,
+   paging and border changes, and IDE data transfers */
+
+static const libspectrum_word in_ports[] = {
+  0xfefe, 0xfdfe, 0xfbfe, 0xf7fe, 0xeffe, 0xdffe, 0xbffe, 0x7ffe, 0x001f,
+  0xfffd, 0xfbdf, 0xffdf, 0x00a3, 0x00a3, 0x00a3, 0x009f,
+};
+
+static const libspectrum_word out_ports[] = {
+  0x00fe, 0xfffd, 0xbffd, 0xfffd, 0xbffd, 0x7ffd, 0x00df, 0x00a3, 0x00a3,
+  0x00e3, 0x00ff, 0x019f,
+};
+
+/* The previous implementation: a walk over every active response */
+
+static GSList *list;
+
+static void
+list_build( void )
+{
+  size_t i;
+  const periph_port_t *ptr;
+
+  for( i = 0; i < ARRAY_SIZE( peripherals ); i++ )
+    for( ptr = peripherals[i].periph.ports; ptr->mask != 0; ptr++ )
+      list = g_slist_append( list, (gpointer)ptr );
+}
+
+struct peripheral_data_t {
+  libspectrum_word port;
+  libspectrum_byte attached;
+  libspectrum_byte value;
+};
+
+static void
+list_read_peripheral( gpointer data, gpointer user_data )
+{
+  const periph_port_t *port = data;
+  struct peripheral_data_t *callback_info = user_data;
+  libspectrum_byte last_attached;
+
+  if( port->read &&
+      ( ( callback_info->port & port->mask ) == port->value ) ) {
+    last_attached = callback_info->attached;
+    callback_info->value &= (   port->read( callback_info->port,
+                                            &( callback_info->attached ) )
+                              | last_attached );
+  }
+}
+
+static libspectrum_byte
+list_readport( libspectrum_word port )
+{
+  struct peripheral_data_t callback_info;
+
+  callback_info.port = port;
+  callback_info.attached = 0x00;
+  callback_info.value = 0xff;
+
+  g_slist_foreach( list, list_read_peripheral, &callback_info );
+
+  if( callback_info.attached != 0xff )
+    callback_info.value =
+      periph_merge_floating_bus( callback_info.value, callback_info.attached,
+                                 machine_current->unattached_port() );
+
+  return callback_info.value;
+}
+
+static void
+list_write_peripheral( gpointer data, gpointer user_data )
+{
+  const periph_port_t *port = data;
+  struct peripheral_data_t *callback_info = user_data;
+
+  if( port->write &&
+      ( ( callback_info->port & port->mask ) == port->value ) )
+    port->write( callback_info->port, callback_info->value );
+}
+
+static void
+list_writeport( libspectrum_word port, libspectrum_byte b )
+{
+  struct peripheral_data_t callback_info;
+
+  callback_info.port = port;
+  callback_info.value = b;
+
+  g_slist_foreach( list, list_write_peripheral, &callback_info );
+}
+
+typedef libspectrum_byte (*read_fn)( libspectrum_word port );
+typedef void (*write_fn)( libspectrum_word port, libspectrum_byte b );
+
+static double
+run_in( read_fn read, unsigned long accesses )
+{
+  double start = compat_timer_get_time();
+  unsigned long i;
+
+  checksum = 0;
+  for( i = 0; i < accesses; i++ )
+    checksum = checksum * 31 + read( in_ports[ i % ARRAY_SIZE( in_ports ) ] );
+
+  return compat_timer_get_time() - start;
+}
+
+static double
+run_out( write_fn write, unsigned long accesses )
+{
+  double start = compat_timer_get_time();
+  unsigned long i;
+
+  checksum = 0;
+  for( i = 0; i < accesses; i++ )
+    write( out_ports[ i % ARRAY_SIZE( out_ports ) ], i );
+
+  return compat_timer_get_time() - start;
+}
+
+int
+main( int argc, char **argv )
+{
+  static fuse_machine_info machine;
+  unsigned long accesses = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 10000000;
+  libspectrum_dword list_checksum;
+  double list_time, table_time, build_time;
+  size_t i;
+  int port;
+
+  machine.memory_map = memory_map;
+  machine.unattached_port = unattached_port;
+  machine_current = &machine;
+
+  for( i = 0; i < ARRAY_SIZE( peripherals ); i++ ) {
+    periph_register( peripherals[i].type, &peripherals[i].periph );
+    periph_set_present( peripherals[i].type, PERIPH_PRESENT_ALWAYS );
+  }
+
+  build_time = compat_timer_get_time();
+  periph_update();
+  build_time = compat_timer_get_time() - build_time;
+
+  list_build();
+
+  for( port = 0; port < 0x10000; port++ ) {
+    if( list_readport( port ) != readport_internal( port ) ) {
+      fprintf( stderr, "%s: port 0x%04x reads differently\n", argv[0], port );
+      return 1;
+    }
+  }
+
+  printf( "decode table built in %.3f ms\n", build_time * 1e3 );
+  printf( "%8s %14s %14s %8s\n", "access", "list Macc/s", "table Macc/s",
+          "speedup" );
+
+  list_time = run_in( list_readport, accesses ); list_checksum = checksum;
+  table_time = run_in( readport_internal, accesses );
+  if( checksum != list_checksum ) {
+    fprintf( stderr, "%s: IN results differ\n", argv[0] );
+    return 1;
+  }
+  printf( "%8s %14.2f %14.2f %7.2fx\n", "IN", accesses / list_time / 1e6,
+          accesses / table_time / 1e6, list_time / table_time );
+
+  list_time = run_out( list_writeport, accesses ); list_checksum = checksum;
+  table_time = run_out( writeport_internal, accesses );
+  if( checksum != list_checksum ) {
+    fprintf( stderr, "%s: OUT results differ\n", argv[0] );
+    return 1;
+  }
+  printf( "%8s %14.2f %14.2f %7.2fx\n", "OUT", accesses / list_time / 1e6,
+          accesses / table_time / 1e6, list_time / table_time );
+
+  g_slist_free( list );
+  periph_end();
+
+  return 0;
+}
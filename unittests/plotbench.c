@@ -0,0 +1,296 @@
+/* plotbench.c: Benchmark for the UIs' pixel expansion and palette conversion
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Times the work the UIs do for a full screen redraw: plotting all 6144
+   bytes of the screen through the routines in ui/uiplot.h, and converting
+   the whole 320x240 frame of palette indices to 16 and 32-bit colours.
+   Each is compared with the bit-by-bit code the UIs used before, which
+   must give the same output. Usage: plotbench [frames] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../ui/ui.h"
+#include "../ui/uiplot.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+
+/* The Timex hi-res screen is twice the size */
+#define IMAGE_WIDTH ( 2 * WIDTH )
+#define IMAGE_HEIGHT ( 2 * HEIGHT )
+
+/* Mock for the Fuse function used by the timer */
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+static libspectrum_byte screen[ 192 ][ 32 ], ink[ 192 ][ 32 ],
+  paper[ 192 ][ 32 ];
+
+static libspectrum_byte image8[2][ IMAGE_HEIGHT ][ IMAGE_WIDTH ];
+static libspectrum_word image16[2][ IMAGE_HEIGHT ][ IMAGE_WIDTH ];
+static libspectrum_word rgb16[2][ HEIGHT ][ WIDTH ];
+static libspectrum_dword rgb32[2][ HEIGHT ][ WIDTH ];
+
+static libspectrum_word palette16[16];
+static libspectrum_dword palette32[16];
+
+static void
+make_screen( void )
+{
+  int x, y;
+
+  srand( 1 );
+
+  for( y = 0; y < 192; y++ )
+    for( x = 0; x < 32; x++ ) {
+      screen[y][x] = rand();
+      ink[y][x] = rand() % 16;
+      paper[y][x] = rand() % 16;
+    }
+
+  for( x = 0; x < 16; x++ ) {
+    palette16[x] = rand();
+    palette32[x] = (libspectrum_dword)rand() << 8 ^ rand();
+  }
+}
+
+/* The old code, one bit at a time */
+
+static void
+plot8_bits( libspectrum_byte *dest, libspectrum_byte data,
+            libspectrum_byte ink, libspectrum_byte paper )
+{
+  int i;
+
+  for( i = 0; i < 8; i++, data <<= 1 )
+    *dest++ = ( data & 0x80 ) ? ink : paper;
+}
+
+static void
+plot8_wide_bits( libspectrum_byte *dest, libspectrum_byte data,
+                 libspectrum_byte ink, libspectrum_byte paper )
+{
+  int i;
+
+  for( i = 0; i < 8; i++, data <<= 1 ) {
+    *dest++ = ( data & 0x80 ) ? ink : paper;
+    *dest++ = ( data & 0x80 ) ? ink : paper;
+  }
+}
+
+static void
+plot8_word_bits( libspectrum_word *dest, libspectrum_byte data,
+                 libspectrum_word ink, libspectrum_word paper )
+{
+  int i;
+
+  for( i = 0; i < 8; i++, data <<= 1 )
+    *dest++ = ( data & 0x80 ) ? ink : paper;
+}
+
+static void
+convert16_lookup( libspectrum_word *dest, const libspectrum_byte *src,
+                  const libspectrum_word *palette, size_t n )
+{
+  size_t i;
+
+  for( i = 0; i < n; i++ ) dest[i] = palette[ src[i] ];
+}
+
+static void
+convert32_lookup( libspectrum_dword *dest, const libspectrum_byte *src,
+                  const libspectrum_dword *palette, size_t n )
+{
+  size_t i;
+
+  for( i = 0; i < n; i++ ) dest[i] = palette[ src[i] ];
+}
+
+/* The redraws, each done with the old code (`which' is 0) or the new */
+
+static void
+redraw8( int which )
+{
+  int x, y;
+
+  for( y = 0; y < 192; y++ )
+    for( x = 0; x < 32; x++ ) {
+      libspectrum_byte *dest = &image8[ which ][ y + 24 ][ 8 * x + 32 ];
+
+      if( which ) {
+        uiplot_bits_byte( dest, screen[y][x], ink[y][x], paper[y][x] );
+      } else {
+        plot8_bits( dest, screen[y][x], ink[y][x], paper[y][x] );
+      }
+    }
+}
+
+static void
+redraw8_wide( int which )
+{
+  int x, y;
+
+  for( y = 0; y < 192; y++ )
+    for( x = 0; x < 32; x++ ) {
+      libspectrum_byte *dest = &image8[ which ][ 2 * y + 48 ][ 16 * x + 64 ];
+
+      if( which ) {
+        uiplot_bits_byte_wide( dest, screen[y][x], ink[y][x], paper[y][x] );
+        uiplot_bits_byte_wide( dest + IMAGE_WIDTH, screen[y][x], ink[y][x],
+                               paper[y][x] );
+      } else {
+        plot8_wide_bits( dest, screen[y][x], ink[y][x], paper[y][x] );
+        plot8_wide_bits( dest + IMAGE_WIDTH, screen[y][x], ink[y][x],
+                         paper[y][x] );
+      }
+    }
+}
+
+static void
+redraw16( int which )
+{
+  int x, y;
+
+  for( y = 0; y < 192; y++ )
+    for( x = 0; x < 32; x++ ) {
+      libspectrum_word *dest = &image16[ which ][ y + 24 ][ 8 * x + 32 ];
+      libspectrum_word i = palette16[ ink[y][x] ],
+                       p = palette16[ paper[y][x] ];
+
+      if( which ) {
+        uiplot_bits_word( dest, screen[y][x], i, p );
+      } else {
+        plot8_word_bits( dest, screen[y][x], i, p );
+      }
+    }
+}
+
+static void
+convert16( int which )
+{
+  int y;
+
+  for( y = 0; y < HEIGHT; y++ ) {
+    if( which ) {
+      uiplot_convert_word( rgb16[ which ][y], image8[0][y], palette16,
+                           WIDTH );
+    } else {
+      convert16_lookup( rgb16[ which ][y], image8[0][y], palette16, WIDTH );
+    }
+  }
+}
+
+static void
+convert32( int which )
+{
+  int y;
+
+  for( y = 0; y < HEIGHT; y++ ) {
+    if( which ) {
+      uiplot_convert_dword( rgb32[ which ][y], image8[0][y], palette32,
+                            WIDTH );
+    } else {
+      convert32_lookup( rgb32[ which ][y], image8[0][y], palette32, WIDTH );
+    }
+  }
+}
+
+/* Returns the us taken for each frame */
+static double
+time_redraw( void (*redraw)( int which ), int which, int frames )
+{
+  double start = compat_timer_get_time();
+  int i;
+
+  for( i = 0; i < frames; i++ ) redraw( which );
+
+  return ( compat_timer_get_time() - start ) * 1000000 / frames;
+}
+
+static int
+run( const char *name, void (*redraw)( int which ), const void *old,
+     const void *new, size_t size, int frames, double *total )
+{
+  double times[2];
+  int differ;
+
+  times[0] = time_redraw( redraw, 0, frames );
+  times[1] = time_redraw( redraw, 1, frames );
+
+  total[0] += times[0];
+  total[1] += times[1];
+
+  differ = memcmp( old, new, size );
+
+  printf( "%-22s %10.2f %10.2f %8.2fx%s\n", name, times[0], times[1],
+          times[0] / times[1], differ ? "  output differs" : "" );
+
+  return differ;
+}
+
+int
+main( int argc, char **argv )
+{
+  int frames = argc > 1 ? atoi( argv[1] ) : 1000;
+  double unused[2] = { 0, 0 }, total[2] = { 0, 0 };
+  int failed = 0;
+
+  if( frames <= 0 ) frames = 1;
+
+  make_screen();
+
+  printf( "Full screen redraw, %d frames, us per frame\n", frames );
+  printf( "%-22s %10s %10s %9s\n", "", "bits", "uiplot", "speedup" );
+
+  /* The palette index image plotted here is the one the conversions below
+     read, so it has to be done first */
+  failed |= run( "plot8 indices", redraw8, image8[0], image8[1],
+                 sizeof( image8[0] ), frames, total );
+  failed |= run( "convert to 32-bit", convert32, rgb32[0], rgb32[1],
+                 sizeof( rgb32[0] ), frames, total );
+
+  printf( "%-22s %10.2f %10.2f %8.2fx\n", "  gtk3 total", total[0],
+          total[1], total[0] / total[1] );
+
+  failed |= run( "convert to 16-bit", convert16, rgb16[0], rgb16[1],
+                 sizeof( rgb16[0] ), frames, unused );
+  failed |= run( "plot8 16-bit", redraw16, image16[0], image16[1],
+                 sizeof( image16[0] ), frames, unused );
+  failed |= run( "plot8 indices, Timex", redraw8_wide, image8[0], image8[1],
+                 sizeof( image8[0] ), frames, unused );
+
+  return failed;
+}
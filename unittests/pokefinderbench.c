@@ -0,0 +1,320 @@
+/* pokefinderbench.c: Microbenchmark for the poke finder
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Fills the RAM of a Pentagon 1024 with pseudo-random data and times a
+   sequence of searches which narrow it down, using pokefinder.c against
+   a byte at a time reference implementation, and checks that each of
+   pokefinder.c's engines which this CPU supports leaves the same
+   candidates as the reference. The times are for the engine pokefinder.c
+   picks for itself. Usage: pokefinderbench [rounds] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../machine.h"
+#include "../memory_pages.h"
+#include "../pokefinder/pokefinder.h"
+#include "../ui/ui.h"
+
+#define PAGES ( MEMORY_PAGES_IN_16K * SPECTRUM_RAM_PAGES )
+#define RAM_PAGES 64
+
+/* Helper functions from pokefinder.c */
+int pokefinder_engine_select( const char *name );
+const char *pokefinder_engine_name( void );
+
+/* Mocks for the Fuse functions used by pokefinder.c */
+
+memory_page memory_map_ram[ PAGES ];
+
+static fuse_machine_info machine;
+fuse_machine_info *machine_current = &machine;
+
+static libspectrum_byte ram[ RAM_PAGES * 0x4000 ];
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+/* The reference implementation, one byte at a time */
+
+static libspectrum_byte ref_possible[ PAGES ][ MEMORY_PAGE_SIZE ];
+static libspectrum_byte ref_impossible[ PAGES ][ MEMORY_PAGE_SIZE / 8 ];
+static size_t ref_count;
+
+typedef enum search_type {
+  SEARCH_CLEAR,
+  SEARCH_VALUE,
+  SEARCH_RANGE,
+  SEARCH_WORD,
+  SEARCH_INCREMENTED,
+  SEARCH_DECREMENTED,
+  SEARCH_CHANGED,
+  SEARCH_UNCHANGED,
+} search_type;
+
+static void
+ref_clear( void )
+{
+  size_t page;
+
+  ref_count = 0;
+  for( page = 0; page < PAGES; page++ )
+    if( page < MEMORY_PAGES_IN_16K * RAM_PAGES ) {
+      ref_count += MEMORY_PAGE_SIZE;
+      memcpy( ref_possible[page], memory_map_ram[page].page, MEMORY_PAGE_SIZE );
+      memset( ref_impossible[page], 0, MEMORY_PAGE_SIZE / 8 );
+    } else
+      memset( ref_impossible[page], 255, MEMORY_PAGE_SIZE / 8 );
+}
+
+static int
+ref_test( search_type type, size_t page, size_t offset, libspectrum_word low,
+          libspectrum_word high )
+{
+  libspectrum_byte value = memory_map_ram[page].page[offset];
+  libspectrum_byte previous = ref_possible[page][offset];
+
+  switch( type ) {
+  case SEARCH_VALUE: return value == low;
+  case SEARCH_RANGE: return value >= low && value <= high;
+  case SEARCH_WORD:
+    if( offset + 1 < MEMORY_PAGE_SIZE )
+      return value == ( low & 0xff ) &&
+             memory_map_ram[page].page[ offset + 1 ] == low >> 8;
+    return value == ( low & 0xff ) && ( page + 1 ) % MEMORY_PAGES_IN_16K &&
+           memory_map_ram[ page + 1 ].page[0] == low >> 8;
+  case SEARCH_INCREMENTED: return value > previous;
+  case SEARCH_DECREMENTED: return value < previous;
+  case SEARCH_CHANGED: return value != previous;
+  default: return value == previous;
+  }
+}
+
+static void
+ref_search( search_type type, libspectrum_word low, libspectrum_word high )
+{
+  size_t page, offset;
+
+  if( type == SEARCH_CLEAR ) {
+    ref_clear();
+    return;
+  }
+
+  for( page = 0; page < PAGES; page++ )
+    for( offset = 0; offset < MEMORY_PAGE_SIZE; offset++ ) {
+      if( ref_impossible[page][offset/8] & 1 << (offset & 7) ) continue;
+
+      if( ref_test( type, page, offset, low, high ) ) {
+        if( type >= SEARCH_INCREMENTED )
+          ref_possible[page][offset] = memory_map_ram[page].page[offset];
+      } else {
+        ref_impossible[page][offset/8] |= 1 << (offset & 7);
+        ref_count--;
+      }
+    }
+}
+
+static void
+search( search_type type, libspectrum_word low, libspectrum_word high )
+{
+  switch( type ) {
+  case SEARCH_CLEAR: pokefinder_clear(); break;
+  case SEARCH_VALUE: pokefinder_search( low ); break;
+  case SEARCH_RANGE: pokefinder_search_range( low, high ); break;
+  case SEARCH_WORD: pokefinder_search_word( low ); break;
+  case SEARCH_INCREMENTED: pokefinder_incremented(); break;
+  case SEARCH_DECREMENTED: pokefinder_decremented(); break;
+  case SEARCH_CHANGED: pokefinder_changed(); break;
+  case SEARCH_UNCHANGED: pokefinder_unchanged(); break;
+  }
+}
+
+/* The steps of a session: each search is made after the RAM has been
+   changed as described */
+
+typedef struct step_t {
+  const char *name;
+  search_type type;
+  libspectrum_word low, high;
+  int mutate;                   /* 0 = none, 1 = scramble, 2 = increment,
+                                   3 = decrement */
+} step_t;
+
+static const step_t steps[] = {
+  { "clear",       SEARCH_CLEAR,       0,      0,    0 },
+  { "unchanged",   SEARCH_UNCHANGED,   0,      0,    1 },
+  { "range",       SEARCH_RANGE,       0x20,   0xa0, 0 },
+  { "changed",     SEARCH_CHANGED,     0,      0,    1 },
+  { "incremented", SEARCH_INCREMENTED, 0,      0,    2 },
+  { "decremented", SEARCH_DECREMENTED, 0,      0,    3 },
+  { "value",       SEARCH_VALUE,       0x47,   0,    0 },
+  { "clear",       SEARCH_CLEAR,       0,      0,    0 },
+  { "word",        SEARCH_WORD,        0x5c47, 0,    0 },
+  { "value",       SEARCH_VALUE,       0x47,   0,    0 },
+};
+
+static unsigned long seed;
+
+static libspectrum_byte
+next_random( void )
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static void
+fill( void )
+{
+  size_t i;
+
+  seed = 1;
+  for( i = 0; i < sizeof( ram ); i++ ) ram[i] = next_random() & 0xbf;
+}
+
+/* Change RAM so each search type has something to find: every fourth
+   byte is altered */
+static void
+mutate( int how )
+{
+  size_t i;
+
+  for( i = 0; i < sizeof( ram ); i += 4 + ( next_random() & 3 ) ) {
+    switch( how ) {
+    case 1: ram[i] = next_random() & 0xbf; break;
+    case 2: ram[i]++; break;
+    case 3: ram[i]--; break;
+    }
+  }
+}
+
+static double
+run( int reference, unsigned long rounds, double *times )
+{
+  double total = 0;
+  unsigned long round;
+  size_t i;
+
+  for( i = 0; i < ARRAY_SIZE( steps ); i++ ) times[i] = 0;
+
+  for( round = 0; round < rounds; round++ ) {
+    fill();
+
+    for( i = 0; i < ARRAY_SIZE( steps ); i++ ) {
+      double start;
+
+      mutate( steps[i].mutate );
+
+      start = compat_timer_get_time();
+      if( reference )
+        ref_search( steps[i].type, steps[i].low, steps[i].high );
+      else
+        search( steps[i].type, steps[i].low, steps[i].high );
+      times[i] += compat_timer_get_time() - start;
+    }
+  }
+
+  for( i = 0; i < ARRAY_SIZE( steps ); i++ ) total += times[i];
+  return total;
+}
+
+/* Run the session once with both implementations, comparing them after
+   every step */
+static int
+check( void )
+{
+  size_t i;
+
+  fill();
+
+  for( i = 0; i < ARRAY_SIZE( steps ); i++ ) {
+    mutate( steps[i].mutate );
+    ref_search( steps[i].type, steps[i].low, steps[i].high );
+    search( steps[i].type, steps[i].low, steps[i].high );
+
+    if( ref_count != pokefinder_count ||
+        memcmp( ref_impossible, pokefinder_impossible,
+                sizeof( ref_impossible ) ) ) {
+      fprintf( stderr, "results differ after step %lu (%s): %lu != %lu\n",
+               (unsigned long)i, steps[i].name, (unsigned long)ref_count,
+               (unsigned long)pokefinder_count );
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+  unsigned long rounds = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 20;
+  double ref_times[ ARRAY_SIZE( steps ) ], times[ ARRAY_SIZE( steps ) ];
+  double ref_total, total;
+  size_t page, i;
+  const char *best;
+  static const char * const engines[] = { "scalar", "SSE2", "AVX2", "NEON" };
+
+  machine.ram.valid_pages = RAM_PAGES;
+  for( page = 0; page < MEMORY_PAGES_IN_16K * RAM_PAGES; page++ ) {
+    memory_map_ram[ page ].page = &ram[ page * MEMORY_PAGE_SIZE ];
+    memory_map_ram[ page ].writable = 1;
+  }
+
+  best = pokefinder_engine_name();
+
+  for( i = 0; i < ARRAY_SIZE( engines ); i++ ) {
+    if( pokefinder_engine_select( engines[i] ) ) continue;
+    if( check() ) {
+      fprintf( stderr, "with the %s engine\n", engines[i] );
+      return 1;
+    }
+    printf( "%s engine matches the reference\n", engines[i] );
+  }
+
+  pokefinder_engine_select( best );
+
+  ref_total = run( 1, rounds, ref_times );
+  total = run( 0, rounds, times );
+
+  printf( "%-12s %12s %9s ms %8s\n", "search", "bytes ms", best,
+          "speedup" );
+  for( i = 0; i < ARRAY_SIZE( steps ); i++ )
+    printf( "%-12s %12.3f %12.3f %7.2fx\n", steps[i].name,
+            ref_times[i] * 1000 / rounds, times[i] * 1000 / rounds,
+            ref_times[i] / times[i] );
+  printf( "%-12s %12.3f %12.3f %7.2fx\n", "total", ref_total * 1000 / rounds,
+          total * 1000 / rounds, ref_total / total );
+
+  return 0;
+}
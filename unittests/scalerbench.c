@@ -0,0 +1,228 @@
+/* scalerbench.c: Benchmark for the graphics scalers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Draws a screen of pseudo-random attribute cells and times every scaler
+   over the full 320x240 frame, in 16-bit and, where the UI has them, 32-bit
+   pixels, first with the scalar kernels from scaler_simd.c and then with
+   the fastest ones the CPU supports, checking that both give the same
+   output. Usage: scalerbench [frames] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../settings.h"
+#include "../ui/scaler/scaler.h"
+#include "../ui/scaler/scaler_simd.h"
+#include "../ui/ui.h"
+#include "../ui/uidisplay.h"
+#include "../utils.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+
+/* Room for the scalers which read around the area they scale */
+#define MARGIN 4
+
+#define SOURCE_WIDTH ( WIDTH + 2 * MARGIN )
+#define SOURCE_HEIGHT ( HEIGHT + 2 * MARGIN )
+
+/* Mocks for the Fuse functions used by the scalers */
+
+settings_info settings_current;
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+char*
+utils_safe_strdup( const char *src )
+{
+  return src ? strdup( src ) : NULL;
+}
+
+int
+uidisplay_hotswap_gfx_mode( void )
+{
+  return 0;
+}
+
+static const libspectrum_byte palette[16][3] = {
+  {   0,   0,   0 }, {   0,   0, 192 }, { 192,   0,   0 }, { 192,   0, 192 },
+  {   0, 192,   0 }, {   0, 192, 192 }, { 192, 192,   0 }, { 192, 192, 192 },
+  {   0,   0,   0 }, {   0,   0, 255 }, { 255,   0,   0 }, { 255,   0, 255 },
+  {   0, 255,   0 }, {   0, 255, 255 }, { 255, 255,   0 }, { 255, 255, 255 },
+};
+
+static libspectrum_word source16[ SOURCE_HEIGHT ][ SOURCE_WIDTH ];
+static libspectrum_dword source32[ SOURCE_HEIGHT ][ SOURCE_WIDTH ];
+
+/* A border around 8x8 cells of random ink and paper with random bits set */
+static void
+make_screen( void )
+{
+  static libspectrum_byte bitmap[192][32], ink[24][32], paper[24][32];
+  int x, y, colour;
+
+  srand( 1 );
+
+  for( y = 0; y < 24; y++ )
+    for( x = 0; x < 32; x++ ) {
+      ink[y][x] = rand() % 16;
+      paper[y][x] = ( ink[y][x] + 1 + rand() % 15 ) % 16;
+    }
+
+  for( y = 0; y < 192; y++ )
+    for( x = 0; x < 32; x++ )
+      bitmap[y][x] = rand();
+
+  for( y = 0; y < SOURCE_HEIGHT; y++ ) {
+    for( x = 0; x < SOURCE_WIDTH; x++ ) {
+      int sx = x - MARGIN - 32, sy = y - MARGIN - 24;
+
+      if( sx < 0 || sx >= 256 || sy < 0 || sy >= 192 ) {
+        colour = 5;
+      } else if( bitmap[ sy ][ sx / 8 ] & ( 0x80 >> ( sx % 8 ) ) ) {
+        colour = ink[ sy / 8 ][ sx / 8 ];
+      } else {
+        colour = paper[ sy / 8 ][ sx / 8 ];
+      }
+
+      source16[y][x] = ( palette[ colour ][0] >> 3 ) |
+                       ( palette[ colour ][1] >> 2 ) << 5 |
+                       ( palette[ colour ][2] >> 3 ) << 11;
+      source32[y][x] = palette[ colour ][0] | palette[ colour ][1] << 8 |
+                       palette[ colour ][2] << 16;
+    }
+  }
+}
+
+/* Scale the frame `frames' times, returning the ms taken for each and
+   leaving the last result in `dest' */
+static double
+time_scaler( ScalerProc *proc, const libspectrum_byte *source,
+             size_t pixel_size, libspectrum_byte *dest,
+             libspectrum_dword dest_pitch, int frames )
+{
+  double start = compat_timer_get_time();
+  int i;
+
+  for( i = 0; i < frames; i++ )
+    proc( source + ( MARGIN * SOURCE_WIDTH + MARGIN ) * pixel_size,
+          SOURCE_WIDTH * pixel_size, dest, dest_pitch, WIDTH, HEIGHT );
+
+  return ( compat_timer_get_time() - start ) * 1000 / frames;
+}
+
+/* Time one scaler in one pixel size with both sets of kernels; returns
+   non-zero if they gave different output */
+static int
+run( scaler_type scaler, ScalerProc *proc, const libspectrum_byte *source,
+     size_t pixel_size, scaler_simd_type simd, int frames, double *times )
+{
+  float factor = scaler_get_scaling_factor( scaler );
+  libspectrum_dword pitch = WIDTH * factor * pixel_size + 16;
+  size_t size = pitch * (size_t)( HEIGHT * factor );
+  libspectrum_byte *scalar_dest = calloc( size, 1 ),
+                   *simd_dest = calloc( size, 1 );
+  int differ;
+
+  if( !scalar_dest || !simd_dest ) {
+    fprintf( stderr, "out of memory\n" );
+    exit( 1 );
+  }
+
+  scaler_simd_select( SCALER_SIMD_SCALAR );
+  times[0] = time_scaler( proc, source, pixel_size, scalar_dest, pitch,
+                          frames );
+  scaler_simd_select( simd );
+  times[1] = time_scaler( proc, source, pixel_size, simd_dest, pitch,
+                          frames );
+
+  differ = memcmp( scalar_dest, simd_dest, size );
+
+  free( scalar_dest );
+  free( simd_dest );
+
+  return differ;
+}
+
+int
+main( int argc, char **argv )
+{
+  int frames = argc > 1 ? atoi( argv[1] ) : 100;
+  scaler_simd_type simd;
+  scaler_type scaler;
+  double times16[2], times32[2];
+  int failed = 0;
+
+  if( frames <= 0 ) frames = 1;
+
+  make_screen();
+  scaler_select_bitformat( 565 );
+
+  scaler_simd_init();
+  simd = scaler_simd_current();
+
+  printf( "%dx%d, %d frames, ms per frame, %s kernels\n", WIDTH, HEIGHT,
+          frames, scaler_simd_name( simd ) );
+  printf( "%-12s %10s %10s %10s %10s\n", "", "16 scalar", "16 simd",
+          "32 scalar", "32 simd" );
+
+  for( scaler = 0; scaler < SCALER_NUM; scaler++ ) {
+    ScalerProc *proc32 = scaler_get_proc32( scaler );
+    int differ;
+
+    differ = run( scaler, scaler_get_proc16( scaler ),
+                  (const libspectrum_byte*)source16, 2, simd, frames,
+                  times16 );
+
+    printf( "%-12s %10.3f %10.3f", scaler_id( scaler ), times16[0],
+            times16[1] );
+
+    if( proc32 ) {
+      differ |= run( scaler, proc32, (const libspectrum_byte*)source32, 4,
+                     simd, frames, times32 );
+      printf( " %10.3f %10.3f", times32[0], times32[1] );
+    } else {
+      printf( " %10s %10s", "-", "-" );
+    }
+
+    if( differ ) {
+      printf( "  output differs" );
+      failed = 1;
+    }
+    printf( "\n" );
+  }
+
+  return failed;
+}
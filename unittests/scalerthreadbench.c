@@ -0,0 +1,219 @@
+/* scalerthreadbench.c: Benchmark for running the scalers on several threads
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Draws a screen of pseudo-random attribute cells and times every scaler
+   over the full 320x240 frame in 16-bit pixels through scaler_run(), with
+   the number of scaler threads going up in powers of two from one to the
+   most scaler_run() will use, checking that the output is always the same
+   as calling the scaler directly. Usage: scalerthreadbench [frames] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../compat.h"
+#include "../settings.h"
+#include "../ui/scaler/scaler.h"
+#include "../ui/scaler/scaler_simd.h"
+#include "../ui/ui.h"
+#include "../ui/uidisplay.h"
+#include "../utils.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+
+/* Room for the scalers which read around the area they scale */
+#define MARGIN 4
+
+#define SOURCE_WIDTH ( WIDTH + 2 * MARGIN )
+#define SOURCE_HEIGHT ( HEIGHT + 2 * MARGIN )
+
+/* The thread counts to try: 1, 2, 4 and 8 */
+#define THREAD_STEPS 4
+
+/* Mocks for the Fuse functions used by the scalers */
+
+settings_info settings_current;
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+char*
+utils_safe_strdup( const char *src )
+{
+  return src ? strdup( src ) : NULL;
+}
+
+int
+uidisplay_hotswap_gfx_mode( void )
+{
+  return 0;
+}
+
+static const libspectrum_byte palette[16][3] = {
+  {   0,   0,   0 }, {   0,   0, 192 }, { 192,   0,   0 }, { 192,   0, 192 },
+  {   0, 192,   0 }, {   0, 192, 192 }, { 192, 192,   0 }, { 192, 192, 192 },
+  {   0,   0,   0 }, {   0,   0, 255 }, { 255,   0,   0 }, { 255,   0, 255 },
+  {   0, 255,   0 }, {   0, 255, 255 }, { 255, 255,   0 }, { 255, 255, 255 },
+};
+
+static libspectrum_word source[ SOURCE_HEIGHT ][ SOURCE_WIDTH ];
+
+/* A border around 8x8 cells of random ink and paper with random bits set */
+static void
+make_screen( void )
+{
+  static libspectrum_byte bitmap[192][32], ink[24][32], paper[24][32];
+  int x, y, colour;
+
+  srand( 1 );
+
+  for( y = 0; y < 24; y++ )
+    for( x = 0; x < 32; x++ ) {
+      ink[y][x] = rand() % 16;
+      paper[y][x] = ( ink[y][x] + 1 + rand() % 15 ) % 16;
+    }
+
+  for( y = 0; y < 192; y++ )
+    for( x = 0; x < 32; x++ )
+      bitmap[y][x] = rand();
+
+  for( y = 0; y < SOURCE_HEIGHT; y++ ) {
+    for( x = 0; x < SOURCE_WIDTH; x++ ) {
+      int sx = x - MARGIN - 32, sy = y - MARGIN - 24;
+
+      if( sx < 0 || sx >= 256 || sy < 0 || sy >= 192 ) {
+        colour = 5;
+      } else if( bitmap[ sy ][ sx / 8 ] & ( 0x80 >> ( sx % 8 ) ) ) {
+        colour = ink[ sy / 8 ][ sx / 8 ];
+      } else {
+        colour = paper[ sy / 8 ][ sx / 8 ];
+      }
+
+      source[y][x] = ( palette[ colour ][0] >> 3 ) |
+                     ( palette[ colour ][1] >> 2 ) << 5 |
+                     ( palette[ colour ][2] >> 3 ) << 11;
+    }
+  }
+}
+
+static const libspectrum_byte*
+source_start( void )
+{
+  return (const libspectrum_byte*)&source[ MARGIN ][ MARGIN ];
+}
+
+/* Scale the frame `frames' times on `threads' threads, returning the ms
+   taken for each and leaving the last result in `dest' */
+static double
+time_scaler( scaler_type scaler, int threads, libspectrum_byte *dest,
+             libspectrum_dword dest_pitch, int frames )
+{
+  ScalerProc *proc = scaler_get_proc16( scaler );
+  double start;
+  int i;
+
+  /* Restart the pool with the new number of threads */
+  settings_current.scaler_threads = threads;
+  scaler_threads_end();
+
+  start = compat_timer_get_time();
+
+  for( i = 0; i < frames; i++ )
+    scaler_run( scaler, proc, source_start(), sizeof( source[0] ), dest,
+                dest_pitch, WIDTH, HEIGHT );
+
+  return ( compat_timer_get_time() - start ) * 1000 / frames;
+}
+
+int
+main( int argc, char **argv )
+{
+  int frames = argc > 1 ? atoi( argv[1] ) : 100;
+  scaler_type scaler;
+  int failed = 0, step;
+
+  if( frames <= 0 ) frames = 1;
+
+  make_screen();
+  scaler_select_bitformat( 565 );
+  scaler_simd_init();
+
+  printf( "%dx%d, %d frames, ms per frame, %s kernels\n", WIDTH, HEIGHT,
+          frames, scaler_simd_name( scaler_simd_current() ) );
+  printf( "%-12s", "threads" );
+  for( step = 0; step < THREAD_STEPS; step++ )
+    printf( " %8d", 1 << step );
+  printf( " %8s\n", "speedup" );
+
+  for( scaler = 0; scaler < SCALER_NUM; scaler++ ) {
+    float factor = scaler_get_scaling_factor( scaler );
+    libspectrum_dword pitch = WIDTH * factor * 2 + 16;
+    size_t size = pitch * (size_t)( HEIGHT * factor );
+    libspectrum_byte *expected = calloc( size, 1 ),
+                     *dest = calloc( size, 1 );
+    double times[ THREAD_STEPS ];
+    int differ = 0;
+
+    if( !expected || !dest ) {
+      fprintf( stderr, "out of memory\n" );
+      return 1;
+    }
+
+    scaler_get_proc16( scaler )( source_start(), sizeof( source[0] ),
+                                 expected, pitch, WIDTH, HEIGHT );
+
+    printf( "%-12s", scaler_id( scaler ) );
+
+    for( step = 0; step < THREAD_STEPS; step++ ) {
+      memset( dest, 0, size );
+      times[ step ] = time_scaler( scaler, 1 << step, dest, pitch, frames );
+      printf( " %8.3f", times[ step ] );
+      if( memcmp( expected, dest, size ) ) differ = 1;
+    }
+
+    printf( " %7.2fx", times[0] / times[ THREAD_STEPS - 1 ] );
+
+    if( differ ) {
+      printf( "  output differs" );
+      failed = 1;
+    }
+    printf( "\n" );
+
+    free( expected );
+    free( dest );
+  }
+
+  scaler_threads_end();
+
+  return failed;
+}
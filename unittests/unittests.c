@@ -29,6 +29,8 @@
 #include "libspectrum.h"
 
 #include "debugger/debugger.h"
+#include "debugger/debugger_internals.h"
+#include "event.h"
 #include "fuse.h"
 #include "machine.h"
 #include "mempool.h"
@@ -50,6 +52,7 @@
 #include "peripherals/ttx2000s.h"
 #include "peripherals/ula.h"
 #include "peripherals/usource.h"
+#include "pokefinder/pokefinder.h"
 #include "settings.h"
 #include "bitmap.h"
 #include "rectangle.h"
@@ -260,6 +263,176 @@ floating_bus_merge_test( void )
   return 0;
 }
 
+/* A peripheral with overlapping port responses, modelled on the ULA, a
+   Kempston joystick, the AY, 128K paging and a fully decoded port, used to
+   check that the decode table dispatches exactly as a walk over the list of
+   responses would */
+
+static int periph_decode_test_writes[ 8 ];
+static size_t periph_decode_test_write_count;
+
+static void
+periph_decode_test_log( int id )
+{
+  if( periph_decode_test_write_count < ARRAY_SIZE( periph_decode_test_writes ) )
+    periph_decode_test_writes[ periph_decode_test_write_count ] = id;
+  periph_decode_test_write_count++;
+}
+
+static libspectrum_byte
+periph_decode_test_read_ula( libspectrum_word port, libspectrum_byte *attached )
+{
+  *attached |= 0xbf;
+  return 0xa0 | ( ( port >> 8 ) & 0x1f );
+}
+
+static libspectrum_byte
+periph_decode_test_read_joystick( libspectrum_word port,
+                                  libspectrum_byte *attached )
+{
+  *attached |= 0x1f;
+  return 0xe0 | ( ( port >> 3 ) & 0x1f );
+}
+
+static libspectrum_byte
+periph_decode_test_read_ay( libspectrum_word port, libspectrum_byte *attached )
+{
+  *attached = 0xff;
+  return port >> 8;
+}
+
+static libspectrum_byte
+periph_decode_test_read_full( libspectrum_word port GCC_UNUSED,
+                              libspectrum_byte *attached )
+{
+  *attached |= 0x0f;
+  return 0x3c;
+}
+
+static void
+periph_decode_test_write_ula( libspectrum_word port GCC_UNUSED,
+                              libspectrum_byte b GCC_UNUSED )
+{
+  periph_decode_test_log( 0 );
+}
+
+static void
+periph_decode_test_write_ay( libspectrum_word port GCC_UNUSED,
+                             libspectrum_byte b GCC_UNUSED )
+{
+  periph_decode_test_log( 2 );
+}
+
+static void
+periph_decode_test_write_paging( libspectrum_word port GCC_UNUSED,
+                                 libspectrum_byte b GCC_UNUSED )
+{
+  periph_decode_test_log( 3 );
+}
+
+static void
+periph_decode_test_write_full( libspectrum_word port GCC_UNUSED,
+                               libspectrum_byte b GCC_UNUSED )
+{
+  periph_decode_test_log( 4 );
+}
+
+static const periph_port_t periph_decode_test_ports[] = {
+  { 0x0001, 0x0000, periph_decode_test_read_ula, periph_decode_test_write_ula },
+  { 0x00e0, 0x0000, periph_decode_test_read_joystick, NULL },
+  { 0xc002, 0xc000, periph_decode_test_read_ay, periph_decode_test_write_ay },
+  { 0x8002, 0x0000, NULL, periph_decode_test_write_paging },
+  { 0xffff, 0xfffd, periph_decode_test_read_full, periph_decode_test_write_full },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_t periph_decode_test_periph = {
+  /* .option = */ NULL,
+  /* .ports = */ periph_decode_test_ports,
+  /* .hard_reset = */ 0,
+  /* .activate = */ NULL,
+};
+
+/* What readport_internal() returned before the decode table: every matching
+   response in list order, then the floating bus */
+static libspectrum_byte
+periph_decode_test_walk( libspectrum_word port, int active )
+{
+  const periph_port_t *response;
+  libspectrum_byte attached = 0x00, last_attached, value = 0xff;
+
+  for( response = periph_decode_test_ports; active && response->mask;
+       response++ ) {
+    if( ( port & response->mask ) == response->value && response->read ) {
+      last_attached = attached;
+      value &= ( response->read( port, &attached ) | last_attached );
+    }
+  }
+
+  if( attached != 0xff )
+    value = periph_merge_floating_bus( value, attached,
+                                       machine_current->unattached_port() );
+
+  return value;
+}
+
+static int
+periph_decode_test_check( int active )
+{
+  const periph_port_t *response;
+  int expected[ 8 ];
+  size_t count;
+  libspectrum_dword port;
+
+  for( port = 0; port < 0x10000; port++ ) {
+    TEST_ASSERT( readport_internal( port ) ==
+                 periph_decode_test_walk( port, active ) );
+
+    count = 0;
+    for( response = periph_decode_test_ports; active && response->mask;
+         response++ ) {
+      if( ( port & response->mask ) == response->value && response->write )
+        expected[ count++ ] = response - periph_decode_test_ports;
+    }
+
+    periph_decode_test_write_count = 0;
+    writeport_internal( port, 0x42 );
+    TEST_ASSERT( periph_decode_test_write_count == count );
+    TEST_ASSERT( !memcmp( periph_decode_test_writes, expected,
+                          count * sizeof( *expected ) ) );
+  }
+
+  return 0;
+}
+
+static int
+periph_decode_test( void )
+{
+  int r = 0;
+
+  periph_register( PERIPH_TYPE_UNKNOWN, &periph_decode_test_periph );
+  periph_clear();
+
+  /* With nothing active, every read is the floating bus */
+  r += periph_decode_test_check( 0 );
+
+  /* Each change to the active ports must be seen on the next access */
+  periph_activate_type( PERIPH_TYPE_UNKNOWN, 1 );
+  r += periph_decode_test_check( 1 );
+
+  periph_activate_type( PERIPH_TYPE_UNKNOWN, 0 );
+  r += periph_decode_test_check( 0 );
+
+  periph_activate_type( PERIPH_TYPE_UNKNOWN, 1 );
+  r += periph_decode_test_check( 1 );
+
+  /* Put the machine's own peripherals back */
+  periph_clear();
+  if( machine_reset( 0 ) ) r++;
+
+  return r;
+}
+
 static int
 bitmap_ops_test( void )
 {
@@ -350,6 +523,94 @@ utils_safe_strdup_test( void )
   return 0;
 }
 
+struct event_test_t {
+  int count;
+  libspectrum_dword last;
+  int ordered;
+};
+
+static int event_test_type = -1;
+
+static void
+event_test_check( gpointer data, gpointer user_data )
+{
+  event_t *event = data;
+  struct event_test_t *state = user_data;
+
+  if( event->type != event_test_type ) return;
+
+  if( state->count && event->tstates < state->last ) state->ordered = 0;
+  state->last = event->tstates;
+  state->count++;
+}
+
+static void
+event_test_count_breakpoints( gpointer data, gpointer user_data )
+{
+  event_t *event = data;
+  int *count = user_data;
+
+  if( event->type == debugger_breakpoint_event ) (*count)++;
+}
+
+static int
+event_test( void )
+{
+  struct event_test_t state;
+  libspectrum_dword i;
+  debugger_breakpoint *bp;
+  int breakpoint_events;
+
+  if( event_test_type == -1 )
+    event_test_type = event_register( NULL, "Unit test" );
+
+  /* Far enough ahead not to fire while the tests run */
+  for( i = 0; i < 100; i++ )
+    event_add_with_data( 0x80000000 + ( i * 7919 ) % 1000, event_test_type,
+                         GINT_TO_POINTER( i % 2 ) );
+
+  state.count = 0; state.ordered = 1;
+  event_foreach( event_test_check, &state );
+  TEST_ASSERT( state.count == 100 );
+  TEST_ASSERT( state.ordered );
+
+  /* Removal takes the events out of the queue */
+  event_remove_type_user_data( event_test_type, GINT_TO_POINTER( 1 ) );
+  state.count = 0; state.ordered = 1;
+  event_foreach( event_test_check, &state );
+  TEST_ASSERT( state.count == 50 );
+  TEST_ASSERT( state.ordered );
+
+  event_remove_type( event_test_type );
+  state.count = 0;
+  event_foreach( event_test_check, &state );
+  TEST_ASSERT( state.count == 0 );
+
+  /* Removing a time breakpoint takes its event out of the queue, leaving
+     the other events at the same time alone */
+  for( i = 0; i < 20; i++ )
+    event_add( 0x80000000 + i % 2, event_test_type );
+  TEST_ASSERT( debugger_breakpoint_add_time( DEBUGGER_BREAKPOINT_TYPE_TIME,
+                                             0x80000000, 0,
+                                             DEBUGGER_BREAKPOINT_LIFE_PERMANENT,
+                                             NULL ) == 0 );
+  bp = g_slist_last( debugger_breakpoints )->data;
+  TEST_ASSERT( debugger_breakpoint_remove( bp->id ) == 0 );
+
+  breakpoint_events = 0;
+  event_foreach( event_test_count_breakpoints, &breakpoint_events );
+  TEST_ASSERT( breakpoint_events == 0 );
+
+  state.count = 0; state.ordered = 1;
+  event_foreach( event_test_check, &state );
+  TEST_ASSERT( state.count == 20 );
+  TEST_ASSERT( state.ordered );
+
+  event_remove_type( event_test_type );
+
+  return 0;
+}
+
 static int
 mempool_test( void )
 {
@@ -1090,11 +1351,16 @@ unittests_run( void )
   r += contention_test();
   r += floating_bus_test();
   r += floating_bus_merge_test();
+  r += periph_decode_test();
   r += utils_safe_strdup_test();
   r += bitmap_ops_test();
   r += mempool_test();
+  r += pokefinder_unittest();
+  r += event_test();
   r += paging_test();
+  r += debugger_breakpoint_unittest();
   r += debugger_disassemble_unittest();
+  r += debugger_expression_unittest();
   r += rectangle_test();
 
   printf("Final return value: %d (should be 0)\n", r);
@@ -0,0 +1,419 @@
+/* w5100bench.c: Throughput benchmark for the W5100 buffers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Connects a W5100 socket to a TCP echo server on the loopback interface
+   and sends data through it as Spectranet code would, polling the socket
+   registers and copying each chunk in and out of the buffers. The copies
+   are made a byte at a time through the W5100 register window, as they
+   were before the buffers were mapped into memory, and then directly
+   through the buffers.
+
+   Then, with the other three sockets open but idle, measures the latency
+   from a byte being sent to the W5100 socket over the loopback interface
+   to the I/O thread reporting it in Sn_RX_RSR.
+   Usage: w5100bench [kilobytes] [packets] */
+
+#include <config.h>
+
+#include <libspectrum.h>
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "../compat.h"
+#include "../peripherals/nic/dns_resolver.h"
+#include "../peripherals/nic/w5100.h"
+#include "../peripherals/security/tls.h"
+#include "../ui/ui.h"
+
+#define CHUNK 1024
+
+/* Mocks for the Fuse functions used by the W5100 code; nothing here
+   connects to port 443, so TLS is never used */
+
+int
+ui_error( ui_error_level severity, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  return 0;
+}
+
+void
+fuse_abort( void )
+{
+  abort();
+}
+
+void
+utils_networking_init( void )
+{
+  compat_socket_networking_init();
+}
+
+char*
+dns_resolve_hostname( uint32_t ipv4 )
+{
+  return NULL;
+}
+
+void
+dns_answers_process_udp( const uint8_t *buf, uint16_t len )
+{
+}
+
+tls_socket_t*
+tls_socket_alloc( compat_socket_t fd, const char *hostname )
+{
+  return NULL;
+}
+
+void tls_socket_free( tls_socket_t *tls ) {}
+int tls_connect( tls_socket_t *tls ) { return -1; }
+void tls_close( tls_socket_t *tls ) {}
+
+ssize_t
+tls_read( tls_socket_t *tls, void *buf, size_t len )
+{
+  return -1;
+}
+
+ssize_t
+tls_write( tls_socket_t *tls, const void *buf, size_t len )
+{
+  return -1;
+}
+
+/* The echo server */
+
+static int listen_fd;
+
+static void*
+echo_server( void *arg )
+{
+  char buffer[ 4096 ];
+  int fd;
+  ssize_t length;
+
+  while( ( fd = accept( listen_fd, NULL, NULL ) ) != -1 ) {
+    while( ( length = recv( fd, buffer, sizeof( buffer ), 0 ) ) > 0 )
+      if( send( fd, buffer, length, 0 ) != length ) break;
+    close( fd );
+  }
+
+  return NULL;
+}
+
+/* Open a listening socket on the loopback interface, returning its port */
+static int
+start_listening( int *fd )
+{
+  struct sockaddr_in sa;
+  socklen_t length = sizeof( sa );
+
+  *fd = socket( AF_INET, SOCK_STREAM, 0 );
+  memset( &sa, 0, sizeof( sa ) );
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+  if( *fd == -1 ||
+      bind( *fd, (struct sockaddr*)&sa, sizeof( sa ) ) == -1 ||
+      listen( *fd, 1 ) == -1 ||
+      getsockname( *fd, (struct sockaddr*)&sa, &length ) == -1 ) {
+    perror( "w5100bench: listening" );
+    return -1;
+  }
+
+  return ntohs( sa.sin_port );
+}
+
+static int
+start_echo_server( void )
+{
+  pthread_t thread;
+  int port = start_listening( &listen_fd );
+
+  if( port != -1 && pthread_create( &thread, NULL, echo_server, NULL ) ) {
+    fprintf( stderr, "w5100bench: couldn't start echo server\n" );
+    return -1;
+  }
+
+  return port;
+}
+
+/* Socket 0's registers and buffers */
+
+enum {
+  S0_MR = 0x400, S0_CR = 0x401, S0_SR = 0x403,
+  S0_DIPR0 = 0x40c, S0_DPORT0 = 0x410,
+  S0_TX_FSR0 = 0x420, S0_TX_WR0 = 0x424,
+  S0_RX_RSR0 = 0x426, S0_RX_RD0 = 0x428,
+  S0_TX_BUFFER = 0x4000, S0_RX_BUFFER = 0x6000,
+};
+
+static nic_w5100_t *w5100;
+
+static libspectrum_word
+read_word( libspectrum_word reg )
+{
+  return nic_w5100_read( w5100, reg ) << 8 | nic_w5100_read( w5100, reg + 1 );
+}
+
+static void
+write_word( libspectrum_word reg, libspectrum_word value )
+{
+  nic_w5100_write( w5100, reg, value >> 8 );
+  nic_w5100_write( w5100, reg + 1, value & 0xff );
+}
+
+static int
+connect_socket( int port )
+{
+  nic_w5100_write( w5100, S0_MR, 0x21 );        /* TCP */
+  nic_w5100_write( w5100, S0_CR, 0x01 );        /* OPEN */
+  nic_w5100_write( w5100, S0_DIPR0, 127 );
+  nic_w5100_write( w5100, S0_DIPR0 + 1, 0 );
+  nic_w5100_write( w5100, S0_DIPR0 + 2, 0 );
+  nic_w5100_write( w5100, S0_DIPR0 + 3, 1 );
+  write_word( S0_DPORT0, port );
+  nic_w5100_write( w5100, S0_CR, 0x04 );        /* CONNECT */
+
+  return nic_w5100_read( w5100, S0_SR ) != 0x17;
+}
+
+static void
+close_socket( void )
+{
+  nic_w5100_write( w5100, S0_CR, 0x10 );        /* CLOSE */
+}
+
+/* Open sockets 1 to 3 as UDP sockets which never receive anything */
+static void
+open_idle_sockets( int open )
+{
+  libspectrum_word base;
+
+  for( base = 0x500; base < 0x800; base += 0x100 ) {
+    if( open ) {
+      nic_w5100_write( w5100, base + ( S0_MR - 0x400 ), 0x02 );   /* UDP */
+      nic_w5100_write( w5100, base + ( S0_CR - 0x400 ), 0x01 );   /* OPEN */
+      write_word( base + 4, 0 );                                  /* Sn_PORT */
+    }
+    else
+      nic_w5100_write( w5100, base + ( S0_CR - 0x400 ), 0x10 );   /* CLOSE */
+  }
+}
+
+/* Send kilobytes of data through the echo server, returning the time
+   taken and the part of it spent copying to and from the buffers */
+static int
+run( int direct, unsigned long kilobytes, double *total, double *copying )
+{
+  libspectrum_byte *tx = nic_w5100_buffer( w5100, S0_TX_BUFFER );
+  libspectrum_byte *rx = nic_w5100_buffer( w5100, S0_RX_BUFFER );
+  unsigned long chunk;
+  libspectrum_byte next_sent = 0, next_received = 0;
+  double start = compat_timer_get_time();
+
+  *copying = 0;
+
+  for( chunk = 0; chunk < kilobytes; chunk++ ) {
+    libspectrum_word tx_wr, rx_rd, rsr;
+    size_t i, received = 0;
+    double copy_start;
+
+    while( read_word( S0_TX_FSR0 ) < CHUNK )
+      ;
+
+    tx_wr = read_word( S0_TX_WR0 );
+    copy_start = compat_timer_get_time();
+    for( i = 0; i < CHUNK; i++ ) {
+      libspectrum_word offset = ( tx_wr + i ) & 0x7ff;
+      if( direct )
+        tx[ offset ] = next_sent++;
+      else
+        nic_w5100_write( w5100, S0_TX_BUFFER + offset, next_sent++ );
+    }
+    *copying += compat_timer_get_time() - copy_start;
+    write_word( S0_TX_WR0, tx_wr + CHUNK );
+    nic_w5100_write( w5100, S0_CR, 0x20 );      /* SEND */
+
+    while( received < CHUNK ) {
+      while( !( rsr = read_word( S0_RX_RSR0 ) ) )
+        ;
+
+      rx_rd = read_word( S0_RX_RD0 );
+      copy_start = compat_timer_get_time();
+      for( i = 0; i < rsr; i++ ) {
+        libspectrum_word offset = ( rx_rd + i ) & 0x7ff;
+        libspectrum_byte b = direct ?
+          rx[ offset ] : nic_w5100_read( w5100, S0_RX_BUFFER + offset );
+        if( b != next_received++ ) {
+          fprintf( stderr, "w5100bench: wrong data echoed\n" );
+          return 1;
+        }
+      }
+      *copying += compat_timer_get_time() - copy_start;
+      write_word( S0_RX_RD0, rx_rd + rsr );
+      nic_w5100_write( w5100, S0_CR, 0x40 );    /* RECV */
+      received += rsr;
+    }
+  }
+
+  *total = compat_timer_get_time() - start;
+
+  return 0;
+}
+
+static double
+now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+compare_doubles( const void *a, const void *b )
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Send single bytes to socket 0 from a peer on the loopback interface,
+   timing how long each takes to appear in Sn_RX_RSR */
+static int
+measure_latency( unsigned long packets )
+{
+  double *latencies = libspectrum_new( double, packets );
+  int peer_listen_fd, peer_fd, port;
+  unsigned long i;
+
+  port = start_listening( &peer_listen_fd );
+  if( port == -1 ) return 1;
+
+  open_idle_sockets( 1 );
+
+  if( connect_socket( port ) ) {
+    fprintf( stderr, "w5100bench: couldn't connect to peer\n" );
+    return 1;
+  }
+
+  peer_fd = accept( peer_listen_fd, NULL, NULL );
+  if( peer_fd == -1 ) {
+    perror( "w5100bench: accepting connection" );
+    return 1;
+  }
+
+  for( i = 0; i < packets; i++ ) {
+    libspectrum_byte b = i;
+    libspectrum_word rx_rd;
+    double start;
+
+    start = now();
+    if( send( peer_fd, &b, 1, 0 ) != 1 ) {
+      perror( "w5100bench: sending" );
+      return 1;
+    }
+    while( !read_word( S0_RX_RSR0 ) )
+      ;
+    latencies[i] = now() - start;
+
+    rx_rd = read_word( S0_RX_RD0 );
+    if( nic_w5100_buffer( w5100, S0_RX_BUFFER )[ rx_rd & 0x7ff ] != b ) {
+      fprintf( stderr, "w5100bench: wrong data received\n" );
+      return 1;
+    }
+    write_word( S0_RX_RD0, rx_rd + 1 );
+    nic_w5100_write( w5100, S0_CR, 0x40 );      /* RECV */
+  }
+
+  qsort( latencies, packets, sizeof( *latencies ), compare_doubles );
+
+  printf( "\n%-10s %10s %10s %10s\n", "latency", "median us", "p99 us",
+          "max us" );
+  printf( "%-10s %10.2f %10.2f %10.2f\n", "loopback",
+          latencies[ packets / 2 ] * 1e6,
+          latencies[ packets - 1 - packets / 100 ] * 1e6,
+          latencies[ packets - 1 ] * 1e6 );
+
+  close_socket();
+  open_idle_sockets( 0 );
+  close( peer_fd );
+  close( peer_listen_fd );
+  libspectrum_free( latencies );
+
+  return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+  unsigned long kilobytes = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 8192;
+  unsigned long packets = argc > 2 ? strtoul( argv[2], NULL, 10 ) : 20000;
+  int port, direct;
+
+  port = start_echo_server();
+  if( port == -1 ) return 1;
+
+  w5100 = nic_w5100_alloc();
+  if( nic_w5100_enable( w5100 ) ) {
+    fprintf( stderr, "w5100bench: couldn't start W5100 I/O thread\n" );
+    return 1;
+  }
+
+  printf( "%-10s %10s %14s\n", "access", "MB/s", "copy ns/byte" );
+
+  for( direct = 0; direct < 2; direct++ ) {
+    double total, copying;
+
+    if( connect_socket( port ) ) {
+      fprintf( stderr, "w5100bench: couldn't connect to echo server\n" );
+      return 1;
+    }
+
+    if( run( direct, kilobytes, &total, &copying ) ) return 1;
+
+    printf( "%-10s %10.2f %14.2f\n", direct ? "direct" : "register",
+            kilobytes / 1024.0 / total,
+            copying * 1e9 / ( 2.0 * kilobytes * CHUNK ) );
+
+    close_socket();
+  }
+
+  if( packets && measure_latency( packets ) ) return 1;
+
+  nic_w5100_free( w5100 );
+
+  return 0;
+}
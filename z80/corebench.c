@@ -0,0 +1,514 @@
+/* corebench.c: Benchmark for Fuse's Z80 core
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Runs a fixed set of instruction mixes, each for the same number of
+   emulated tstates, and reports the emulated speed, the host time per
+   instruction and how many instructions came from each opcode table.
+   Usage: corebench [-c] [tstates]
+
+   -c gives comma-separated output with a header line, for comparing runs
+   from scripts */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compat.h"
+#include "fuse.h"
+#include "machine.h"
+#include "peripherals/disk/beta.h"
+#include "peripherals/disk/didaktik.h"
+#include "peripherals/disk/disciple.h"
+#include "peripherals/disk/opus.h"
+#include "peripherals/disk/plusd.h"
+#include "peripherals/if1.h"
+#include "peripherals/multiface.h"
+#include "peripherals/sound/uspeech.h"
+#include "peripherals/spectranet.h"
+#include "peripherals/usource.h"
+#include "settings.h"
+#include "spectrum.h"
+#include "z80.h"
+#include "z80_macros.h"
+#include "coretest_dummies.h"
+
+/* 48K timings */
+#define FRAME_LENGTH 69888
+#define LINE_LENGTH 224
+#define FIRST_CONTENDED 14335
+
+#define DEFAULT_BUDGET 100000000
+
+libspectrum_dword tstates;
+libspectrum_dword event_next_event;
+
+/* 64Kb of RAM */
+static libspectrum_byte memory[ 0x10000 ];
+
+/* Extra tstates for an access to contended memory at each point in the
+   frame, following the 48K's 6,5,4,3,2,1,0,0 pattern; with room for an
+   instruction to overrun the end of the frame */
+static libspectrum_byte contention[ FRAME_LENGTH + 64 ];
+
+/* Which 16Kb pages are contended */
+static int contended[4];
+
+/* The opcode tables an instruction can come from */
+typedef enum opcode_table {
+  TABLE_BASE,
+  TABLE_CB,
+  TABLE_ED,
+  TABLE_DDFD,
+  TABLE_DDFDCB,
+
+  TABLE_COUNT
+} opcode_table;
+
+static const char * const table_names[] = {
+  "base", "cb", "ed", "ddfd", "ddfdcb"
+};
+
+/* Opcode fetches are the only calls to readbyte_internal(), so following
+   the prefixes through them tells us which table each instruction used */
+static enum {
+  FETCH_OPCODE,
+  FETCH_CB,
+  FETCH_ED,
+  FETCH_DDFD,
+  FETCH_DDFDCB_DISPLACEMENT,
+  FETCH_DDFDCB_OPCODE,
+} fetch_state;
+
+static unsigned long instructions[ TABLE_COUNT ];
+
+/* An instruction mix: a loop which starts at 0x8000 */
+typedef struct mix_t {
+  const char *name;
+  const libspectrum_byte *code;
+  size_t length;
+
+  /* Run with all of memory contended */
+  int contended;
+
+  /* Enable every peripheral which traps on the program counter */
+  int peripherals;
+
+  /* Interrupt every this many tstates; 0 for no interrupts */
+  libspectrum_dword interrupt_period;
+} mix_t;
+
+/* Loads, arithmetic and jumps from the base table:
+
+   8000 F3          DI
+   8001 21 00 90    LD HL,0x9000
+   8004 06 00       LD B,0x00
+   8006 7E          LD A,(HL)
+   8007 81          ADD A,C
+   8008 77          LD (HL),A
+   8009 23          INC HL
+   800A 4F          LD C,A
+   800B E6 0F       AND 0x0f
+   800D 20 01       JR NZ,0x8010
+   800F 3C          INC A
+   8010 10 F4       DJNZ 0x8006
+   8012 18 ED       JR 0x8001 */
+static const libspectrum_byte code_base[] = {
+  0xf3, 0x21, 0x00, 0x90, 0x06, 0x00, 0x7e, 0x81, 0x77, 0x23, 0x4f, 0xe6,
+  0x0f, 0x20, 0x01, 0x3c, 0x10, 0xf4, 0x18, 0xed,
+};
+
+/* Rotates, shifts and bit operations:
+
+   8000 F3          DI
+   8001 21 00 90    LD HL,0x9000
+   8004 06 00       LD B,0x00
+   8006 CB 01       RLC C
+   8008 CB 3A       SRL D
+   800A CB 5B       BIT 3,E
+   800C CB CF       SET 1,A
+   800E CB 97       RES 2,A
+   8010 CB 16       RL (HL)
+   8012 CB 7E       BIT 7,(HL)
+   8014 10 F0       DJNZ 0x8006
+   8016 18 E9       JR 0x8001 */
+static const libspectrum_byte code_cb[] = {
+  0xf3, 0x21, 0x00, 0x90, 0x06, 0x00, 0xcb, 0x01, 0xcb, 0x3a, 0xcb, 0x5b,
+  0xcb, 0xcf, 0xcb, 0x97, 0xcb, 0x16, 0xcb, 0x7e, 0x10, 0xf0, 0x18, 0xe9,
+};
+
+/* 16-bit arithmetic and other ED instructions:
+
+   8000 F3          DI
+   8001 21 00 90    LD HL,0x9000
+   8004 11 34 12    LD DE,0x1234
+   8007 06 00       LD B,0x00
+   8009 ED 5A       ADC HL,DE
+   800B ED 52       SBC HL,DE
+   800D ED 44       NEG
+   800F ED 57       LD A,I
+   8011 ED 6F       RLD
+   8013 ED 5B 00 90 LD DE,(0x9000)
+   8017 10 F0       DJNZ 0x8009
+   8019 18 E6       JR 0x8001 */
+static const libspectrum_byte code_ed[] = {
+  0xf3, 0x21, 0x00, 0x90, 0x11, 0x34, 0x12, 0x06, 0x00, 0xed, 0x5a, 0xed,
+  0x52, 0xed, 0x44, 0xed, 0x57, 0xed, 0x6f, 0xed, 0x5b, 0x00, 0x90, 0x10,
+  0xf0, 0x18, 0xe6,
+};
+
+/* IX and IY:
+
+   8000 F3          DI
+   8001 DD 21 00 90 LD IX,0x9000
+   8005 FD 21 00 A0 LD IY,0xa000
+   8009 06 00       LD B,0x00
+   800B DD 7E 01    LD A,(IX+1)
+   800E FD 86 02    ADD A,(IY+2)
+   8011 DD 77 03    LD (IX+3),A
+   8014 FD 77 04    LD (IY+4),A
+   8017 DD 23       INC IX
+   8019 FD 2B       DEC IY
+   801B DD 7C       LD A,IXH
+   801D FD 85       ADD A,IYL
+   801F 10 EA       DJNZ 0x800b
+   8021 18 DE       JR 0x8001 */
+static const libspectrum_byte code_index[] = {
+  0xf3, 0xdd, 0x21, 0x00, 0x90, 0xfd, 0x21, 0x00, 0xa0, 0x06, 0x00, 0xdd,
+  0x7e, 0x01, 0xfd, 0x86, 0x02, 0xdd, 0x77, 0x03, 0xfd, 0x77, 0x04, 0xdd,
+  0x23, 0xfd, 0x2b, 0xdd, 0x7c, 0xfd, 0x85, 0x10, 0xea, 0x18, 0xde,
+};
+
+/* Bit operations on (IX+d) and (IY+d):
+
+   8000 F3          DI
+   8001 DD 21 00 90 LD IX,0x9000
+   8005 FD 21 00 A0 LD IY,0xa000
+   8009 06 00       LD B,0x00
+   800B DD CB 01 46 BIT 0,(IX+1)
+   800F FD CB 02 CE SET 1,(IY+2)
+   8013 DD CB 03 06 RLC (IX+3)
+   8017 FD CB 04 BE RES 7,(IY+4)
+   801B DD CB 05 16 RL (IX+5)
+   801F 10 EA       DJNZ 0x800b
+   8021 18 DE       JR 0x8001 */
+static const libspectrum_byte code_index_cb[] = {
+  0xf3, 0xdd, 0x21, 0x00, 0x90, 0xfd, 0x21, 0x00, 0xa0, 0x06, 0x00, 0xdd,
+  0xcb, 0x01, 0x46, 0xfd, 0xcb, 0x02, 0xce, 0xdd, 0xcb, 0x03, 0x06, 0xfd,
+  0xcb, 0x04, 0xbe, 0xdd, 0xcb, 0x05, 0x16, 0x10, 0xea, 0x18, 0xde,
+};
+
+/* Block copies and searches:
+
+   8000 F3          DI
+   8001 21 00 90    LD HL,0x9000
+   8004 11 00 A0    LD DE,0xa000
+   8007 01 00 04    LD BC,0x0400
+   800A ED B0       LDIR
+   800C 21 00 90    LD HL,0x9000
+   800F 01 00 04    LD BC,0x0400
+   8012 3E 55       LD A,0x55
+   8014 ED B1       CPIR
+   8016 21 FF 93    LD HL,0x93ff
+   8019 11 FF A3    LD DE,0xa3ff
+   801C 01 00 04    LD BC,0x0400
+   801F ED B8       LDDR
+   8021 18 DE       JR 0x8001 */
+static const libspectrum_byte code_block[] = {
+  0xf3, 0x21, 0x00, 0x90, 0x11, 0x00, 0xa0, 0x01, 0x00, 0x04, 0xed, 0xb0,
+  0x21, 0x00, 0x90, 0x01, 0x00, 0x04, 0x3e, 0x55, 0xed, 0xb1, 0x21, 0xff,
+  0x93, 0x11, 0xff, 0xa3, 0x01, 0x00, 0x04, 0xed, 0xb8, 0x18, 0xde,
+};
+
+/* A tight loop to be interrupted:
+
+   8000 ED 56       IM 1
+   8002 31 00 C0    LD SP,0xc000
+   8005 FB          EI
+   8006 3C          INC A
+   8007 80          ADD A,B
+   8008 18 FC       JR 0x8006 */
+static const libspectrum_byte code_interrupt[] = {
+  0xed, 0x56, 0x31, 0x00, 0xc0, 0xfb, 0x3c, 0x80, 0x18, 0xfc,
+};
+
+/* and its IM 1 handler:
+
+   0038 D9          EXX
+   0039 23          INC HL
+   003A D9          EXX
+   003B FB          EI
+   003C ED 4D       RETI */
+static const libspectrum_byte code_interrupt_handler[] = {
+  0xd9, 0x23, 0xd9, 0xfb, 0xed, 0x4d,
+};
+
+static const mix_t mixes[] = {
+  { "base", code_base, sizeof( code_base ), 0, 0, 0 },
+  { "cb", code_cb, sizeof( code_cb ), 0, 0, 0 },
+  { "ed", code_ed, sizeof( code_ed ), 0, 0, 0 },
+  { "index", code_index, sizeof( code_index ), 0, 0, 0 },
+  { "index_cb", code_index_cb, sizeof( code_index_cb ), 0, 0, 0 },
+  { "block", code_block, sizeof( code_block ), 0, 0, 0 },
+  { "base_contended", code_base, sizeof( code_base ), 1, 0, 0 },
+  { "block_contended", code_block, sizeof( code_block ), 1, 0, 0 },
+  { "interrupt", code_interrupt, sizeof( code_interrupt ), 0, 0,
+    LINE_LENGTH },
+  { "peripherals", code_base, sizeof( code_base ), 0, 1, 0 },
+};
+
+static inline void
+contend( libspectrum_word address )
+{
+  if( contended[ address >> 14 ] ) tstates += contention[ tstates ];
+}
+
+libspectrum_byte
+readbyte( libspectrum_word address )
+{
+  contend( address );
+  tstates += 3;
+  return memory[ address ];
+}
+
+libspectrum_byte
+readbyte_internal( libspectrum_word address )
+{
+  libspectrum_byte opcode = memory[ address ];
+
+  switch( fetch_state ) {
+
+  case FETCH_OPCODE:
+    switch( opcode ) {
+    case 0xcb: fetch_state = FETCH_CB; break;
+    case 0xed: fetch_state = FETCH_ED; break;
+    case 0xdd: case 0xfd: fetch_state = FETCH_DDFD; break;
+    default: instructions[ TABLE_BASE ]++; break;
+    }
+    break;
+
+  case FETCH_CB:
+    instructions[ TABLE_CB ]++; fetch_state = FETCH_OPCODE;
+    break;
+
+  case FETCH_ED:
+    instructions[ TABLE_ED ]++; fetch_state = FETCH_OPCODE;
+    break;
+
+  case FETCH_DDFD:
+    if( opcode == 0xcb ) {
+      fetch_state = FETCH_DDFDCB_DISPLACEMENT;
+    } else {
+      instructions[ TABLE_DDFD ]++; fetch_state = FETCH_OPCODE;
+    }
+    break;
+
+  case FETCH_DDFDCB_DISPLACEMENT:
+    fetch_state = FETCH_DDFDCB_OPCODE;
+    break;
+
+  case FETCH_DDFDCB_OPCODE:
+    instructions[ TABLE_DDFDCB ]++; fetch_state = FETCH_OPCODE;
+    break;
+
+  }
+
+  return opcode;
+}
+
+void
+writebyte( libspectrum_word address, libspectrum_byte b )
+{
+  contend( address );
+  tstates += 3;
+  memory[ address ] = b;
+}
+
+void
+writebyte_internal( libspectrum_word address, libspectrum_byte b )
+{
+  memory[ address ] = b;
+}
+
+void
+contend_read( libspectrum_word address, libspectrum_dword time )
+{
+  contend( address );
+  tstates += time;
+}
+
+void
+contend_read_no_mreq( libspectrum_word address, libspectrum_dword time )
+{
+  contend_read( address, time );
+}
+
+void
+contend_write_no_mreq( libspectrum_word address, libspectrum_dword time )
+{
+  contend( address );
+  tstates += time;
+}
+
+libspectrum_byte
+readport( libspectrum_word port )
+{
+  tstates += 4;
+  return port >> 8;
+}
+
+void
+writeport( libspectrum_word port GCC_UNUSED, libspectrum_byte b GCC_UNUSED )
+{
+  tstates += 4;
+}
+
+static void
+init_contention( void )
+{
+  static const libspectrum_byte pattern[] = { 6, 5, 4, 3, 2, 1, 0, 0 };
+  int line, x;
+
+  for( line = 0; line < 192; line++ )
+    for( x = 0; x < 128; x++ )
+      contention[ FIRST_CONTENDED + line * LINE_LENGTH + x ] = pattern[ x % 8 ];
+}
+
+static void
+set_peripherals( int enabled )
+{
+  beta_available = enabled;
+  plusd_available = enabled;
+  didaktik80_available = enabled;
+  disciple_available = enabled;
+  usource_available = enabled;
+  uspeech_available = enabled;
+  multiface_activated = enabled;
+  if1_available = enabled;
+  settings_current.divide_enabled = enabled;
+  settings_current.divmmc_enabled = enabled;
+  settings_current.spectranet_disable = 0;
+  spectranet_available = enabled;
+  spectranet_programmable_trap_active = enabled;
+  spectranet_programmable_trap = 0x0100;
+  opus_available = enabled;
+  didaktik80_snap = enabled;
+}
+
+/* Returns the time in seconds taken to run the mix for the given number
+   of tstates */
+static double
+run( const mix_t *mix, libspectrum_qword budget )
+{
+  libspectrum_dword period =
+    mix->interrupt_period ? mix->interrupt_period : FRAME_LENGTH;
+  libspectrum_qword done;
+  double start;
+  int i;
+
+  set_peripherals( mix->peripherals );
+  for( i = 0; i < 4; i++ ) contended[i] = mix->contended;
+
+  z80_reset( 1 );
+  memset( memory, 0, sizeof( memory ) );
+  memcpy( &memory[ 0x0038 ], code_interrupt_handler,
+          sizeof( code_interrupt_handler ) );
+  memcpy( &memory[ 0x8000 ], mix->code, mix->length );
+  PC = 0x8000;
+
+  tstates = 0;
+  fetch_state = FETCH_OPCODE;
+  memset( instructions, 0, sizeof( instructions ) );
+
+  start = compat_timer_get_time();
+
+  for( done = 0; done < budget; done += period ) {
+    if( mix->interrupt_period ) z80_interrupt();
+
+    event_next_event = period;
+    z80_do_opcodes();
+
+    /* Carry any overrun into the next period, as at the end of a frame */
+    tstates -= period;
+    if( z80.interrupts_enabled_at >= 0 )
+      z80.interrupts_enabled_at -= period;
+  }
+
+  return compat_timer_get_time() - start;
+}
+
+int
+main( int argc, char **argv )
+{
+  libspectrum_qword budget = DEFAULT_BUDGET;
+  int csv = 0;
+  size_t i, j;
+
+  for( i = 1; i < (size_t)argc; i++ ) {
+    if( !strcmp( argv[i], "-c" ) ) {
+      csv = 1;
+    } else {
+      budget = strtoull( argv[i], NULL, 10 );
+      if( !budget ) {
+        fprintf( stderr, "Usage: %s [-c] [tstates]\n", argv[0] );
+        return 1;
+      }
+    }
+  }
+
+  if( coretest_init_dummies( memory ) ) return 1;
+
+  /* /INT is held low for 32 tstates, as on the 48K */
+  machine_current->timings.interrupt_length = 32;
+
+  z80_init( NULL );
+  init_contention();
+
+  if( csv ) {
+    printf( "mix,tstates,seconds,mhz,instructions,ns_per_instruction" );
+    for( j = 0; j < TABLE_COUNT; j++ ) printf( ",%s", table_names[j] );
+  } else {
+    printf( "%-16s %9s %9s %12s", "mix", "MHz", "ns/instr", "instructions" );
+    for( j = 0; j < TABLE_COUNT; j++ ) printf( " %7s", table_names[j] );
+  }
+  printf( "\n" );
+
+  for( i = 0; i < ARRAY_SIZE( mixes ); i++ ) {
+    const mix_t *mix = &mixes[i];
+    double elapsed = run( mix, budget );
+    unsigned long total = 0;
+
+    for( j = 0; j < TABLE_COUNT; j++ ) total += instructions[j];
+
+    if( csv ) {
+      printf( "%s,%llu,%.6f,%.3f,%lu,%.4f", mix->name,
+              (unsigned long long)budget, elapsed, budget / elapsed / 1e6,
+              total, elapsed * 1e9 / total );
+      for( j = 0; j < TABLE_COUNT; j++ ) printf( ",%lu", instructions[j] );
+    } else {
+      printf( "%-16s %9.2f %9.3f %12lu", mix->name, budget / elapsed / 1e6,
+              elapsed * 1e9 / total, total );
+      for( j = 0; j < TABLE_COUNT; j++ )
+        printf( " %6.1f%%", 100.0 * instructions[j] / total );
+    }
+    printf( "\n" );
+  }
+
+  return 0;
+}
@@ -52,12 +52,11 @@
 #include "ui/ui.h"
 #include "z80.h"
 #include "z80_macros.h"
+#include "coretest_dummies.h"
 
 static const char *progname;		/* argv[0] */
 static const char *testsfile;		/* argv[1] */
 
-static int init_dummies( void );
-
 libspectrum_dword tstates;
 libspectrum_dword event_next_event;
 
@@ -90,7 +89,7 @@ main( int argc, char **argv )
 
   testsfile = argv[1];
 
-  if( init_dummies() ) return 1;
+  if( coretest_init_dummies( memory ) ) return 1;
 
   /* Initialise the tables used by the Z80 core */
   z80_init( NULL );
@@ -350,352 +349,3 @@ dump_memory_state( void )
     printf( "-1\n" );
   }
 }
-
-/* Error 'handing': dump core as these should never be called */
-
-void
-fuse_abort( void )
-{
-  abort();
-}
-
-int
-ui_error( ui_error_level severity GCC_UNUSED, const char *format, ... )
-{
-  va_list ap;
-
-  va_start( ap, format );
-  vfprintf( stderr, format, ap );
-  va_end( ap );
-
-  abort();
-}
-
-/*
- * Stuff below here not interesting: dummy functions and variables to replace
- * things used by Fuse, but not by the core test code
- */
-
-#include "debugger/debugger.h"
-#include "machine.h"
-#include "peripherals/scld.h"
-#include "settings.h"
-
-libspectrum_byte *slt[256];
-size_t slt_length[256];
-
-int
-tape_load_trap( void )
-{
-  /* Should never be called */
-  abort();
-}
-
-int
-tape_save_trap( void )
-{
-  /* Should never be called */
-  abort();
-}
-
-scld scld_last_dec;
-
-size_t rzx_instruction_count;
-int rzx_playback;
-int rzx_instructions_offset;
-
-enum debugger_mode_t debugger_mode;
-
-libspectrum_byte **ROM = NULL;
-memory_page memory_map[8];
-memory_page *memory_map_home[MEMORY_PAGES_IN_64K];
-memory_page memory_map_rom[SPECTRUM_ROM_PAGES * MEMORY_PAGES_IN_16K];
-int memory_contended[8] = { 1 };
-libspectrum_byte spectrum_contention[ 80000 ] = { 0 };
-int profile_active = 0;
-
-void
-profile_map( libspectrum_word pc GCC_UNUSED )
-{
-  abort();
-}
-
-int
-debugger_check( debugger_breakpoint_type type GCC_UNUSED, libspectrum_dword value GCC_UNUSED )
-{
-  abort();
-}
-
-void debugger_system_variable_register(
-  const char *type, const char *detail,
-  debugger_get_system_variable_fn_t get,
-  debugger_set_system_variable_fn_t set )
-{
-}
-
-int
-debugger_trap( void )
-{
-  abort();
-}
-
-int
-is_debugger_enabled( void )
-{
-  return 0;
-}
-
-uint32_t
-debugger_track_tstates( void )
-{
-  static libspectrum_dword last_tstates;
-  uint32_t diff = (uint32_t)( tstates - last_tstates );
-  last_tstates = tstates;
-  return diff;
-}
-
-int
-slt_trap( libspectrum_word address GCC_UNUSED, libspectrum_byte level GCC_UNUSED )
-{
-  return 0;
-}
-
-int beta_available = 0;
-int beta_active = 0;
-int if1_available = 0;
-
-void
-beta_page( void )
-{
-  abort();
-}
-
-void
-beta_unpage( void )
-{
-  abort();
-}
-
-int spectrum_frame_event = 0;
-
-int
-event_register( event_fn_t fn GCC_UNUSED, const char *string GCC_UNUSED )
-{
-  return 0;
-}
-
-int opus_available = 0;
-int opus_active = 0;
-
-void
-opus_page( void )
-{
-  abort();
-}
-
-void
-opus_unpage( void )
-{
-  abort();
-}
-
-int plusd_available = 0;
-int plusd_active = 0;
-
-void
-plusd_page( void )
-{
-  abort();
-}
-
-int disciple_available = 0;
-int disciple_active = 0;
-
-void
-disciple_page( void )
-{
-  abort();
-}
-
-int didaktik80_available = 0;
-int didaktik80_active = 0;
-int didaktik80_snap = 0;
-
-void
-didaktik80_page( void )
-{
-  abort();
-}
-
-void
-didaktik80_unpage( void )
-{
-  abort();
-}
-
-int usource_available = 0;
-int usource_active = 0;
-
-void
-usource_toggle( void )
-{
-  abort();
-}
-
-int uspeech_available = 0;
-int uspeech_active = 0;
-
-void
-uspeech_toggle( void )
-{
-  abort();
-}
-
-void
-if1_page( void )
-{
-  abort();
-}
-
-void
-if1_unpage( void )
-{
-  abort();
-}
-
-int multiface_activated = 0;
-
-void
-multiface_setic8( void )
-{
-  abort();
-}
-
-void
-divide_set_automap( int state GCC_UNUSED )
-{
-  abort();
-}
-
-void
-divmmc_set_automap( int state GCC_UNUSED )
-{
-  abort();
-}
-
-int spectranet_available = 0;
-
-void
-spectranet_page( int via_io GCC_UNUSED )
-{
-  abort();
-}
-
-void
-spectranet_nmi( void )
-{
-  abort();
-}
-
-void
-spectranet_unpage( void )
-{
-  abort();
-}
-
-void
-spectranet_retn( void )
-{
-}
-
-int
-spectranet_nmi_flipflop( void )
-{
-  return 0;
-}
-
-void
-startup_manager_register( startup_manager_module module,
-  startup_manager_module *dependencies, size_t dependency_count,
-  startup_manager_init_fn init_fn, void *init_context,
-  startup_manager_end_fn end_fn )
-{
-}
-
-int svg_capture_active = 0;     /* SVG capture enabled? */
-
-void
-svg_capture( void )
-{
-  abort();
-}
-
-int
-rzx_frame( void )
-{
-  abort();
-}
-
-void
-writeport_internal( libspectrum_word port GCC_UNUSED, libspectrum_byte b GCC_UNUSED )
-{
-  abort();
-}
-
-void
-event_add_with_data( libspectrum_dword event_time GCC_UNUSED,
-		     int type GCC_UNUSED, void *user_data GCC_UNUSED )
-{
-  /* Do nothing */
-}
-
-int
-module_register( module_info_t *module GCC_UNUSED )
-{
-  return 0;
-}
-
-void
-z80_debugger_variables_init( void )
-{
-}
-
-fuse_machine_info *machine_current;
-static fuse_machine_info dummy_machine;
-
-settings_info settings_current;
-
-libspectrum_word beta_pc_mask;
-libspectrum_word beta_pc_value;
-
-int spectranet_programmable_trap_active;
-libspectrum_word spectranet_programmable_trap;
-
-/* Initialise the dummy variables such that we're running on a clean a
-   machine as possible */
-static int
-init_dummies( void )
-{
-  size_t i;
-
-  for( i = 0; i < 8; i++ ) {
-    memory_map[i].page = &memory[ i * MEMORY_PAGE_SIZE ];
-  }
-
-  debugger_mode = DEBUGGER_MODE_INACTIVE;
-  dummy_machine.capabilities = 0;
-  dummy_machine.ram.current_rom = 0;
-  machine_current = &dummy_machine;
-  rzx_playback = 0;
-  scld_last_dec.name.intdisable = 0;
-  settings_current.slt_traps = 0;
-  settings_current.divide_enabled = 0;
-  settings_current.divmmc_enabled = 0;
-  settings_current.z80_is_cmos = 0;
-  beta_pc_mask = 0xfe00;
-  beta_pc_value = 0x3c00;
-  spectranet_programmable_trap_active = 0;
-  spectranet_programmable_trap = 0x0000;
-
-  return 0;
-}
@@ -0,0 +1,414 @@
+/* coretest_dummies.c: Dummy Fuse functions and variables for the Z80 core
+                       test and benchmark programs
+   Copyright (c) 2003-2017 Philip Kendall
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: philip-fuse@shadowmagic.org.uk
+
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fuse.h"
+#include "peripherals/disk/beta.h"
+#include "peripherals/disk/didaktik.h"
+#include "peripherals/disk/disciple.h"
+#include "peripherals/disk/opus.h"
+#include "peripherals/disk/plusd.h"
+#include "peripherals/ide/divide.h"
+#include "peripherals/ide/divmmc.h"
+#include "peripherals/if1.h"
+#include "peripherals/spectranet.h"
+#include "peripherals/ula.h"
+#include "peripherals/usource.h"
+#include "profile.h"
+#include "rzx.h"
+#include "slt.h"
+#include "tape.h"
+
+#include "event.h"
+#include "infrastructure/startup_manager.h"
+#include "module.h"
+#include "spectrum.h"
+#include "ui/ui.h"
+#include "z80.h"
+#include "z80_macros.h"
+#include "coretest_dummies.h"
+
+/* Error 'handing': dump core as these should never be called */
+
+void
+fuse_abort( void )
+{
+  abort();
+}
+
+int
+ui_error( ui_error_level severity GCC_UNUSED, const char *format, ... )
+{
+  va_list ap;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+
+  abort();
+}
+
+/*
+ * Stuff below here not interesting: dummy functions and variables to replace
+ * things used by Fuse, but not by the core test code
+ */
+
+#include "debugger/debugger.h"
+#include "machine.h"
+#include "peripherals/scld.h"
+#include "settings.h"
+
+libspectrum_byte *slt[256];
+size_t slt_length[256];
+
+int
+tape_load_trap( void )
+{
+  /* Should never be called */
+  abort();
+}
+
+int
+tape_save_trap( void )
+{
+  /* Should never be called */
+  abort();
+}
+
+scld scld_last_dec;
+
+size_t rzx_instruction_count;
+int rzx_playback;
+int rzx_instructions_offset;
+
+enum debugger_mode_t debugger_mode;
+
+libspectrum_byte **ROM = NULL;
+memory_page memory_map[8];
+memory_page *memory_map_home[MEMORY_PAGES_IN_64K];
+memory_page memory_map_rom[SPECTRUM_ROM_PAGES * MEMORY_PAGES_IN_16K];
+int memory_contended[8] = { 1 };
+libspectrum_byte spectrum_contention[ 80000 ] = { 0 };
+int profile_active = 0;
+
+void
+profile_map( libspectrum_word pc GCC_UNUSED )
+{
+  abort();
+}
+
+int
+debugger_check( debugger_breakpoint_type type GCC_UNUSED, libspectrum_dword value GCC_UNUSED )
+{
+  abort();
+}
+
+void debugger_system_variable_register(
+  const char *type, const char *detail,
+  debugger_get_system_variable_fn_t get,
+  debugger_set_system_variable_fn_t set )
+{
+}
+
+int
+debugger_trap( void )
+{
+  abort();
+}
+
+int
+is_debugger_enabled( void )
+{
+  return 0;
+}
+
+uint32_t
+debugger_track_tstates( void )
+{
+  static libspectrum_dword last_tstates;
+  uint32_t diff = (uint32_t)( tstates - last_tstates );
+  last_tstates = tstates;
+  return diff;
+}
+
+int
+slt_trap( libspectrum_word address GCC_UNUSED, libspectrum_byte level GCC_UNUSED )
+{
+  return 0;
+}
+
+coretest_trap_fn coretest_trap = NULL;
+
+/* The peripheral paging functions are called only if a test has asked to
+   see them */
+static void
+trap( const char *what )
+{
+  if( !coretest_trap ) abort();
+  coretest_trap( what );
+}
+
+int beta_available = 0;
+int beta_active = 0;
+int if1_available = 0;
+
+void
+beta_page( void )
+{
+  trap( "beta_page" );
+}
+
+void
+beta_unpage( void )
+{
+  trap( "beta_unpage" );
+}
+
+int spectrum_frame_event = 0;
+
+int
+event_register( event_fn_t fn GCC_UNUSED, const char *string GCC_UNUSED )
+{
+  return 0;
+}
+
+int opus_available = 0;
+int opus_active = 0;
+
+void
+opus_page( void )
+{
+  trap( "opus_page" );
+}
+
+void
+opus_unpage( void )
+{
+  trap( "opus_unpage" );
+}
+
+int plusd_available = 0;
+int plusd_active = 0;
+
+void
+plusd_page( void )
+{
+  trap( "plusd_page" );
+}
+
+int disciple_available = 0;
+int disciple_active = 0;
+
+void
+disciple_page( void )
+{
+  trap( "disciple_page" );
+}
+
+int didaktik80_available = 0;
+int didaktik80_active = 0;
+int didaktik80_snap = 0;
+
+void
+didaktik80_page( void )
+{
+  trap( "didaktik80_page" );
+}
+
+void
+didaktik80_unpage( void )
+{
+  trap( "didaktik80_unpage" );
+}
+
+int usource_available = 0;
+int usource_active = 0;
+
+void
+usource_toggle( void )
+{
+  trap( "usource_toggle" );
+}
+
+int uspeech_available = 0;
+int uspeech_active = 0;
+
+void
+uspeech_toggle( void )
+{
+  trap( "uspeech_toggle" );
+}
+
+void
+if1_page( void )
+{
+  trap( "if1_page" );
+}
+
+void
+if1_unpage( void )
+{
+  trap( "if1_unpage" );
+}
+
+int multiface_activated = 0;
+
+void
+multiface_setic8( void )
+{
+  trap( "multiface_setic8" );
+}
+
+void
+divide_set_automap( int state )
+{
+  trap( state ? "divide_set_automap 1" : "divide_set_automap 0" );
+}
+
+void
+divmmc_set_automap( int state )
+{
+  trap( state ? "divmmc_set_automap 1" : "divmmc_set_automap 0" );
+}
+
+int spectranet_available = 0;
+
+void
+spectranet_page( int via_io GCC_UNUSED )
+{
+  trap( "spectranet_page" );
+}
+
+void
+spectranet_nmi( void )
+{
+  abort();
+}
+
+void
+spectranet_unpage( void )
+{
+  trap( "spectranet_unpage" );
+}
+
+void
+spectranet_retn( void )
+{
+}
+
+int
+spectranet_nmi_flipflop( void )
+{
+  return 0;
+}
+
+void
+startup_manager_register( startup_manager_module module,
+  startup_manager_module *dependencies, size_t dependency_count,
+  startup_manager_init_fn init_fn, void *init_context,
+  startup_manager_end_fn end_fn )
+{
+}
+
+int svg_capture_active = 0;     /* SVG capture enabled? */
+
+void
+svg_capture( void )
+{
+  abort();
+}
+
+int
+rzx_frame( void )
+{
+  abort();
+}
+
+void
+writeport_internal( libspectrum_word port GCC_UNUSED, libspectrum_byte b GCC_UNUSED )
+{
+  abort();
+}
+
+void
+event_add_with_data( libspectrum_dword event_time GCC_UNUSED,
+		     int type GCC_UNUSED, void *user_data GCC_UNUSED )
+{
+  if( coretest_trap ) coretest_trap( "event_add" );
+}
+
+int
+module_register( module_info_t *module GCC_UNUSED )
+{
+  return 0;
+}
+
+void
+z80_debugger_variables_init( void )
+{
+}
+
+fuse_machine_info *machine_current;
+static fuse_machine_info dummy_machine;
+
+settings_info settings_current;
+
+libspectrum_word beta_pc_mask;
+libspectrum_word beta_pc_value;
+
+int spectranet_programmable_trap_active;
+libspectrum_word spectranet_programmable_trap;
+
+/* Initialise the dummy variables such that we're running on a clean a
+   machine as possible */
+int
+coretest_init_dummies( libspectrum_byte *memory )
+{
+  size_t i;
+
+  for( i = 0; i < 8; i++ ) {
+    memory_map[i].page = &memory[ i * MEMORY_PAGE_SIZE ];
+  }
+
+  debugger_mode = DEBUGGER_MODE_INACTIVE;
+  dummy_machine.capabilities = 0;
+  dummy_machine.ram.current_rom = 0;
+  machine_current = &dummy_machine;
+  rzx_playback = 0;
+  scld_last_dec.name.intdisable = 0;
+  settings_current.slt_traps = 0;
+  settings_current.divide_enabled = 0;
+  settings_current.divmmc_enabled = 0;
+  settings_current.z80_is_cmos = 0;
+  beta_pc_mask = 0xfe00;
+  beta_pc_value = 0x3c00;
+  spectranet_programmable_trap_active = 0;
+  spectranet_programmable_trap = 0x0000;
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+/* coretest_dummies.h: Dummy Fuse functions and variables for the Z80 core
+                       test and benchmark programs
+   Copyright (c) 2003-2017 Philip Kendall
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: philip-fuse@shadowmagic.org.uk
+
+*/
+
+#ifndef FUSE_CORETEST_DUMMIES_H
+#define FUSE_CORETEST_DUMMIES_H
+
+#include <libspectrum.h>
+
+/* Point the dummy memory map at the 64Kb of memory */
+int coretest_init_dummies( libspectrum_byte *memory );
+
+/* Called with the name of each peripheral paging function the core calls;
+   if NULL, those functions abort */
+typedef void (*coretest_trap_fn)( const char *what );
+extern coretest_trap_fn coretest_trap;
+
+#endif			/* #ifndef FUSE_CORETEST_DUMMIES_H */
@@ -0,0 +1,382 @@
+/* traptest.c: Check the Z80 core's program counter traps
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Executes a single NOP at every address with each combination of
+   peripherals below, and checks that the paging functions called are
+   exactly those the per-opcode checks made before the core looked the
+   traps up in a table */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuse.h"
+#include "machine.h"
+#include "peripherals/disk/beta.h"
+#include "peripherals/disk/didaktik.h"
+#include "peripherals/disk/disciple.h"
+#include "peripherals/disk/opus.h"
+#include "peripherals/disk/plusd.h"
+#include "peripherals/if1.h"
+#include "peripherals/multiface.h"
+#include "peripherals/sound/uspeech.h"
+#include "peripherals/spectranet.h"
+#include "peripherals/usource.h"
+#include "settings.h"
+#include "spectrum.h"
+#include "z80.h"
+#include "z80_macros.h"
+#include "coretest_dummies.h"
+
+#define SPECTRANET_TRAP 0x0100
+
+libspectrum_dword tstates;
+libspectrum_dword event_next_event;
+
+static libspectrum_byte memory[ 0x10000 ];
+
+enum {
+  BETA = 1 << 0,
+  PLUSD = 1 << 1,
+  DIDAKTIK80 = 1 << 2,
+  DISCIPLE = 1 << 3,
+  USOURCE = 1 << 4,
+  USPEECH = 1 << 5,
+  MULTIFACE = 1 << 6,
+  IF1 = 1 << 7,
+  DIVIDE = 1 << 8,
+  DIVMMC = 1 << 9,
+  SPECTRANET = 1 << 10,
+  OPUS = 1 << 11,
+  DIDAKTIK80_SNAP = 1 << 12,
+
+  ALL = ( 1 << 13 ) - 1,
+};
+
+typedef struct config_t {
+  const char *name;
+  int peripherals;
+  int beta_active;
+  int opus_active;
+  int didaktik80_active;
+  int spectranet_disable;
+  int spectranet_trap_active;
+  libspectrum_word beta_pc_mask, beta_pc_value;
+} config_t;
+
+static const config_t configs[] = {
+  { "none", 0, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "beta", BETA, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "beta_active", BETA, 1, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "beta_pentagon", BETA, 0, 0, 0, 0, 0, 0xff00, 0x3d00 },
+  { "plusd", PLUSD, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "didaktik80", DIDAKTIK80, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "disciple", DISCIPLE, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "usource", USOURCE, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "uspeech", USPEECH, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "multiface", MULTIFACE, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "if1", IF1, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "divide", DIVIDE, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "divmmc", DIVMMC, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "spectranet", SPECTRANET, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "spectranet_trap", SPECTRANET, 0, 0, 0, 0, 1, 0xfe00, 0x3c00 },
+  { "spectranet_disabled", SPECTRANET, 0, 0, 0, 1, 1, 0xfe00, 0x3c00 },
+  { "opus", OPUS, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "opus_active", OPUS, 0, 1, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "didaktik80_snap", DIDAKTIK80_SNAP, 0, 0, 0, 0, 0, 0xfe00, 0x3c00 },
+  { "didaktik80_snap_active", DIDAKTIK80_SNAP, 0, 0, 1, 0, 0, 0xfe00, 0x3c00 },
+  { "all", ALL, 0, 0, 0, 0, 1, 0xfe00, 0x3c00 },
+  { "all_active", ALL, 1, 1, 1, 0, 1, 0xfe00, 0x3c00 },
+};
+
+static char actual[ 256 ];
+
+libspectrum_byte
+readbyte( libspectrum_word address )
+{
+  tstates += 3;
+  return memory[ address ];
+}
+
+libspectrum_byte
+readbyte_internal( libspectrum_word address )
+{
+  return memory[ address ];
+}
+
+void
+writebyte( libspectrum_word address, libspectrum_byte b )
+{
+  tstates += 3;
+  memory[ address ] = b;
+}
+
+void
+writebyte_internal( libspectrum_word address, libspectrum_byte b )
+{
+  memory[ address ] = b;
+}
+
+void
+contend_read( libspectrum_word address GCC_UNUSED, libspectrum_dword time )
+{
+  tstates += time;
+}
+
+void
+contend_read_no_mreq( libspectrum_word address GCC_UNUSED,
+                      libspectrum_dword time )
+{
+  tstates += time;
+}
+
+void
+contend_write_no_mreq( libspectrum_word address GCC_UNUSED,
+                       libspectrum_dword time )
+{
+  tstates += time;
+}
+
+libspectrum_byte
+readport( libspectrum_word port )
+{
+  tstates += 4;
+  return port >> 8;
+}
+
+void
+writeport( libspectrum_word port GCC_UNUSED, libspectrum_byte b GCC_UNUSED )
+{
+  tstates += 4;
+}
+
+static void
+record( char *buffer, const char *what )
+{
+  if( *buffer ) strcat( buffer, ", " );
+  strcat( buffer, what );
+}
+
+static void
+record_actual( const char *what )
+{
+  record( actual, what );
+}
+
+/* The checks as they were made on every opcode; returns the address of
+   the next instruction */
+static libspectrum_word
+expected_traps( const config_t *config, libspectrum_word pc, char *buffer )
+{
+  int p = config->peripherals;
+  libspectrum_word next = pc + 1;
+
+  if( p & BETA ) {
+    if( config->beta_active ) {
+      if( pc >= 0x4000 ) record( buffer, "beta_unpage" );
+    } else if( ( pc & config->beta_pc_mask ) == config->beta_pc_value ) {
+      record( buffer, "beta_page" );
+    }
+  }
+
+  if( p & PLUSD ) {
+    if( pc == 0x0008 || pc == 0x003a || pc == 0x0066 || pc == 0x028e )
+      record( buffer, "plusd_page" );
+  }
+
+  if( p & DIDAKTIK80 ) {
+    if( pc == 0x0000 || pc == 0x0008 ) {
+      record( buffer, "didaktik80_page" );
+    } else if( pc == 0x1700 ) {
+      record( buffer, "didaktik80_unpage" );
+    }
+  }
+
+  if( p & DISCIPLE ) {
+    if( pc == 0x0001 || pc == 0x0008 || pc == 0x0066 || pc == 0x028e )
+      record( buffer, "disciple_page" );
+  }
+
+  if( p & USOURCE ) {
+    if( pc == 0x2bae ) record( buffer, "usource_toggle" );
+  }
+
+  if( p & USPEECH ) {
+    if( pc == 0x0038 ) record( buffer, "uspeech_toggle" );
+  }
+
+  if( p & MULTIFACE ) {
+    if( pc == 0x0066 ) record( buffer, "multiface_setic8" );
+  }
+
+  if( p & IF1 ) {
+    if( pc == 0x0008 || pc == 0x1708 ) record( buffer, "if1_page" );
+  }
+
+  if( p & DIVIDE ) {
+    if( ( pc & 0xff00 ) == 0x3d00 ) record( buffer, "divide_set_automap 1" );
+  }
+
+  if( p & DIVMMC ) {
+    if( ( pc & 0xff00 ) == 0x3d00 ) record( buffer, "divmmc_set_automap 1" );
+  }
+
+  if( ( p & SPECTRANET ) && !config->spectranet_disable ) {
+    if( pc == 0x0008 || ( pc & 0xfff8 ) == 0x3ff8 )
+      record( buffer, "spectranet_page" );
+    if( pc == SPECTRANET_TRAP && config->spectranet_trap_active )
+      record( buffer, "event_add" );
+  }
+
+  /* Opcode fetch */
+
+  if( p & IF1 ) {
+    if( pc == 0x0700 ) record( buffer, "if1_unpage" );
+  }
+
+  if( p & DIVIDE ) {
+    if( ( pc & 0xfff8 ) == 0x1ff8 ) {
+      record( buffer, "divide_set_automap 0" );
+    } else if( pc == 0x0000 || pc == 0x0008 || pc == 0x0038 ||
+               pc == 0x0066 || pc == 0x04c6 || pc == 0x0562 ) {
+      record( buffer, "divide_set_automap 1" );
+    }
+  }
+
+  if( p & DIVMMC ) {
+    if( ( pc & 0xfff8 ) == 0x1ff8 ) {
+      record( buffer, "divmmc_set_automap 0" );
+    } else if( pc == 0x0000 || pc == 0x0008 || pc == 0x0038 ||
+               pc == 0x0066 || pc == 0x04c6 || pc == 0x0562 ) {
+      record( buffer, "divmmc_set_automap 1" );
+    }
+  }
+
+  if( p & OPUS ) {
+    if( config->opus_active ) {
+      if( pc == 0x1748 ) record( buffer, "opus_unpage" );
+    } else if( pc == 0x0008 || pc == 0x0048 || pc == 0x1708 ) {
+      record( buffer, "opus_page" );
+    }
+  }
+
+  if( p & SPECTRANET ) {
+    if( pc == 0x007c ) record( buffer, "spectranet_unpage" );
+  }
+
+  if( p & DIDAKTIK80_SNAP ) {
+    if( pc == 0x0066 && !config->didaktik80_active ) next = 0x0000;
+  }
+
+  return next;
+}
+
+static void
+set_peripherals( const config_t *config )
+{
+  int p = config->peripherals;
+
+  beta_available = !!( p & BETA );
+  beta_active = config->beta_active;
+  beta_pc_mask = config->beta_pc_mask;
+  beta_pc_value = config->beta_pc_value;
+  plusd_available = !!( p & PLUSD );
+  didaktik80_available = !!( p & DIDAKTIK80 );
+  didaktik80_active = config->didaktik80_active;
+  didaktik80_snap = !!( p & DIDAKTIK80_SNAP );
+  disciple_available = !!( p & DISCIPLE );
+  usource_available = !!( p & USOURCE );
+  uspeech_available = !!( p & USPEECH );
+  multiface_activated = !!( p & MULTIFACE );
+  if1_available = !!( p & IF1 );
+  settings_current.divide_enabled = !!( p & DIVIDE );
+  settings_current.divmmc_enabled = !!( p & DIVMMC );
+  spectranet_available = !!( p & SPECTRANET );
+  settings_current.spectranet_disable = config->spectranet_disable;
+  spectranet_programmable_trap_active = config->spectranet_trap_active;
+  spectranet_programmable_trap = SPECTRANET_TRAP;
+  opus_available = !!( p & OPUS );
+  opus_active = config->opus_active;
+}
+
+/* Run one NOP at every address; returns the number of mismatches */
+static int
+test_config( const config_t *config )
+{
+  char expected[ 256 ];
+  libspectrum_word expected_pc;
+  int errors = 0;
+  size_t pc;
+
+  for( pc = 0; pc < 0x10000; pc++ ) {
+
+    /* Set every time as the Didaktik snap trap clears its flag */
+    set_peripherals( config );
+
+    PC = pc; SP = 0x8000;
+    tstates = 0; event_next_event = 1;
+    actual[0] = '\0';
+
+    z80_do_opcodes();
+
+    /* RST 00 pushed the return address */
+    memory[ 0x7ffe ] = memory[ 0x7fff ] = 0x00;
+
+    expected[0] = '\0';
+    expected_pc = expected_traps( config, pc, expected );
+
+    if( strcmp( actual, expected ) || PC != expected_pc ) {
+      if( errors++ < 10 )
+        fprintf( stderr,
+                 "%s: 0x%04x: called [%s], PC 0x%04x; expected [%s], "
+                 "PC 0x%04x\n", config->name, (unsigned)pc, actual,
+                 (unsigned)PC, expected, (unsigned)expected_pc );
+    }
+  }
+
+  return errors;
+}
+
+int
+main( void )
+{
+  int errors = 0;
+  size_t i;
+
+  if( coretest_init_dummies( memory ) ) return 1;
+
+  z80_init( NULL );
+  z80_reset( 1 );
+  coretest_trap = record_actual;
+
+  /* All NOPs */
+  memset( memory, 0, sizeof( memory ) );
+
+  for( i = 0; i < ARRAY_SIZE( configs ); i++ )
+    errors += test_config( &configs[i] );
+
+  if( errors ) {
+    printf( "TRAPTEST FAILED: %d errors\n", errors );
+    return 1;
+  }
+
+  printf( "TRAPTEST OK\n" );
+  return 0;
+}
@@ -72,6 +72,7 @@ int z80_interrupt( void );
 void z80_retn( void );
 
 void z80_do_opcodes(void);
+void z80_traps_update( void );
 
 void z80_enable_interrupts( void );
 
@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "debugger/debugger.h"
 #include "event.h"
@@ -109,228 +110,309 @@ enum {
 static libspectrum_byte opcode = 0x00;
 #endif
 
-/* Execute Z80 opcodes until the next event */
-void
-z80_do_opcodes( void )
+/* Most peripherals page themselves in or out when the Z80 fetches an
+   opcode from one of a handful of addresses. Rather than have every
+   enabled peripheral compare PC against its addresses before every
+   opcode, we keep a table saying which addresses are of interest to
+   any enabled peripheral, so that each opcode costs a single lookup
+   and the peripherals' own checks are made only on a hit */
+
+/* Traps checked before the opcode fetch */
+#define Z80_TRAP_EARLY 0x01
+/* Traps checked after the opcode fetch */
+#define Z80_TRAP_LATE  0x02
+
+static libspectrum_byte z80_traps[ 0x10000 ];
+
+/* The peripherals which may trap at the moment */
+enum {
+  Z80_TRAP_SOURCE_BETA = 1 << 0,
+  Z80_TRAP_SOURCE_PLUSD = 1 << 1,
+  Z80_TRAP_SOURCE_DIDAKTIK80 = 1 << 2,
+  Z80_TRAP_SOURCE_DISCIPLE = 1 << 3,
+  Z80_TRAP_SOURCE_USOURCE = 1 << 4,
+  Z80_TRAP_SOURCE_USPEECH = 1 << 5,
+  Z80_TRAP_SOURCE_MULTIFACE = 1 << 6,
+  Z80_TRAP_SOURCE_IF1 = 1 << 7,
+  Z80_TRAP_SOURCE_DIVIDE = 1 << 8,
+  Z80_TRAP_SOURCE_DIVMMC = 1 << 9,
+  Z80_TRAP_SOURCE_SPECTRANET_PAGE = 1 << 10,
+  Z80_TRAP_SOURCE_SPECTRANET_UNPAGE = 1 << 11,
+  Z80_TRAP_SOURCE_OPUS = 1 << 12,
+  Z80_TRAP_SOURCE_DIDAKTIK80_SNAP = 1 << 13,
+};
+
+/* Everything the contents of z80_traps depends on */
+typedef struct z80_traps_state_t {
+  int sources;
+  libspectrum_word beta_pc_mask, beta_pc_value;
+  int spectranet_trap_active;
+  libspectrum_word spectranet_trap;
+} z80_traps_state_t;
+
+/* sources == -1 forces the first build */
+static z80_traps_state_t z80_traps_built = { -1, 0, 0, 0, 0 };
+
+static void
+z80_traps_get_state( z80_traps_state_t *state )
 {
-#ifdef HAVE_ENOUGH_MEMORY
-  libspectrum_byte opcode = 0x00;
-#endif
-  libspectrum_byte last_Q;
+  int sources = 0;
+
+  if( beta_available ) sources |= Z80_TRAP_SOURCE_BETA;
+  if( plusd_available ) sources |= Z80_TRAP_SOURCE_PLUSD;
+  if( didaktik80_available ) sources |= Z80_TRAP_SOURCE_DIDAKTIK80;
+  if( disciple_available ) sources |= Z80_TRAP_SOURCE_DISCIPLE;
+  if( usource_available ) sources |= Z80_TRAP_SOURCE_USOURCE;
+  if( uspeech_available ) sources |= Z80_TRAP_SOURCE_USPEECH;
+  if( multiface_activated ) sources |= Z80_TRAP_SOURCE_MULTIFACE;
+  if( if1_available ) sources |= Z80_TRAP_SOURCE_IF1;
+  if( settings_current.divide_enabled ) sources |= Z80_TRAP_SOURCE_DIVIDE;
+  if( settings_current.divmmc_enabled ) sources |= Z80_TRAP_SOURCE_DIVMMC;
+  if( spectranet_available && !settings_current.spectranet_disable )
+    sources |= Z80_TRAP_SOURCE_SPECTRANET_PAGE;
+  if( spectranet_available ) sources |= Z80_TRAP_SOURCE_SPECTRANET_UNPAGE;
+  if( opus_available ) sources |= Z80_TRAP_SOURCE_OPUS;
+  if( didaktik80_snap ) sources |= Z80_TRAP_SOURCE_DIDAKTIK80_SNAP;
+
+  state->sources = sources;
+  state->beta_pc_mask = beta_pc_mask;
+  state->beta_pc_value = beta_pc_value;
+  state->spectranet_trap_active = spectranet_programmable_trap_active;
+  state->spectranet_trap = spectranet_programmable_trap;
+}
 
-  int even_m1 =
-    machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_EVEN_M1; 
+static void
+z80_traps_set( libspectrum_word address, libspectrum_byte when )
+{
+  z80_traps[ address ] |= when;
+}
 
-#ifdef __GNUC__
+static void
+z80_traps_set_range( libspectrum_word first, libspectrum_word last,
+                     libspectrum_byte when )
+{
+  size_t i;
 
-#undef SETUP_CHECK
-#define SETUP_CHECK( label, condition ) \
-  if( condition ) { cgoto[ next ] = &&label; next = pos_##label + 1; } \
-  check++;
+  for( i = first; i <= last; i++ ) z80_traps[ i ] |= when;
+}
 
-#undef SETUP_NEXT
-#define SETUP_NEXT( label ) \
-  if( next != check ) { cgoto[ next ] = &&label; } \
-  next = check;
+/* The addresses here must match those checked in z80_traps_early() and
+   z80_traps_late() */
+static void
+z80_traps_build( const z80_traps_state_t *state )
+{
+  int sources = state->sources;
+  size_t i;
 
-  void *cgoto[ numchecks ]; size_t next = 0; size_t check = 0;
+  memset( z80_traps, 0, sizeof( z80_traps ) );
 
-#include "z80_checks.h"
+  if( sources & Z80_TRAP_SOURCE_BETA ) {
+    for( i = 0; i < 0x10000; i++ )
+      if( ( i & state->beta_pc_mask ) == state->beta_pc_value )
+        z80_traps[ i ] |= Z80_TRAP_EARLY;
+  }
 
-#endif				/* #ifdef __GNUC__ */
+  if( sources & Z80_TRAP_SOURCE_PLUSD ) {
+    z80_traps_set( 0x0008, Z80_TRAP_EARLY );
+    z80_traps_set( 0x003a, Z80_TRAP_EARLY );
+    z80_traps_set( 0x0066, Z80_TRAP_EARLY );
+    z80_traps_set( 0x028e, Z80_TRAP_EARLY );
+  }
 
-  while( tstates < event_next_event ) {
+  if( sources & Z80_TRAP_SOURCE_DIDAKTIK80 ) {
+    z80_traps_set( 0x0000, Z80_TRAP_EARLY );
+    z80_traps_set( 0x0008, Z80_TRAP_EARLY );
+    z80_traps_set( 0x1700, Z80_TRAP_EARLY );
+  }
 
-    /* Profiler */
-    CHECK( profile, profile_active )
+  if( sources & Z80_TRAP_SOURCE_DISCIPLE ) {
+    z80_traps_set( 0x0001, Z80_TRAP_EARLY );
+    z80_traps_set( 0x0008, Z80_TRAP_EARLY );
+    z80_traps_set( 0x0066, Z80_TRAP_EARLY );
+    z80_traps_set( 0x028e, Z80_TRAP_EARLY );
+  }
 
-    profile_map( PC );
+  if( sources & Z80_TRAP_SOURCE_USOURCE )
+    z80_traps_set( 0x2bae, Z80_TRAP_EARLY );
 
-    END_CHECK
+  if( sources & Z80_TRAP_SOURCE_USPEECH )
+    z80_traps_set( 0x0038, Z80_TRAP_EARLY );
 
-    /* If we're due an end of frame from RZX playback, generate one */
-    CHECK( rzx, rzx_playback )
+  if( sources & Z80_TRAP_SOURCE_MULTIFACE )
+    z80_traps_set( 0x0066, Z80_TRAP_EARLY );
 
-    if( R + rzx_instructions_offset >= rzx_instruction_count ) {
-      event_add( tstates, spectrum_frame_event );
-      break;		/* And break out of the execution loop to let
-			   the interrupt happen */
-    }
+  if( sources & Z80_TRAP_SOURCE_IF1 ) {
+    z80_traps_set( 0x0008, Z80_TRAP_EARLY );
+    z80_traps_set( 0x1708, Z80_TRAP_EARLY );
+    z80_traps_set( 0x0700, Z80_TRAP_LATE );
+  }
 
-    END_CHECK
+  if( sources & ( Z80_TRAP_SOURCE_DIVIDE | Z80_TRAP_SOURCE_DIVMMC ) ) {
+    z80_traps_set_range( 0x3d00, 0x3dff, Z80_TRAP_EARLY );
+    z80_traps_set_range( 0x1ff8, 0x1fff, Z80_TRAP_LATE );
+    z80_traps_set( 0x0000, Z80_TRAP_LATE );
+    z80_traps_set( 0x0008, Z80_TRAP_LATE );
+    z80_traps_set( 0x0038, Z80_TRAP_LATE );
+    z80_traps_set( 0x0066, Z80_TRAP_LATE );
+    z80_traps_set( 0x04c6, Z80_TRAP_LATE );
+    z80_traps_set( 0x0562, Z80_TRAP_LATE );
+  }
 
-    /* Check if the debugger should become active at this point */
-    CHECK( debugger, (debugger_mode != DEBUGGER_MODE_INACTIVE) || is_debugger_enabled() )
-    
-    {
-      uint16_t new_clock_l = CLOCKL + debugger_track_tstates();
-      
-      if (new_clock_l < CLOCKL) {
-        CLOCKH++;
-      }
-      
-      CLOCKL = new_clock_l;
-    }
+  if( sources & Z80_TRAP_SOURCE_SPECTRANET_PAGE ) {
+    z80_traps_set( 0x0008, Z80_TRAP_EARLY );
+    z80_traps_set_range( 0x3ff8, 0x3fff, Z80_TRAP_EARLY );
+    if( state->spectranet_trap_active )
+      z80_traps_set( state->spectranet_trap, Z80_TRAP_EARLY );
+  }
 
-    if( debugger_check( DEBUGGER_BREAKPOINT_TYPE_EXECUTE, PC ) )
-      debugger_trap();
+  if( sources & Z80_TRAP_SOURCE_SPECTRANET_UNPAGE )
+    z80_traps_set( 0x007c, Z80_TRAP_LATE );
 
-    END_CHECK
+  if( sources & Z80_TRAP_SOURCE_OPUS ) {
+    z80_traps_set( 0x0008, Z80_TRAP_LATE );
+    z80_traps_set( 0x0048, Z80_TRAP_LATE );
+    z80_traps_set( 0x1708, Z80_TRAP_LATE );
+    z80_traps_set( 0x1748, Z80_TRAP_LATE );
+  }
 
-    CHECK( beta, beta_available )
+  if( sources & Z80_TRAP_SOURCE_DIDAKTIK80_SNAP )
+    z80_traps_set( 0x0066, Z80_TRAP_LATE );
+
+  z80_traps_built = *state;
+}
+
+/* Rebuild the trap table if any peripheral's traps have changed */
+void
+z80_traps_update( void )
+{
+  z80_traps_state_t state;
+
+  z80_traps_get_state( &state );
+
+  if( state.sources != z80_traps_built.sources ||
+      state.beta_pc_mask != z80_traps_built.beta_pc_mask ||
+      state.beta_pc_value != z80_traps_built.beta_pc_value ||
+      state.spectranet_trap_active != z80_traps_built.spectranet_trap_active ||
+      state.spectranet_trap != z80_traps_built.spectranet_trap )
+    z80_traps_build( &state );
+}
 
 #define NOT_128_TYPE_OR_IS_48_TYPE ( !( machine_current->capabilities & \
             LIBSPECTRUM_MACHINE_CAPABILITY_128_MEMORY ) || \
             machine_current->ram.current_rom )
 
-    if( beta_active ) {
-      if( NOT_128_TYPE_OR_IS_48_TYPE && PC >= 16384 ) {
-	beta_unpage();
-      }
-    } else if( ( PC & beta_pc_mask ) == beta_pc_value &&
-               NOT_128_TYPE_OR_IS_48_TYPE ) {
+/* The traps which happen before the opcode fetch, in the order the
+   peripherals have always been checked */
+static void
+z80_traps_early( void )
+{
+  int sources = z80_traps_built.sources;
+
+  if( sources & Z80_TRAP_SOURCE_BETA ) {
+    if( !beta_active && ( PC & beta_pc_mask ) == beta_pc_value &&
+        NOT_128_TYPE_OR_IS_48_TYPE ) {
       beta_page();
     }
+  }
 
-    END_CHECK
-
-    CHECK( plusd, plusd_available )
-
+  if( sources & Z80_TRAP_SOURCE_PLUSD ) {
     if( PC == 0x0008 || PC == 0x003a || PC == 0x0066 || PC == 0x028e ) {
       plusd_page();
     }
+  }
 
-    END_CHECK
-
-    CHECK( didaktik80, didaktik80_available )
-
+  if( sources & Z80_TRAP_SOURCE_DIDAKTIK80 ) {
     if( PC == 0x0000 || PC == 0x0008 ) {
       didaktik80_page();
     } else if( PC == 0x1700 ) {
       didaktik80_unpage();
     }
+  }
 
-    END_CHECK
-
-    CHECK( disciple, disciple_available )
-
+  if( sources & Z80_TRAP_SOURCE_DISCIPLE ) {
     if( PC == 0x0001 || PC == 0x0008 || PC == 0x0066 || PC == 0x028e ) {
       disciple_page();
     }
+  }
 
-    END_CHECK
-
-    CHECK( usource, usource_available )
-
+  if( sources & Z80_TRAP_SOURCE_USOURCE ) {
     if( PC == 0x2bae ) {
       usource_toggle();
     }
+  }
 
-    END_CHECK
-
-    CHECK( uspeech, uspeech_available )
-
+  if( sources & Z80_TRAP_SOURCE_USPEECH ) {
     if( PC == 0x0038 ) {
       uspeech_toggle();
     }
+  }
 
-    END_CHECK
-
-    CHECK( multiface, multiface_activated )
-
+  if( sources & Z80_TRAP_SOURCE_MULTIFACE ) {
     if( PC == 0x0066 ) {
       multiface_setic8();
     }
+  }
 
-    END_CHECK
-
-    CHECK( if1p, if1_available )
-
+  if( sources & Z80_TRAP_SOURCE_IF1 ) {
     if( PC == 0x0008 || PC == 0x1708 ) {
       if1_page();
     }
+  }
 
-    END_CHECK
-
-    CHECK( divide_early, settings_current.divide_enabled )
-    
+  if( sources & Z80_TRAP_SOURCE_DIVIDE ) {
     if( ( PC & 0xff00 ) == 0x3d00 ) {
       divide_set_automap( 1 );
     }
-    
-    END_CHECK
+  }
 
-    CHECK( divmmc_early, settings_current.divmmc_enabled )
-    
+  if( sources & Z80_TRAP_SOURCE_DIVMMC ) {
     if( ( PC & 0xff00 ) == 0x3d00 ) {
       divmmc_set_automap( 1 );
     }
-    
-    END_CHECK
-
-    CHECK( spectranet_page, spectranet_available && !settings_current.spectranet_disable )
+  }
 
+  if( sources & Z80_TRAP_SOURCE_SPECTRANET_PAGE ) {
     if( PC == 0x0008 || ((PC & 0xfff8) == 0x3ff8) )
       spectranet_page( 0 );
 
     if( PC == spectranet_programmable_trap &&
       spectranet_programmable_trap_active )
       event_add( 0, z80_nmi_event );
+  }
+}
 
-    END_CHECK
-
-  opcode_delay:
-
-    contend_read( PC, 4 );
-
-    /* Check to see if M1 cycles happen on even tstates */
-    CHECK( evenm1, even_m1 )
-
-    if( tstates & 1 ) {
-      if( ++tstates == event_next_event ) {
-	break;
-      }
-    }
-
-    END_CHECK
-
-  run_opcode:
-    /* Do the instruction fetch; readbyte_internal used here to avoid
-       triggering read breakpoints */
-    opcode = readbyte_internal( PC );
-
-    CHECK( if1u, if1_available )
+/* The traps which happen after the opcode fetch; returns the opcode to
+   execute */
+static libspectrum_byte
+z80_traps_late( libspectrum_byte opcode )
+{
+  int sources = z80_traps_built.sources;
 
+  if( sources & Z80_TRAP_SOURCE_IF1 ) {
     if( PC == 0x0700 ) {
       if1_unpage();
     }
+  }
 
-    END_CHECK
-
-    CHECK( divide_late, settings_current.divide_enabled )
-
+  if( sources & Z80_TRAP_SOURCE_DIVIDE ) {
     if( ( PC & 0xfff8 ) == 0x1ff8 ) {
       divide_set_automap( 0 );
     } else if( (PC == 0x0000) || (PC == 0x0008) || (PC == 0x0038)
       || (PC == 0x0066) || (PC == 0x04c6) || (PC == 0x0562) ) {
       divide_set_automap( 1 );
     }
-    
-    END_CHECK
-
-    CHECK( divmmc_late, settings_current.divmmc_enabled )
+  }
 
+  if( sources & Z80_TRAP_SOURCE_DIVMMC ) {
     if( ( PC & 0xfff8 ) == 0x1ff8 ) {
       divmmc_set_automap( 0 );
     } else if( (PC == 0x0000) || (PC == 0x0008) || (PC == 0x0038)
       || (PC == 0x0066) || (PC == 0x04c6) || (PC == 0x0562) ) {
       divmmc_set_automap( 1 );
     }
-    
-    END_CHECK
-
-    CHECK( opus, opus_available )
+  }
 
+  if( sources & Z80_TRAP_SOURCE_OPUS ) {
     if( opus_active ) {
       if( PC == 0x1748 ) {
         opus_unpage();
@@ -338,33 +420,136 @@ z80_do_opcodes( void )
     } else if( PC == 0x0008 || PC == 0x0048 || PC == 0x1708 ) {
       opus_page();
     }
+  }
+
+  if( sources & Z80_TRAP_SOURCE_SPECTRANET_UNPAGE ) {
+    if( PC == 0x007c )
+      spectranet_unpage();
+  }
+
+  if( sources & Z80_TRAP_SOURCE_DIDAKTIK80_SNAP ) {
+    if( PC == 0x0066 && !didaktik80_active ) {
+      opcode = 0xc7;	/* RST 00 */
+      didaktik80_snap = 0; /* FIXME: this should be a time-based reset */
+    }
+  }
+
+  return opcode;
+}
+
+/* Execute Z80 opcodes until the next event */
+void
+z80_do_opcodes( void )
+{
+#ifdef HAVE_ENOUGH_MEMORY
+  libspectrum_byte opcode = 0x00;
+#endif
+  libspectrum_byte last_Q;
+
+  int even_m1 =
+    machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_EVEN_M1; 
+
+#ifdef __GNUC__
+
+#undef SETUP_CHECK
+#define SETUP_CHECK( label, condition ) \
+  if( condition ) { cgoto[ next ] = &&label; next = pos_##label + 1; } \
+  check++;
+
+#undef SETUP_NEXT
+#define SETUP_NEXT( label ) \
+  if( next != check ) { cgoto[ next ] = &&label; } \
+  next = check;
+
+  void *cgoto[ numchecks ]; size_t next = 0; size_t check = 0;
+
+#include "z80_checks.h"
+
+#endif				/* #ifdef __GNUC__ */
+
+  z80_traps_update();
+
+  while( tstates < event_next_event ) {
+
+    /* Profiler */
+    CHECK( profile, profile_active )
+
+    profile_map( PC );
+
+    END_CHECK
+
+    /* If we're due an end of frame from RZX playback, generate one */
+    CHECK( rzx, rzx_playback )
+
+    if( R + rzx_instructions_offset >= rzx_instruction_count ) {
+      event_add( tstates, spectrum_frame_event );
+      break;		/* And break out of the execution loop to let
+			   the interrupt happen */
+    }
 
     END_CHECK
 
-    CHECK( spectranet_unpage, spectranet_available )
+    /* Check if the debugger should become active at this point */
+    CHECK( debugger, (debugger_mode != DEBUGGER_MODE_INACTIVE) || is_debugger_enabled() )
+    
+    {
+      uint16_t new_clock_l = CLOCKL + debugger_track_tstates();
+      
+      if (new_clock_l < CLOCKL) {
+        CLOCKH++;
+      }
+      
+      CLOCKL = new_clock_l;
+    }
 
-    if( PC == 0x007c )
-      spectranet_unpage();
+    if( debugger_check( DEBUGGER_BREAKPOINT_TYPE_EXECUTE, PC ) )
+      debugger_trap();
 
     END_CHECK
 
-    CHECK( z80_iff2_read, z80.iff2_read )
+    /* Unlike the other traps, leaving TR-DOS happens anywhere in the top
+       48K, so it isn't in the trap table */
+    CHECK( beta, beta_available )
 
-    z80.iff2_read = 0;
-    /* Execute *one* instruction before reevaluating the checks */
-    event_add( tstates, z80_nmos_iff2_event );
+    if( beta_active && PC >= 16384 && NOT_128_TYPE_OR_IS_48_TYPE ) {
+      beta_unpage();
+    }
 
     END_CHECK
 
-    CHECK( didaktik80snap, didaktik80_snap )
+  pc_traps:
+    if( z80_traps[ PC ] & Z80_TRAP_EARLY ) z80_traps_early();
 
-    if( PC == 0x0066 && !didaktik80_active ) {
-      opcode = 0xc7;	/* RST 00 */
-      didaktik80_snap = 0; /* FIXME: this should be a time-based reset */
+  opcode_delay:
+
+    contend_read( PC, 4 );
+
+    /* Check to see if M1 cycles happen on even tstates */
+    CHECK( evenm1, even_m1 )
+
+    if( tstates & 1 ) {
+      if( ++tstates == event_next_event ) {
+	break;
+      }
     }
 
     END_CHECK
 
+  run_opcode:
+    /* Do the instruction fetch; readbyte_internal used here to avoid
+       triggering read breakpoints */
+    opcode = readbyte_internal( PC );
+
+    if( z80_traps[ PC ] & Z80_TRAP_LATE ) opcode = z80_traps_late( opcode );
+
+    CHECK( z80_iff2_read, z80.iff2_read )
+
+    z80.iff2_read = 0;
+    /* Execute *one* instruction before reevaluating the checks */
+    event_add( tstates, z80_nmos_iff2_event );
+
+    END_CHECK
+
     CHECK( svg_capture, svg_capture_active )
 
     svg_capture();